@@ -41,6 +41,7 @@ C2H_OPCODE(CHAN_HWTRACE_STATE, 37, union c2h_ChanHwTraceState)
 C2H_OPCODE(CHAN_EXEC_ERROR_LIST, 38, union c2h_ExecErrorList)
 C2H_OPCODE(CHAN_ETH_CONFIG, 39, union c2h_ChanEthernetConfig)
 C2H_OPCODE(CHAN_ETH_MSG_DSCR, 40, union c2h_ChanEthernetMsgDscr)
+C2H_OPCODE(CHAN_EXEC_ERROR_LIST_MBOX, 41, union c2h_ExecErrorList)
 /** NOTE: opcode value range is 32 to 63 **/
 
 #ifdef ULT
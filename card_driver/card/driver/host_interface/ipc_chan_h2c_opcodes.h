@@ -58,6 +58,7 @@ H2C_OPCODE(CHAN_IDS_MAP, 55, union h2c_ChanIdsMap)
 H2C_OPCODE(CHAN_MARK_INF_RESOURCE, 56, union h2c_ChanMarkInferenceResource)
 H2C_OPCODE(CHAN_ETH_CONFIG, 57, union h2c_ChanEthernetConfig)
 H2C_OPCODE(CHAN_ETH_MSG_DSCR, 58, union h2c_ChanEthernetMsgDscr)
+H2C_OPCODE(CHAN_INF_RESOURCE_BATCH, 59, union h2c_ChanInferenceResourceBatch)
 /** NOTE: opcode value range is 32 to 63 **/
 
 
@@ -53,6 +53,63 @@ struct ipc_exec_error_desc {
 	__le32               error_msg_size;
 };
 
+//
+// Device resource descriptor, an array of these is passed in a ring buffer
+// page with CHAN_INF_RESOURCE_BATCH. Fields have the same meaning as the
+// fields of h2c_ChanInferenceResourceOp.
+//
+#define NNP_DEVRES_DESC_INPUT     BIT(0)
+#define NNP_DEVRES_DESC_OUTPUT    BIT(1)
+#define NNP_DEVRES_DESC_NETWORK   BIT(2)
+#define NNP_DEVRES_DESC_FORCE_4G  BIT(3)
+#define NNP_DEVRES_DESC_ECC       BIT(4)
+#define NNP_DEVRES_DESC_P2P_DST   BIT(5)
+#define NNP_DEVRES_DESC_P2P_SRC   BIT(6)
+
+struct ipc_devres_desc {
+	__le64               size;
+	__le16               resID;
+	__le16               align;
+	__u8                 depth;
+	__u8                 flags; /* NNP_DEVRES_DESC_* */
+	__le16               reserved;
+};
+NNP_STATIC_ASSERT(sizeof(struct ipc_devres_desc) == 16,
+		  "Size of ipc_devres_desc does not match");
+
+#define NNP_IPC_MAX_DEVRES_DESCS (NNP_PAGE_SIZE / sizeof(struct ipc_devres_desc))
+
+//
+// Channel mailbox page.
+// When the card has an inbound memory window, each context channel gets a
+// mailbox page in it and reports its page offset in the window as obj_id_2
+// of the CREATE_CHANNEL_SUCCESS event. Small payloads are passed through
+// the mailbox slots instead of the channel ring buffers, which saves a DMA
+// transaction for each of them:
+//  - h2c: host writes the data of a SCHEDULE_CMDLIST command to a free h2c
+//         slot and sends the command with inline_data set and the slot
+//         index. The card increments h2c_done[slot] when it has read the
+//         slot, the slot is free while h2c_done[slot] equals the number of
+//         times host has used it.
+//  - c2h: card writes an error list which fits in a slot to the next c2h
+//         slot and sends CHAN_EXEC_ERROR_LIST_MBOX instead of
+//         CHAN_EXEC_ERROR_LIST. The host advances c2h_consumed after
+//         reading it.
+//
+#define NNP_CHAN_MBOX_SLOT_SIZE   256
+#define NNP_CHAN_MBOX_H2C_SLOTS   8 /* h2c_ChanInferenceCmdListOp.mbox_slot is 3 bits */
+#define NNP_CHAN_MBOX_C2H_SLOTS   7
+
+struct nnp_chan_mbox {
+	__u8                 h2c_done[NNP_CHAN_MBOX_H2C_SLOTS]; /* written by card */
+	__le32               c2h_consumed; /* written by host */
+	__u8                 reserved[NNP_CHAN_MBOX_SLOT_SIZE - NNP_CHAN_MBOX_H2C_SLOTS - 4];
+	__u8                 h2c[NNP_CHAN_MBOX_H2C_SLOTS][NNP_CHAN_MBOX_SLOT_SIZE];
+	__u8                 c2h[NNP_CHAN_MBOX_C2H_SLOTS][NNP_CHAN_MBOX_SLOT_SIZE];
+};
+NNP_STATIC_ASSERT(sizeof(struct nnp_chan_mbox) == NNP_PAGE_SIZE,
+		  "Channel mailbox must fill a page");
+
 /***************************************************************************
  * IPC messages layout definition
  *    All messages must start with opcode and chan_id as defined by:
@@ -96,13 +153,17 @@ union h2c_ChanInferenceContextOp {
 		__le64 destroy    : 1;
 		__le64 recover    : 1;
 		__le64 cflags     : 8;
-		__le64 reserved   :37;
+		__le64 host_caps  : 8;  /* NNP_CHAN_CTX_CAP_* */
+		__le64 reserved   :29;
 	};
 
 	__le64 value;
 };
 CHECK_MESSAGE_SIZE(union h2c_ChanInferenceContextOp, 1);
 
+/* host runtime handles c2h_ChanSyncDone.nsyncs > 1 */
+#define NNP_CHAN_CTX_CAP_SYNC_DONE_COALESCE  BIT(0)
+
 union h2c_ChanInferenceResourceOp {
 	struct {
 		__le64 opcode      : 6;  /* NNP_IPC_H2C_OP_CHAN_INF_RESOURCE */
@@ -128,6 +189,19 @@ union h2c_ChanInferenceResourceOp {
 };
 CHECK_MESSAGE_SIZE(union h2c_ChanInferenceResourceOp, 2);
 
+union h2c_ChanInferenceResourceBatch {
+	struct {
+		__le64 opcode      : 6;  /* NNP_IPC_H2C_OP_CHAN_INF_RESOURCE_BATCH */
+		__le64 chan_id     : NNP_IPC_CHANNEL_BITS;
+		__le64 rb_id       : 1;
+		__le64 num_res     : 8;  /* number of descriptors minus 1 */
+		__le64 reserved    : 39;
+	};
+
+	__le64 value;
+};
+CHECK_MESSAGE_SIZE(union h2c_ChanInferenceResourceBatch, 1);
+
 union h2c_ChanMarkInferenceResource {
 	struct {
 		__le64 opcode      : 6;  /* NNP_IPC_H2C_OP_CHAN_MARK_INF_RESOURCE */
@@ -299,7 +373,9 @@ union h2c_ChanInferenceCmdListOp {
 		__le64 is_last     :  1;
 		__le64 opt_dependencies : 1;
 		__le64 size        : 16;
-		__le64 unused      : 12;
+		__le64 inline_data : 1; /* data is in mailbox slot mbox_slot */
+		__le64 mbox_slot   : 3;
+		__le64 unused      : 8;
 	};
 
 	__le64 value;
@@ -399,7 +475,8 @@ union c2h_ChanSyncDone {
 		__le64 opcode      : 6; /* NNP_IPC_C2H_OP_CHAN_SYNC_DONE */
 		__le64 chan_id      : NNP_IPC_CHANNEL_BITS;
 		__le32 syncSeq     : 16;
-		__le64 reserved    : 32;
+		__le64 nsyncs      : 16; /* sync points acknowledged, ending at syncSeq */
+		__le64 reserved    : 16;
 	};
 
 	__le64 value;
@@ -424,7 +501,7 @@ CHECK_MESSAGE_SIZE(union c2h_ChanInfReqFailed, 2);
 
 union c2h_ExecErrorList {
 	struct {
-		__le64 opcode      : 6; /* NNP_IPC_C2H_OP_CHAN_EXEC_ERROR_LIST */
+		__le64 opcode      : 6; /* NNP_IPC_C2H_OP_CHAN_EXEC_ERROR_LIST(_MBOX) */
 		__le64 chan_id      : NNP_IPC_CHANNEL_BITS;
 		__le64 cmdID       : NNP_IPC_INF_CMDS_BITS;
 		__le64 cmdID_valid : 1;
@@ -531,7 +608,8 @@ union h2c_ChanConnectPeers {
 		__le64 peer_dev_id : 5;
 		__le64 peer_buf_id : 8;
 		__le64 disconnect  : 1;
-		__le64 reserved    : 9;
+		__le64 peer_nslots : 4;  /* slots of the peer p2p buffer, 0 means 1 */
+		__le64 reserved    : 5;
 	};
 
 	__le64 value;
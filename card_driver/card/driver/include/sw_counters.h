@@ -13,6 +13,7 @@
 
 #include <linux/types.h>
 #include <linux/spinlock.h>
+#include <linux/percpu.h>
 
 struct kobject;
 
@@ -38,6 +39,7 @@ struct nnp_sw_counters_set {
 	const u32				counters_count;
 	const struct nnp_sw_counters_group_info *groups_info;
 	const u32				groups_count;
+	const bool				perCPU; /* has per-CPU counter shards */
 };
 
 /* struct to describe counter values and enabled groups */
@@ -46,6 +48,7 @@ struct nnp_sw_counters {
 	u32        *groups;
 	const u32  *global_groups;
 	spinlock_t *spinlocks;
+	u64 __percpu *pcpu_values;
 };
 
 /* create sw counters_set_node */
@@ -66,6 +69,9 @@ int nnp_create_sw_counters_values_node(void *hInfoNode,
 /* create values object, also need to attach to corrent info node that matches values creation */
 int nnp_remove_sw_counters_values_node(struct nnp_sw_counters *counters);
 
+/* publish per-CPU counter shards of all values objects to their values pages */
+void nnp_sw_counters_fold_all(void);
+
 /* MACROS FOR SW COUNTER - g_nnp_sw_counters */
 
 #define NNP_SW_GROUP_IS_ENABLE(_obj, _index)    \
@@ -122,5 +128,21 @@ int nnp_remove_sw_counters_values_node(struct nnp_sw_counters *counters);
 		spin_unlock(&((_obj)->spinlocks[(_index)]));        \
 	} while (0)
 
+/*
+ * Per-CPU counter updates, for counters updated on hot paths from several
+ * cores. The value is accumulated in a per-CPU shard without locking and is
+ * added to the published value by the counters aggregator, which runs
+ * periodically, on read of the values file and on gen_sync refresh.
+ * Only valid for counter sets with perCPU set. A counter index must be
+ * updated either by these macros or by the plain ones, not by both.
+ */
+#define NNP_SW_COUNTER_PCPU_ADD(_obj, _index, _val) \
+	this_cpu_add(*((_obj)->pcpu_values + (_index)), (_val))
+
+#define NNP_SW_COUNTER_PCPU_INC(_obj, _index) \
+	this_cpu_inc(*((_obj)->pcpu_values + (_index)))
+
+#define NNP_SW_COUNTER_PCPU_DEC(_obj, _index) \
+	this_cpu_dec(*((_obj)->pcpu_values + (_index)))
 
 #endif //__NNP_SW_COUNTERS_H
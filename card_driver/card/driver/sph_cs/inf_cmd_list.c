@@ -13,15 +13,10 @@
 #include "inf_cpylst.h"
 #include "sphcs_trace.h"
 #include "inf_ptr2id.h"
+#include "inf_slab.h"
 
 //#define OPT_EXTRA_DEBUG
 
-struct id_range {
-	struct list_head node;
-	uint16_t         first;
-	uint16_t         last;
-};
-
 int inf_cmd_create(uint16_t              protocol_id,
 		   struct inf_context   *context,
 		   struct inf_cmd_list **out_cmd)
@@ -55,6 +50,8 @@ int inf_cmd_create(uint16_t              protocol_id,
 
 	cmd->num_reqs = 0;
 	atomic_set(&cmd->num_left, 0);
+	atomic_set(&cmd->sched_dma_inflight, 0);
+	init_waitqueue_head(&cmd->sched_dma_waitq);
 
 	inf_exec_error_list_init(&cmd->error_list, context);
 	INIT_LIST_HEAD(&cmd->devres_id_ranges);
@@ -160,7 +157,7 @@ static void release_cmd(struct kref *kref)
 	if (!list_empty(&cmd->devres_id_ranges))
 		list_for_each_entry_safe(range, tmp, &cmd->devres_id_ranges, node) {
 			list_del(&range->node);
-			kfree(range);
+			inf_slab_free(INF_SLAB_ID_RANGE, range);
 		}
 
 	inf_exec_error_list_fini(&cmd->error_list);
@@ -199,27 +196,11 @@ struct inf_devres_list_entry {
 	struct inf_devres *devres;
 };
 
-struct id_set {
-	struct list_head node;
-	struct list_head ranges;
-	struct list_head req_list;
-	bool             is_output;
-	bool             merged;
-
-	struct list_head  devres_groups;
-};
-
-struct req_entry {
-	struct list_head     node;
-	struct inf_exec_req *req;
-	struct id_set       *idset;
-};
-
 static struct id_set *id_set_create(bool for_write)
 {
 	struct id_set *idset;
 
-	idset = kmalloc(sizeof(*idset), GFP_KERNEL);
+	idset = inf_slab_alloc(INF_SLAB_ID_SET, GFP_KERNEL);
 	if (!idset)
 		return NULL;
 
@@ -256,9 +237,10 @@ static int id_range_add(struct list_head *ranges, uint16_t first_id, uint16_t la
 				new_range = list_next_entry(range, node);
 				if (range->first <= last_id) {
 					range->first = last_id + 1;
-					if (range->first > range->last)
+					if (range->first > range->last) {
 						list_del(&range->node);
-					else
+						inf_slab_free(INF_SLAB_ID_RANGE, range);
+					} else
 						break;
 				} else
 					break;
@@ -269,7 +251,7 @@ static int id_range_add(struct list_head *ranges, uint16_t first_id, uint16_t la
 			break;
 	}
 
-	new_range = kzalloc(sizeof(struct id_range), GFP_KERNEL);
+	new_range = inf_slab_zalloc(INF_SLAB_ID_RANGE, GFP_KERNEL);
 	if (!new_range)
 		return -1;
 
@@ -287,7 +269,7 @@ static int id_set_add_req(struct id_set *set, struct inf_exec_req *req, struct i
 {
 	struct req_entry *r;
 
-	r = kzalloc(sizeof(*r), GFP_KERNEL);
+	r = inf_slab_zalloc(INF_SLAB_REQ_ENTRY, GFP_KERNEL);
 	if (!r)
 		return -1;
 
@@ -334,7 +316,7 @@ static uint32_t id_range_intersect(struct list_head *isect,
 			if (first > r0->first) {
 				keep_last = r0->last;
 				if (last < keep_last) {
-					n = kzalloc(sizeof(struct id_range), GFP_KERNEL);
+					n = inf_slab_zalloc(INF_SLAB_ID_RANGE, GFP_KERNEL);
 					if (unlikely(n == NULL)) {
 						n_intersect -= (last - first + 1);
 						return n_intersect;
@@ -352,7 +334,7 @@ static uint32_t id_range_intersect(struct list_head *isect,
 				if (r0->first > r0->last) {
 					n = list_next_entry(r0, node);
 					list_del(&r0->node);
-					kfree(r0);
+					inf_slab_free(INF_SLAB_ID_RANGE, r0);
 					r0 = n;
 				}
 			}
@@ -360,7 +342,7 @@ static uint32_t id_range_intersect(struct list_head *isect,
 			if (first > r1->first) {
 				keep_last = r1->last;
 				if (last < keep_last) {
-					n = kzalloc(sizeof(struct id_range), GFP_KERNEL);
+					n = inf_slab_zalloc(INF_SLAB_ID_RANGE, GFP_KERNEL);
 					if (unlikely(n == NULL)) {
 						n_intersect -= (last - first + 1);
 						return n_intersect;
@@ -378,7 +360,7 @@ static uint32_t id_range_intersect(struct list_head *isect,
 				if (r1->first > r1->last) {
 					n = list_next_entry(r1, node);
 					list_del(&r1->node);
-					kfree(r1);
+					inf_slab_free(INF_SLAB_ID_RANGE, r1);
 					r1 = n;
 				}
 			}
@@ -414,7 +396,7 @@ static struct id_set *id_set_intersect(struct id_set *set0, struct id_set *set1)
 		return NULL;
 
 	if (id_range_intersect(&isect->ranges, &set0->ranges, &set1->ranges) == 0) {
-		kfree(isect);
+		inf_slab_free(INF_SLAB_ID_SET, isect);
 		return NULL;
 	}
 
@@ -459,12 +441,12 @@ static void id_set_free(struct id_set *set)
 
 	list_for_each_entry_safe(range, tmp, &set->ranges, node) {
 		list_del(&range->node);
-		kfree(range);
+		inf_slab_free(INF_SLAB_ID_RANGE, range);
 	}
 
 	list_for_each_entry_safe(r, tmpr, &set->req_list, node) {
 		list_del(&r->node);
-		kfree(r);
+		inf_slab_free(INF_SLAB_REQ_ENTRY, r);
 	}
 
 	list_for_each_entry_safe(devres_entry, devres_tmp, &set->devres_groups, node) {
@@ -472,7 +454,7 @@ static void id_set_free(struct id_set *set)
 		kfree(devres_entry);
 	}
 
-	kfree(set);
+	inf_slab_free(INF_SLAB_ID_SET, set);
 }
 
 #ifdef OPT_EXTRA_DEBUG
@@ -559,7 +541,7 @@ static void inf_cmd_clear_group_devres_optimization(struct inf_cmd_list *cmd)
 	if (!list_empty(&cmd->devres_id_ranges))
 		list_for_each_entry_safe(range, tmp, &cmd->devres_id_ranges, node) {
 			list_del(&range->node);
-			kfree(range);
+			inf_slab_free(INF_SLAB_ID_RANGE, range);
 		}
 }
 
@@ -792,7 +774,7 @@ void inf_cmd_optimize_group_devres(struct inf_cmd_list *cmd)
 			} else {
 				list_for_each_entry_safe(r, tmpr, &idset->ranges, node) {
 					list_del(&r->node);
-					kfree(r);
+					inf_slab_free(INF_SLAB_ID_RANGE, r);
 				}
 			}
 		}
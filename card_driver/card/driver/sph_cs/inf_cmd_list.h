@@ -10,6 +10,7 @@
 #include <linux/kref.h>
 #include <linux/hashtable.h>
 #include <linux/spinlock.h>
+#include <linux/wait.h>
 #include "inf_types.h"
 #include "sphcs_dma_sched.h"
 
@@ -35,6 +36,9 @@ struct inf_cmd_list {
 	struct req_params   *edits;
 	uint16_t             edits_idx;
 	enum event_val       sched_failed;
+	/* schedule packets in DMA, inline packets are parsed after them */
+	atomic_t             sched_dma_inflight;
+	wait_queue_head_t    sched_dma_waitq;
 	unsigned int         ptr2id;
 
 	// list of devres ids acccessed by this command list.
@@ -42,6 +46,31 @@ struct inf_cmd_list {
 	struct list_head     devres_id_ranges;
 };
 
+/*
+ * dependency list optimization objects, allocated from the inf_slab caches
+ */
+struct id_range {
+	struct list_head node;
+	uint16_t         first;
+	uint16_t         last;
+};
+
+struct id_set {
+	struct list_head node;
+	struct list_head ranges;
+	struct list_head req_list;
+	bool             is_output;
+	bool             merged;
+
+	struct list_head  devres_groups;
+};
+
+struct req_entry {
+	struct list_head     node;
+	struct inf_exec_req *req;
+	struct id_set       *idset;
+};
+
 int inf_cmd_create(uint16_t              protocol_id,
 		   struct inf_context   *context,
 		   struct inf_cmd_list **out_cmd);
@@ -8,6 +8,7 @@
 #include <linux/kernel.h>
 #include <linux/hashtable.h>
 #include <linux/slab.h>
+#include <linux/moduleparam.h>
 #include "inf_devres.h"
 #include "inf_devnet.h"
 #include "inf_copy.h"
@@ -19,6 +20,15 @@
 #include "sphcs_inf.h"
 #include "inf_ptr2id.h"
 
+/*
+ * Report all sync points reached at once with a single SYNC_DONE
+ * message carrying the number of sync points it acknowledges.
+ * Used only for contexts whose host runtime advertised
+ * NNP_CHAN_CTX_CAP_SYNC_DONE_COALESCE when creating the context.
+ */
+static bool sync_done_coalesce;
+module_param(sync_done_coalesce, bool, 0444);
+
 static void update_sw_counters(void *ctx)
 {
 	struct inf_context *context = (struct inf_context *)ctx;
@@ -26,7 +36,7 @@ static void update_sw_counters(void *ctx)
 	unsigned long flags;
 
 	NNP_SPIN_LOCK_IRQSAVE(&context->sw_counters_lock_irq, flags);
-	if (context->infreq_counter > 0 &&
+	if (atomic_read(&context->infreq_counter) > 0 &&
 	    NNP_SW_GROUP_IS_ENABLE(context->sw_counters,
 				   CTX_SPHCS_SW_COUNTERS_GROUP_INFERENCE)) {
 		current_time = nnp_time_us();
@@ -43,6 +53,7 @@ static void update_sw_counters(void *ctx)
 }
 
 int inf_context_create(uint16_t             protocol_id,
+		       uint8_t              host_caps,
 		       struct sphcs_cmd_chan *chan,
 		       struct inf_context **out_context)
 {
@@ -73,17 +84,31 @@ int inf_context_create(uint16_t             protocol_id,
 	context->attached = 0;
 	context->destroyed = 0;
 	context->runtime_detach_sent = false;
+	context->sync_done_coalesce = sync_done_coalesce &&
+		(host_caps & NNP_CHAN_CTX_CAP_SYNC_DONE_COALESCE);
 	atomic_set(&context->sched_tick, 1);
 	spin_lock_init(&context->lock);
 	spin_lock_init(&context->sync_lock_irq);
 	spin_lock_init(&context->sw_counters_lock_irq);
+	atomic_set(&context->infreq_counter, 0);
 	inf_cmd_queue_init(&context->cmdq);
 	hash_init(context->cmd_hash);
 	hash_init(context->devres_hash);
 	hash_init(context->copy_hash);
 	hash_init(context->devnet_hash);
+	sphcs_mem_acct_user_init(&context->mem_acct);
 	context->daemon_ref_released = true;
-	INIT_LIST_HEAD(&context->sync_points);
+	context->sync_points = kmalloc_array(INF_SYNC_POINTS_INIT_SIZE,
+					     sizeof(struct inf_sync_point),
+					     GFP_KERNEL);
+	if (unlikely(context->sync_points == NULL)) {
+		ret = -ENOMEM;
+		goto free_kmem_cache;
+	}
+	context->sync_points_size = INF_SYNC_POINTS_INIT_SIZE;
+	context->sync_points_head = 0;
+	context->sync_points_tail = 0;
+	context->next_seq_id = 0;
 	INIT_LIST_HEAD(&context->active_seq_list);
 	init_waitqueue_head(&context->sched_waitq);
 
@@ -94,7 +119,7 @@ int inf_context_create(uint16_t             protocol_id,
 						 g_nnp_sw_counters,
 						 &context->sw_counters);
 	if (unlikely(ret < 0))
-		goto free_kmem_cache;
+		goto free_sync_points;
 
 	//Init periodic timer
 	periodic_timer_data.timer_callback = update_sw_counters;
@@ -118,6 +143,8 @@ int inf_context_create(uint16_t             protocol_id,
 
 free_counters:
 	nnp_remove_sw_counters_values_node(context->sw_counters);
+free_sync_points:
+	kfree(context->sync_points);
 free_kmem_cache:
 	kmem_cache_destroy(context->exec_req_slab_cache);
 freeCtx:
@@ -183,8 +210,6 @@ static void release_context(struct inf_context *context)
 {
 	struct inf_devres *devres;
 	struct inf_copy *copy;
-	struct inf_sync_point *sync_point;
-	struct inf_sync_point *n;
 	int i;
 
 	NNP_SPIN_LOCK_BH(&g_the_sphcs->inf_data->lock_bh);
@@ -202,10 +227,7 @@ static void release_context(struct inf_context *context)
 	hash_for_each(context->devres_hash, i, devres, hash_node) {
 		inf_devres_put(devres);
 	}
-	list_for_each_entry_safe(sync_point, n, &context->sync_points, node) {
-		list_del(&sync_point->node);
-		kfree(sync_point);
-	}
+	kfree(context->sync_points);
 	SPH_SW_COUNTER_ATOMIC_DEC(g_nnp_sw_counters, SPHCS_SW_COUNTERS_INFERENCE_NUM_CONTEXTS);
 
 	nnp_remove_sw_counters_values_node(context->sw_counters);
@@ -237,7 +259,6 @@ void inf_context_destroy_objects(struct inf_context *context)
 	struct inf_copy *copy;
 	struct inf_devnet *devnet;
 	struct inf_cmd_list *cmd;
-	struct inf_sync_point *sync_point;
 	int i;
 	bool connected, found;
 	unsigned long flags;
@@ -349,21 +370,9 @@ void inf_context_destroy_objects(struct inf_context *context)
 	} while (connected || found);
 	NNP_SPIN_UNLOCK(&context->lock);
 
-	do {
-		found = false;
-		NNP_SPIN_LOCK(&context->lock);
-		if (!list_empty(&context->sync_points)) {
-			sync_point = list_first_entry(&context->sync_points,
-						      struct inf_sync_point,
-						      node);
-			list_del(&sync_point->node);
-			NNP_SPIN_UNLOCK(&context->lock);
-			kfree(sync_point);
-			found = true;
-			break;
-		}
-	} while (found);
-	NNP_SPIN_UNLOCK(&context->lock);
+	NNP_SPIN_LOCK_IRQSAVE(&context->sync_lock_irq, flags);
+	context->sync_points_head = context->sync_points_tail;
+	NNP_SPIN_UNLOCK_IRQRESTORE(&context->sync_lock_irq, flags);
 }
 
 int inf_context_get(struct inf_context *context)
@@ -404,83 +413,66 @@ int inf_context_put(struct inf_context *context)
 	return 0;
 }
 
+static void send_sync_done(struct inf_context *context,
+			   u16                 host_sync_id,
+			   u16                 nsyncs)
+{
+	union c2h_ChanSyncDone msg;
+
+	msg.value = 0;
+	msg.opcode = NNP_IPC_C2H_OP_CHAN_SYNC_DONE;
+	msg.chan_id = context->chan->protocol_id;
+	msg.syncSeq = host_sync_id;
+	msg.nsyncs = nsyncs;
+
+	sphcs_msg_scheduler_queue_add_msg(context->chan->respq,
+					  &msg.value, 1);
+}
+
 /* This function evaluates if a sync point has reached and send out
  * a message to host when needed, as well as removing done sync points
- * from the list.
- * the function must be called while the context lock is held!
+ * from the ring.
+ * Sync points are added with non decreasing seq_id, so only the ring head
+ * needs to be compared with the completed watermark, which is the seq_id
+ * of the oldest request in flight.
+ * the function must be called while the context sync lock is held!
  */
 static void evaluate_sync_points(struct inf_context *context)
 {
 	struct inf_sync_point *sync_point;
 	struct inf_req_sequence *oldest;
-	union c2h_ChanSyncDone msg;
+	u32 mask = context->sync_points_size - 1;
+	u64 watermark;
+	u16 nsyncs = 0;
+	u16 last_host_sync_id = 0;
 
 	oldest = list_first_entry_or_null(&context->active_seq_list,
 					  struct inf_req_sequence,
 					  node);
+	watermark = oldest != NULL ? oldest->seq_id : context->next_seq_id;
 
-	while (!list_empty(&context->sync_points)) {
-		sync_point = list_first_entry(&context->sync_points,
-					      struct inf_sync_point,
-					      node);
+	while (context->sync_points_head != context->sync_points_tail) {
+		sync_point = &context->sync_points[context->sync_points_head & mask];
 
-		if (oldest != NULL && sync_point->seq_id >= oldest->seq_id)
+		if (sync_point->seq_id > watermark)
 			break; /* no need to test rest of sync points */
 
-		msg.value = 0;
-		msg.opcode = NNP_IPC_C2H_OP_CHAN_SYNC_DONE;
-		msg.chan_id = context->chan->protocol_id;
-		msg.syncSeq = sync_point->host_sync_id;
-
-		sphcs_msg_scheduler_queue_add_msg(context->chan->respq,
-						  &msg.value, 1);
+		context->sync_points_head++;
 
-		list_del(&sync_point->node);
-		kfree(sync_point);
-	}
-}
-
-static void handle_seq_id_wrap(struct inf_context    *context)
-{
-	struct inf_req_sequence *oldest;
-
-	/* report back completed sync points */
-	if (!list_empty(&context->sync_points))
-		evaluate_sync_points(context);
-
-	oldest = list_first_entry_or_null(&context->active_seq_list,
-					  struct inf_req_sequence,
-					  node);
-
-	if (oldest) {
-		struct inf_req_sequence *req = NULL;
-		struct inf_sync_point *sync_point;
-		u16 min_seq_id = oldest->seq_id;
-		u16 max_seq_id;
-
-		list_for_each_entry(req, &context->active_seq_list, node) {
-			NNP_ASSERT(req->seq_id >= min_seq_id);
-			req->seq_id -= min_seq_id;
+		if (!context->sync_done_coalesce) {
+			send_sync_done(context, sync_point->host_sync_id, 1);
+			continue;
 		}
 
-		list_for_each_entry(sync_point, &context->sync_points, node) {
-			NNP_ASSERT(sync_point->seq_id >= min_seq_id);
-			sync_point->seq_id -= min_seq_id;
+		last_host_sync_id = sync_point->host_sync_id;
+		if (++nsyncs == U16_MAX) {
+			send_sync_done(context, last_host_sync_id, nsyncs);
+			nsyncs = 0;
 		}
-
-		max_seq_id = list_last_entry(&context->active_seq_list,
-					     struct inf_req_sequence,
-					     node)->seq_id;
-		NNP_ASSERT(max_seq_id + 2 > max_seq_id + 1);
-		context->next_seq_id = max_seq_id + 1;
-	} else {
-		/* if no active requests are in flight, all sync points must
-		 * have been completed as well.
-		 * safe to reset the seq_id counter
-		 */
-		NNP_ASSERT(list_empty(&context->sync_points));
-		context->next_seq_id = 0;
 	}
+
+	if (nsyncs > 0)
+		send_sync_done(context, last_host_sync_id, nsyncs);
 }
 
 void inf_context_seq_id_init(struct inf_context      *context,
@@ -489,10 +481,6 @@ void inf_context_seq_id_init(struct inf_context      *context,
 	unsigned long flags;
 
 	NNP_SPIN_LOCK_IRQSAVE(&context->sync_lock_irq, flags);
-
-	if (context->next_seq_id + 1 < context->next_seq_id)
-		handle_seq_id_wrap(context);
-
 	seq->seq_id = context->next_seq_id++;
 	list_add_tail(&seq->node, &context->active_seq_list);
 	NNP_SPIN_UNLOCK_IRQRESTORE(&context->sync_lock_irq, flags);
@@ -505,7 +493,7 @@ void inf_context_seq_id_fini(struct inf_context      *context,
 
 	NNP_SPIN_LOCK_IRQSAVE(&context->sync_lock_irq, flags);
 	list_del(&seq->node);
-	if (!list_empty(&context->sync_points))
+	if (context->sync_points_head != context->sync_points_tail)
 		evaluate_sync_points(context);
 	NNP_SPIN_UNLOCK_IRQRESTORE(&context->sync_lock_irq, flags);
 	wake_up_all(&context->sched_waitq);
@@ -652,14 +640,42 @@ enum context_state inf_context_get_state(struct inf_context *context)
 	return context->state;
 }
 
+/* called with the context sync lock held */
+static int grow_sync_points(struct inf_context *context)
+{
+	struct inf_sync_point *ring;
+	u32 mask = context->sync_points_size - 1;
+	u32 n = context->sync_points_tail - context->sync_points_head;
+	u32 i;
+
+	ring = kmalloc_array(context->sync_points_size * 2,
+			     sizeof(struct inf_sync_point),
+			     GFP_NOWAIT);
+	if (unlikely(ring == NULL))
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++)
+		ring[i] = context->sync_points[(context->sync_points_head + i) & mask];
+
+	kfree(context->sync_points);
+	context->sync_points = ring;
+	context->sync_points_size *= 2;
+	context->sync_points_head = 0;
+	context->sync_points_tail = n;
+
+	return 0;
+}
+
 void inf_context_add_sync_point(struct inf_context *context,
 				u16                 host_sync_id)
 {
 	struct inf_sync_point *sync_point;
 	unsigned long flags;
 
-	sync_point = kzalloc(sizeof(*sync_point), GFP_NOWAIT);
-	if (!sync_point) {
+	NNP_SPIN_LOCK_IRQSAVE(&context->sync_lock_irq, flags);
+	if (context->sync_points_tail - context->sync_points_head == context->sync_points_size &&
+	    unlikely(grow_sync_points(context) != 0)) {
+		NNP_SPIN_UNLOCK_IRQRESTORE(&context->sync_lock_irq, flags);
 		sphcs_send_event_report(g_the_sphcs,
 					NNP_IPC_CREATE_SYNC_FAILED,
 					NNP_IPC_NO_MEMORY,
@@ -669,10 +685,11 @@ void inf_context_add_sync_point(struct inf_context *context,
 		return;
 	}
 
+	sync_point = &context->sync_points[context->sync_points_tail & (context->sync_points_size - 1)];
 	sync_point->host_sync_id = host_sync_id;
-	NNP_SPIN_LOCK_IRQSAVE(&context->sync_lock_irq, flags);
-	sync_point->seq_id = context->next_seq_id > 0 ? context->next_seq_id - 1 : 0;
-	list_add_tail(&sync_point->node, &context->sync_points);
+	/* reached when all requests scheduled so far are done */
+	sync_point->seq_id = context->next_seq_id;
+	context->sync_points_tail++;
 	evaluate_sync_points(context);
 	NNP_SPIN_UNLOCK_IRQRESTORE(&context->sync_lock_irq, flags);
 }
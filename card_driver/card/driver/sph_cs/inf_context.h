@@ -25,6 +25,7 @@
 #include "sphcs_sw_counters.h"
 #include "sphcs_cmd_chan.h"
 #include "inf_exec_req.h"
+#include "sphcs_mem_acct.h"
 
 struct nnp_device;
 
@@ -50,15 +51,20 @@ struct inf_context {
 	int                attached;
 	int                destroyed;
 	bool               runtime_detach_sent;
+	bool               sync_done_coalesce; /* host handles SYNC_DONE nsyncs */
+	u32                runtime_caps;       /* INF_RT_CAP_* */
 	DECLARE_HASHTABLE(cmd_hash, 6);
 	DECLARE_HASHTABLE(devres_hash, 6);
 	DECLARE_HASHTABLE(devnet_hash, 6);
 	DECLARE_HASHTABLE(copy_hash, 6);
 
-	struct list_head     sync_points;
+	struct inf_sync_point *sync_points; /* ring ordered by seq_id */
+	u32                  sync_points_size;  /* power of 2 */
+	u32                  sync_points_head;
+	u32                  sync_points_tail;
 	struct list_head     active_seq_list;
 	wait_queue_head_t    sched_waitq;
-	u32                  next_seq_id;
+	u64                  next_seq_id;       /* never wraps */
 	atomic_t             sched_tick;
 	u32                  num_optimized_cmd_lists;
 
@@ -68,21 +74,29 @@ struct inf_context {
 
 	struct nnp_sw_counters *sw_counters;
 	u64                 runtime_busy_starttime;
-	u32                 infreq_counter;
+	atomic_t            infreq_counter;
 	uint64_t            counters_cb_data_handler;
 
 	enum context_state state;
 	struct kmem_cache *exec_req_slab_cache;
 	bool daemon_ref_released;
+
+	struct sphcs_mem_acct_user mem_acct;
 };
 
+/*
+ * A sync point is reached when all requests with seq_id lower than
+ * the sync point seq_id have completed.
+ */
 struct inf_sync_point {
-	struct list_head node;
-	u32              seq_id;
+	u64              seq_id;
 	u16              host_sync_id;
 };
 
+#define INF_SYNC_POINTS_INIT_SIZE 64
+
 int inf_context_create(uint16_t             protocol_id,
+		       uint8_t              host_caps,
 		       struct sphcs_cmd_chan *chan,
 		       struct inf_context **out_context);
 
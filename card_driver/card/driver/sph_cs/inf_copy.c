@@ -18,6 +18,7 @@
 #include "inf_exec_req.h"
 #include "nnp_error.h"
 #include "sphcs_trace.h"
+#include "inf_slab.h"
 
 static enum EXEC_REQ_READINESS inf_copy_req_ready(struct inf_exec_req *req);
 static int inf_copy_req_execute(struct inf_exec_req *req);
@@ -113,7 +114,10 @@ static int d2d_copy_complete_cb(struct sphcs *sphcs, void *ctx, const void *user
 		devres->p2p_buf.ready = false;
 		err = -EIO;
 		if (likely(devres->p2p_buf.peer_dev != NULL))
-			err = sphcs_p2p_send_fw_cr_and_ring_db(&devres->p2p_buf, copy_complete_cb, req);
+			err = sphcs_p2p_send_fw_cr_and_ring_db(&devres->p2p_buf,
+							       sphcs_p2p_buf_fill_slot(&devres->p2p_buf),
+							       copy_complete_cb,
+							       req);
 		NNP_SPIN_UNLOCK_IRQRESTORE(&devres->lock_irq, flags);
 		if (unlikely(err != 0))
 			sph_log_err(EXECUTE_COMMAND_LOG, "Failed to initiate forward credit(devres %hu), buf(%hhu) was diconnected, err:%d.\n",
@@ -136,6 +140,9 @@ int inf_d2d_copy_create(union h2c_ChanInferenceCopyOp *cmd,
 	uint64_t dest_host_addr = NNP_IPC_DMA_PFN_TO_ADDR(cmd->hostres);
 	struct inf_copy *copy;
 	struct sg_table *to_sgt;
+	u8 nslots = from_devres->p2p_buf.nslots;
+	u32 lli_size;
+	u8 slot;
 	int ret;
 	u64 transfer_size;
 
@@ -145,7 +152,7 @@ int inf_d2d_copy_create(union h2c_ChanInferenceCopyOp *cmd,
 	}
 	NNP_ASSERT(from_devres->p2p_buf.ready);
 
-	copy = kzalloc(sizeof(struct inf_copy), GFP_KERNEL);
+	copy = inf_slab_zalloc(INF_SLAB_COPY, GFP_KERNEL);
 	if (unlikely(copy == NULL)) {
 		sph_log_err(CREATE_COMMAND_LOG, "FATAL: failed to allocate 2d2 copy object\n");
 		return -ENOMEM;
@@ -158,7 +165,8 @@ int inf_d2d_copy_create(union h2c_ChanInferenceCopyOp *cmd,
 		goto failed_to_allocate_sgt;
 	}
 
-	to_sgt->sgl->length = from_devres->size;
+	/* the peer buffer has the same number of slots, checked on connect */
+	to_sgt->sgl->length = from_devres->size * nslots;
 	to_sgt->sgl->dma_address = dest_host_addr;
 
 	sph_log_debug(GENERAL_LOG, "d2d target dma addr %pad, length %u\n", &to_sgt->sgl->dma_address, to_sgt->sgl->length);
@@ -189,13 +197,19 @@ int inf_d2d_copy_create(union h2c_ChanInferenceCopyOp *cmd,
 	if (unlikely(ret < 0))
 		goto failed_to_create_counters;
 
-	/* Calculate DMA LLI size */
-	ret = g_the_sphcs->hw_ops->dma.init_lli(g_the_sphcs->hw_handle, &copy->lli, from_devres->dma_map, to_sgt, 0, false);
-	if (ret != 0) {
-		sph_log_err(CREATE_COMMAND_LOG, "FATAL: line:%u failed to init lli buffer\n", __LINE__);
-		ret = -ENOMEM;
-		goto failed_to_allocate_lli;
+	/* Calculate DMA LLI size, big enough for a copy to any slot */
+	lli_size = 0;
+	for (slot = nslots; slot-- > 0; ) {
+		ret = g_the_sphcs->hw_ops->dma.init_lli(g_the_sphcs->hw_handle, &copy->lli, from_devres->dma_map, to_sgt,
+							slot * from_devres->size, false);
+		if (ret != 0) {
+			sph_log_err(CREATE_COMMAND_LOG, "FATAL: line:%u failed to init lli buffer\n", __LINE__);
+			ret = -ENOMEM;
+			goto failed_to_allocate_lli;
+		}
+		lli_size = max(lli_size, copy->lli.size);
 	}
+	copy->lli.size = lli_size;
 
 	NNP_ASSERT(copy->lli.size > 0);
 
@@ -209,7 +223,8 @@ int inf_d2d_copy_create(union h2c_ChanInferenceCopyOp *cmd,
 
 	/* Generate LLI */
 	transfer_size = g_the_sphcs->hw_ops->dma.gen_lli(g_the_sphcs->hw_handle, from_devres->dma_map, to_sgt, &copy->lli, 0);
-	NNP_ASSERT(transfer_size == from_devres->size);
+	/* trimmed to the copy size on execute */
+	NNP_ASSERT(transfer_size >= from_devres->size);
 
 	/* Increment devres and context refcount as copy has the references to them */
 	inf_devres_get(from_devres);
@@ -241,7 +256,9 @@ int inf_d2d_copy_create(union h2c_ChanInferenceCopyOp *cmd,
 				copy->context->protocol_id,
 				copy->protocol_id);
 
-	sg_free_table(to_sgt);
+	/* keep the target of a multi slot buffer to generate the lli per slot */
+	if (nslots == 1)
+		sg_free_table(to_sgt);
 
 	return 0;
 
@@ -250,7 +267,7 @@ failed_to_allocate_lli:
 failed_to_create_counters:
 	sg_free_table(to_sgt);
 failed_to_allocate_sgt:
-	kfree(copy);
+	inf_slab_free(INF_SLAB_COPY, copy);
 
 	return ret;
 }
@@ -273,7 +290,13 @@ int inf_copy_create(union h2c_ChanInferenceCopyOp *cmd,
 	if (subres_copy && card2Host)
 		return -EINVAL;
 
-	copy = kzalloc(sizeof(struct inf_copy), GFP_KERNEL);
+	/* only the runtime knows which slot of a multi slot p2p buffer to access */
+	if (devres->is_p2p_dst && devres->p2p_buf.nslots > 1) {
+		sph_log_err(CREATE_COMMAND_LOG, "Copy of multi slot p2p dst devres(%hu) is not supported.\n", devres->protocol_id);
+		return -EINVAL;
+	}
+
+	copy = inf_slab_zalloc(INF_SLAB_COPY, GFP_KERNEL);
 	if (unlikely(copy == NULL)) {
 		sph_log_err(CREATE_COMMAND_LOG, "FATAL: failed to allocate copy object.\n");
 		return -ENOMEM;
@@ -395,7 +418,7 @@ int inf_copy_create(union h2c_ChanInferenceCopyOp *cmd,
 	return 0;
 
 failed:
-	kfree(copy);
+	inf_slab_free(INF_SLAB_COPY, copy);
 
 	return res;
 }
@@ -413,6 +436,8 @@ static void release_copy(struct work_struct *work)
 				copy->lli.size,
 				copy->lli.vptr,
 				copy->lli.dma_addr);
+	if (copy->d2d && copy->devres->p2p_buf.nslots > 1)
+		sg_free_table(&copy->host_sgt);
 	if (copy->sw_counters)
 		nnp_remove_sw_counters_values_node(copy->sw_counters);
 
@@ -428,7 +453,7 @@ static void release_copy(struct work_struct *work)
 
 	inf_context_put(copy->context);
 
-	kfree(copy);
+	inf_slab_free(INF_SLAB_COPY, copy);
 }
 
 static void sched_release_copy(struct kref *kref)
@@ -650,6 +675,36 @@ static int inf_copy_req_execute(struct inf_exec_req *req)
 		if (transfer_size < 1)
 			return -EINVAL;
 		NNP_ASSERT(transfer_size >= req->size);
+	} else if (copy->d2d && copy->devres->p2p_buf.nslots > 1) {
+		u64 transfer_size;
+		u64 dst_offset;
+		u32 lli_size_keep;
+		int ret;
+
+		/* wr_slot changes only when this copy completes */
+		dst_offset = copy->devres->p2p_buf.wr_slot * copy->devres->size;
+
+		lli_size_keep = copy->lli.size;
+		ret = g_the_sphcs->hw_ops->dma.init_lli(g_the_sphcs->hw_handle,
+							&copy->lli,
+							copy->devres->dma_map,
+							&copy->host_sgt,
+							dst_offset, false);
+		if (ret != 0 || copy->lli.size > lli_size_keep) {
+			sph_log_err(EXECUTE_COMMAND_LOG, "Failed init lli for p2p slot ret=%d size=%u size_keep=%u\n",
+				    ret, copy->lli.size, lli_size_keep);
+			copy->lli.size = lli_size_keep;
+			return -ENOMEM;
+		}
+		copy->lli.size = lli_size_keep;
+
+		transfer_size = g_the_sphcs->hw_ops->dma.gen_lli(g_the_sphcs->hw_handle,
+								 copy->devres->dma_map,
+								 &copy->host_sgt,
+								 &copy->lli,
+								 dst_offset);
+		if (transfer_size < 1)
+			return -EINVAL;
 	}
 
 	if (copy->sw_counters &&
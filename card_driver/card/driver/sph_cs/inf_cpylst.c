@@ -19,6 +19,7 @@
 #include "nnp_error.h"
 #include "sphcs_trace.h"
 #include "sph_safe.h"
+#include "inf_slab.h"
 
 static int inf_cpylst_req_sched(struct inf_exec_req *req);
 static enum EXEC_REQ_READINESS inf_cpylst_req_ready(struct inf_exec_req *req);
@@ -83,7 +84,7 @@ int inf_cpylst_create(struct inf_cmd_list *cmd,
 	if (unlikely(num_copies == 0))
 		return -EINVAL;
 
-	cpylst = kmalloc(sizeof(struct inf_cpylst), GFP_KERNEL);
+	cpylst = inf_slab_alloc(INF_SLAB_CPYLST, GFP_KERNEL);
 	if (unlikely(cpylst == NULL)) {
 		sph_log_err(CREATE_COMMAND_LOG, "FATAL: line:%u failed to allocate copy list object\n", __LINE__);
 		return -ENOMEM;
@@ -143,7 +144,7 @@ free_priorities:
 free_copies:
 	kfree(cpylst->copies);
 free_cpylst:
-	kfree(cpylst);
+	inf_slab_free(INF_SLAB_CPYLST, cpylst);
 
 	return -ENOMEM;
 }
@@ -352,7 +353,7 @@ static void release_cpylst(struct inf_cpylst *cpylst)
 	kfree(cpylst->priorities);
 	kfree(cpylst->copies);
 
-	kfree(cpylst);
+	inf_slab_free(INF_SLAB_CPYLST, cpylst);
 }
 
 static void inf_cpylst_req_release(struct kref *kref)
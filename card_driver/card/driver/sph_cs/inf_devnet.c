@@ -377,7 +377,7 @@ static int inf_req_create_dma_complete_callback(struct sphcs *sphcs,
 	for (i = 0; i < n_outputs; ++i)
 		inf_devres_put(outputs[i]);
 	if (unlikely(ret < 0)) {
-		val = NNP_IPC_NO_MEMORY;
+		val = (ret == -EINVAL) ? NNP_IPC_NOT_SUPPORTED : NNP_IPC_NO_MEMORY;
 		goto free_config;
 	}
 
@@ -14,6 +14,7 @@
 #include "inf_exec_req.h"
 #include "ioctl_inf.h"
 #include "inf_ptr2id.h"
+#include "inf_slab.h"
 
 static void treat_credit_release_failure(struct inf_exec_req *req, enum event_val event_val)
 {
@@ -84,10 +85,31 @@ int inf_devres_create(uint16_t            protocol_id,
 	if ((usage_flags & IOCTL_INF_RES_P2P_SRC) && (usage_flags & IOCTL_INF_RES_P2P_DST))
 		return -EINVAL;
 
-	devres = kzalloc(sizeof(*devres), GFP_KERNEL);
+	/* depth of p2p resource is the number of slots of the p2p buffer */
+	if ((usage_flags & (IOCTL_INF_RES_P2P_SRC | IOCTL_INF_RES_P2P_DST)) && depth > SPHCS_P2P_MAX_SLOTS)
+		return -EINVAL;
+
+	devres = inf_slab_zalloc(INF_SLAB_DEVRES, GFP_KERNEL);
 	if (unlikely(devres == NULL))
 		return -ENOMEM;
 
+	/* runtime allocates size bytes for each of the depth copies */
+	if (usage_flags & IOCTL_INF_RES_P2P_DST)
+		devres->mem_pool = SPHCS_MEM_POOL_P2P;
+	else if (usage_flags & IOCTL_INF_RES_ECC)
+		devres->mem_pool = SPHCS_MEM_POOL_DEVICE_ECC;
+	else
+		devres->mem_pool = SPHCS_MEM_POOL_DEVICE;
+	devres->mem_reserved = size * max_t(u8, depth, 1);
+
+	rc = sphcs_mem_acct_reserve(&context->mem_acct,
+				    devres->mem_pool,
+				    devres->mem_reserved);
+	if (unlikely(rc < 0)) {
+		inf_slab_free(INF_SLAB_DEVRES, devres);
+		return rc;
+	}
+
 	kref_init(&devres->ref);
 	devres->magic = inf_devres_create;
 	devres->protocol_id = protocol_id;
@@ -117,16 +139,16 @@ int inf_devres_create(uint16_t            protocol_id,
 	devres->is_p2p_dst = (devres->usage_flags & IOCTL_INF_RES_P2P_DST) ? true : false;
 	devres->ptr2id = add_ptr2id(devres);
 	if (unlikely(devres->ptr2id == 0)) {
-		kfree(devres);
-		return -ENOMEM;
+		rc = -ENOMEM;
+		goto unreserve;
 	}
 
 	if (inf_devres_is_p2p(devres)) {
+		devres->p2p_buf.nslots = max_t(u8, depth, 1);
 		rc = sphcs_p2p_init_p2p_buf(devres->is_p2p_src, &devres->p2p_buf);
 		if (unlikely(rc < 0)) {
 			del_ptr2id(devres);
-			kfree(devres);
-			return rc;
+			goto unreserve;
 		}
 	}
 
@@ -137,6 +159,11 @@ int inf_devres_create(uint16_t            protocol_id,
 
 	*out_devres = devres;
 	return 0;
+
+unreserve:
+	sphcs_mem_acct_release(&context->mem_acct, devres->mem_pool, devres->mem_reserved);
+	inf_slab_free(INF_SLAB_DEVRES, devres);
+	return rc;
 }
 
 int inf_devres_attach_buf(struct inf_devres *devres,
@@ -273,6 +300,7 @@ static void release_devres(struct kref *kref)
 	}
 
 	SPH_SW_COUNTER_DEC_VAL(devres->context->sw_counters, CTX_SPHCS_SW_COUNTERS_INFERENCE_DEVICE_RESOURCE_SIZE, devres->size);
+	sphcs_mem_acct_release(&devres->context->mem_acct, devres->mem_pool, devres->mem_reserved);
 
 
 	if (likely(devres->destroyed == 1))
@@ -286,7 +314,7 @@ static void release_devres(struct kref *kref)
 	inf_context_put(devres->context);
 	del_ptr2id(devres);
 
-	kfree(devres);
+	inf_slab_free(INF_SLAB_DEVRES, devres);
 }
 
 int inf_devres_get(struct inf_devres *devres)
@@ -330,7 +358,7 @@ int inf_devres_add_req_to_queue(struct inf_devres *devres, struct inf_exec_req *
 	NNP_ASSERT(devres != NULL);
 	NNP_ASSERT(req != NULL);
 
-	queue_ent = kmalloc(sizeof(struct exec_queue_entry), GFP_NOWAIT);
+	queue_ent = inf_slab_alloc(INF_SLAB_EXEC_QUEUE_ENTRY, GFP_NOWAIT);
 	if (unlikely(queue_ent == NULL))
 		return -ENOMEM;
 
@@ -353,7 +381,10 @@ int inf_devres_send_release_credit(struct inf_devres *devres, struct inf_exec_re
 	inf_exec_req_get(req);
 	rc = -EIO;
 	if (likely(devres->p2p_buf.peer_dev != NULL))
-		rc = sphcs_p2p_send_rel_cr_and_ring_db(&devres->p2p_buf, credit_released_cb, req);
+		rc = sphcs_p2p_send_rel_cr_and_ring_db(&devres->p2p_buf,
+						       sphcs_p2p_buf_consume_slot(&devres->p2p_buf),
+						       credit_released_cb,
+						       req);
 	if (unlikely(rc != 0)) {
 		sph_log_err(EXECUTE_COMMAND_LOG, "Failed to initiate credit release(devres %hu), buf(%hhu) was diconnected, rc:%d.\n",
 			    devres->protocol_id, devres->p2p_buf.buf_id, rc);
@@ -382,7 +413,7 @@ void inf_devres_del_req_from_queue(struct inf_devres   *devres,
 
 	NNP_SPIN_UNLOCK_IRQRESTORE(&devres->lock_irq, flags);
 
-	kfree(pos);
+	inf_slab_free(INF_SLAB_EXEC_QUEUE_ENTRY, pos);
 }
 
 void inf_devres_try_execute(struct inf_devres *devres)
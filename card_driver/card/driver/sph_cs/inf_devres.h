@@ -14,6 +14,7 @@
 #include <linux/atomic.h>
 #include "inf_types.h"
 #include "sphcs_p2p.h"
+#include "sphcs_mem_acct.h"
 
 enum DEV_RES_READINESS {
 	DEV_RES_READINESS_NOT_READY = 0,
@@ -66,6 +67,10 @@ struct inf_devres {
 	/* The device resource contains inconsistent data */
 	bool is_dirty;
 
+	/* memory reserved for the resource in the card memory accounting */
+	enum sphcs_mem_pool mem_pool;
+	uint64_t            mem_reserved;
+
 };
 
 static inline bool inf_devres_is_p2p(struct inf_devres *devres)
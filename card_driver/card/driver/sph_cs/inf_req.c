@@ -21,6 +21,7 @@
 #include "sphcs_ibecc.h"
 #include "sph_safe.h"
 #include "inf_ptr2id.h"
+#include "inf_slab.h"
 #include "nnp_hwtrace_protocol.h"
 
 static struct inf_devres *devres_for_err_inj;
@@ -64,7 +65,7 @@ int inf_req_create(uint16_t            protocol_id,
 	struct inf_req *infreq;
 	int ret = 0;
 
-	infreq = kzalloc(sizeof(*infreq), GFP_KERNEL);
+	infreq = inf_slab_zalloc(INF_SLAB_INFREQ, GFP_KERNEL);
 	if (unlikely(infreq == NULL))
 		return -ENOMEM;
 
@@ -113,10 +114,26 @@ int inf_req_create(uint16_t            protocol_id,
 	return 0;
 
 free_infreq:
-	kfree(infreq);
+	inf_slab_free(INF_SLAB_INFREQ, infreq);
 	return ret;
 }
 
+/* rd_slot of an input changes only when this request completes */
+static u64 inf_req_p2p_slots(struct inf_req *infreq)
+{
+	struct inf_devres *devres;
+	u64 slots = 0;
+	u32 i, n = 0;
+
+	for (i = 0; i < infreq->n_inputs; i++) {
+		devres = infreq->inputs[i];
+		if (devres->is_p2p_dst && devres->p2p_buf.nslots > 1)
+			slots |= (u64)devres->p2p_buf.rd_slot << (INF_P2P_SLOT_BITS * n++);
+	}
+
+	return slots;
+}
+
 int inf_req_add_resources(struct inf_req     *infreq,
 			  uint32_t            n_inputs,
 			  struct inf_devres **inputs,
@@ -126,10 +143,21 @@ int inf_req_add_resources(struct inf_req     *infreq,
 			  void               *config_data)
 {
 	int i;
+	int n_slotted = 0;
 
 	if (unlikely(infreq == NULL))
 		return -EINVAL;
 
+	/* slot of each multi slot p2p input is passed to runtime on execute */
+	for (i = 0; i < n_inputs; i++)
+		if (inputs[i]->is_p2p_dst && inputs[i]->p2p_buf.nslots > 1)
+			n_slotted++;
+	if (n_slotted > 0 &&
+	    (n_slotted > INF_P2P_MAX_SLOTTED_INPUTS ||
+	     !(infreq->devnet->context->runtime_caps & INF_RT_CAP_P2P_SLOTS)))
+		return -EINVAL;
+
+	infreq->n_slotted_inputs = n_slotted;
 	infreq->n_inputs = n_inputs;
 	infreq->n_outputs = n_outputs;
 	infreq->inputs = inputs;
@@ -236,7 +264,7 @@ static void release_infreq(struct kref *kref)
 	if (likely(infreq->config_data != NULL))
 		kfree(infreq->config_data);
 	del_ptr2id(infreq);
-	kfree(infreq);
+	inf_slab_free(INF_SLAB_INFREQ, infreq);
 }
 
 int inf_req_get(struct inf_req *infreq)
@@ -348,8 +376,8 @@ int infreq_req_sched(struct inf_exec_req *req)
 		migrate_priority(infreq, req);
 
 	// Request scheduled
-	NNP_SW_COUNTER_INC(infreq->devnet->context->sw_counters,
-			   CTX_SPHCS_SW_COUNTERS_INFERENCE_SUBMITTED_INF_REQ);
+	NNP_SW_COUNTER_PCPU_INC(infreq->devnet->context->sw_counters,
+				CTX_SPHCS_SW_COUNTERS_INFERENCE_SUBMITTED_INF_REQ);
 
 	// First try to execute
 	req->last_sched_tick = 0;
@@ -512,6 +540,7 @@ static int inf_req_execute(struct inf_exec_req *req)
 {
 	struct inf_req *infreq;
 	struct inf_context *context;
+	struct inf_exec_infreq_slots slots_cmd;
 	unsigned long flags, flags2;
 	int ret;
 
@@ -564,6 +593,12 @@ static int inf_req_execute(struct inf_exec_req *req)
 
 	NNP_SPIN_LOCK_IRQSAVE(&infreq->lock_irq, flags);
 	infreq->exec_cmd.ready_flags = 1;
+	if (infreq->n_slotted_inputs > 0) {
+		slots_cmd.infreq_rt_handle = infreq->exec_cmd.infreq_rt_handle;
+		slots_cmd.version = INF_EXEC_INFREQ_SLOTS_VERSION;
+		slots_cmd.reserved = 0;
+		slots_cmd.p2p_slots = inf_req_p2p_slots(infreq);
+	}
 	infreq->exec_cmd.sched_params_is_null = req->sched_params_is_null;
 	if (!req->sched_params_is_null) {
 		infreq->exec_cmd.sched_params.batchSize = (uint16_t)req->size;
@@ -576,12 +611,18 @@ static int inf_req_execute(struct inf_exec_req *req)
 		infreq->exec_cmd.sched_params_is_null = 0;
 		infreq->exec_cmd.sched_params.hwtraceEnabled = (g_the_sphcs->hw_tracing.hwtrace_status == NNPCS_HWTRACE_ACTIVATED);
 	}
-	NNP_SPIN_LOCK_IRQSAVE(&context->sw_counters_lock_irq, flags2);
-	if (context->infreq_counter == 0 &&
-	    NNP_SW_GROUP_IS_ENABLE(context->sw_counters, CTX_SPHCS_SW_COUNTERS_GROUP_INFERENCE))
-		context->runtime_busy_starttime = nnp_time_us();
-	context->infreq_counter++;
-	NNP_SPIN_UNLOCK_IRQRESTORE(&context->sw_counters_lock_irq, flags2);
+	/*
+	 * Only the idle->busy transition needs the lock, it is re-checked
+	 * under the lock in case the last request completed meanwhile.
+	 */
+	if (atomic_inc_return(&context->infreq_counter) == 1) {
+		NNP_SPIN_LOCK_IRQSAVE(&context->sw_counters_lock_irq, flags2);
+		if (context->runtime_busy_starttime == 0 &&
+		    atomic_read(&context->infreq_counter) > 0 &&
+		    NNP_SW_GROUP_IS_ENABLE(context->sw_counters, CTX_SPHCS_SW_COUNTERS_GROUP_INFERENCE))
+			context->runtime_busy_starttime = nnp_time_us();
+		NNP_SPIN_UNLOCK_IRQRESTORE(&context->sw_counters_lock_irq, flags2);
+	}
 
 	infreq->active_req = req;
 
@@ -596,12 +637,20 @@ static int inf_req_execute(struct inf_exec_req *req)
 		ret = -NNPER_CONTEXT_BROKEN;
 	} else {
 		ibecc_inject_error(infreq->devnet);
-		ret = inf_cmd_queue_add(&infreq->devnet->context->cmdq,
-					SPHCS_RUNTIME_CMD_EXECUTE_INFREQ,
-					NULL,
-					sizeof(infreq->exec_cmd),
-					inf_req_read_exec_command,
-					req);
+		ret = 0;
+		if (infreq->n_slotted_inputs > 0)
+			ret = inf_cmd_queue_add(&infreq->devnet->context->cmdq,
+						SPHCS_RUNTIME_CMD_EXECUTE_INFREQ_SLOTS,
+						&slots_cmd,
+						sizeof(slots_cmd),
+						NULL, NULL);
+		if (likely(ret == 0))
+			ret = inf_cmd_queue_add(&infreq->devnet->context->cmdq,
+						SPHCS_RUNTIME_CMD_EXECUTE_INFREQ,
+						NULL,
+						sizeof(infreq->exec_cmd),
+						inf_req_read_exec_command,
+						req);
 	}
 	/* if ret != 0 then the request was not added to cmdq successfuly
 	 * therefore will not be handled by the runtime.
@@ -730,7 +779,6 @@ void inf_req_complete(struct inf_exec_req *req,
 	struct inf_cmd_list *cmd;
 	unsigned long flags;
 	enum event_val event_val;
-	bool last_completed;
 	uint32_t i;
 	bool has_dirty_outputs = false;
 
@@ -741,22 +789,22 @@ void inf_req_complete(struct inf_exec_req *req,
 	context = infreq->devnet->context;
 	cmd = req->cmd;
 
-	NNP_SPIN_LOCK_IRQSAVE(&context->sw_counters_lock_irq, flags);
-	context->infreq_counter--;
-	last_completed = (context->infreq_counter == 0);
-	NNP_SW_COUNTER_INC(context->sw_counters, CTX_SPHCS_SW_COUNTERS_INFERENCE_COMPLETED_INF_REQ);
+	NNP_SW_COUNTER_PCPU_INC(context->sw_counters, CTX_SPHCS_SW_COUNTERS_INFERENCE_COMPLETED_INF_REQ);
 
-	if (last_completed &&
-	    NNP_SW_GROUP_IS_ENABLE(context->sw_counters, CTX_SPHCS_SW_COUNTERS_GROUP_INFERENCE) &&
-	    context->runtime_busy_starttime) {
-		NNP_SW_COUNTER_ADD(context->sw_counters,
-				   CTX_SPHCS_SW_COUNTERS_INFERENCE_RUNTIME_BUSY_TIME,
-				   nnp_time_us() - context->runtime_busy_starttime);
+	if (atomic_dec_and_test(&context->infreq_counter)) {
+		NNP_SPIN_LOCK_IRQSAVE(&context->sw_counters_lock_irq, flags);
+		if (atomic_read(&context->infreq_counter) == 0 &&
+		    NNP_SW_GROUP_IS_ENABLE(context->sw_counters, CTX_SPHCS_SW_COUNTERS_GROUP_INFERENCE) &&
+		    context->runtime_busy_starttime) {
+			NNP_SW_COUNTER_ADD(context->sw_counters,
+					   CTX_SPHCS_SW_COUNTERS_INFERENCE_RUNTIME_BUSY_TIME,
+					   nnp_time_us() - context->runtime_busy_starttime);
 
-		context->runtime_busy_starttime = 0;
+			context->runtime_busy_starttime = 0;
+		}
+		NNP_SPIN_UNLOCK_IRQRESTORE(&context->sw_counters_lock_irq, flags);
 	}
-	NNP_SPIN_UNLOCK_IRQRESTORE(&context->sw_counters_lock_irq, flags);
-	SPH_SW_COUNTER_ATOMIC_INC(g_nnp_sw_counters, SPHCS_SW_COUNTERS_INFERENCE_COMPLETED_INF_REQ);
+	NNP_SW_COUNTER_PCPU_INC(g_nnp_sw_counters, SPHCS_SW_COUNTERS_INFERENCE_COMPLETED_INF_REQ);
 
 	 DO_TRACE(trace_infreq(SPH_TRACE_OP_STATUS_COMPLETE,
 				  infreq->devnet->context->protocol_id,
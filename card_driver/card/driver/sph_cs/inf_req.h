@@ -37,6 +37,7 @@ struct inf_req {
 	void              *config_data;
 
 	struct inf_exec_infreq exec_cmd;
+	uint32_t           n_slotted_inputs; /* p2p dst inputs with depth > 1 */
 	struct inf_exec_req *active_req;
 
 	dma_addr_t         exec_config_data_dma_addr;
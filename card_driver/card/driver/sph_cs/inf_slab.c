@@ -0,0 +1,165 @@
+/********************************************
+ * Copyright (C) 2019-2021 Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ ********************************************/
+
+#include "inf_slab.h"
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/atomic.h>
+#include <linux/seq_file.h>
+#include "sph_log.h"
+#include "nnp_debug.h"
+#include "inf_devres.h"
+#include "inf_copy.h"
+#include "inf_cpylst.h"
+#include "inf_req.h"
+#include "inf_cmd_list.h"
+
+struct inf_slab {
+	const char        *name;
+	size_t             size;
+	struct kmem_cache *cache;
+	atomic_t           live;
+	atomic_t           peak;
+	atomic64_t         allocs;
+	atomic64_t         failed;
+};
+
+static struct inf_slab s_slabs[INF_NUM_SLABS] = {
+	[INF_SLAB_DEVRES]           = { "sph_devres",     sizeof(struct inf_devres) },
+	[INF_SLAB_COPY]             = { "sph_copy",       sizeof(struct inf_copy) },
+	[INF_SLAB_CPYLST]           = { "sph_cpylst",     sizeof(struct inf_cpylst) },
+	[INF_SLAB_INFREQ]           = { "sph_infreq",     sizeof(struct inf_req) },
+	[INF_SLAB_EXEC_QUEUE_ENTRY] = { "sph_exec_qent",  sizeof(struct exec_queue_entry) },
+	[INF_SLAB_ID_SET]           = { "sph_id_set",     sizeof(struct id_set) },
+	[INF_SLAB_ID_RANGE]         = { "sph_id_range",   sizeof(struct id_range) },
+	[INF_SLAB_REQ_ENTRY]        = { "sph_req_entry",  sizeof(struct req_entry) },
+};
+
+int inf_slab_init(void)
+{
+	int i;
+
+	for (i = 0; i < INF_NUM_SLABS; i++) {
+		s_slabs[i].cache = kmem_cache_create(s_slabs[i].name,
+						     s_slabs[i].size,
+						     0, SLAB_HWCACHE_ALIGN, NULL);
+		if (unlikely(s_slabs[i].cache == NULL)) {
+			sph_log_err(START_UP_LOG, "failed to create %s slab cache\n", s_slabs[i].name);
+			goto fail;
+		}
+		atomic_set(&s_slabs[i].live, 0);
+		atomic_set(&s_slabs[i].peak, 0);
+		atomic64_set(&s_slabs[i].allocs, 0);
+		atomic64_set(&s_slabs[i].failed, 0);
+	}
+
+	return 0;
+
+fail:
+	while (--i >= 0) {
+		kmem_cache_destroy(s_slabs[i].cache);
+		s_slabs[i].cache = NULL;
+	}
+
+	return -ENOMEM;
+}
+
+void inf_slab_fini(void)
+{
+	int i;
+
+	for (i = 0; i < INF_NUM_SLABS; i++) {
+		/* a cache with live objects is leaked rather than destroyed */
+		if (unlikely(atomic_read(&s_slabs[i].live) != 0)) {
+			sph_log_err(GENERAL_LOG, "%d %s objects still allocated\n",
+				    atomic_read(&s_slabs[i].live), s_slabs[i].name);
+			continue;
+		}
+		kmem_cache_destroy(s_slabs[i].cache);
+		s_slabs[i].cache = NULL;
+	}
+}
+
+void *inf_slab_alloc(enum inf_slab_type type, gfp_t gfp)
+{
+	struct inf_slab *slab = &s_slabs[type];
+	void *obj;
+	int live, peak;
+
+	NNP_ASSERT(type < INF_NUM_SLABS);
+
+	obj = kmem_cache_alloc(slab->cache, gfp);
+	if (unlikely(obj == NULL)) {
+		atomic64_inc(&slab->failed);
+		return NULL;
+	}
+
+	atomic64_inc(&slab->allocs);
+	live = atomic_inc_return(&slab->live);
+	peak = atomic_read(&slab->peak);
+	while (live > peak) {
+		int old = atomic_cmpxchg(&slab->peak, peak, live);
+
+		if (old == peak)
+			break;
+		peak = old;
+	}
+
+	return obj;
+}
+
+void inf_slab_free(enum inf_slab_type type, void *obj)
+{
+	NNP_ASSERT(type < INF_NUM_SLABS);
+
+	if (unlikely(obj == NULL))
+		return;
+
+	atomic_dec(&s_slabs[type].live);
+	kmem_cache_free(s_slabs[type].cache, obj);
+}
+
+static int debug_inf_slab_show(struct seq_file *m, void *v)
+{
+	int i;
+
+	seq_printf(m, "%-16s %8s %8s %8s %12s %8s\n",
+		   "cache", "objsize", "live", "peak", "allocs", "failed");
+	for (i = 0; i < INF_NUM_SLABS; i++)
+		seq_printf(m, "%-16s %8zu %8d %8d %12lld %8lld\n",
+			   s_slabs[i].name,
+			   s_slabs[i].size,
+			   atomic_read(&s_slabs[i].live),
+			   atomic_read(&s_slabs[i].peak),
+			   (long long)atomic64_read(&s_slabs[i].allocs),
+			   (long long)atomic64_read(&s_slabs[i].failed));
+
+	return 0;
+}
+
+static int debug_inf_slab_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, debug_inf_slab_show, inode->i_private);
+}
+
+static const struct file_operations debug_inf_slab_fops = {
+	.open		= debug_inf_slab_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void inf_slab_init_debugfs(struct dentry *parent)
+{
+	if (!parent)
+		return;
+
+	debugfs_create_file("inf_slabs",
+			    0444,
+			    parent,
+			    NULL,
+			    &debug_inf_slab_fops);
+}
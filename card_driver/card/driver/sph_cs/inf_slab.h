@@ -0,0 +1,43 @@
+/********************************************
+ * Copyright (C) 2019-2021 Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ ********************************************/
+
+#ifndef SPHCS_INF_SLAB_H
+#define SPHCS_INF_SLAB_H
+
+#include <linux/types.h>
+#include <linux/gfp.h>
+#include <linux/debugfs.h>
+
+/*
+ * Dedicated kmem caches for inference objects which are created and
+ * destroyed at high rate. Requests for the exec queues keep using the
+ * per context exec_req_slab_cache.
+ */
+enum inf_slab_type {
+	INF_SLAB_DEVRES = 0,
+	INF_SLAB_COPY,
+	INF_SLAB_CPYLST,
+	INF_SLAB_INFREQ,
+	INF_SLAB_EXEC_QUEUE_ENTRY,
+	INF_SLAB_ID_SET,
+	INF_SLAB_ID_RANGE,
+	INF_SLAB_REQ_ENTRY,
+	INF_NUM_SLABS
+};
+
+int inf_slab_init(void);
+void inf_slab_fini(void);
+void inf_slab_init_debugfs(struct dentry *parent);
+
+void *inf_slab_alloc(enum inf_slab_type type, gfp_t gfp);
+void inf_slab_free(enum inf_slab_type type, void *obj);
+
+static inline void *inf_slab_zalloc(enum inf_slab_type type, gfp_t gfp)
+{
+	return inf_slab_alloc(type, gfp | __GFP_ZERO);
+}
+
+#endif
@@ -12,7 +12,7 @@
 #include "ipc_chan_protocol.h"
 
 struct inf_req_sequence {
-	u32              seq_id;
+	u64              seq_id;
 	struct list_head node;
 };
 
@@ -65,7 +65,10 @@ static int s_dev_id = -1;
 static unsigned char s_mac_addr[ETH_ALEN];
 static pool_handle   s_net_dma_page_pool;
 static int           s_c2h_handles;
-static uint8_t      *s_c2h_busy_handles;
+static unsigned long *s_c2h_busy_map;
+static int           s_c2h_next_handle;
+static struct napi_struct s_net_napi;
+static struct sk_buff_head s_net_rx_q;
 
 static struct net_device_stats *sphcs_net_dev_get_stats(struct net_device *dev)
 {
@@ -95,6 +98,7 @@ static int sphcs_net_dev_open(struct net_device *dev)
 {
 	sph_log_debug(ETH_LOG, "SPH_NET - sphcs_net_dev_open(%s)\n", dev->name);
 
+	napi_enable(&s_net_napi);
 	netif_start_queue(dev); //start up the transmission queue
 	return 0;
 }
@@ -103,6 +107,8 @@ static int sphcs_net_dev_close(struct net_device *dev)
 {
 	sph_log_debug(ETH_LOG, "SPH_NET - sphcs_net_dev_close(%s)\n", dev->name);
 	netif_stop_queue(dev); //shutdown the transmission queue
+	napi_disable(&s_net_napi);
+	skb_queue_purge(&s_net_rx_q);
 	return 0;
 }
 
@@ -113,6 +119,36 @@ static int sphcs_net_dev_do_ioctl(struct net_device *dev, struct ifreq *ifr,
 	return -1;
 }
 
+/* returns free c2h ring buffer page handle, or -1 if all are busy */
+static int sphcs_net_get_c2h_handle(void)
+{
+	int h;
+
+	NNP_SPIN_LOCK_BH(&s_net_cmd_chan->c2h_rb[0].lock_bh);
+	h = find_next_zero_bit(s_c2h_busy_map, s_c2h_handles, s_c2h_next_handle);
+	if (h >= s_c2h_handles)
+		h = find_first_zero_bit(s_c2h_busy_map, s_c2h_handles);
+	if (h < s_c2h_handles) {
+		set_bit(h, s_c2h_busy_map);
+		s_c2h_next_handle = h + 1;
+	} else {
+		h = -1;
+	}
+	NNP_SPIN_UNLOCK_BH(&s_net_cmd_chan->c2h_rb[0].lock_bh);
+
+	return h;
+}
+
+static void sphcs_net_put_c2h_handle(int h)
+{
+	clear_bit(h, s_c2h_busy_map);
+
+	/* pairs with the re-check after netif_stop_queue in xmit */
+	smp_mb__after_atomic();
+	if (netif_queue_stopped(s_net_dev))
+		netif_wake_queue(s_net_dev);
+}
+
 static int sphcs_net_out_msg_dma_complete_callback(struct sphcs *sphcs,
 						   void *ctx,
 						   const void *user_data,
@@ -183,19 +219,17 @@ static int sphcs_net_dev_start_xmit(struct sk_buff *skb, struct net_device *netd
 	}
 
 	/* allocate page in the c2h ring buffer */
-	NNP_SPIN_LOCK_BH(&s_net_cmd_chan->c2h_rb[0].lock_bh);
-	for (c2h_skb_handle = 0; c2h_skb_handle < s_c2h_handles; c2h_skb_handle++)
-		if (!s_c2h_busy_handles[c2h_skb_handle]) {
-			s_c2h_busy_handles[c2h_skb_handle] = 1;
-			break;
-		}
-	NNP_SPIN_UNLOCK_BH(&s_net_cmd_chan->c2h_rb[0].lock_bh);
-
-	if (c2h_skb_handle >= s_c2h_handles) {
-		sph_log_err(ETH_LOG, "SPH_NET - c2h ringbuffer full\n");
-		s_net_dev->stats.tx_dropped++;
-		kfree_skb(skb);
-		return 0;
+	c2h_skb_handle = sphcs_net_get_c2h_handle();
+	if (c2h_skb_handle < 0) {
+		/*
+		 * c2h ring buffer full, stop the queue until host acks
+		 * a page. Re-check in case ack arrived before the stop.
+		 */
+		netif_stop_queue(netdev);
+		smp_mb__after_atomic();
+		if (find_first_zero_bit(s_c2h_busy_map, s_c2h_handles) < s_c2h_handles)
+			netif_start_queue(netdev);
+		return NETDEV_TX_BUSY;
 	}
 
 	write_host_dma_addr = host_rb_get_addr(&s_net_cmd_chan->c2h_rb[0],
@@ -204,7 +238,7 @@ static int sphcs_net_dev_start_xmit(struct sk_buff *skb, struct net_device *netd
 	if (!write_host_dma_addr || cont < skb_size) {
 		s_net_dev->stats.tx_dropped++;
 		kfree_skb(skb);
-		s_c2h_busy_handles[c2h_skb_handle] = 0;
+		sphcs_net_put_c2h_handle(c2h_skb_handle);
 		return 0;
 	}
 
@@ -217,7 +251,7 @@ static int sphcs_net_dev_start_xmit(struct sk_buff *skb, struct net_device *netd
 		sph_log_debug(ETH_LOG, "SPH_NET - Failed to map skb for dma xfer\n");
 		s_net_dev->stats.tx_dropped++;
 		kfree_skb(skb);
-		s_c2h_busy_handles[c2h_skb_handle] = 0;
+		sphcs_net_put_c2h_handle(c2h_skb_handle);
 		return 0;
 	}
 
@@ -263,6 +297,29 @@ static void sphcs_net_dev_setup(struct net_device *netdev)
 	netdev->netdev_ops = &ndo;
 }
 
+static int sphcs_net_dev_poll(struct napi_struct *napi, int budget)
+{
+	struct sk_buff *skb;
+	int work_done = 0;
+
+	while (work_done < budget) {
+		skb = skb_dequeue(&s_net_rx_q);
+		if (!skb)
+			break;
+		napi_gro_receive(napi, skb);
+		work_done++;
+	}
+
+	if (work_done < budget) {
+		napi_complete_done(napi, work_done);
+		/* packet may have been queued after last dequeue */
+		if (!skb_queue_empty(&s_net_rx_q))
+			napi_schedule(napi);
+	}
+
+	return work_done;
+}
+
 static int sphcs_net_dev_init(uint32_t h2c_pages, uint32_t c2h_pages)
 {
 	int ret;
@@ -297,8 +354,9 @@ static int sphcs_net_dev_init(uint32_t h2c_pages, uint32_t c2h_pages)
 	}
 
 	s_c2h_handles = c2h_pages;
-	s_c2h_busy_handles = kcalloc(c2h_pages, sizeof(uint8_t), GFP_KERNEL);
-	if (!s_c2h_busy_handles) {
+	s_c2h_next_handle = 0;
+	s_c2h_busy_map = kcalloc(BITS_TO_LONGS(c2h_pages), sizeof(unsigned long), GFP_KERNEL);
+	if (!s_c2h_busy_map) {
 		sph_log_err(START_UP_LOG, "Failed to create net dma page pool\n");
 		free_netdev(s_net_dev);
 		dma_page_pool_destroy(s_net_dma_page_pool);
@@ -309,6 +367,13 @@ static int sphcs_net_dev_init(uint32_t h2c_pages, uint32_t c2h_pages)
 				   g_the_sphcs->debugfs_dir,
 				   "chan_net_dma_page_pool");
 
+	skb_queue_head_init(&s_net_rx_q);
+#if KERNEL_VERSION(6, 1, 0) > LINUX_VERSION_CODE  /* SPH_IGNORE_STYLE_CHECK */
+	netif_napi_add(s_net_dev, &s_net_napi, sphcs_net_dev_poll, NAPI_POLL_WEIGHT);
+#else
+	netif_napi_add(s_net_dev, &s_net_napi, sphcs_net_dev_poll);
+#endif
+
 	if (register_netdev(s_net_dev)) {
 		sph_log_err(ETH_LOG, "SPH_NET - Failed to register sph net device\n");
 		free_netdev(s_net_dev);
@@ -324,9 +389,11 @@ static void sphcs_net_dev_exit(void)
 	sph_log_info(ETH_LOG, "SPH_NET - Unloading sph network module\n\n");
 	if (s_net_dev != NULL) {
 		unregister_netdev(s_net_dev);
+		netif_napi_del(&s_net_napi);
+		skb_queue_purge(&s_net_rx_q);
 		free_netdev(s_net_dev);
 		dma_page_pool_destroy(s_net_dma_page_pool);
-		kfree(s_c2h_busy_handles);
+		kfree(s_c2h_busy_map);
 		s_net_dev = NULL;
 		s_net_cmd_chan = NULL;
 		memset(s_mac_addr, 0, ETH_ALEN);
@@ -336,14 +403,15 @@ static void sphcs_net_dev_exit(void)
 
 /*
  * The packet has been retrieved from the transmission
- * medium. build an skb around it, so upper layers can handle it
+ * medium. build an skb around it and queue it, NAPI poll
+ * hands the queued packets to upper layers in batches
  */
 static void sphcs_net_dev_rx(struct net_device *netdev, int data_size,
 		unsigned char *buf)
 {
 	struct sk_buff *skb;
 
-	if (netdev == NULL)
+	if (netdev == NULL || !netif_running(netdev))
 		return;
 
 	skb = dev_alloc_skb(data_size + 2);
@@ -360,7 +428,12 @@ static void sphcs_net_dev_rx(struct net_device *netdev, int data_size,
 	netdev->stats.rx_packets++;
 	netdev->stats.rx_bytes += data_size;
 
-	netif_rx(skb); //pass to the receive level
+	skb_queue_tail(&s_net_rx_q, skb);
+
+	/* called from DMA completion work, poll runs on bh enable */
+	local_bh_disable();
+	napi_schedule(&s_net_napi);
+	local_bh_enable();
 }
 
 static void sphcs_net_send_ack(struct sphcs_cmd_chan *cmd_chan, int skb_handle)
@@ -468,7 +541,7 @@ static void netmsg_op_work_handler(struct work_struct *work)
 						 work);
 
 	if (op->cmd.is_ack) {
-		s_c2h_busy_handles[op->cmd.skb_handle] = 0;
+		sphcs_net_put_c2h_handle(op->cmd.skb_handle);
 		sphcs_cmd_chan_put(op->chan);
 		goto free_op;
 	}
@@ -515,7 +588,6 @@ fail:
 }
 
 struct eth_set_ip_op_work {
-	struct work_struct work;
 	struct sphcs *sphcs;
 	struct sphcs_cmd_chan *chan;
 	union h2c_ChanEthernetConfig cmd;
@@ -540,14 +612,12 @@ static void sphcs_net_chan_destroyed(struct sphcs_cmd_chan *cmd_chan, void *cb_c
 		sphcs_net_dev_exit();
 }
 
-static void config_card_eth(struct work_struct *work)
+static void config_card_eth(void *payload)
 {
 	int ret = 0;
 	char ip_str[16];
 	union c2h_ChanEthernetConfig msg;
-	struct eth_set_ip_op_work *op = container_of(work,
-						     struct eth_set_ip_op_work,
-						     work);
+	struct eth_set_ip_op_work *op = payload;
 
 	char *argv[] = {           /* SPH_IGNORE_STYLE_CHECK */
 		"/sbin/ifconfig",
@@ -592,8 +662,6 @@ static void config_card_eth(struct work_struct *work)
 					  sizeof(msg) / sizeof(u64));
 
 	sphcs_cmd_chan_put(op->chan);
-
-	kfree(op);
 }
 
 /*
@@ -603,7 +671,7 @@ static void config_card_eth(struct work_struct *work)
 void IPC_OPCODE_HANDLER(CHAN_ETH_CONFIG)(struct sphcs                 *sphcs,
 					 union h2c_ChanEthernetConfig *cmd)
 {
-	struct eth_set_ip_op_work *work;
+	struct eth_set_ip_op_work work;
 	struct sphcs_cmd_chan *chan;
 	union c2h_ChanEthernetConfig msg;
 
@@ -611,16 +679,12 @@ void IPC_OPCODE_HANDLER(CHAN_ETH_CONFIG)(struct sphcs                 *sphcs,
 	if (!chan)
 		return;
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (!work)
+	safe_c_memcpy(work.cmd.value, 16, cmd->value, sizeof(cmd->value));
+	work.sphcs = sphcs;
+	work.chan = chan;
+	if (SPHCS_CHAN_DISPATCH(&chan->msgq, config_card_eth, &work) != 0)
 		goto fail;
 
-	safe_c_memcpy(work->cmd.value, 16, cmd->value, sizeof(cmd->value));
-	work->sphcs = sphcs;
-	work->chan = chan;
-	INIT_WORK(&work->work, config_card_eth);
-	queue_work(chan->wq, &work->work);
-
 	return;
 
 fail:
@@ -7,14 +7,249 @@
 #include "sphcs_cmd_chan.h"
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/dma-mapping.h>
+#include <linux/ion_exp.h>
 #include "ipc_protocol.h"
 #include "sph_log.h"
 #include "sphcs_cs.h"
+#include "sph_mem_alloc_defs.h"
+
+/*
+ * Largest error list sent to host through the channel mailbox, larger
+ * ones are sent by DMA through the channel ring buffer. 0 disables the
+ * c2h mailbox path. Off by default, a host driver which does not know
+ * CHAN_EXEC_ERROR_LIST_MBOX would drop those error lists.
+ */
+static unsigned int chan_mbox_c2h_max;
+module_param(chan_mbox_c2h_max, uint, 0644);
 
 static void sphcs_host_rb_init(struct sphcs_host_rb *rb,
 			       struct sg_table      *host_sgt,
 			       uint64_t              size);
 
+static void chan_msgq_work_handler(struct work_struct *work)
+{
+	struct sphcs_chan_msgq *q = container_of(work, struct sphcs_chan_msgq, work);
+	struct sphcs_chan_msg *msg;
+	bool in_slot;
+	u64 latency;
+
+	while (true) {
+		NNP_SPIN_LOCK_BH(&q->lock_bh);
+		if (q->head != q->tail) {
+			msg = &q->slots[q->head % SPHCS_CHAN_MSGQ_SLOTS];
+			in_slot = true;
+		} else if (!list_empty(&q->overflow)) {
+			msg = list_first_entry(&q->overflow, struct sphcs_chan_msg, overflow_node);
+			list_del(&msg->overflow_node);
+			in_slot = false;
+		} else {
+			NNP_SPIN_UNLOCK_BH(&q->lock_bh);
+			break;
+		}
+		NNP_SPIN_UNLOCK_BH(&q->lock_bh);
+
+		latency = ktime_get_ns() - msg->queued_ns;
+		q->latency_ns += latency;
+		if (latency > q->max_latency_ns)
+			q->max_latency_ns = latency;
+
+		msg->handler(msg->payload);
+
+		/* the slot is released only after the handler is done with the payload */
+		NNP_SPIN_LOCK_BH(&q->lock_bh);
+		if (in_slot)
+			q->head++;
+		q->depth--;
+		NNP_SPIN_UNLOCK_BH(&q->lock_bh);
+
+		if (!in_slot)
+			kfree(msg);
+	}
+}
+
+static void cmd_chan_mbox_destroy(struct sphcs_cmd_chan *chan)
+{
+	if (!chan->mbox)
+		return;
+
+	dma_unmap_sg(g_the_sphcs->hw_device,
+		     chan->mbox_sgt->sgl,
+		     chan->mbox_sgt->orig_nents,
+		     DMA_BIDIRECTIONAL);
+	ion_kbuf_free(chan->mbox_handle);
+	chan->mbox = NULL;
+}
+
+/* Returns the page offset of the mailbox in the inbound window or -1 */
+int sphcs_cmd_chan_mbox_offset(struct sphcs_cmd_chan *chan)
+{
+	if (!chan->mbox)
+		return -1;
+
+	return (sg_dma_address(chan->mbox_sgt->sgl) - g_the_sphcs->inbound_mem_dma_addr) >> NNP_PAGE_SHIFT;
+}
+
+static void cmd_chan_mbox_create(struct sphcs_cmd_chan *chan)
+{
+	struct device *dev = g_the_sphcs->hw_device;
+
+	if (!g_the_sphcs->inbound_mem_dma_addr)
+		return;
+
+	chan->mbox_handle = ion_kbuf_alloc(NNP_PAGE_SIZE,
+					   PAGE_SIZE,
+					   P2P_HEAP_NAME,
+					   2, /*ION_FLAG_CONTIG*/
+					   &chan->mbox_sgt,
+					   (void **)&chan->mbox);
+	if (IS_ERR_OR_NULL(chan->mbox_handle)) {
+		sph_log_info(CREATE_COMMAND_LOG, "No mailbox for chan %u, using ring buffers only\n", chan->protocol_id);
+		goto fail;
+	}
+
+	memset(chan->mbox, 0, NNP_PAGE_SIZE);
+
+	chan->mbox_sgt->nents = dma_map_sg(dev,
+					   chan->mbox_sgt->sgl,
+					   chan->mbox_sgt->orig_nents,
+					   DMA_BIDIRECTIONAL);
+	if (unlikely(!chan->mbox_sgt->nents)) {
+		sph_log_err(CREATE_COMMAND_LOG, "Failed to map mailbox of chan %u\n", chan->protocol_id);
+		ion_kbuf_free(chan->mbox_handle);
+		goto fail;
+	}
+
+	/* host gets the page offset in a 16 bits event field */
+	if (unlikely(sphcs_cmd_chan_mbox_offset(chan) > U16_MAX)) {
+		cmd_chan_mbox_destroy(chan);
+		goto fail;
+	}
+
+	return;
+
+fail:
+	chan->mbox_handle = NULL;
+	chan->mbox_sgt = NULL;
+	chan->mbox = NULL;
+}
+
+/*
+ * Copies size bytes of an h2c mailbox slot written by host and releases
+ * the slot. A size of 0 only releases it.
+ */
+int sphcs_cmd_chan_mbox_read(struct sphcs_cmd_chan *chan,
+			     u8                     slot,
+			     void                  *buf,
+			     u32                    size)
+{
+	if (unlikely(!chan->mbox ||
+		     slot >= NNP_CHAN_MBOX_H2C_SLOTS ||
+		     size > NNP_CHAN_MBOX_SLOT_SIZE))
+		return -EINVAL;
+
+	if (size > 0)
+		memcpy(buf, chan->mbox->h2c[slot], size);
+
+	/* data must be read before host may reuse the slot */
+	smp_mb();
+	WRITE_ONCE(chan->mbox->h2c_done[slot], chan->mbox->h2c_done[slot] + 1);
+	chan->mbox_h2c_reads++;
+
+	return 0;
+}
+
+/*
+ * Copies buf to the next c2h mailbox slot. Fails with -ENOSPC when buf
+ * should be sent through the ring buffer instead: it is too large, or
+ * host did not consume the slots yet.
+ */
+int sphcs_cmd_chan_mbox_write(struct sphcs_cmd_chan *chan,
+			      const void            *buf,
+			      u32                    size)
+{
+	u32 max_size = min_t(u32, READ_ONCE(chan_mbox_c2h_max), NNP_CHAN_MBOX_SLOT_SIZE);
+	u32 slot;
+
+	if (!chan->mbox || size > max_size)
+		return -ENOSPC;
+
+	if (chan->mbox_c2h_produced - READ_ONCE(chan->mbox->c2h_consumed) >= NNP_CHAN_MBOX_C2H_SLOTS) {
+		chan->mbox_c2h_fallbacks++;
+		return -ENOSPC;
+	}
+
+	slot = chan->mbox_c2h_produced % NNP_CHAN_MBOX_C2H_SLOTS;
+	memcpy(chan->mbox->c2h[slot], buf, size);
+
+	/* data must be visible before the message which announces it */
+	wmb();
+	chan->mbox_c2h_produced++;
+
+	return 0;
+}
+
+static void chan_msgq_init(struct sphcs_chan_msgq *q)
+{
+	spin_lock_init(&q->lock_bh);
+	INIT_WORK(&q->work, chan_msgq_work_handler);
+	INIT_LIST_HEAD(&q->overflow);
+}
+
+int sphcs_chan_msgq_dispatch(struct sphcs_chan_msgq *q,
+			     sphcs_chan_msg_handler  handler,
+			     const void             *payload,
+			     u32                     size)
+{
+	struct sphcs_chan_msg *msg;
+
+	NNP_ASSERT(size <= SPHCS_CHAN_MSG_PAYLOAD_SIZE);
+
+	NNP_SPIN_LOCK_BH(&q->lock_bh);
+	if (likely(list_empty(&q->overflow) &&
+		   q->tail - q->head < SPHCS_CHAN_MSGQ_SLOTS)) {
+		msg = &q->slots[q->tail % SPHCS_CHAN_MSGQ_SLOTS];
+		q->tail++;
+	} else {
+		msg = kmalloc(sizeof(*msg), GFP_NOWAIT);
+		if (unlikely(msg == NULL)) {
+			NNP_SPIN_UNLOCK_BH(&q->lock_bh);
+			return -ENOMEM;
+		}
+		list_add_tail(&msg->overflow_node, &q->overflow);
+		q->overflowed++;
+	}
+
+	msg->handler = handler;
+	msg->queued_ns = ktime_get_ns();
+	memcpy(msg->payload, payload, size);
+
+	q->dispatched++;
+	q->depth++;
+	if (q->depth > q->max_depth)
+		q->max_depth = q->depth;
+	NNP_SPIN_UNLOCK_BH(&q->lock_bh);
+
+	queue_work(g_the_sphcs->chan_wq, &q->work);
+
+	return 0;
+}
+
+void sphcs_chan_msgq_drain(struct sphcs_chan_msgq *q)
+{
+	bool empty;
+
+	do {
+		flush_work(&q->work);
+		NNP_SPIN_LOCK_BH(&q->lock_bh);
+		empty = (q->depth == 0);
+		NNP_SPIN_UNLOCK_BH(&q->lock_bh);
+	} while (!empty);
+}
+
 int sphcs_cmd_chan_create(uint16_t                protocol_id,
 			  uint32_t                uid,
 			  bool                    privileged,
@@ -52,17 +287,12 @@ int sphcs_cmd_chan_create(uint16_t                protocol_id,
 	cmd_chan->h2c_dma_desc.serial_channel =
 		sphcs_dma_sched_create_serial_channel(g_the_sphcs->dmaSched);
 
-	cmd_chan->wq = create_singlethread_workqueue("chan_wq");
-	if (!cmd_chan->wq) {
-		sph_log_err(CREATE_COMMAND_LOG, "Failed to initialize channel workqueue\n");
-		kfree(cmd_chan);
-		return NNP_IPC_NO_MEMORY;
-	}
+	chan_msgq_init(&cmd_chan->msgq);
+	chan_msgq_init(&cmd_chan->exec_msgq);
 
 	cmd_chan->respq = sphcs_create_response_queue(g_the_sphcs, 1);
 	if (!cmd_chan->respq) {
 		sph_log_err(START_UP_LOG, "Failed to create channel response q\n");
-		destroy_workqueue(cmd_chan->wq);
 		kfree(cmd_chan);
 		return NNP_IPC_NO_MEMORY;
 	}
@@ -75,14 +305,8 @@ int sphcs_cmd_chan_create(uint16_t                protocol_id,
 			sphcs_dma_sched_create_serial_channel(g_the_sphcs->dmaSched);
 
 		atomic_set(&cmd_chan->sched_queued, 0);
-		cmd_chan->wq_exec = create_singlethread_workqueue("chan_wq_exec");
-		if (!cmd_chan->wq_exec) {
-			sph_log_err(CREATE_COMMAND_LOG, "Failed to initialize channel execution workqueue\n");
-			sphcs_destroy_response_queue(g_the_sphcs, cmd_chan->respq);
-			destroy_workqueue(cmd_chan->wq);
-			kfree(cmd_chan);
-			return NNP_IPC_NO_MEMORY;
-		}
+
+		cmd_chan_mbox_create(cmd_chan);
 	}
 
 	//
@@ -112,9 +336,7 @@ int sphcs_cmd_chan_create(uint16_t                protocol_id,
 	NNP_SPIN_UNLOCK_BH(&g_the_sphcs->lock_bh);
 
 	if (found) {
-		if (protocol_id < 256)
-			destroy_workqueue(cmd_chan->wq_exec);
-		destroy_workqueue(cmd_chan->wq);
+		cmd_chan_mbox_destroy(cmd_chan);
 		sphcs_destroy_response_queue(g_the_sphcs, cmd_chan->respq);
 		kfree(cmd_chan);
 		return ret;
@@ -132,12 +354,8 @@ static void cmd_chan_release(struct work_struct *work)
 
 	cmd_chan = container_of(work, struct sphcs_cmd_chan, work);
 
-	if (cmd_chan->protocol_id < 256) { //for context
-		drain_workqueue(cmd_chan->wq_exec);
-		destroy_workqueue(cmd_chan->wq_exec);
-	}
-	drain_workqueue(cmd_chan->wq);
-	destroy_workqueue(cmd_chan->wq);
+	sphcs_chan_msgq_drain(&cmd_chan->exec_msgq);
+	sphcs_chan_msgq_drain(&cmd_chan->msgq);
 	sphcs_destroy_response_queue(g_the_sphcs, cmd_chan->respq);
 
 	for (i = 0; i < NNP_IPC_MAX_CHANNEL_RINGBUFS; i++) {
@@ -145,6 +363,8 @@ static void cmd_chan_release(struct work_struct *work)
 		sphcs_host_rb_init(&cmd_chan->c2h_rb[i], NULL, 0);
 	}
 
+	cmd_chan_mbox_destroy(cmd_chan);
+
 	sphcs_send_event_report(g_the_sphcs,
 				NNP_IPC_CHANNEL_DESTROYED,
 				0,
@@ -367,7 +587,6 @@ void host_rb_update_avail_space(struct sphcs_host_rb *rb,
 }
 
 struct channel_rb_op_work {
-	struct work_struct  work;
 	struct sphcs_cmd_chan *chan;
 	union h2c_channel_data_ringbuf_op cmd;
 };
@@ -410,11 +629,10 @@ static void rb_hostres_pagetable_complete_cb(void                  *cb_ctx,
 	kfree(op);
 }
 
-static void channel_rb_op_work_handler(struct work_struct *work)
+static void channel_rb_op_work_handler(void *payload)
 {
-	struct channel_rb_op_work *op = container_of(work,
-						     struct channel_rb_op_work,
-						     work);
+	/* op lives until the host pagetable is retrieved */
+	struct channel_rb_op_work *op = *(struct channel_rb_op_work **)payload;
 	struct sphcs *sphcs = g_the_sphcs;
 	struct sphcs_cmd_chan *chan = op->chan;
 	int ret;
@@ -500,8 +718,17 @@ void IPC_OPCODE_HANDLER(CHANNEL_RB_OP)(
 
 
 	work->cmd.value = cmd->value;
-	INIT_WORK(&work->work, channel_rb_op_work_handler);
-	queue_work(work->chan->wq, &work->work);
+	if (unlikely(SPHCS_CHAN_DISPATCH(&work->chan->msgq, channel_rb_op_work_handler, &work) != 0)) {
+		sphcs_send_event_report_ext(sphcs,
+					    NNP_IPC_CHANNEL_SET_RB_FAILED,
+					    NNP_IPC_NO_MEMORY,
+					    NULL,
+					    -1,
+					    cmd->chan_id,
+					    cmd->rb_id);
+		sphcs_cmd_chan_put(work->chan);
+		kfree(work);
+	}
 }
 
 void IPC_OPCODE_HANDLER(CHANNEL_RB_UPDATE)(
@@ -566,7 +793,6 @@ static int remove_hostres(struct sphcs_cmd_chan *chan, uint16_t protocol_id)
 }
 
 struct channel_hostres_op_work {
-	struct work_struct  work;
 	struct sphcs_cmd_chan *chan;
 	union h2c_channel_hostres_op cmd;
 };
@@ -625,11 +851,10 @@ done:
 	kfree(op);
 }
 
-static void channel_hostres_op_work_handler(struct work_struct *work)
+static void channel_hostres_op_work_handler(void *payload)
 {
-	struct channel_hostres_op_work *op = container_of(work,
-							  struct channel_hostres_op_work,
-							  work);
+	/* op lives until the host pagetable is retrieved */
+	struct channel_hostres_op_work *op = *(struct channel_hostres_op_work **)payload;
 	struct sphcs *sphcs = g_the_sphcs;
 	struct sphcs_cmd_chan *chan = op->chan;
 	int ret;
@@ -710,6 +935,82 @@ void IPC_OPCODE_HANDLER(CHANNEL_HOSTRES_OP)(
 
 
 	memcpy(work->cmd.value, cmd->value, sizeof(cmd->value));
-	INIT_WORK(&work->work, channel_hostres_op_work_handler);
-	queue_work(work->chan->wq, &work->work);
+	if (unlikely(SPHCS_CHAN_DISPATCH(&work->chan->msgq, channel_hostres_op_work_handler, &work) != 0)) {
+		sphcs_send_event_report_ext(sphcs,
+					    cmd->unmap ? NNP_IPC_CHANNEL_UNMAP_HOSTRES_FAILED :
+							 NNP_IPC_CHANNEL_MAP_HOSTRES_FAILED,
+					    NNP_IPC_NO_MEMORY,
+					    NULL,
+					    -1,
+					    cmd->chan_id,
+					    cmd->hostres_id);
+		sphcs_cmd_chan_put(work->chan);
+		kfree(work);
+	}
+}
+
+static void chan_msgq_show(struct seq_file *m, const char *name, struct sphcs_chan_msgq *q)
+{
+	u64 handled;
+
+	NNP_SPIN_LOCK_BH(&q->lock_bh);
+	handled = q->dispatched - q->depth;
+	seq_printf(m, "\t%s: depth=%u max_depth=%u dispatched=%llu overflowed=%llu avg_latency_ns=%llu max_latency_ns=%llu\n",
+		   name,
+		   q->depth,
+		   q->max_depth,
+		   q->dispatched,
+		   q->overflowed,
+		   handled ? div64_u64(q->latency_ns, handled) : 0,
+		   q->max_latency_ns);
+	NNP_SPIN_UNLOCK_BH(&q->lock_bh);
+}
+
+static int debug_chan_msgq_show(struct seq_file *m, void *v)
+{
+	struct sphcs_cmd_chan *chan;
+	int bkt;
+
+	if (unlikely(g_the_sphcs == NULL))
+		return -EINVAL;
+
+	NNP_SPIN_LOCK_BH(&g_the_sphcs->lock_bh);
+	hash_for_each(g_the_sphcs->cmd_chan_hash, bkt, chan, hash_node) {
+		seq_printf(m, "chan %u:\n", chan->protocol_id);
+		chan_msgq_show(m, "msgq", &chan->msgq);
+		if (chan->protocol_id < 256)
+			chan_msgq_show(m, "exec_msgq", &chan->exec_msgq);
+		if (chan->mbox)
+			seq_printf(m, "\tmbox: h2c_reads=%llu c2h_produced=%u c2h_fallbacks=%llu\n",
+				   chan->mbox_h2c_reads,
+				   chan->mbox_c2h_produced,
+				   chan->mbox_c2h_fallbacks);
+	}
+	NNP_SPIN_UNLOCK_BH(&g_the_sphcs->lock_bh);
+
+	return 0;
+}
+
+static int debug_chan_msgq_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, debug_chan_msgq_show, inode->i_private);
+}
+
+static const struct file_operations debug_chan_msgq_fops = {
+	.open		= debug_chan_msgq_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void sphcs_cmd_chan_init_debugfs(struct dentry *parent)
+{
+	if (!parent)
+		return;
+
+	debugfs_create_file("chan_msgq",
+			    0444,
+			    parent,
+			    NULL,
+			    &debug_chan_msgq_fops);
 }
@@ -30,6 +30,45 @@ struct sphcs_host_rb {
 	bool disconnected;
 };
 
+/*
+ * Per channel message queue.
+ *
+ * Messages received from host are copied into an inline slot and handled
+ * in order by the queue work, which runs on the shared unbound
+ * sphcs->chan_wq pool, so a slow channel does not delay other channels.
+ * When all slots are in use messages are allocated and kept on the
+ * overflow list, which is consumed only after the slots, to keep order.
+ */
+#define SPHCS_CHAN_MSG_PAYLOAD_SIZE 48
+#define SPHCS_CHAN_MSGQ_SLOTS       32
+
+typedef void (*sphcs_chan_msg_handler)(void *payload);
+
+struct sphcs_chan_msg {
+	sphcs_chan_msg_handler handler;
+	u64                    queued_ns;
+	struct list_head       overflow_node;
+	u64                    payload[SPHCS_CHAN_MSG_PAYLOAD_SIZE / sizeof(u64)];
+};
+
+struct sphcs_chan_msgq {
+	spinlock_t         lock_bh;
+	struct work_struct work;
+	u32                head; /* next slot to handle */
+	u32                tail; /* next free slot */
+	struct list_head   overflow;
+
+	/* stats */
+	u32 depth;
+	u32 max_depth;
+	u64 dispatched;
+	u64 overflowed;
+	u64 latency_ns; /* total time from dispatch to handler start */
+	u64 max_latency_ns;
+
+	struct sphcs_chan_msg slots[SPHCS_CHAN_MSGQ_SLOTS];
+};
+
 struct sphcs_hostres_map {
 	struct sg_table host_sgt;
 	uint16_t protocol_id;
@@ -46,8 +85,8 @@ struct sphcs_cmd_chan {
 	bool              privileged;
 	struct hlist_node hash_node;
 	int               destroyed;
-	struct workqueue_struct *wq;
-	struct workqueue_struct *wq_exec;
+	struct sphcs_chan_msgq   msgq;
+	struct sphcs_chan_msgq   exec_msgq;
 	atomic_t                 sched_queued;
 	struct msg_scheduler_queue *respq;
 	struct work_struct work;
@@ -64,6 +103,14 @@ struct sphcs_cmd_chan {
 
 	struct sphcs_host_rb     h2c_rb[NNP_IPC_MAX_CHANNEL_RINGBUFS];
 	struct sphcs_host_rb     c2h_rb[NNP_IPC_MAX_CHANNEL_RINGBUFS];
+
+	/* mailbox page in the inbound memory window, NULL if not available */
+	struct nnp_chan_mbox    *mbox;
+	void                    *mbox_handle;
+	struct sg_table         *mbox_sgt;
+	u64                      mbox_h2c_reads;
+	u32                      mbox_c2h_produced;
+	u64                      mbox_c2h_fallbacks;
 };
 
 int sphcs_cmd_chan_create(uint16_t            protocol_id,
@@ -88,6 +135,22 @@ void IPC_OPCODE_HANDLER(CHANNEL_HOSTRES_OP)(
 			struct sphcs               *sphcs,
 			union h2c_channel_hostres_op *cmd);
 
+int sphcs_chan_msgq_dispatch(struct sphcs_chan_msgq *q,
+			     sphcs_chan_msg_handler  handler,
+			     const void             *payload,
+			     u32                     size);
+
+/* copies *op into the queue, op must fit in an inline slot */
+#define SPHCS_CHAN_DISPATCH(q, handler, op)					\
+({										\
+	BUILD_BUG_ON(sizeof(*(op)) > SPHCS_CHAN_MSG_PAYLOAD_SIZE);		\
+	sphcs_chan_msgq_dispatch((q), (handler), (op), sizeof(*(op)));		\
+})
+
+void sphcs_chan_msgq_drain(struct sphcs_chan_msgq *q);
+
+void sphcs_cmd_chan_init_debugfs(struct dentry *parent);
+
 void sphcs_cmd_chan_update_cmd_head(struct sphcs_cmd_chan *chan, uint16_t rb_id, uint32_t size);
 
 dma_addr_t host_rb_get_addr(struct    sphcs_host_rb *rb,
@@ -152,5 +215,16 @@ int host_rb_get_avail_space(struct sphcs_host_rb *rb,
 void host_rb_update_avail_space(struct sphcs_host_rb *rb,
 				uint32_t              size);
 
+int sphcs_cmd_chan_mbox_offset(struct sphcs_cmd_chan *chan);
+
+int sphcs_cmd_chan_mbox_read(struct sphcs_cmd_chan *chan,
+			     u8                     slot,
+			     void                  *buf,
+			     u32                    size);
+
+int sphcs_cmd_chan_mbox_write(struct sphcs_cmd_chan *chan,
+			      const void            *buf,
+			      u32                    size);
+
 struct sphcs_hostres_map *sphcs_cmd_chan_find_hostres(struct sphcs_cmd_chan *chan, uint16_t protocol_id);
 #endif
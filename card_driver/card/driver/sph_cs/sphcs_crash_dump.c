@@ -9,6 +9,9 @@
 #include <linux/kmsg_dump.h>
 #include <linux/dma-mapping.h>
 #include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/lz4.h>
+#include <linux/moduleparam.h>
 
 #if KERNEL_VERSION(4, 16, 1) <= LINUX_VERSION_CODE /* SPH_IGNORE_STYLE_CHECK */
 #include <linux/dma-direct.h>
@@ -25,12 +28,24 @@
 struct crash_dump_desc {
 	dma_addr_t card_dma_addr;
 	void *card_vaddr;
+	size_t size;
 	bool  alloced;
 	spinlock_t lock_irq;
 	dma_addr_t host_dma_addr;
 	size_t actually_copied;
+	void *lz4_wrkmem;
+	char *lz4_src;
 } crash_dump_desc;
 
+/*
+ * Compress the kernel log with LZ4 before handing it to the host.
+ * This lets up to NNP_CRASH_DUMP_LZ4_MAX_ORIG bytes of log fit in the
+ * crash dump area and shortens the C2H transfer. Only takes effect if
+ * set when the module is loaded since the buffers are allocated at init.
+ */
+static bool crash_dump_compress;
+module_param(crash_dump_compress, bool, 0400);
+
 static const char *get_reason_str(enum kmsg_dump_reason reason)
 {
 	switch (reason) {
@@ -80,22 +95,72 @@ int sphcs_crash_dump_dma_complete_callback(struct sphcs *sphcs,
 					 1);
 }
 
+/*
+ * Compress the kernel log collected in lz4_src into the crash dump area.
+ * If it does not compress, the newest part of the log that fits is copied
+ * raw instead, starting at a line boundary.
+ */
+static size_t pack_dump(size_t src_len)
+{
+	struct nnp_crash_dump_lz4_hdr *hdr = crash_dump_desc.card_vaddr;
+	const char *src = crash_dump_desc.lz4_src;
+	const char *nl;
+	int comp_size;
+
+	comp_size = LZ4_compress_default(src,
+					 (char *)hdr->data,
+					 src_len,
+					 crash_dump_desc.size - sizeof(*hdr),
+					 crash_dump_desc.lz4_wrkmem);
+	if (comp_size > 0 && comp_size + sizeof(*hdr) < src_len) {
+		hdr->magic = NNP_CRASH_DUMP_LZ4_MAGIC;
+		hdr->orig_size = src_len;
+		hdr->comp_size = comp_size;
+		return comp_size + sizeof(*hdr);
+	}
+
+	if (src_len > crash_dump_desc.size) {
+		src += src_len - crash_dump_desc.size;
+		src_len = crash_dump_desc.size;
+		nl = memchr(src, '\n', src_len);
+		if (nl) {
+			src_len -= nl + 1 - src;
+			src = nl + 1;
+		}
+	}
+	memcpy(crash_dump_desc.card_vaddr, src, src_len);
+
+	return src_len;
+}
+
 static void dump(struct kmsg_dumper *dumper, enum kmsg_dump_reason reason)
 {
 	bool rc;
 	dma_addr_t host_dma_addr;
 	union c2h_event_report event;
 	unsigned long flags;
+	size_t len;
 
 	sph_log_debug(GENERAL_LOG, "dump %s\n", get_reason_str(reason));
 
-	rc = kmsg_dump_get_buffer(dumper,
-			false,
-			crash_dump_desc.card_vaddr,
-			NNP_CRASH_DUMP_SIZE,
-			&crash_dump_desc.actually_copied);
+	if (crash_dump_desc.lz4_wrkmem) {
+		rc = kmsg_dump_get_buffer(dumper,
+				false,
+				crash_dump_desc.lz4_src,
+				NNP_CRASH_DUMP_LZ4_MAX_ORIG,
+				&len);
+		crash_dump_desc.actually_copied = len ? pack_dump(len) : 0;
+		sph_log_debug(GENERAL_LOG, "log %zu packed to %zu, rc %d\n",
+			      len, crash_dump_desc.actually_copied, rc);
+	} else {
+		rc = kmsg_dump_get_buffer(dumper,
+				false,
+				crash_dump_desc.card_vaddr,
+				crash_dump_desc.size,
+				&crash_dump_desc.actually_copied);
 
-	sph_log_debug(GENERAL_LOG, "actually_copied %zu, rc %d\n", crash_dump_desc.actually_copied, rc);
+		sph_log_debug(GENERAL_LOG, "actually_copied %zu, rc %d\n", crash_dump_desc.actually_copied, rc);
+	}
 
 	if (!g_the_sphcs)
 		return;
@@ -165,6 +230,8 @@ int sphcs_crash_dump_init(void)
 		g_the_sphcs->inbound_mem->crash_dump_size = 0;
 
 		crash_dump_desc.card_vaddr = &g_the_sphcs->inbound_mem->crash_dump[0];
+		crash_dump_desc.size = NNP_CRASH_DUMP_SIZE -
+			offsetof(union nnp_inbound_mem, crash_dump);
 		crash_dump_desc.card_dma_addr =
 			g_the_sphcs->inbound_mem_dma_addr +
 			offsetof(union nnp_inbound_mem, crash_dump);
@@ -180,9 +247,26 @@ int sphcs_crash_dump_init(void)
 			sph_log_err(START_UP_LOG, "Failed to allocate crash dump buffer\n");
 			return -ENOMEM;
 		}
+		crash_dump_desc.size = NNP_CRASH_DUMP_SIZE;
 
 	}
 
+	/*
+	 * The dumper runs in panic context and cannot allocate,
+	 * so the compression buffers are set up here.
+	 */
+	if (crash_dump_compress) {
+		crash_dump_desc.lz4_wrkmem = vmalloc(LZ4_MEM_COMPRESS);
+		crash_dump_desc.lz4_src = vmalloc(NNP_CRASH_DUMP_LZ4_MAX_ORIG);
+		if (!crash_dump_desc.lz4_wrkmem || !crash_dump_desc.lz4_src) {
+			sph_log_err(START_UP_LOG, "Failed to allocate crash dump compression buffers, dump will be raw\n");
+			vfree(crash_dump_desc.lz4_wrkmem);
+			vfree(crash_dump_desc.lz4_src);
+			crash_dump_desc.lz4_wrkmem = NULL;
+			crash_dump_desc.lz4_src = NULL;
+		}
+	}
+
 	sph_log_info(START_UP_LOG, "Crash log buffer at: 0x%llx\n",
 		     dma_to_phys(g_the_sphcs->hw_device, crash_dump_desc.card_dma_addr));
 
@@ -201,6 +285,10 @@ int sphcs_crash_dump_init(void)
 	return 0;
 
 failed_to_register_dump:
+	vfree(crash_dump_desc.lz4_wrkmem);
+	vfree(crash_dump_desc.lz4_src);
+	crash_dump_desc.lz4_wrkmem = NULL;
+	crash_dump_desc.lz4_src = NULL;
 	if (g_the_sphcs->inbound_mem_dma_addr)
 		vm_unmap_ram(g_the_sphcs->inbound_mem, NNP_CRASH_DUMP_SIZE_PAGES);
 	else
@@ -215,6 +303,10 @@ failed_to_register_dump:
 void sphcs_crash_dump_cleanup(void)
 {
 	kmsg_dump_unregister(&dumper);
+	vfree(crash_dump_desc.lz4_wrkmem);
+	vfree(crash_dump_desc.lz4_src);
+	crash_dump_desc.lz4_wrkmem = NULL;
+	crash_dump_desc.lz4_src = NULL;
 	if (g_the_sphcs->inbound_mem_dma_addr)
 		vm_unmap_ram(g_the_sphcs->inbound_mem, NNP_CRASH_DUMP_SIZE_PAGES);
 	else
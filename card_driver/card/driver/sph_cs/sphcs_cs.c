@@ -27,6 +27,7 @@
 #include "nnp_inbound_mem.h"
 #include "sphcs_intel_th.h"
 #include "sphcs_maintenance.h"
+#include "sphcs_mem_acct.h"
 #include <linux/trace_clock.h>
 #include <linux/delay.h>
 #include <linux/reboot.h>
@@ -63,6 +64,10 @@ void *g_hSwCountersInfo_infreq;
 void *g_hSwCountersInfo_copy;
 struct nnp_sw_counters *g_nnp_sw_counters;
 
+/* max concurrently running channel message queues, 0 for the workqueue default */
+static int chan_workers;
+module_param(chan_workers, int, 0400);
+
 #ifdef CARD_PLATFORM_BR
 LIST_HEAD(p2p_regions);
 static void *p2p_heap_handle;
@@ -248,7 +253,7 @@ static void destroy_removed_chan(struct sphcs_cmd_chan *chan)
 	void (*cb)(struct sphcs_cmd_chan *chan, void *cb_ctx);
 	int i;
 
-	drain_workqueue(chan->wq);
+	sphcs_chan_msgq_drain(&chan->msgq);
 
 	cb = chan->destroy_cb;
 	if (cb != NULL)
@@ -319,12 +324,14 @@ static void channel_op_work_handler(struct work_struct *work)
 		goto send_error;
 	}
 
-	sphcs_send_event_report(sphcs,
-				NNP_IPC_CREATE_CHANNEL_SUCCESS,
-				0,
-				NULL,
-				-1,
-				op->cmd.protocol_id);
+	/* obj_id_2 is the mailbox page offset, if the channel has one */
+	sphcs_send_event_report_ext(sphcs,
+				    NNP_IPC_CREATE_CHANNEL_SUCCESS,
+				    0,
+				    NULL,
+				    -1,
+				    op->cmd.protocol_id,
+				    sphcs_cmd_chan_mbox_offset(chan));
 
 	goto done;
 
@@ -657,6 +664,37 @@ static void sphcs_remove_p2p_heap(void)
 #endif
 }
 
+/*
+ * Card memory reclaimer, frees the dma pool pages which were not used
+ * since the last reclaim.
+ */
+static u64 sphcs_dma_page_pool_reclaim(void *ctx, enum sphcs_mem_pool pool, u64 bytes)
+{
+	struct sphcs *sphcs = (struct sphcs *)ctx;
+	pool_handle pools[] = { sphcs->dma_page_pool, sphcs->net_dma_page_pool };
+	struct dma_pool_stat before, after;
+	u64 freed = 0;
+	unsigned int i;
+
+	if (pool != SPHCS_MEM_POOL_SYSTEM)
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(pools); i++) {
+		dma_page_pool_get_stats(pools[i], &before);
+		dma_page_pool_deallocate_unused_pages(pools[i]);
+		dma_page_pool_get_stats(pools[i], &after);
+		if (before.free_pages > after.free_pages)
+			freed += (u64)(before.free_pages - after.free_pages) * NNP_PAGE_SIZE;
+	}
+
+	return freed;
+}
+
+static struct sphcs_mem_reclaimer s_dma_page_pool_reclaimer = {
+	.name = "dma_page_pool",
+	.reclaim = sphcs_dma_page_pool_reclaim,
+};
+
 static int sphcs_create_p2p_heap(struct sphcs *sphcs)
 {
 	int ret = 0;
@@ -684,8 +722,11 @@ static int sphcs_create_p2p_heap(struct sphcs *sphcs)
 		sph_log_err(START_UP_LOG, "Failed to create p2p heap\n");
 		ret = PTR_ERR(p2p_heap_handle);
 		p2p_heap_handle = NULL;
-	} else
+	} else {
 		sph_log_debug(START_UP_LOG, "p2p heap successfully created\n");
+		sphcs_mem_acct_set_budget(SPHCS_MEM_POOL_P2P,
+					  sphcs->inbound_mem_size - NNP_CRASH_DUMP_SIZE);
+	}
 #endif
 
 	return ret;
@@ -988,6 +1029,9 @@ static int sphcs_create_sphcs(void                           *hw_handle,
 				   sphcs->debugfs_dir,
 				   "net_dma_page_pool");
 
+	s_dma_page_pool_reclaimer.ctx = sphcs;
+	sphcs_mem_acct_register_reclaimer(&s_dma_page_pool_reclaimer);
+
 	sphcs->respq_sched = msg_scheduler_create();
 	if (!sphcs->respq_sched) {
 		sph_log_err(START_UP_LOG, "Failed to create response q scheduler\n");
@@ -1023,15 +1067,24 @@ static int sphcs_create_sphcs(void                           *hw_handle,
 		goto free_sched;
 	}
 
+	sphcs->chan_wq = alloc_workqueue("sphcs_chan_wq", WQ_UNBOUND, chan_workers);
+	if (!sphcs->chan_wq) {
+		sph_log_err(START_UP_LOG, "Failed to initialize channel workqueue\n");
+		destroy_workqueue(sphcs->wq);
+		goto free_sched;
+	}
+
 	INIT_WORK(&sphcs->host_disconnect_work, sphcs_host_disconnect_work_handler);
 
 	ret = inference_init(sphcs);
 	if (ret) {
 		sph_log_err(START_UP_LOG, "Failed to initialize inference module\n");
-		goto free_sched;
+		goto free_wq;
 	}
 
 	sphcs_inf_init_debugfs(sphcs->debugfs_dir);
+	sphcs_cmd_chan_init_debugfs(sphcs->debugfs_dir);
+	sphcs_mem_acct_init_debugfs(sphcs->debugfs_dir);
 
 	debugfs_create_file("trace_timestamp",
 			    0444,
@@ -1166,6 +1219,9 @@ free_counters_info_global:
 	nnp_remove_sw_counters_info_node(g_hSwCountersInfo_global);
 free_inference:
 	inference_fini(sphcs);
+free_wq:
+	destroy_workqueue(sphcs->chan_wq);
+	destroy_workqueue(sphcs->wq);
 free_sched:
 	sphcs_dma_sched_destroy(sphcs->dmaSched);
 free_public_respq:
@@ -1173,6 +1229,7 @@ free_public_respq:
 free_respq_sched:
 	msg_scheduler_destroy(sphcs->respq_sched);
 free_net_dma_pool:
+	sphcs_mem_acct_unregister_reclaimer(&s_dma_page_pool_reclaimer);
 	dma_page_pool_destroy(sphcs->net_dma_page_pool);
 free_dma_pool:
 	dma_page_pool_destroy(sphcs->dma_page_pool);
@@ -1256,11 +1313,13 @@ static int sphcs_destroy_sphcs(struct sphcs *sphcs)
 	sphcs_ibecc_fini();
 	sphcs_crash_dump_cleanup();
 	destroy_workqueue(sphcs->wq);
+	destroy_workqueue(sphcs->chan_wq);
 	inference_fini(sphcs);
 	sphcs_dma_sched_destroy(sphcs->dmaSched);
 	msg_scheduler_queue_flush(sphcs->public_respq);
 	sphcs_destroy_response_queue(sphcs, sphcs->public_respq);
 	msg_scheduler_destroy(sphcs->respq_sched);
+	sphcs_mem_acct_unregister_reclaimer(&s_dma_page_pool_reclaimer);
 	dma_page_pool_destroy(sphcs->dma_page_pool);
 	dma_page_pool_destroy(sphcs->net_dma_page_pool);
 	periodic_timer_delete(&sphcs->periodic_timer);
@@ -43,6 +43,7 @@ struct sphcs {
 	struct inf_data   *inf_data;
 
 	struct workqueue_struct *wq;
+	struct workqueue_struct *chan_wq; /* runs the channel message queues */
 	u32                      host_connected;
 	u32                      host_doorbell_val;
 
@@ -10,6 +10,11 @@
 #include <linux/interrupt.h>
 #include <linux/slab.h>
 #include <linux/workqueue.h>
+#include <linux/llist.h>
+#include <linux/hash.h>
+#include <linux/math64.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
 #include <linux/completion.h>
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
@@ -37,6 +42,18 @@
 // Disable use of C2H DMA channel 1 due since it getting hang after FLR reset.
 //#define DMA_DISABLE_C2H_CHANNEL_1_WA
 
+#define SPHCS_DMA_MAX_CB_SHARDS 8
+#define SPHCS_DMA_FREE_BULK 16
+
+/*
+ * Number of completion lists per priority queue. Requests are spread by
+ * callback context so callbacks of the same context keep their order.
+ * With more than one shard, callbacks of different contexts of the
+ * same queue may run concurrently on different CPUs.
+ */
+static unsigned int dma_cb_shards = 1;
+module_param(dma_cb_shards, uint, 0400);
+
 const struct sphcs_dma_desc g_dma_desc_h2c_low = {
 	.dma_direction  = SPHCS_DMA_DIRECTION_HOST_TO_CARD,
 	.dma_priority   = SPHCS_DMA_PRIORITY_LOW,
@@ -121,15 +138,24 @@ const struct sphcs_dma_desc g_dma_desc_c2h_high_nowait = {
 	.flags          = SPHCS_DMA_START_XFER_COMPLETION_NO_WAIT
 };
 
-struct sphcs_dma_request_callback_wq {
+/* completed requests waiting for their callback, drained in batches */
+struct sphcs_dma_cb_shard {
+	struct llist_head done_list;
 	struct work_struct work;
 	struct sphcs_dma_sched *dmaSched;
-	struct sphcs_dma_req *req;
+
+	/* updated by the drain work only */
+	u64 drains;
+	u64 completions;
+	u32 max_batch;
+	u64 cb_latency_ns;	/* total time from completion to callback */
+	u64 cb_latency_max_ns;
 };
 
 struct sphcs_dma_sched_priority_queue {
 	struct list_head reqList;
 	struct workqueue_struct *req_callbacks_wq;
+	struct sphcs_dma_cb_shard cb_shards[SPHCS_DMA_MAX_CB_SHARDS];
 	u32 allowed_hw_channels;
 	u32 reqList_size;
 	u32 reqList_max_size;
@@ -177,10 +203,13 @@ struct sphcs_dma_sched {
 	struct spcs_dma_direction_info direction[SPHCS_DMA_NUM_DIRECTIONS];
 	spinlock_t lock;
 	struct kmem_cache *slab_cache_ptr;
+	u32 num_cb_shards;
 };
 
 struct sphcs_dma_req {
 	struct list_head node;
+	struct llist_node done_node;
+	u64 done_time_ns;
 	sphcs_dma_sched_completion_callback callback;
 	void *callback_ctx;
 
@@ -240,30 +269,61 @@ static int start_request(struct sphcs_dma_sched *dmaSched,
 
 static void request_callback_handler(struct work_struct *work)
 {
-	struct sphcs_dma_request_callback_wq *cb_work = (struct sphcs_dma_request_callback_wq *)work;
-	struct sphcs_dma_sched *dmaSched = cb_work->dmaSched;
-	struct sphcs_dma_req *req = cb_work->req;
-
-	DO_TRACE(trace_dma(SPH_TRACE_OP_STATUS_CB_START, req->direction == SPHCS_DMA_DIRECTION_CARD_TO_HOST,
-			req->transfer_size, req->channel, req->priority, (uint64_t)(uintptr_t)req));
-
-	req->callback(dmaSched->sphcs, req->callback_ctx, &req->user_data[0], req->status, req->timeUS);
-
-	DO_TRACE(trace_dma(SPH_TRACE_OP_STATUS_CB_COMPLETE, req->direction == SPHCS_DMA_DIRECTION_CARD_TO_HOST,
-			req->transfer_size, req->channel, req->priority, (uint64_t)(uintptr_t)req));
+	struct sphcs_dma_cb_shard *shard = container_of(work, struct sphcs_dma_cb_shard, work);
+	struct sphcs_dma_sched *dmaSched = shard->dmaSched;
+	struct sphcs_dma_req *req, *tmp;
+	struct llist_node *batch;
+	void *free_reqs[SPHCS_DMA_FREE_BULK];
+	u32 n_free = 0;
+	u32 n;
+	u64 latency;
+
+	while ((batch = llist_del_all(&shard->done_list)) != NULL) {
+		/* llist is LIFO, restore completion order */
+		batch = llist_reverse_order(batch);
+		n = 0;
+
+		llist_for_each_entry_safe(req, tmp, batch, done_node) {
+			latency = ktime_get_ns() - req->done_time_ns;
+			shard->cb_latency_ns += latency;
+			if (latency > shard->cb_latency_max_ns)
+				shard->cb_latency_max_ns = latency;
+
+			DO_TRACE(trace_dma(SPH_TRACE_OP_STATUS_CB_START, req->direction == SPHCS_DMA_DIRECTION_CARD_TO_HOST,
+					req->transfer_size, req->channel, req->priority, (uint64_t)(uintptr_t)req));
+
+			req->callback(dmaSched->sphcs, req->callback_ctx, &req->user_data[0], req->status, req->timeUS);
+
+			DO_TRACE(trace_dma(SPH_TRACE_OP_STATUS_CB_COMPLETE, req->direction == SPHCS_DMA_DIRECTION_CARD_TO_HOST,
+					req->transfer_size, req->channel, req->priority, (uint64_t)(uintptr_t)req));
+
+			if (req->is_slab_cache_alloc) {
+				free_reqs[n_free++] = req;
+				if (n_free == SPHCS_DMA_FREE_BULK) {
+					kmem_cache_free_bulk(dmaSched->slab_cache_ptr, n_free, free_reqs);
+					n_free = 0;
+				}
+			} else {
+				kfree(req);
+			}
+			n++;
+		}
 
-	if (req->is_slab_cache_alloc)
-		kmem_cache_free(dmaSched->slab_cache_ptr, req);
-	else
-		kfree(req);
+		shard->drains++;
+		shard->completions += n;
+		if (n > shard->max_batch)
+			shard->max_batch = n;
+	}
 
-	kfree(cb_work);
+	if (n_free > 0)
+		kmem_cache_free_bulk(dmaSched->slab_cache_ptr, n_free, free_reqs);
 }
 
 static void complete_request(struct sphcs_dma_sched *dmaSched,
 			     struct sphcs_dma_req *req)
 {
-	struct sphcs_dma_request_callback_wq *cb_work;
+	struct sphcs_dma_sched_priority_queue *q;
+	struct sphcs_dma_cb_shard *shard;
 
 	if (req->flags & SPHCS_DMA_START_XFER_COMPLETION_NO_WAIT) {
 		req->callback(dmaSched->sphcs,
@@ -283,19 +343,15 @@ static void complete_request(struct sphcs_dma_sched *dmaSched,
 		return;
 	}
 
-	/* assume M_WAITOK */
-	cb_work = kzalloc(sizeof(*cb_work), GFP_NOWAIT);
+	q = DMA_QUEUE_INFO_PTR(dmaSched, req->direction, req->priority);
+	shard = &q->cb_shards[dmaSched->num_cb_shards > 1 ?
+			      hash_ptr(req->callback_ctx, 8) % dmaSched->num_cb_shards : 0];
 
-	if (cb_work) {
-		INIT_WORK(&cb_work->work, request_callback_handler);
-		cb_work->dmaSched = dmaSched;
-		cb_work->req = req;
-		queue_work(DMA_QUEUE_WORKQUEUE(dmaSched,
-					       req->direction,
-					       req->priority), &cb_work->work);
-	} else {
-		/* in case cb_work was not allocated */
-	}
+	req->done_time_ns = ktime_get_ns();
+
+	/* only the first request added to an empty list kicks the work */
+	if (llist_add(&req->done_node, &shard->done_list))
+		queue_work(q->req_callbacks_wq, &shard->work);
 }
 
 static void reset_handler(struct work_struct *work)
@@ -692,6 +748,7 @@ int sphcs_dma_sched_create(struct sphcs *sphcs,
 	dmaSched->sphcs = sphcs;
 	dmaSched->serial_channel = 0;
 	spin_lock_init(&dmaSched->lock);
+	dmaSched->num_cb_shards = clamp_t(u32, dma_cb_shards, 1, SPHCS_DMA_MAX_CB_SHARDS);
 
 	DMA_DIRECTION_INFO(dmaSched, SPHCS_DMA_DIRECTION_CARD_TO_HOST).reset_work.reset = hw_ops->reset_wr_dma_engine;
 	DMA_DIRECTION_INFO(dmaSched, SPHCS_DMA_DIRECTION_HOST_TO_CARD).reset_work.reset = hw_ops->reset_rd_dma_engine;
@@ -714,6 +771,7 @@ int sphcs_dma_sched_create(struct sphcs *sphcs,
 		/* initialize priority request queues */
 		for (idxPriority = 0; idxPriority < SPHCS_DMA_NUM_PRIORITIES; idxPriority++) {
 			struct sphcs_dma_sched_priority_queue *q = DMA_QUEUE_INFO_PTR(dmaSched, direction_index, idxPriority);
+			u32 i;
 
 			/* initialize requrest list for every priority */
 
@@ -724,11 +782,23 @@ int sphcs_dma_sched_create(struct sphcs *sphcs,
 			/* queue spin lock init */
 			spin_lock_init(&q->lock_irq);
 
+			for (i = 0; i < dmaSched->num_cb_shards; i++) {
+				init_llist_head(&q->cb_shards[i].done_list);
+				INIT_WORK(&q->cb_shards[i].work, request_callback_handler);
+				q->cb_shards[i].dmaSched = dmaSched;
+			}
 
-			/* create a single threaded work queue for each priority queue */
+			/*
+			 * create a single threaded work queue for each priority queue,
+			 * or an unbound one if callbacks are sharded by context.
+			 */
 
-			DMA_QUEUE_WORKQUEUE(dmaSched, direction_index, idxPriority) =
-				create_singlethread_workqueue("work queue for request callback");
+			if (dmaSched->num_cb_shards > 1)
+				DMA_QUEUE_WORKQUEUE(dmaSched, direction_index, idxPriority) =
+					alloc_workqueue("sphcs_dma_cb", WQ_UNBOUND, dmaSched->num_cb_shards);
+			else
+				DMA_QUEUE_WORKQUEUE(dmaSched, direction_index, idxPriority) =
+					create_singlethread_workqueue("work queue for request callback");
 
 			if (DMA_QUEUE_WORKQUEUE(dmaSched, direction_index, idxPriority) == NULL) {
 				sphcs_dma_sched_destroy(dmaSched);
@@ -1350,6 +1420,9 @@ static int debug_direction_show(struct seq_file *m, void *v)
 	for (i = 0; i < SPHCS_DMA_NUM_PRIORITIES; i++) {
 		struct sphcs_dma_sched_priority_queue *q = &dir_info->reqQueue[i];
 		unsigned long queue_flags;
+		u64 drains = 0, completions = 0, latency = 0, latency_max = 0;
+		u32 max_batch = 0;
+		int j;
 
 		NNP_SPIN_LOCK_IRQSAVE(&q->lock_irq, queue_flags);
 		seq_printf(m, "\tprio%d: qsize=%u max_qsize=%u allowed_channels_mask=0x%x\n",
@@ -1358,6 +1431,23 @@ static int debug_direction_show(struct seq_file *m, void *v)
 			   q->reqList_max_size,
 			   q->allowed_hw_channels);
 		NNP_SPIN_UNLOCK_IRQRESTORE(&q->lock_irq, queue_flags);
+
+		for (j = 0; j < SPHCS_DMA_MAX_CB_SHARDS; j++) {
+			const struct sphcs_dma_cb_shard *shard = &q->cb_shards[j];
+
+			drains += shard->drains;
+			completions += shard->completions;
+			latency += shard->cb_latency_ns;
+			latency_max = max(latency_max, shard->cb_latency_max_ns);
+			max_batch = max(max_batch, shard->max_batch);
+		}
+		seq_printf(m, "\t       completions=%llu drains=%llu avg_batch=%llu max_batch=%u cb_latency_avg_ns=%llu cb_latency_max_ns=%llu\n",
+			   completions,
+			   drains,
+			   drains ? div64_u64(completions, drains) : 0,
+			   max_batch,
+			   completions ? div64_u64(latency, completions) : 0,
+			   latency_max);
 	}
 
 	NNP_SPIN_UNLOCK_IRQRESTORE(&dir_info->lock_irq, flags);
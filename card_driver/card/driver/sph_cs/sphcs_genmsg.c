@@ -24,6 +24,8 @@
 #include <linux/file.h>
 #include <linux/hashtable.h>
 #include <linux/atomic.h>
+#include <linux/mm.h>
+#include <linux/dma-mapping.h>
 #include "dma_page_pool.h"
 #include "sphcs_cs.h"
 #include "ipc_protocol.h"
@@ -35,6 +37,9 @@
 
 #define SPH_MAX_GENERIC_SERVICES (32UL + 256UL)
 
+/* max user pages pinned by a single stream mode write */
+#define GENMSG_STREAM_MAX_PAGES 64
+
 static struct cdev s_cdev;
 static dev_t       s_devnum;
 static struct class *s_class;
@@ -126,6 +131,8 @@ struct channel_data {
 	wait_queue_head_t write_waitq;
 	atomic_t          n_write_dma_req;
 	struct mutex      write_lock;
+
+	bool              stream_mode;
 };
 
 struct service_data {
@@ -150,6 +157,8 @@ struct dma_req_user_data {
 	page_handle dma_page_hndl;
 	page_handle host_dma_page_hndl;
 	void       *dma_vptr;
+	struct page *user_page;   /* pinned user page of stream mode write */
+	dma_addr_t  user_dma_addr;
 	u32         xfer_size;
 	u32         param1;
 	union {
@@ -293,21 +302,13 @@ static int sphcs_genmsg_chan_release(struct inode *inode, struct file *f)
 	return 0;
 }
 
-static ssize_t sphcs_genmsg_chan_read(struct file *f,
-				      char __user *buf,
-				      size_t       size,
-				      loff_t      *off)
+static ssize_t read_one_packet(struct channel_data *channel,
+			       char __user         *buf,
+			       size_t               size)
 {
-	struct channel_data *channel = (struct channel_data *)f->private_data;
 	size_t read_size;
 	ssize_t ret;
 
-	if (unlikely(!is_channel_file(f)))
-		return -EINVAL;
-
-	if (channel->io_error)
-		return -EIO;
-
 	if (!channel->current_read_packet) {
 
 		/* wait for a pending read packets */
@@ -366,6 +367,182 @@ static ssize_t sphcs_genmsg_chan_read(struct file *f,
 	return ret;
 }
 
+/* true if a data packet was already received and can be read without waiting */
+static bool next_data_packet_ready(struct channel_data *channel)
+{
+	struct pending_packet *pend;
+	bool ready = false;
+
+	if (channel->current_read_packet)
+		return false;
+
+	NNP_SPIN_LOCK(&channel->read_lock);
+	if (!list_empty(&channel->pending_read_packets)) {
+		pend = list_first_entry(&channel->pending_read_packets,
+					struct pending_packet, node);
+		ready = !pend->is_hangup_command;
+	}
+	NNP_SPIN_UNLOCK(&channel->read_lock);
+
+	return ready;
+}
+
+static ssize_t sphcs_genmsg_chan_read(struct file *f,
+				      char __user *buf,
+				      size_t       size,
+				      loff_t      *off)
+{
+	struct channel_data *channel = (struct channel_data *)f->private_data;
+	ssize_t n_read = 0;
+	ssize_t ret;
+
+	if (unlikely(!is_channel_file(f)))
+		return -EINVAL;
+
+	if (channel->io_error)
+		return -EIO;
+
+	ret = read_one_packet(channel, buf, size);
+	if (!channel->stream_mode)
+		return ret;
+
+	/*
+	 * In stream mode keep filling user buffer with packets which
+	 * already arrived. Hangup packet is still returned by its own read.
+	 */
+	while (ret > 0) {
+		n_read += ret;
+		if (n_read >= size || !next_data_packet_ready(channel))
+			break;
+		ret = read_one_packet(channel, buf + n_read, size - n_read);
+	}
+
+	return n_read > 0 ? n_read : ret;
+}
+
+/*
+ * Make sure channel holds a host response page for the next packet.
+ * Called with write_lock held.
+ */
+static int get_write_host_page(struct channel_data *channel)
+{
+	struct sphcs_host_rb *resp_data_rb = &channel->cmd_chan->c2h_rb[0];
+	uint32_t chunk_size;
+	int n;
+
+	if (channel->write_host_page_valid)
+		return 0;
+
+	n = host_rb_wait_free_space(resp_data_rb,
+				    NNP_PAGE_SIZE,
+				    1,
+				    &channel->write_host_page_addr,
+				    &chunk_size);
+	if (n != 1 || chunk_size != NNP_PAGE_SIZE) {
+		sph_log_err(SERVICE_LOG, "Failed to get host response page for write n=%d chunk_size=%u\n", n, chunk_size);
+		return -1;
+	}
+	host_rb_update_free_space(resp_data_rb, NNP_PAGE_SIZE);
+	channel->write_host_page_valid = 1;
+
+	return 0;
+}
+
+/*
+ * Stream mode write - pins the user buffer and DMAs each user page
+ * directly to a host response page, without a bounce copy.
+ * Packets are split on user page boundaries so each packet is a
+ * single DMA. Returns once all DMAs are done so user may reuse
+ * the buffer. Called with write_lock held.
+ */
+static ssize_t genmsg_chan_stream_write(struct channel_data *channel,
+					const char __user   *buf,
+					size_t               size)
+{
+	struct page *pages[GENMSG_STREAM_MAX_PAGES];
+	struct dma_req_user_data dma_req_data;
+	unsigned long uaddr = (unsigned long)buf;
+	u32 offset = offset_in_page(uaddr);
+	ssize_t n_written = 0;
+	size_t write_size;
+	dma_addr_t dma_addr;
+	int npages, pinned, i;
+	int ret = 0;
+
+	npages = min_t(size_t, DIV_ROUND_UP(offset + size, PAGE_SIZE),
+		       GENMSG_STREAM_MAX_PAGES);
+	pinned = pin_user_pages_fast(uaddr & PAGE_MASK, npages, 0, pages);
+	if (pinned <= 0)
+		return pinned < 0 ? pinned : -EFAULT;
+
+	for (i = 0; i < pinned && n_written < size; i++) {
+		if (channel->hanging_up) {
+			ret = -EPIPE;
+			break;
+		}
+
+		if (get_write_host_page(channel))
+			break;
+
+		/* card page size equals NNP_PAGE_SIZE */
+		write_size = min_t(size_t, size - n_written, PAGE_SIZE - offset);
+
+		dma_addr = dma_map_page(g_the_sphcs->hw_device, pages[i],
+					offset, write_size, DMA_TO_DEVICE);
+		if (unlikely(dma_mapping_error(g_the_sphcs->hw_device, dma_addr))) {
+			sph_log_err(SERVICE_LOG, "Failed to map user page for write\n");
+			ret = -ENOMEM;
+			break;
+		}
+
+		dma_req_data.user_page = pages[i];
+		dma_req_data.user_dma_addr = dma_addr;
+		dma_req_data.dma_vptr = NULL;
+		dma_req_data.xfer_size = write_size;
+		dma_req_data.channel = channel;
+
+		atomic_inc(&channel->n_write_dma_req);
+
+		ret = sphcs_dma_sched_start_xfer_single(g_the_sphcs->dmaSched,
+						&channel->cmd_chan->c2h_dma_desc,
+						dma_addr,
+						channel->write_host_page_addr,
+						write_size,
+						chan_response_dma_completed,
+						NULL,
+						&dma_req_data,
+						sizeof(dma_req_data));
+		if (unlikely(ret < 0)) {
+			sph_log_err(SERVICE_LOG, "Failed to schedule DMA transfer\n");
+			dma_unmap_page(g_the_sphcs->hw_device, dma_addr,
+				       write_size, DMA_TO_DEVICE);
+			atomic_dec(&channel->n_write_dma_req);
+			break;
+		}
+
+		/* page is released by dma completion */
+		channel->write_host_page_valid = 0;
+		n_written += write_size;
+		offset = 0;
+	}
+
+	/* unpin pages which were not handed to dma */
+	if (i < pinned)
+		unpin_user_pages(&pages[i], pinned - i);
+
+	/*
+	 * The DMA engine reads the pinned user pages until completion,
+	 * so never return to user before all transfers are done.
+	 */
+	wait_event(channel->write_waitq,
+		   atomic_read(&channel->n_write_dma_req) == 0);
+
+	if (n_written == 0)
+		return ret;
+
+	return n_written;
+}
+
 static ssize_t sphcs_genmsg_chan_write(struct file       *f,
 				       const char __user *buf,
 				       size_t             size,
@@ -391,6 +568,12 @@ static ssize_t sphcs_genmsg_chan_write(struct file       *f,
 
 	mutex_lock(&channel->write_lock);
 
+	if (channel->stream_mode) {
+		n_written = genmsg_chan_stream_write(channel, buf, size);
+		mutex_unlock(&channel->write_lock);
+		return n_written;
+	}
+
 	do {
 		if (channel->hanging_up) {
 			ret = -EPIPE;
@@ -398,23 +581,9 @@ static ssize_t sphcs_genmsg_chan_write(struct file       *f,
 		}
 
 		// Need to have a host response page for sending data to host
-		if (!channel->write_host_page_valid) {
-			struct sphcs_host_rb *resp_data_rb = &channel->cmd_chan->c2h_rb[0];
-			uint32_t chunk_size;
-			int n;
-
-			n = host_rb_wait_free_space(resp_data_rb,
-						    NNP_PAGE_SIZE,
-						    1,
-						    &channel->write_host_page_addr,
-						    &chunk_size);
-			if (n != 1 || chunk_size != NNP_PAGE_SIZE) {
-				sph_log_err(SERVICE_LOG, "Failed to get host response page for write n=%d chunk_size=%u\n", n, chunk_size);
-				/* end the write loop and return */
-				break;
-			}
-			host_rb_update_free_space(resp_data_rb, NNP_PAGE_SIZE);
-			channel->write_host_page_valid = 1;
+		if (get_write_host_page(channel)) {
+			/* end the write loop and return */
+			break;
 		}
 
 		/* need to have local dma address for copying data from user */
@@ -444,6 +613,7 @@ static ssize_t sphcs_genmsg_chan_write(struct file       *f,
 		dma_req_data.dma_page_hndl = channel->write_page_hndl;
 		dma_req_data.host_dma_page_hndl = channel->write_host_page_hndl;
 		dma_req_data.dma_vptr = channel->write_page_vptr;
+		dma_req_data.user_page = NULL;
 		dma_req_data.xfer_size = write_size;
 		dma_req_data.channel = channel;
 
@@ -553,6 +723,21 @@ static long write_response_wait(struct file *f, void __user *arg)
 	return ret;
 }
 
+static long set_stream_mode(struct file *f, void __user *arg)
+{
+	struct channel_data *channel = (struct channel_data *)f->private_data;
+	int enable;
+
+	if (copy_from_user(&enable, arg, sizeof(int)))
+		return -EFAULT;
+
+	mutex_lock(&channel->write_lock);
+	channel->stream_mode = (enable != 0);
+	mutex_unlock(&channel->write_lock);
+
+	return 0;
+}
+
 static long chan_is_privileged(struct file *f, void __user *arg)
 {
 	struct channel_data *channel = (struct channel_data *)f->private_data;
@@ -586,6 +771,9 @@ static long sphcs_genmsg_chan_ioctl(struct file *f, unsigned int cmd, unsigned l
 	case IOCTL_GENMSG_IS_PRIVILEGED:
 		ret = chan_is_privileged(f, (void __user *)arg);
 		break;
+	case IOCTL_GENMSG_SET_STREAM_MODE:
+		ret = set_stream_mode(f, (void __user *)arg);
+		break;
 	default:
 		sph_log_err(SERVICE_LOG, "Unsupported genmsg chan IOCTL 0x%x\n", cmd);
 		ret = -EINVAL;
@@ -1217,8 +1405,14 @@ static int chan_response_dma_completed(struct sphcs *sphcs,
 						  &msg2.value, 1);
 	}
 
-	/* return the local dma page back to the dma pool */
-	dma_page_pool_set_page_free(sphcs->dma_page_pool, dma_req_user_data->dma_page_hndl);
+	/* return the local dma page back to the dma pool, or unpin user page */
+	if (dma_req_user_data->user_page) {
+		dma_unmap_page(sphcs->hw_device, dma_req_user_data->user_dma_addr,
+			       dma_req_user_data->xfer_size, DMA_TO_DEVICE);
+		unpin_user_page(dma_req_user_data->user_page);
+	} else {
+		dma_page_pool_set_page_free(sphcs->dma_page_pool, dma_req_user_data->dma_page_hndl);
+	}
 
 	/* Decrement pending write dma requests - wake threads waiting for it */
 	atomic_dec_if_positive(&dma_req_user_data->channel->n_write_dma_req);
@@ -1547,16 +1741,13 @@ int process_genmsg_command(struct sphcs *sphcs,
  * Interface from new "channel" based protocol
  */
 struct chan_genmsg_command_entry {
-	struct work_struct             work;
 	struct sphcs_cmd_chan         *chan;
 	union h2c_ChanGenericMessaging msg;
 };
 
-static void chan_genmsg_command_handler(struct work_struct *work)
+static void chan_genmsg_command_handler(void *payload)
 {
-	struct chan_genmsg_command_entry *op = container_of(work,
-							    struct chan_genmsg_command_entry,
-							    work);
+	struct chan_genmsg_command_entry *op = payload;
 	union h2c_GenericMessaging old_msg;
 	struct sphcs_host_rb *cmd_data_rb = &op->chan->h2c_rb[op->msg.rb_id];
 	dma_addr_t host_dma_addr;
@@ -1570,7 +1761,7 @@ static void chan_genmsg_command_handler(struct work_struct *work)
 		sph_log_err(GENERAL_LOG, "ringbuf size error rb_id=%d h2c size %d c2h size %d\n",
 			    op->msg.rb_id, op->chan->h2c_rb[op->msg.rb_id].size, op->chan->c2h_rb[op->msg.rb_id].size);
 		sphcs_cmd_chan_put(op->chan);
-		goto done;
+		return;
 	}
 
 	old_msg.opcode = op->msg.opcode;
@@ -1605,9 +1796,6 @@ static void chan_genmsg_command_handler(struct work_struct *work)
 
 	/* call to process command */
 	process_genmsg_command(g_the_sphcs, &old_msg, op->chan);
-
-done:
-	kfree(op);
 }
 
 static void sphcs_chan_genmsg_hangup(struct sphcs_cmd_chan *cmd_chan, void *cb_ctx)
@@ -1632,7 +1820,7 @@ static void sphcs_chan_genmsg_hangup(struct sphcs_cmd_chan *cmd_chan, void *cb_c
 void IPC_OPCODE_HANDLER(CHAN_GENERIC_MSG_PACKET)(struct sphcs                   *sphcs,
 						 union h2c_ChanGenericMessaging *msg)
 {
-	struct chan_genmsg_command_entry *entry;
+	struct chan_genmsg_command_entry entry;
 	struct sphcs_cmd_chan *chan;
 
 	chan = sphcs_find_channel(sphcs, msg->chan_id);
@@ -1642,19 +1830,15 @@ void IPC_OPCODE_HANDLER(CHAN_GENERIC_MSG_PACKET)(struct sphcs
 	}
 
 	/*
-	 * place the command in pending list and schedule the pending work to handle it
+	 * place the command in the channel message queue to handle it
 	 */
-	entry = kzalloc(sizeof(*entry), GFP_NOWAIT);
-	if (!entry) {
+	entry.chan = chan;
+	entry.msg.value = msg->value;
+
+	if (SPHCS_CHAN_DISPATCH(&chan->msgq, chan_genmsg_command_handler, &entry) != 0) {
 		sph_log_err(SERVICE_LOG, "No memory for pending command entry!!!\n");
-		return;
+		sphcs_cmd_chan_put(chan);
 	}
-
-	entry->chan = chan;
-	entry->msg.value = msg->value;
-
-	INIT_WORK(&entry->work, chan_genmsg_command_handler);
-	queue_work(chan->wq, &entry->work);
 }
 
 /*
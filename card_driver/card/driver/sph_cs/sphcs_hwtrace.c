@@ -127,7 +127,6 @@ struct sphcs_state_cmd {
 };
 
 struct sphcs_hwtrace_cmd_work {
-	struct work_struct		work;
 	enum SPH_HWTRACE_WORK_CMD_TYPE	type;
 	struct sphcs_add_resource_cmd	add_resource_cmd;
 	struct sphcs_state_cmd		state_cmd;
@@ -568,9 +567,18 @@ static int sphcs_hwtrace_dma_stream_complete_cb(struct sphcs *sphcs, void *ctx,
 			sph_log_err(HWTRACE_LOG, "hwtrace dma failed for resource unknown\n");
 		}
 
+		NNP_SPIN_LOCK_IRQSAVE(&hw_tracing->lock_irq, flags);
+		hw_tracing->windows_dropped++;
+		NNP_SPIN_UNLOCK_IRQRESTORE(&hw_tracing->lock_irq, flags);
+
 		return -EINVAL;
 	}
 
+	NNP_SPIN_LOCK_IRQSAVE(&hw_tracing->lock_irq, flags);
+	hw_tracing->windows_streamed++;
+	hw_tracing->bytes_streamed += bytes;
+	NNP_SPIN_UNLOCK_IRQRESTORE(&hw_tracing->lock_irq, flags);
+
 	//send notification to host that resource is ready for read.
 	memset(chan_response_msg.value, 0x0, sizeof(chan_response_msg.value));
 
@@ -592,6 +600,80 @@ static int sphcs_hwtrace_dma_stream_complete_cb(struct sphcs *sphcs, void *ctx,
 	return 0;
 }
 
+void do_stream_hwtrace(struct sphcs_dma_res_info *r);
+
+//stream all ready npk resources which have a free host resource.
+//must be called with lock_irq held
+static void stream_ready_resources(struct sphcs_hwtrace_data *hw_tracing)
+{
+	struct sphcs_dma_res_info *r;
+
+	list_for_each_entry(r, &hw_tracing->dma_stream_list, node)
+		if (r->state & HWTRACE_STATE_NPK_RESOURCE_READY)
+			do_stream_hwtrace(r);
+}
+
+//rebuild dma binding of rebound resources and stream them
+static void sphcs_hwtrace_rebind_work_handler(struct work_struct *work)
+{
+	struct sphcs_hwtrace_data *hw_tracing = &g_the_sphcs->hw_tracing;
+	unsigned long flags;
+
+	sphcs_hwtrace_update_state();
+
+	NNP_SPIN_LOCK_IRQSAVE(&hw_tracing->lock_irq, flags);
+	stream_ready_resources(hw_tracing);
+	NNP_SPIN_UNLOCK_IRQRESTORE(&hw_tracing->lock_irq, flags);
+}
+
+static DECLARE_WORK(s_rebind_work, sphcs_hwtrace_rebind_work_handler);
+
+//
+// npk window r is ready but its host resource is still owned by host.
+// In case host added more resources than npk windows, move a free spare
+// host resource to the window, so streaming does not wait for host to
+// release the previous one. The busy host resource is parked in the
+// spare container until host unlocks it.
+// must be called with lock_irq held, returns true if rebound.
+//
+static bool rebind_free_host_resource(struct sphcs_hwtrace_data *hw_tracing,
+				      struct sphcs_dma_res_info *r)
+{
+	struct sphcs_dma_res_info *spare;
+	struct host_res_info *host;
+
+	if (!(r->state & HWTRACE_STATE_HOST_RESOURCE_BUSY) ||
+	    (r->state & (HWTRACE_STATE_NPK_RESOURCE_BUSY |
+			 HWTRACE_STATE_HOST_RESOURCE_CLEANUP |
+			 HWTRACE_STATE_NO_CLEANUP_RESOURCE)))
+		return false;
+
+	list_for_each_entry(spare, &hw_tracing->dma_stream_list, node) {
+		if (spare->npk_res == NULL && spare->host_res != NULL &&
+		    !(spare->state & (HWTRACE_STATE_HOST_RESOURCE_BUSY |
+				      HWTRACE_STATE_HOST_RESOURCE_CLEANUP |
+				      HWTRACE_STATE_NPK_RESOURCE_CLEANUP)))
+			goto found;
+	}
+
+	return false;
+
+found:
+	host = spare->host_res;
+	spare->host_res = r->host_res;
+	spare->state |= HWTRACE_STATE_HOST_RESOURCE_BUSY;
+
+	r->host_res = host;
+	r->state &= ~HWTRACE_STATE_HOST_RESOURCE_BUSY;
+	//dma binding was built for the previous host resource
+	r->state |= HWTRACE_STATE_DMA_INFO_DIRTY;
+
+	hw_tracing->windows_rebound++;
+	schedule_work(&s_rebind_work);
+
+	return true;
+}
+
 //function handle streaming NPK resource to host
 void do_stream_hwtrace(struct sphcs_dma_res_info *r)
 {
@@ -866,7 +948,12 @@ int intel_th_window_ready(void *priv, struct sg_table *sgt, size_t bytes)
 
 	if (bFound) {
 		hw_tracing->npk_resources_ready++;
+		if (r->state & HWTRACE_STATE_HOST_RESOURCE_BUSY &&
+		    !rebind_free_host_resource(hw_tracing, r))
+			hw_tracing->windows_stalled++;
 		do_stream_hwtrace(r);
+	} else {
+		hw_tracing->windows_dropped++;
 	}
 
 	NNP_SPIN_UNLOCK_IRQRESTORE(&hw_tracing->lock_irq, flags);
@@ -940,6 +1027,11 @@ int sphcs_hwtrace_init(struct sphcs *sphcs, struct sphcs_cmd_chan *chan)
 
 	hw_tracing->requests_in_flight = 0;
 	hw_tracing->npk_resources_ready = 0;
+	hw_tracing->windows_streamed = 0;
+	hw_tracing->bytes_streamed = 0;
+	hw_tracing->windows_stalled = 0;
+	hw_tracing->windows_rebound = 0;
+	hw_tracing->windows_dropped = 0;
 	hw_tracing->hwtrace_status = NNPCS_HWTRACE_INITIALIZED;
 
 reply_message:
@@ -983,6 +1075,7 @@ int sphcs_hwtrace_deinit(struct sphcs *sphcs)
 
 	NNP_SPIN_UNLOCK_IRQRESTORE(&hw_tracing->lock_irq, flags);
 
+	cancel_work_sync(&s_rebind_work);
 	sphcs_hwtrace_update_state();
 
 	hw_tracing->hwtrace_status = NNPCS_HWTRACE_REGISTERED;
@@ -1034,8 +1127,17 @@ void sphcs_hwtrace_unlock_host_res(struct sphcs *sphcs,
 		}
 	}
 
-	if (bFound)
-		do_stream_hwtrace(r);
+	if (bFound) {
+		if (r->npk_res) {
+			do_stream_hwtrace(r);
+		} else {
+			//released a parked resource - a stalled window may use it
+			list_for_each_entry(r, &hw_tracing->dma_stream_list, node)
+				if (r->state & HWTRACE_STATE_NPK_RESOURCE_READY &&
+				    rebind_free_host_resource(hw_tracing, r))
+					break;
+		}
+	}
 
 
 	NNP_SPIN_UNLOCK_IRQRESTORE(&hw_tracing->lock_irq, flags);
@@ -1268,12 +1370,10 @@ reply_message:
 	sphcs_msg_scheduler_queue_add_msg(chan->respq, chan_response_msg.value, 2);
 }
 
-static void hwtrace_op_work_handler(struct work_struct *work)
+static void hwtrace_op_work_handler(void *payload)
 {
 	struct sphcs *sphcs = g_the_sphcs;
-	struct sphcs_hwtrace_cmd_work *op = container_of(work,
-							 struct sphcs_hwtrace_cmd_work,
-							 work);
+	struct sphcs_hwtrace_cmd_work *op = payload;
 
 	switch (op->type) {
 	case SPH_HWTRACE_WORK_ADD_RESOURCE:
@@ -1285,13 +1385,12 @@ static void hwtrace_op_work_handler(struct work_struct *work)
 	};
 
 	sphcs_cmd_chan_put(op->chan);
-	kfree(op);
 }
 
 void IPC_OPCODE_HANDLER(CHAN_HWTRACE_ADD_RESOURCE)(struct sphcs *sphcs,
 					      union h2c_ChanHwTraceAddResource *msg)
 {
-	struct sphcs_hwtrace_cmd_work *work;
+	struct sphcs_hwtrace_cmd_work work;
 	union c2h_ChanHwTraceState response_msg;
 	struct sphcs_hwtrace_data *hw_tracing = &sphcs->hw_tracing;
 	struct sphcs_cmd_chan *chan;
@@ -1309,21 +1408,17 @@ void IPC_OPCODE_HANDLER(CHAN_HWTRACE_ADD_RESOURCE)(struct sphcs *sphcs,
 		goto reply_err;
 	}
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL)) {
-		sph_log_err(HWTRACE_LOG, "unable to allocate hwtrace_cmd_work object\n");
+	work.type = SPH_HWTRACE_WORK_ADD_RESOURCE;
+	work.chan = chan;
+	work.add_resource_cmd.resource_size = msg->resource_size;
+	work.add_resource_cmd.mapID = msg->mapID;
+
+	if (unlikely(SPHCS_CHAN_DISPATCH(&chan->msgq, hwtrace_op_work_handler, &work) != 0)) {
+		sph_log_err(HWTRACE_LOG, "unable to queue hwtrace_cmd_work object\n");
 		hwtrace_err = NNP_HWTRACE_ERR_NO_MEMORY;
 		goto reply_err;
 	}
 
-	work->type = SPH_HWTRACE_WORK_ADD_RESOURCE;
-	work->chan = chan;
-	work->add_resource_cmd.resource_size = msg->resource_size;
-	work->add_resource_cmd.mapID = msg->mapID;
-
-	INIT_WORK(&work->work, hwtrace_op_work_handler);
-	queue_work(chan->wq, &work->work);
-
 	return;
 reply_err:
 	memset(response_msg.value, 0x0, sizeof(response_msg.value));
@@ -1340,7 +1435,7 @@ reply_err:
 void IPC_OPCODE_HANDLER(CHAN_HWTRACE_STATE)(struct sphcs *sphcs,
 				       union h2c_ChanHwTraceState *msg)
 {
-	struct sphcs_hwtrace_cmd_work *work;
+	struct sphcs_hwtrace_cmd_work work;
 	union c2h_ChanHwTraceState response_msg;
 	struct sphcs_cmd_chan *chan;
 
@@ -1350,20 +1445,16 @@ void IPC_OPCODE_HANDLER(CHAN_HWTRACE_STATE)(struct sphcs *sphcs,
 		return;
 	}
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL)) {
-		sph_log_err(HWTRACE_LOG, "unable to allocate hwtrace_cmd_work object\n");
+	work.chan = chan;
+	work.type = SPH_HWTRACE_WORK_STATE;
+	work.state_cmd.subOpcode = msg->subOpcode;
+	work.state_cmd.resource_index = msg->val;
+
+	if (unlikely(SPHCS_CHAN_DISPATCH(&chan->msgq, hwtrace_op_work_handler, &work) != 0)) {
+		sph_log_err(HWTRACE_LOG, "unable to queue hwtrace_cmd_work object\n");
 		goto reply_err;
 	}
 
-	work->chan = chan;
-	work->type = SPH_HWTRACE_WORK_STATE;
-	work->state_cmd.subOpcode = msg->subOpcode;
-	work->state_cmd.resource_index = msg->val;
-
-	INIT_WORK(&work->work, hwtrace_op_work_handler);
-	queue_work(chan->wq, &work->work);
-
 	return;
 reply_err:
 	memset(response_msg.value, 0x0, sizeof(response_msg.value));
@@ -1433,6 +1524,11 @@ static int debug_status_show(struct seq_file *m, void *v)
 	seq_printf(m, "number of host resources mapped to npk resource  %u\n", host_res_count);
 	seq_printf(m, "npk resources count  %u\n", dma_stream_list_count);
 	seq_printf(m, "npk nr_pool_pages %u\n", hw_tracing->nr_pool_pages);
+	seq_printf(m, "windows streamed %llu\n", hw_tracing->windows_streamed);
+	seq_printf(m, "bytes streamed %llu\n", hw_tracing->bytes_streamed);
+	seq_printf(m, "windows stalled on host %llu\n", hw_tracing->windows_stalled);
+	seq_printf(m, "windows rebound to spare host resource %llu\n", hw_tracing->windows_rebound);
+	seq_printf(m, "windows dropped %llu\n", hw_tracing->windows_dropped);
 
 	NNP_SPIN_UNLOCK_IRQRESTORE(&hw_tracing->lock_irq, flags);
 	return 0;
@@ -45,6 +45,12 @@ struct sphcs_hwtrace_data {
 	uint32_t		nr_pool_pages;
 	uint32_t		requests_in_flight;
 	uint32_t		npk_resources_ready;
+	/* streaming statistics, protected by lock_irq */
+	u64			windows_streamed;
+	u64			bytes_streamed;
+	u64			windows_stalled;
+	u64			windows_rebound;
+	u64			windows_dropped;
 	struct device		*intel_th_device;
 	struct sphcs_hwtrace_mem_pool mem_pool[SPHCS_HWTRACING_MAX_POOL_LENGTH];
 	wait_queue_head_t waitq;
@@ -15,6 +15,7 @@
 #include <linux/hashtable.h>
 #include <linux/spinlock.h>
 #include <linux/workqueue.h>
+#include <linux/completion.h>
 #include "sphcs_cs.h"
 #include "ioctl_inf.h"
 #include "sph_log.h"
@@ -33,6 +34,8 @@
 #include "safe_mem_lib.h"
 #include <linux/module.h>
 #include "inf_ptr2id.h"
+#include "sphcs_mem_acct.h"
+#include "inf_slab.h"
 
 #define PTR2ID_SLOTS_HASH_BITS 16
 static DEFINE_HASHTABLE(ptr2id_slots_hash, PTR2ID_SLOTS_HASH_BITS);
@@ -159,23 +162,6 @@ void clean_ptr2id(void)
 	NNP_SPIN_UNLOCK(&ptr2id_lock);
 }
 
-/* min system memory threshold in KB */
-static uint32_t mem_thr;
-module_param(mem_thr, uint, 0644);
-
-static inline bool check_memory_threshold(void)
-{
-	if (mem_thr) {
-		uint32_t available_ram_kb = si_mem_available() << (NNP_PAGE_SHIFT - 10);
-
-		if (available_ram_kb < mem_thr) {
-			sph_log_err(CREATE_COMMAND_LOG, "Available memory (%u KB) below the threshold (%u KB) ", available_ram_kb, mem_thr);
-			return false;
-		}
-	}
-	return true;
-}
-
 static struct cdev s_cdev;
 static dev_t       s_devnum;
 static struct class *s_class;
@@ -462,13 +448,14 @@ static void sphcs_inf_context_chan_cleanup(struct sphcs_cmd_chan *chan, void *cb
 	inf_context_put(context); // release the ref taken for this function
 }
 
-enum event_val create_context(struct sphcs *sphcs, uint16_t protocol_id, uint8_t flags, uint32_t uid, struct sphcs_cmd_chan *chan)
+enum event_val create_context(struct sphcs *sphcs, uint16_t protocol_id, uint8_t flags, uint8_t host_caps,
+			      uint32_t uid, struct sphcs_cmd_chan *chan)
 {
 	struct inf_context *context;
 	struct inf_create_context cmd_args;
 	int ret;
 
-	ret = inf_context_create(protocol_id, chan, &context);
+	ret = inf_context_create(protocol_id, host_caps, chan, &context);
 	if (unlikely(ret < 0))
 		return NNP_IPC_NO_MEMORY;
 
@@ -1203,6 +1190,22 @@ failed_infreq:
 		}
 		break;
 	}
+	case IOCTL_INF_SET_RUNTIME_CAPS: {
+		uint32_t caps;
+
+		ret = copy_from_user(&caps,
+				     (void __user *)arg,
+				     sizeof(uint32_t));
+		if (unlikely(ret != 0))
+			return -EIO;
+
+		if (unlikely(!is_inf_context_ptr(f->private_data)))
+			return -EINVAL;
+
+		context = (struct inf_context *)f->private_data;
+		context->runtime_caps = caps;
+		break;
+	}
 	case IOCTL_INF_GET_ALLOC_PGT:
 		return handle_get_alloc_pgt((void __user *)arg);
 	default:
@@ -1261,16 +1264,13 @@ static ssize_t sphcs_inf_read(struct file *f,
 }
 
 struct context_op_work {
-	struct work_struct           work;
 	union h2c_ChanInferenceContextOp cmd;
 	struct sphcs_cmd_chan       *chan;
 };
 
-static void context_op_work_handler(struct work_struct *work)
+static void context_op_work_handler(void *payload)
 {
-	struct context_op_work *op = container_of(work,
-						  struct context_op_work,
-						  work);
+	struct context_op_work *op = payload;
 	struct sphcs *sphcs = g_the_sphcs;
 	struct inf_context *context;
 	uint8_t event;
@@ -1278,7 +1278,7 @@ static void context_op_work_handler(struct work_struct *work)
 	int ret;
 
 	if (!op->cmd.recover && !op->cmd.destroy)
-		if (!check_memory_threshold()) {
+		if (!sphcs_mem_acct_check_system()) {
 			event = NNP_IPC_CREATE_CONTEXT_FAILED;
 			val = NNP_IPC_NO_MEMORY;
 			goto send_error;
@@ -1318,7 +1318,8 @@ static void context_op_work_handler(struct work_struct *work)
 
 			DO_TRACE(trace_infer_create(SPH_TRACE_INF_CONTEXT, op->cmd.chan_id, op->cmd.chan_id, SPH_TRACE_OP_STATUS_START, -1, -1));
 
-			val = create_context(sphcs, op->cmd.chan_id, op->cmd.cflags, op->chan->uid, op->chan);
+			val = create_context(sphcs, op->cmd.chan_id, op->cmd.cflags,
+					     op->cmd.host_caps, op->chan->uid, op->chan);
 			if (unlikely(val != 0)) {
 				event = NNP_IPC_CREATE_CONTEXT_FAILED;
 				goto send_error;
@@ -1326,55 +1327,48 @@ static void context_op_work_handler(struct work_struct *work)
 		}
 	}
 
-	goto done;
+	return;
 
 send_error:
 	sphcs_send_event_report(sphcs, event, val, op->chan->respq, op->cmd.chan_id, -1);
 	sphcs_cmd_chan_put(op->chan);
-done:
-	kfree(op);
 }
 
 void IPC_OPCODE_HANDLER(CHAN_INF_CONTEXT)(struct sphcs *sphcs,
 					  union h2c_ChanInferenceContextOp *cmd)
 {
-	struct context_op_work *work;
+	struct context_op_work work;
 	uint8_t event;
 	struct sphcs_cmd_chan *chan;
 
 	chan = sphcs_find_channel(sphcs, cmd->chan_id);
+	if (likely(chan != NULL)) {
+		work.cmd.value = cmd->value;
+		work.chan = chan;
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL || chan == NULL)) {
-		if (cmd->recover)
-			event = NNP_IPC_RECOVER_CONTEXT_FAILED;
-		else if (cmd->destroy)
-			event = NNP_IPC_DESTROY_CONTEXT_FAILED;
-		else
-			event = NNP_IPC_CREATE_CONTEXT_FAILED;
-
-		sphcs_send_event_report(sphcs,
-					event,
-					NNP_IPC_NO_MEMORY,
-					chan != NULL ? chan->respq : NULL,
-					cmd->chan_id,
-					-1);
+		DO_TRACE_IF(!cmd->destroy && !cmd->recover, trace_infer_create(SPH_TRACE_INF_CONTEXT,
+				cmd->chan_id, cmd->chan_id, SPH_TRACE_OP_STATUS_QUEUED, -1, -1));
 
-		if (chan != NULL)
-			sphcs_cmd_chan_put(chan);
-		if (work != NULL)
-			kfree(work);
-		return;
+		if (likely(SPHCS_CHAN_DISPATCH(&chan->msgq, context_op_work_handler, &work) == 0))
+			return;
 	}
 
-	work->cmd.value = cmd->value;
-	work->chan = chan;
-	INIT_WORK(&work->work, context_op_work_handler);
+	if (cmd->recover)
+		event = NNP_IPC_RECOVER_CONTEXT_FAILED;
+	else if (cmd->destroy)
+		event = NNP_IPC_DESTROY_CONTEXT_FAILED;
+	else
+		event = NNP_IPC_CREATE_CONTEXT_FAILED;
 
-	DO_TRACE_IF(!cmd->destroy && !cmd->recover, trace_infer_create(SPH_TRACE_INF_CONTEXT,
-			cmd->chan_id, cmd->chan_id, SPH_TRACE_OP_STATUS_QUEUED, -1, -1));
+	sphcs_send_event_report(sphcs,
+				event,
+				NNP_IPC_NO_MEMORY,
+				chan != NULL ? chan->respq : NULL,
+				cmd->chan_id,
+				-1);
 
-	queue_work(chan->wq, &work->work);
+	if (chan != NULL)
+		sphcs_cmd_chan_put(chan);
 }
 
 void IPC_OPCODE_HANDLER(CHAN_SYNC)(struct sphcs   *sphcs,
@@ -1405,24 +1399,52 @@ void IPC_OPCODE_HANDLER(CHAN_SYNC)(struct sphcs   *sphcs,
 }
 
 struct resource_op_work {
-	struct work_struct           work;
 	struct inf_context          *context;
 	union h2c_ChanInferenceResourceOp cmd;
 };
 
-static void resource_op_work_handler(struct work_struct *work)
+static enum event_val create_devres(struct inf_context *context,
+				    uint16_t            resID,
+				    uint64_t            size,
+				    uint8_t             depth,
+				    uint64_t            align,
+				    uint32_t            usage_flags)
 {
-	struct resource_op_work *op = container_of(work,
-						   struct resource_op_work,
-						   work);
 	struct inf_devres *devres;
+	int ret;
+
+	if (unlikely(context->destroyed != 0))
+		return NNP_IPC_NO_SUCH_CONTEXT;
+
+	devres = inf_context_find_devres(context, resID);
+	if (unlikely(devres != NULL))
+		return NNP_IPC_ALREADY_EXIST;
+
+	DO_TRACE(trace_infer_create(SPH_TRACE_INF_DEVRES, context->chan->protocol_id, resID, SPH_TRACE_OP_STATUS_START, -1, -1));
+
+	ret = inf_context_create_devres(context,
+					resID,
+					size,
+					depth,
+					align,
+					usage_flags,
+					&devres);
+	if (unlikely(ret < 0))
+		return NNP_IPC_NO_MEMORY;
+
+	return NNP_IPC_NO_ERROR;
+}
+
+static void resource_op_work_handler(void *payload)
+{
+	struct resource_op_work *op = payload;
 	uint8_t event;
 	enum event_val val = NNP_IPC_NO_ERROR;
 	uint32_t usage_flags;
 	int ret;
 
 	if (!op->cmd.destroy)
-		if (!check_memory_threshold()) {
+		if (!sphcs_mem_acct_check_system()) {
 			event = NNP_IPC_CREATE_DEVRES_FAILED;
 			val = NNP_IPC_NO_MEMORY;
 			goto send_error;
@@ -1437,18 +1459,6 @@ static void resource_op_work_handler(struct work_struct *work)
 		}
 	} else {
 		event = NNP_IPC_CREATE_DEVRES_FAILED;
-		if (unlikely(op->context->destroyed != 0)) {
-			val = NNP_IPC_NO_SUCH_CONTEXT;
-			goto send_error;
-		}
-		devres = inf_context_find_devres(op->context, op->cmd.resID);
-		if (unlikely(devres != NULL)) {
-			val = NNP_IPC_ALREADY_EXIST;
-			goto send_error;
-		}
-
-		DO_TRACE(trace_infer_create(SPH_TRACE_INF_DEVRES, op->cmd.chan_id, op->cmd.resID, SPH_TRACE_OP_STATUS_START, -1, -1));
-
 		usage_flags = 0;
 		if (op->cmd.is_input || op->cmd.is_network)
 			usage_flags |= IOCTL_INF_RES_INPUT;
@@ -1465,17 +1475,14 @@ static void resource_op_work_handler(struct work_struct *work)
 		if (op->cmd.is_p2p_src)
 			usage_flags |= IOCTL_INF_RES_P2P_SRC;
 
-		ret = inf_context_create_devres(op->context,
-						op->cmd.resID,
-						op->cmd.size,
-						op->cmd.depth,
-						op->cmd.align << NNP_PAGE_SHIFT,
-						usage_flags,
-						&devres);
-		if (unlikely(ret < 0)) {
-			val = NNP_IPC_NO_MEMORY;
+		val = create_devres(op->context,
+				    op->cmd.resID,
+				    op->cmd.size,
+				    op->cmd.depth,
+				    op->cmd.align << NNP_PAGE_SHIFT,
+				    usage_flags);
+		if (unlikely(val != NNP_IPC_NO_ERROR))
 			goto send_error;
-		}
 	}
 
 	goto done;
@@ -1485,13 +1492,12 @@ send_error:
 
 done:
 	inf_context_put(op->context);
-	kfree(op);
 }
 
 void IPC_OPCODE_HANDLER(CHAN_INF_RESOURCE)(struct sphcs                  *sphcs,
 					   union h2c_ChanInferenceResourceOp     *cmd)
 {
-	struct resource_op_work *work;
+	struct resource_op_work work;
 	struct inf_context *context;
 	uint8_t event;
 	enum event_val val;
@@ -1512,20 +1518,16 @@ void IPC_OPCODE_HANDLER(CHAN_INF_RESOURCE)(struct sphcs                  *sphcs,
 		goto send_error;
 	}
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL)) {
-		val = NNP_IPC_NO_MEMORY;
-		goto send_error;
-	}
-
-	work->cmd.value[0] = cmd->value[0];
-	work->cmd.value[1] = cmd->value[1];
-	work->context = context;
-	INIT_WORK(&work->work, resource_op_work_handler);
+	work.cmd.value[0] = cmd->value[0];
+	work.cmd.value[1] = cmd->value[1];
+	work.context = context;
 
 	DO_TRACE_IF(!cmd->destroy, trace_infer_create(SPH_TRACE_INF_DEVRES, cmd->chan_id, cmd->resID, SPH_TRACE_OP_STATUS_QUEUED, -1, -1));
 
-	queue_work(context->chan->wq, &work->work);
+	if (unlikely(SPHCS_CHAN_DISPATCH(&context->chan->msgq, resource_op_work_handler, &work) != 0)) {
+		val = NNP_IPC_NO_MEMORY;
+		goto send_error;
+	}
 
 	return;
 
@@ -1538,18 +1540,215 @@ send_error:
 	}
 }
 
+struct resource_batch_work {
+	struct inf_context          *context;
+	union h2c_ChanInferenceResourceBatch cmd;
+};
+
+struct resource_batch_dma_data {
+	struct completion done;
+	int status;
+};
+
+static uint32_t devres_desc_usage_flags(const struct ipc_devres_desc *desc)
+{
+	uint32_t usage_flags = 0;
+
+	if (desc->flags & (NNP_DEVRES_DESC_INPUT | NNP_DEVRES_DESC_NETWORK))
+		usage_flags |= IOCTL_INF_RES_INPUT;
+	if (desc->flags & NNP_DEVRES_DESC_OUTPUT)
+		usage_flags |= IOCTL_INF_RES_OUTPUT;
+	if (desc->flags & NNP_DEVRES_DESC_NETWORK)
+		usage_flags |= IOCTL_INF_RES_NETWORK;
+	if (desc->flags & NNP_DEVRES_DESC_FORCE_4G)
+		usage_flags |= IOCTL_INF_RES_FORCE_4G_ALLOC;
+	if (desc->flags & NNP_DEVRES_DESC_ECC)
+		usage_flags |= IOCTL_INF_RES_ECC;
+	if (desc->flags & NNP_DEVRES_DESC_P2P_DST)
+		usage_flags |= IOCTL_INF_RES_P2P_DST;
+	if (desc->flags & NNP_DEVRES_DESC_P2P_SRC)
+		usage_flags |= IOCTL_INF_RES_P2P_SRC;
+
+	return usage_flags;
+}
+
+static int resource_batch_dma_complete(struct sphcs *sphcs,
+				       void *ctx,
+				       const void *user_data,
+				       int status,
+				       u32 xferTimeUS)
+{
+	struct resource_batch_dma_data *data = (struct resource_batch_dma_data *)ctx;
+
+	data->status = status;
+	complete(&data->done);
+
+	return 0;
+}
+
+/*
+ * DMAs the descriptors page of a batch and creates its device resources.
+ * The message queue is held until the resources are created, as later
+ * commands of the channel may refer to them. Each devres gets the same
+ * create reply as if it was created by CHAN_INF_RESOURCE.
+ */
+static void resource_batch_work_handler(void *payload)
+{
+	struct resource_batch_work *op = payload;
+	struct inf_context *context = op->context;
+	struct sphcs_host_rb *cmd_data_rb = &context->chan->h2c_rb[op->cmd.rb_id];
+	struct resource_batch_dma_data dma_data;
+	struct ipc_devres_desc *desc;
+	page_handle dma_page_hndl;
+	dma_addr_t host_dma_addr;
+	dma_addr_t dma_addr;
+	u32 host_chunk_size;
+	uint32_t num_res = op->cmd.num_res + 1;
+	enum event_val val;
+	void *vptr;
+	uint32_t i;
+	int n;
+	int ret;
+
+	/* need to advance h2c ring buffer by one page */
+	host_rb_update_free_space(cmd_data_rb, NNP_PAGE_SIZE);
+	n = host_rb_get_avail_space(cmd_data_rb,
+				    NNP_PAGE_SIZE,
+				    1,
+				    &host_dma_addr,
+				    &host_chunk_size);
+
+	NNP_ASSERT(n == 1);
+	NNP_ASSERT((host_dma_addr & NNP_IPC_DMA_ADDR_ALIGN_MASK) == 0);
+	if (unlikely(n != 1 || (host_dma_addr & NNP_IPC_DMA_ADDR_ALIGN_MASK) != 0)) {
+		val = NNP_IPC_DMA_ERROR;
+		goto send_error;
+	}
+
+	host_rb_update_avail_space(cmd_data_rb, NNP_PAGE_SIZE);
+
+	if (!sphcs_mem_acct_check_system()) {
+		val = NNP_IPC_NO_MEMORY;
+		goto send_error;
+	}
+
+	if (unlikely(context->destroyed != 0)) {
+		val = NNP_IPC_NO_SUCH_CONTEXT;
+		goto send_error;
+	}
+
+	ret = dma_page_pool_get_free_page(g_the_sphcs->dma_page_pool,
+					  &dma_page_hndl,
+					  &vptr,
+					  &dma_addr);
+	if (unlikely(ret < 0)) {
+		val = NNP_IPC_NO_MEMORY;
+		goto send_error;
+	}
+
+	init_completion(&dma_data.done);
+
+	ret = sphcs_dma_sched_start_xfer_single(g_the_sphcs->dmaSched,
+						&context->chan->h2c_dma_desc,
+						host_dma_addr,
+						dma_addr,
+						num_res * sizeof(struct ipc_devres_desc),
+						resource_batch_dma_complete,
+						&dma_data,
+						NULL,
+						0);
+	if (unlikely(ret < 0)) {
+		val = NNP_IPC_NO_MEMORY;
+		goto free_page;
+	}
+
+	wait_for_completion(&dma_data.done);
+
+	sphcs_cmd_chan_update_cmd_head(context->chan, op->cmd.rb_id, NNP_PAGE_SIZE);
+
+	if (unlikely(dma_data.status == SPHCS_DMA_STATUS_FAILED)) {
+		/* no object id - the whole batch failed */
+		sphcs_send_event_report(g_the_sphcs, NNP_IPC_CREATE_DEVRES_FAILED, NNP_IPC_DMA_ERROR,
+					context->chan->respq, op->cmd.chan_id, -1);
+		goto done;
+	}
+
+	desc = (struct ipc_devres_desc *)vptr;
+	for (i = 0; i < num_res; i++, desc++) {
+		val = create_devres(context,
+				    desc->resID,
+				    desc->size,
+				    desc->depth,
+				    (uint64_t)desc->align << NNP_PAGE_SHIFT,
+				    devres_desc_usage_flags(desc));
+		if (unlikely(val != NNP_IPC_NO_ERROR))
+			sphcs_send_event_report(g_the_sphcs, NNP_IPC_CREATE_DEVRES_FAILED, val,
+						context->chan->respq, op->cmd.chan_id, desc->resID);
+	}
+
+done:
+	dma_page_pool_set_page_free(g_the_sphcs->dma_page_pool, dma_page_hndl);
+	inf_context_put(context);
+	return;
+
+free_page:
+	dma_page_pool_set_page_free(g_the_sphcs->dma_page_pool, dma_page_hndl);
+send_error:
+	sphcs_cmd_chan_update_cmd_head(context->chan, op->cmd.rb_id, NNP_PAGE_SIZE);
+	/* no object id - the whole batch failed */
+	sphcs_send_event_report(g_the_sphcs, NNP_IPC_CREATE_DEVRES_FAILED, val,
+				context->chan->respq, op->cmd.chan_id, -1);
+	inf_context_put(context);
+}
+
+/* NNP_IPC_H2C_OP_CHAN_INF_RESOURCE_BATCH */
+void IPC_OPCODE_HANDLER(CHAN_INF_RESOURCE_BATCH)(struct sphcs                         *sphcs,
+						 union h2c_ChanInferenceResourceBatch *cmd)
+{
+	struct resource_batch_work work;
+	struct inf_context *context;
+	enum event_val val;
+
+	context = find_and_get_context(sphcs->inf_data, cmd->chan_id);
+	if (unlikely(context == NULL)) {
+		val = NNP_IPC_NO_SUCH_CONTEXT;
+		goto send_error;
+	}
+
+	if (unlikely(context->chan == NULL || context->chan->protocol_id != cmd->chan_id)) {
+		val = NNP_IPC_NO_SUCH_CONTEXT;
+		goto send_error;
+	}
+
+	work.cmd.value = cmd->value;
+	work.context = context;
+
+	if (unlikely(SPHCS_CHAN_DISPATCH(&context->chan->msgq, resource_batch_work_handler, &work) != 0)) {
+		val = NNP_IPC_NO_MEMORY;
+		goto send_error;
+	}
+
+	return;
+
+send_error:
+	if (context != NULL && context->chan != NULL) {
+		if (val == NNP_IPC_NO_MEMORY) // the descriptors page will not be read
+			sphcs_cmd_chan_update_cmd_head(context->chan, cmd->rb_id, NNP_PAGE_SIZE);
+		sphcs_send_event_report(sphcs, NNP_IPC_CREATE_DEVRES_FAILED, val, context->chan->respq, cmd->chan_id, -1);
+		inf_context_put(context);
+	} else {
+		sphcs_send_event_report(sphcs, NNP_IPC_CREATE_DEVRES_FAILED, val, NULL, cmd->chan_id, -1);
+	}
+}
 
 struct mark_resource_work {
-	struct work_struct work;
 	struct inf_context *context;
 	union h2c_ChanMarkInferenceResource cmd;
 };
 
-static void mark_resource_work_handler(struct work_struct *work)
+static void mark_resource_work_handler(void *payload)
 {
-	struct mark_resource_work *op = container_of(work,
-						   struct mark_resource_work,
-						   work);
+	struct mark_resource_work *op = payload;
 	struct inf_devres *devres;
 	unsigned long flags;
 
@@ -1578,13 +1777,12 @@ put_devres:
 	inf_devres_put(devres);
 put_ctx:
 	inf_context_put(op->context);
-	kfree(op);
 }
 
 /* NNP_IPC_H2C_OP_CHAN_MARK_INF_RESOURCE */
 void IPC_OPCODE_HANDLER(CHAN_MARK_INF_RESOURCE)(struct sphcs *sphcs, union h2c_ChanMarkInferenceResource *cmd)
 {
-	struct mark_resource_work *work;
+	struct mark_resource_work work;
 	struct inf_context *context;
 
 	context = find_and_get_context(sphcs->inf_data, cmd->chan_id);
@@ -1598,16 +1796,12 @@ void IPC_OPCODE_HANDLER(CHAN_MARK_INF_RESOURCE)(struct sphcs *sphcs, union h2c_C
 		return;
 	}
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL)) {
+	work.cmd.value = cmd->value;
+	work.context = context;
+	if (unlikely(SPHCS_CHAN_DISPATCH(&context->chan->msgq, mark_resource_work_handler, &work) != 0)) {
 		sph_log_err(GENERAL_LOG, "Couldn't allocate memory\n");
-		return;
+		inf_context_put(context);
 	}
-
-	work->cmd.value = cmd->value;
-	work->context = context;
-	INIT_WORK(&work->work, mark_resource_work_handler);
-	queue_work(context->chan->wq, &work->work);
 }
 void IPC_OPCODE_HANDLER(CHAN_TRACE_USER_DATA)(struct sphcs                *sphcs,
 					      union h2c_ChanTraceUserData *cmd)
@@ -1703,7 +1897,6 @@ do {					\
 } while (false)
 
 struct cmdlist_op_work {
-	struct work_struct           work;
 	struct inf_context          *context;
 	union h2c_ChanInferenceCmdListOp cmd;
 };
@@ -1941,11 +2134,9 @@ done:
 	return ret;
 }
 
-static void cmdlist_op_work_handler(struct work_struct *work)
+static void cmdlist_op_work_handler(void *payload)
 {
-	struct cmdlist_op_work *op = container_of(work,
-						  struct cmdlist_op_work,
-						  work);
+	struct cmdlist_op_work *op = payload;
 	struct inf_cmd_list *cmd;
 	uint8_t event;
 	enum event_val val;
@@ -2073,14 +2264,13 @@ send_error:
 	sphcs_send_event_report(g_the_sphcs, event, val, op->context->chan->respq, op->cmd.chan_id, op->cmd.cmdID);
 done:
 	inf_context_put(op->context);
-	kfree(op);
 }
 
 /* NNP_IPC_H2C_OP_CHAN_INF_CMDLIST */
 void IPC_OPCODE_HANDLER(CHAN_INF_CMDLIST)(struct sphcs                      *sphcs,
 					  union h2c_ChanInferenceCmdListOp  *cmd)
 {
-	struct cmdlist_op_work *work;
+	struct cmdlist_op_work work;
 	struct inf_context *context;
 	uint8_t event;
 	enum event_val val;
@@ -2096,19 +2286,15 @@ void IPC_OPCODE_HANDLER(CHAN_INF_CMDLIST)(struct sphcs                      *sph
 		goto send_error;
 	}
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL)) {
-		val = NNP_IPC_NO_MEMORY;
-		goto send_error;
-	}
-
-	work->cmd.value = cmd->value;
-	work->context = context;
-	INIT_WORK(&work->work, cmdlist_op_work_handler);
+	work.cmd.value = cmd->value;
+	work.context = context;
 
 	DO_TRACE_IF(!cmd->destroy, trace_infer_create(SPH_TRACE_INF_COMMAND_LIST, cmd->chan_id, cmd->cmdID, SPH_TRACE_OP_STATUS_QUEUED, -1, -1));
 
-	queue_work(context->chan->wq, &work->work);
+	if (unlikely(SPHCS_CHAN_DISPATCH(&context->chan->msgq, cmdlist_op_work_handler, &work) != 0)) {
+		val = NNP_IPC_NO_MEMORY;
+		goto send_error;
+	}
 
 	return;
 
@@ -2122,13 +2308,11 @@ send_error:
 }
 
 struct network_op_work {
-	struct work_struct work;
 	struct inf_context *context;
 	union h2c_ChanInferenceNetworkOp cmd;
 };
 
 struct subres_op_work {
-	struct work_struct work;
 	struct sphcs *sphcs;
 	struct inf_context *context;
 	union h2c_ChanInferenceSchedCopySubres cmd;
@@ -2286,12 +2470,9 @@ done_curr_packet:
 	return ret;
 }
 
-static void network_op_work_handler(struct work_struct *work)
+static void network_op_work_handler(void *payload)
 {
-	struct network_op_work
-	*op = container_of(work,
-			struct network_op_work,
-			work);
+	struct network_op_work *op = payload;
 	struct network_dma_data *dma_data;
 	struct inf_devnet *devnet;
 	uint16_t config_data_size;
@@ -2330,7 +2511,7 @@ static void network_op_work_handler(struct work_struct *work)
 
 		host_rb_update_avail_space(cmd_data_rb, NNP_PAGE_SIZE);
 
-		if (!check_memory_threshold()) {
+		if (!sphcs_mem_acct_check_system()) {
 			event = NNP_IPC_CREATE_DEVNET_FAILED;
 			val = NNP_IPC_NO_MEMORY;
 			goto send_error;
@@ -2475,12 +2656,11 @@ send_error:
 				op->context->chan->protocol_id, op->cmd.netID);
 done:
 	inf_context_put(op->context);
-	kfree(op);
 }
 
 void IPC_OPCODE_HANDLER(CHAN_INF_NETWORK)(struct sphcs *sphcs, union h2c_ChanInferenceNetworkOp *cmd)
 {
-	struct network_op_work *work;
+	struct network_op_work work;
 	struct inf_context *context;
 	uint8_t event;
 	enum event_val val;
@@ -2498,20 +2678,16 @@ void IPC_OPCODE_HANDLER(CHAN_INF_NETWORK)(struct sphcs *sphcs, union h2c_ChanInf
 		goto send_error;
 	}
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL)) {
-		val = NNP_IPC_NO_MEMORY;
-		goto send_error;
-	}
-
-	work->cmd.value[0] = cmd->value[0];
-	work->cmd.value[1] = cmd->value[1];
-	work->context = context;
-	INIT_WORK(&work->work, network_op_work_handler);
+	work.cmd.value[0] = cmd->value[0];
+	work.cmd.value[1] = cmd->value[1];
+	work.context = context;
 
 	DO_TRACE_IF(!cmd->destroy, trace_infer_create(SPH_TRACE_INF_NETWORK, cmd->chan_id, cmd->netID, SPH_TRACE_OP_STATUS_QUEUED, -1, -1));
 
-	queue_work(context->chan->wq, &work->work);
+	if (unlikely(SPHCS_CHAN_DISPATCH(&context->chan->msgq, network_op_work_handler, &work) != 0)) {
+		val = NNP_IPC_NO_MEMORY;
+		goto send_error;
+	}
 
 	return;
 
@@ -2525,16 +2701,13 @@ send_error:
 }
 
 struct copy_op_work {
-	struct work_struct           work;
 	struct inf_context          *context;
 	union h2c_ChanInferenceCopyOp    cmd;
 };
 
-static void copy_op_work_handler(struct work_struct *work)
+static void copy_op_work_handler(void *payload)
 {
-	struct copy_op_work *op = container_of(work,
-					       struct copy_op_work,
-					       work);
+	struct copy_op_work *op = payload;
 	struct inf_devres *devres;
 	struct inf_copy *copy;
 	uint8_t event;
@@ -2542,7 +2715,7 @@ static void copy_op_work_handler(struct work_struct *work)
 	int ret;
 
 	if (!op->cmd.destroy)
-		if (!check_memory_threshold()) {
+		if (!sphcs_mem_acct_check_system()) {
 			event = NNP_IPC_CREATE_COPY_FAILED;
 			val = NNP_IPC_NO_MEMORY;
 			goto send_error;
@@ -2616,13 +2789,12 @@ send_error:
 	sphcs_send_event_report(g_the_sphcs, event, val, op->context->chan->respq, op->cmd.chan_id, op->cmd.protCopyID);
 done:
 	inf_context_put(op->context);
-	kfree(op);
 }
 
 void IPC_OPCODE_HANDLER(CHAN_COPY_OP)(struct sphcs                  *sphcs,
 				      union h2c_ChanInferenceCopyOp *cmd)
 {
-	struct copy_op_work *work;
+	struct copy_op_work work;
 	struct inf_context *context;
 	uint8_t event;
 	enum event_val val;
@@ -2643,16 +2815,9 @@ void IPC_OPCODE_HANDLER(CHAN_COPY_OP)(struct sphcs                  *sphcs,
 		goto send_error;
 	}
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL)) {
-		val = NNP_IPC_NO_MEMORY;
-		goto send_error;
-	}
-
-	work->cmd.value[0] = cmd->value[0];
-	work->cmd.value[1] = cmd->value[1];
-	work->context = context;
-	INIT_WORK(&work->work, copy_op_work_handler);
+	work.cmd.value[0] = cmd->value[0];
+	work.cmd.value[1] = cmd->value[1];
+	work.context = context;
 
 	DO_TRACE_IF(!cmd->subres_copy && !cmd->destroy,
 			trace_copy_create(cmd->c2h,
@@ -2666,7 +2831,10 @@ void IPC_OPCODE_HANDLER(CHAN_COPY_OP)(struct sphcs                  *sphcs,
 					cmd->peerChanID,
 					cmd->peerDevID));
 
-	queue_work(context->chan->wq, &work->work);
+	if (unlikely(SPHCS_CHAN_DISPATCH(&context->chan->msgq, copy_op_work_handler, &work) != 0)) {
+		val = NNP_IPC_NO_MEMORY;
+		goto send_error;
+	}
 
 	return;
 
@@ -2698,7 +2866,6 @@ static void send_exec_error_cmd_error(union h2c_ExecErrorList   *cmd,
 }
 
 struct error_list_work {
-	struct work_struct           work;
 	struct inf_context          *context;
 	union h2c_ExecErrorList      cmd;
 	struct inf_cmd_list         *cmdlist;
@@ -2746,11 +2913,35 @@ static int error_list_dma_completed(struct sphcs *sphcs, void *ctx, const void *
 	if (op->cmdlist != NULL)
 		inf_cmd_put(op->cmdlist);
 	inf_context_put(op->context);
+	kfree(op->err_buffer);
 	kfree(op);
 
 	return 0;
 }
 
+/* Sends an error list which fits in a mailbox slot without DMA */
+static int error_list_send_inline(struct error_list_work *op)
+{
+	union c2h_ExecErrorList reply;
+	int ret;
+
+	ret = sphcs_cmd_chan_mbox_write(op->context->chan, op->err_buffer, op->err_buffer_size);
+	if (ret != 0)
+		return ret;
+
+	reply.value = 0;
+	reply.opcode = NNP_IPC_C2H_OP_CHAN_EXEC_ERROR_LIST_MBOX;
+	reply.chan_id = op->cmd.chan_id;
+	reply.cmdID = op->cmd.cmdID;
+	reply.cmdID_valid = op->cmd.cmdID_valid;
+	reply.pkt_size = (op->err_buffer_size - 1);
+	reply.total_size = op->err_buffer_size;
+
+	sphcs_msg_scheduler_queue_add_msg(g_the_sphcs->public_respq, &reply.value, 1);
+
+	return 0;
+}
+
 static int error_list_send_next_packet(struct error_list_work *op)
 {
 	dma_addr_t host_dma_page_addr;
@@ -2804,11 +2995,9 @@ send_error:
 	return -1;
 }
 
-static void error_list_work_handler(struct work_struct *work)
+static void error_list_work_handler(void *payload)
 {
-	struct error_list_work *op = container_of(work,
-						  struct error_list_work,
-						  work);
+	struct error_list_work *op = *(struct error_list_work **)payload;
 	enum event_val err_val;
 	int ret;
 
@@ -2875,6 +3064,9 @@ static void error_list_work_handler(struct work_struct *work)
 		goto send_error;
 	}
 
+	if (error_list_send_inline(op) == 0)
+		goto done;
+
 	ret = dma_page_pool_get_free_page(g_the_sphcs->dma_page_pool,
 					  &op->dma_page_hndl,
 					  &op->dma_page_vptr,
@@ -2900,6 +3092,7 @@ done:
 	if (op->cmdlist != NULL)
 		inf_cmd_put(op->cmdlist);
 	inf_context_put(op->context);
+	kfree(op->err_buffer);
 	kfree(op);
 }
 
@@ -2931,8 +3124,12 @@ void IPC_OPCODE_HANDLER(CHAN_EXEC_ERROR_LIST)(struct sphcs              *sphcs,
 
 	work->cmd.value = cmd->value;
 	work->context = context;
-	INIT_WORK(&work->work, error_list_work_handler);
-	queue_work(context->chan->wq, &work->work);
+	if (unlikely(SPHCS_CHAN_DISPATCH(&context->chan->msgq, error_list_work_handler, &work) != 0)) {
+		kfree(work);
+		inf_context_put(context);
+		error_val = NNP_IPC_NO_MEMORY;
+		goto send_error;
+	}
 
 	return;
 
@@ -3064,11 +3261,9 @@ send_error:
 	}
 }
 
-static void copy_subres_op_work_handler(struct work_struct *work)
+static void copy_subres_op_work_handler(void *payload)
 {
-	struct subres_op_work *op = container_of(work,
-			struct subres_op_work,
-			work);
+	struct subres_op_work *op = payload;
 	struct inf_copy *copy;
 	struct inf_exec_req *req;
 	enum event_val val;
@@ -3112,8 +3307,6 @@ static void copy_subres_op_work_handler(struct work_struct *work)
 	inf_copy_put(copy);
 	inf_context_put(op->context);
 
-	kfree(op);
-
 	return;
 
 put_copy:
@@ -3122,15 +3315,13 @@ put_ctx:
 
 	sphcs_send_event_report(op->sphcs, NNP_IPC_EXECUTE_COPY_SUBRES_FAILED, val, op->context->chan->respq, op->cmd.chan_id, op->cmd.protCopyID);
 	inf_context_put(op->context);
-
-	kfree(op);
 }
 
 /* NNP_IPC_H2C_OP_CHAN_SCHEDULE_COPY_SUBRES */
 void IPC_OPCODE_HANDLER(CHAN_SCHEDULE_COPY_SUBRES)(struct sphcs                 *sphcs,
 						   union h2c_ChanInferenceSchedCopySubres *cmd)
 {
-	struct subres_op_work *work;
+	struct subres_op_work work;
 	enum event_val val;
 	struct inf_context *context;
 
@@ -3150,19 +3341,15 @@ void IPC_OPCODE_HANDLER(CHAN_SCHEDULE_COPY_SUBRES)(struct sphcs
 		goto send_error;
 	}
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL)) {
+	work.sphcs = sphcs;
+	work.context = context;
+	memcpy(work.cmd.value, cmd->value, sizeof(cmd->value));
+
+	if (unlikely(SPHCS_CHAN_DISPATCH(&context->chan->msgq, copy_subres_op_work_handler, &work) != 0)) {
 		val = NNP_IPC_NO_MEMORY;
 		goto send_error;
 	}
 
-	work->sphcs = sphcs;
-	work->context = context;
-	memcpy(work->cmd.value, cmd->value, sizeof(cmd->value));
-
-	INIT_WORK(&work->work, copy_subres_op_work_handler);
-	queue_work(context->chan->wq, &work->work);
-
 	return;
 
 send_error:
@@ -3209,12 +3396,13 @@ struct cmdlist_sched_dma_data {
 	uint16_t data_size;
 	page_handle dma_page_hndl;
 	bool is_last;
+	bool inline_data; /* vptr points to a copy of a mailbox slot */
 };
 
 struct cmdlst_op_work {
-	struct work_struct work;
 	struct inf_cmd_list *cmd;
 	dma_addr_t host_dma_addr;
+	u8 mbox_slot;
 	struct cmdlist_sched_dma_data dma_data;
 };
 
@@ -3337,22 +3525,15 @@ static int cmdlist_schedule_dma_complete(struct sphcs *sphcs,
 	uint16_t sched_dma_size;
 	enum event_val val;
 	struct cmdlist_sched_dma_data *data;
-	struct cmdlst_op_work *op;
 	int ret = 0;
 
-	if (ctx == NULL) { //from opwork
-		op = *((struct cmdlst_op_work **)user_data);
-		cmd = op->cmd;
-		data = &op->dma_data;
-	} else { // from bottom half
-		op = NULL;
-		cmd = (struct inf_cmd_list *)ctx;
-		data = (struct cmdlist_sched_dma_data *)user_data;
-	}
+	cmd = (struct inf_cmd_list *)ctx;
+	data = (struct cmdlist_sched_dma_data *)user_data;
 	p = data->vptr;
 	sched_dma_size = data->data_size;
 
-	sphcs_cmd_chan_update_cmd_head(cmd->context->chan, 1, PAGE_SIZE);
+	if (!data->inline_data)
+		sphcs_cmd_chan_update_cmd_head(cmd->context->chan, 1, PAGE_SIZE);
 
 	if (unlikely(status == SPHCS_DMA_STATUS_FAILED)) {
 		val = NNP_IPC_DMA_ERROR;
@@ -3442,14 +3623,9 @@ static int cmdlist_schedule_dma_complete(struct sphcs *sphcs,
 	handle_sched_cmdlist(cmd, cmd->edits, cmd->edits_idx);
 
 finish:
-	// put kref for DMA
-	inf_cmd_put(cmd);
-
-	if (op != NULL) // from opwork
-		kfree(op);
-
-	dma_page_pool_set_page_free(g_the_sphcs->dma_page_pool,
-				    data->dma_page_hndl);
+	if (!data->inline_data)
+		dma_page_pool_set_page_free(g_the_sphcs->dma_page_pool,
+					    data->dma_page_hndl);
 
 	if (unlikely(ret < 0)) {
 		cmd->edits_idx = 0;
@@ -3457,14 +3633,55 @@ finish:
 		cmdlst_send_fail_reports(cmd, val, data->is_last, 0);
 	}
 
+	if (!data->inline_data && atomic_dec_and_test(&cmd->sched_dma_inflight))
+		wake_up_all(&cmd->sched_dma_waitq);
+
+	// put kref for DMA
+	inf_cmd_put(cmd);
+
 	return ret;
 }
 
-static void cmd_sched_op_work_handler(struct work_struct *work)
+/*
+ * Schedule data which host wrote to the channel mailbox is copied by the
+ * CPU and handled as if its DMA has just completed.
+ * Called only when no earlier packet of the command list is in DMA.
+ */
+static int cmdlist_schedule_inline(struct inf_cmd_list           *cmd,
+				   u8                             slot,
+				   struct cmdlist_sched_dma_data *data)
+{
+	u8 buf[NNP_CHAN_MBOX_SLOT_SIZE];
+	int ret;
+
+	ret = sphcs_cmd_chan_mbox_read(cmd->context->chan, slot, buf, data->data_size);
+	if (unlikely(ret < 0))
+		return ret;
+
+	data->vptr = buf;
+	data->inline_data = true;
+
+	// for DMA
+	inf_cmd_get(cmd);
+
+	cmdlist_schedule_dma_complete(g_the_sphcs, cmd, data, SPHCS_DMA_STATUS_DONE, 0);
+
+	return 0;
+}
+
+static void cmdlist_schedule_release_data(struct inf_cmd_list *cmd,
+					  bool                 inline_data,
+					  u8                   slot)
+{
+	if (inline_data)
+		sphcs_cmd_chan_mbox_read(cmd->context->chan, slot, NULL, 0);
+	else
+		sphcs_cmd_chan_update_cmd_head(cmd->context->chan, 1, PAGE_SIZE);
+}
+
+static void cmd_sched_op_work_handler(void *payload)
 {
-	struct cmdlst_op_work *op = container_of(work,
-			struct cmdlst_op_work,
-			work);
+	struct cmdlst_op_work *op = payload;
 	dma_addr_t dma_addr;
 	enum event_val val;
 	struct inf_cmd_list *cmd = op->cmd;
@@ -3477,6 +3694,17 @@ static void cmd_sched_op_work_handler(struct work_struct *work)
 		goto send_error;
 	}
 
+	if (op->dma_data.inline_data) {
+		/* earlier packets must be parsed first */
+		wait_event(cmd->sched_dma_waitq, atomic_read(&cmd->sched_dma_inflight) == 0);
+		ret = cmdlist_schedule_inline(cmd, op->mbox_slot, &op->dma_data);
+		if (unlikely(ret < 0)) {
+			val = NNP_IPC_RUNTIME_NOT_SUPPORTED;
+			goto send_error;
+		}
+		goto done;
+	}
+
 	ret = dma_page_pool_get_free_page(g_the_sphcs->dma_page_pool,
 					  &op->dma_data.dma_page_hndl,
 					  &op->dma_data.vptr,
@@ -3488,6 +3716,7 @@ static void cmd_sched_op_work_handler(struct work_struct *work)
 
 	// for DMA
 	inf_cmd_get(cmd);
+	atomic_inc(&cmd->sched_dma_inflight);
 
 	ret = sphcs_dma_sched_start_xfer_single(g_the_sphcs->dmaSched,
 						&cmd->context->chan->h2c_dma_exec_desc,
@@ -3495,9 +3724,9 @@ static void cmd_sched_op_work_handler(struct work_struct *work)
 						dma_addr,
 						op->dma_data.data_size,
 						cmdlist_schedule_dma_complete,
-						NULL,
-						&op,
-						sizeof(op));
+						cmd,
+						&op->dma_data,
+						sizeof(op->dma_data));
 	if (unlikely(ret < 0)) {
 		val = NNP_IPC_NO_MEMORY;
 		goto free_page;
@@ -3506,14 +3735,15 @@ static void cmd_sched_op_work_handler(struct work_struct *work)
 	goto done;
 
 free_page:
+	if (atomic_dec_and_test(&cmd->sched_dma_inflight))
+		wake_up_all(&cmd->sched_dma_waitq);
 	// put kref for DMA
 	inf_cmd_put(cmd);
 	dma_page_pool_set_page_free(g_the_sphcs->dma_page_pool,
 				    op->dma_data.dma_page_hndl);
 send_error:
 	cmdlst_send_fail_reports(cmd, val, op->dma_data.is_last, 0);
-	sphcs_cmd_chan_update_cmd_head(cmd->context->chan, 1, PAGE_SIZE);
-	kfree(op);
+	cmdlist_schedule_release_data(cmd, op->dma_data.inline_data, op->mbox_slot);
 done:
 	atomic_dec(&cmd->context->chan->sched_queued);
 	// for opwork
@@ -3532,7 +3762,7 @@ void IPC_OPCODE_HANDLER(CHAN_SCHEDULE_CMDLIST)(struct sphcs                    *
 	u32 host_chunk_size;
 	struct cmdlist_sched_dma_data dma_data;
 	dma_addr_t dma_addr;
-	struct cmdlst_op_work *work;
+	struct cmdlst_op_work work;
 	int ret;
 
 	context = find_and_get_context(sphcs->inf_data, cmd->chan_id);
@@ -3547,7 +3777,7 @@ void IPC_OPCODE_HANDLER(CHAN_SCHEDULE_CMDLIST)(struct sphcs                    *
 		goto cmd_not_found;
 	}
 
-	if (cmd->size > 0) {
+	if (cmd->size > 0 && !cmd->inline_data) {
 		cmd_data_rb = &context->chan->h2c_rb[1];
 		/* need to advance h2c ring buffer by one page */
 		host_rb_update_free_space(cmd_data_rb, NNP_PAGE_SIZE);
@@ -3595,12 +3825,27 @@ void IPC_OPCODE_HANDLER(CHAN_SCHEDULE_CMDLIST)(struct sphcs                    *
 	}
 
 	NNP_ASSERT(cmd->size > 0);
-	if (unlikely(cmd->size == 0)) {
+	if (unlikely(cmd->size == 0 ||
+		     (cmd->inline_data && cmd->size > NNP_CHAN_MBOX_SLOT_SIZE))) {
 		val = NNP_IPC_RUNTIME_NOT_SUPPORTED;
 		goto send_error;
 	}
 
-	if (atomic_read(&cmdlist->context->chan->sched_queued) == 0)
+	/* inline packet may not overtake an earlier packet still in DMA */
+	if (cmd->inline_data &&
+	    atomic_read(&cmdlist->context->chan->sched_queued) == 0 &&
+	    atomic_read(&cmdlist->sched_dma_inflight) == 0) {
+		dma_data.data_size = cmd->size;
+		dma_data.is_last = cmd->is_last;
+		ret = cmdlist_schedule_inline(cmdlist, cmd->mbox_slot, &dma_data);
+		if (unlikely(ret < 0)) {
+			val = NNP_IPC_RUNTIME_NOT_SUPPORTED;
+			goto send_error;
+		}
+		goto done;
+	}
+
+	if (!cmd->inline_data && atomic_read(&cmdlist->context->chan->sched_queued) == 0)
 		ret = dma_page_pool_get_free_page_nowait(g_the_sphcs->dma_page_pool,
 						&dma_data.dma_page_hndl,
 						&dma_data.vptr,
@@ -3611,9 +3856,11 @@ void IPC_OPCODE_HANDLER(CHAN_SCHEDULE_CMDLIST)(struct sphcs                    *
 	if (likely(ret == 0)) {
 		dma_data.data_size = cmd->size;
 		dma_data.is_last = cmd->is_last;
+		dma_data.inline_data = false;
 
 		// for DMA
 		inf_cmd_get(cmdlist);
+		atomic_inc(&cmdlist->sched_dma_inflight);
 
 		ret = sphcs_dma_sched_start_xfer_single(g_the_sphcs->dmaSched,
 							&context->chan->h2c_dma_exec_desc,
@@ -3637,27 +3884,29 @@ void IPC_OPCODE_HANDLER(CHAN_SCHEDULE_CMDLIST)(struct sphcs                    *
 	}
 
 	//Add opwork
-	work = kmalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL)) {
-		val = NNP_IPC_NO_MEMORY;
-		goto send_error;
-	}
-
 	atomic_inc(&cmdlist->context->chan->sched_queued);
 	// put kref for opwork
 	inf_cmd_get(cmdlist);
 
-	work->cmd = cmdlist;
-	work->host_dma_addr = host_dma_addr;
-	work->dma_data.data_size = cmd->size;
-	work->dma_data.is_last = cmd->is_last;
+	work.cmd = cmdlist;
+	work.host_dma_addr = host_dma_addr;
+	work.mbox_slot = cmd->mbox_slot;
+	work.dma_data.data_size = cmd->size;
+	work.dma_data.is_last = cmd->is_last;
+	work.dma_data.inline_data = cmd->inline_data;
 
-	INIT_WORK(&work->work, cmd_sched_op_work_handler);
-	queue_work(context->chan->wq_exec, &work->work);
+	if (unlikely(SPHCS_CHAN_DISPATCH(&context->chan->exec_msgq, cmd_sched_op_work_handler, &work) != 0)) {
+		atomic_dec(&cmdlist->context->chan->sched_queued);
+		inf_cmd_put(cmdlist);
+		val = NNP_IPC_NO_MEMORY;
+		goto send_error;
+	}
 
 	goto done;
 
 free_page:
+	if (atomic_dec_and_test(&cmdlist->sched_dma_inflight))
+		wake_up_all(&cmdlist->sched_dma_waitq);
 	// put kref for DMA
 	inf_cmd_put(cmdlist);
 	dma_page_pool_set_page_free(g_the_sphcs->dma_page_pool,
@@ -3665,7 +3914,9 @@ free_page:
 send_error:
 	cmdlst_send_fail_reports(cmdlist, val, cmd->is_last, 0);
 cmd_not_found:
-	if (cmd->size > 0)
+	if (cmd->inline_data)
+		sphcs_cmd_chan_mbox_read(context->chan, cmd->mbox_slot, NULL, 0);
+	else if (cmd->size > 0)
 		sphcs_cmd_chan_update_cmd_head(context->chan, 0, PAGE_SIZE);
 done:
 	inf_context_put(context);
@@ -3673,16 +3924,13 @@ done:
 
 
 struct inf_req_op_work {
-	struct work_struct           work;
 	struct inf_context          *context;
 	union  h2c_ChanInferenceReqOp    cmd;
 };
 
-static void inf_req_op_work_handler(struct work_struct *work)
+static void inf_req_op_work_handler(void *payload)
 {
-	struct inf_req_op_work *op = container_of(work,
-						  struct inf_req_op_work,
-						  work);
+	struct inf_req_op_work *op = payload;
 	struct inf_devnet *devnet;
 	struct inf_req *infreq;
 	uint8_t event;
@@ -3717,7 +3965,7 @@ static void inf_req_op_work_handler(struct work_struct *work)
 
 		host_rb_update_avail_space(cmd_data_rb, NNP_PAGE_SIZE);
 
-		if (!check_memory_threshold()) {
+		if (!sphcs_mem_acct_check_system()) {
 			val = NNP_IPC_NO_MEMORY;
 			goto send_error;
 		}
@@ -3780,13 +4028,12 @@ send_error:
 				op->cmd.netID);
 done:
 	inf_context_put(op->context);
-	kfree(op);
 }
 
 void IPC_OPCODE_HANDLER(CHAN_INF_REQ_OP)(struct sphcs             *sphcs,
 					 union h2c_ChanInferenceReqOp *cmd)
 {
-	struct inf_req_op_work *work;
+	struct inf_req_op_work work;
 	struct inf_context *context;
 	uint8_t event;
 	enum event_val val;
@@ -3802,19 +4049,15 @@ void IPC_OPCODE_HANDLER(CHAN_INF_REQ_OP)(struct sphcs             *sphcs,
 		goto send_error;
 	}
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL)) {
-		val = NNP_IPC_NO_MEMORY;
-		goto send_error;
-	}
-
-	work->cmd.value = cmd->value;
-	work->context = context;
-	INIT_WORK(&work->work, inf_req_op_work_handler);
+	work.cmd.value = cmd->value;
+	work.context = context;
 
 	DO_TRACE_IF(!cmd->destroy, trace_infer_create(SPH_TRACE_INF_INF_REQ, cmd->chan_id, cmd->infreqID, SPH_TRACE_OP_STATUS_QUEUED, cmd->netID, -1));
 
-	queue_work(context->chan->wq, &work->work);
+	if (unlikely(SPHCS_CHAN_DISPATCH(&context->chan->msgq, inf_req_op_work_handler, &work) != 0)) {
+		val = NNP_IPC_NO_MEMORY;
+		goto send_error;
+	}
 
 	return;
 
@@ -3917,16 +4160,13 @@ send_error:
 }
 
 struct network_property_op_work {
-	struct work_struct work;
 	struct inf_context *context;
 	union h2c_ChanInferenceNetworkSetProperty cmd;
 };
 
-static void network_property_op_work_handler(struct work_struct *work)
+static void network_property_op_work_handler(void *payload)
 {
-	struct network_property_op_work	*op = container_of(work,
-			struct network_property_op_work,
-			work);
+	struct network_property_op_work *op = payload;
 	struct inf_devnet *devnet;
 	enum event_val event_val = NNP_IPC_NO_ERROR;
 
@@ -4019,12 +4259,11 @@ static void network_property_op_work_handler(struct work_struct *work)
 
 free_op:
 	inf_context_put(op->context);
-	kfree(op);
 }
 
 void IPC_OPCODE_HANDLER(CHAN_NETWORK_PROPERTY)(struct sphcs *sphcs,
 		union h2c_ChanInferenceNetworkSetProperty *cmd) {
-	struct network_property_op_work *work;
+	struct network_property_op_work work;
 	struct inf_context *context;
 	enum event_val val;
 
@@ -4034,18 +4273,14 @@ void IPC_OPCODE_HANDLER(CHAN_NETWORK_PROPERTY)(struct sphcs *sphcs,
 		goto send_error;
 	}
 
-	work = kzalloc(sizeof(*work), GFP_NOWAIT);
-	if (unlikely(work == NULL)) {
+	memcpy(work.cmd.value, cmd->value, sizeof(work.cmd.value));
+	work.context = context;
+
+	if (unlikely(SPHCS_CHAN_DISPATCH(&context->chan->msgq, network_property_op_work_handler, &work) != 0)) {
 		val = NNP_IPC_NO_MEMORY;
 		goto send_error;
 	}
 
-	memcpy(work->cmd.value, cmd->value, sizeof(work->cmd.value));
-	work->context = context;
-
-	INIT_WORK(&work->work, network_property_op_work_handler);
-	queue_work(context->chan->wq, &work->work);
-
 	return;
 
 send_error:
@@ -4182,77 +4417,104 @@ static inline struct inf_devres *get_devres_from_p2p_buf(struct sphcs_p2p_buf *b
 	return devres;
 }
 
-static void sphcs_inf_new_data_arrived(struct sphcs_p2p_buf *buf)
+/* Accounts the credit slot, returns the buffer devres with a reference held */
+static struct inf_devres *sphcs_inf_p2p_buf_ready(struct sphcs_p2p_credit *cr, bool new_data)
 {
+	struct sphcs_p2p_buf *buf = cr->buf;
 	struct inf_devres *devres = get_devres_from_p2p_buf(buf);
+	const char *what = new_data ? "New data arrived" : "Data consumed";
 	unsigned long flags;
+	u8 expected_slot;
 
 	if (unlikely(devres == NULL)) {
-		sph_log_err(EXECUTE_COMMAND_LOG, "New data arrived for non-existing buffer.\n");
-		return;
+		sph_log_err(EXECUTE_COMMAND_LOG, "%s for non-existing buffer.\n", what);
+		return NULL;
 	}
 
 	NNP_SPIN_LOCK_IRQSAVE(&devres->lock_irq, flags);
 	if (unlikely(buf->peer_dev == NULL)) {
 		NNP_SPIN_UNLOCK_IRQRESTORE(&devres->lock_irq, flags);
-		sph_log_err(EXECUTE_COMMAND_LOG, "New data arrived for not paired buffer(%hhu), devres(%hu).\n", buf->buf_id, devres->protocol_id);
+		sph_log_err(EXECUTE_COMMAND_LOG, "%s for not paired buffer(%hhu), devres(%hu).\n", what, buf->buf_id, devres->protocol_id);
 		inf_devres_put(devres);
-		return;
+		return NULL;
 	}
 
-	NNP_ASSERT(devres->is_p2p_dst);
+	sph_log_debug(EXECUTE_COMMAND_LOG, "%s (buf id %hhu, slot %hhu).\n", what, buf->buf_id, cr->slot);
 
-	sph_log_debug(EXECUTE_COMMAND_LOG, "New data arrived (buf id %hhu).\n", buf->buf_id);
+	/* slots are filled and consumed in order on both sides */
+	if (new_data) {
+		NNP_ASSERT(devres->is_p2p_dst);
+		expected_slot = (buf->rd_slot + buf->navail) % buf->nslots;
+	} else {
+		NNP_ASSERT(devres->is_p2p_src);
+		expected_slot = (buf->wr_slot + buf->navail) % buf->nslots;
+	}
+	if (unlikely(cr->slot != expected_slot)) {
+		/* slot accounting is lost, stop the edge and fail the context */
+		sph_log_err(EXECUTE_COMMAND_LOG, "%s for unexpected slot %hhu of buffer(%hhu), expected %hhu.\n",
+			    what, cr->slot, buf->buf_id, expected_slot);
+		if (new_data)
+			inf_devres_set_dirty(devres, true);
+		buf->ready = false;
+		buf->navail = 0;
+		NNP_SPIN_UNLOCK_IRQRESTORE(&devres->lock_irq, flags);
+		inf_context_set_state(devres->context, CONTEXT_BROKEN_RECOVERABLE);
+		inf_devres_put(devres);
+		return NULL;
+	}
 
-	DO_TRACE(trace_credit(devres->context->protocol_id,
-			      devres->protocol_id,
-			      buf->buf_id,
-			      sphcs_p2p_get_peer_dev_id(buf)));
+	if (new_data) {
+		DO_TRACE(trace_credit(devres->context->protocol_id,
+				      devres->protocol_id,
+				      buf->buf_id,
+				      sphcs_p2p_get_peer_dev_id(buf)));
 
-	inf_devres_set_dirty(devres, false);
-	devres->p2p_buf.ready = true;
+		inf_devres_set_dirty(devres, false);
+		sphcs_p2p_buf_slot_filled(buf);
+	} else {
+		sphcs_p2p_buf_slot_released(buf);
+	}
 	NNP_SPIN_UNLOCK_IRQRESTORE(&devres->lock_irq, flags);
 
-	/* advance sched tick and try execute next requests */
-	atomic_add(2, &devres->context->sched_tick);
-	inf_devres_try_execute(devres);
-
-	inf_devres_put(devres);
+	return devres;
 }
 
-static void sphcs_inf_data_consumed(struct sphcs_p2p_buf *buf)
+static void sphcs_inf_p2p_bufs_ready(struct sphcs_p2p_credit *crs, u32 ncrs, bool new_data)
 {
-	struct inf_devres *devres = get_devres_from_p2p_buf(buf);
-	unsigned long flags;
+	struct inf_devres *devres[SPHCS_P2P_MAX_CR_BATCH];
+	u32 i;
 
-	if (unlikely(devres == NULL)) {
-		sph_log_err(EXECUTE_COMMAND_LOG, "Data consumed for non-existing buffer.\n");
-		return;
-	}
+	NNP_ASSERT(ncrs <= SPHCS_P2P_MAX_CR_BATCH);
 
-	NNP_SPIN_LOCK_IRQSAVE(&devres->lock_irq, flags);
-	if (unlikely(buf->peer_dev == NULL)) {
-		NNP_SPIN_UNLOCK_IRQRESTORE(&devres->lock_irq, flags);
-		sph_log_err(EXECUTE_COMMAND_LOG, "Data consumed for not paired buffer(%hhu), devres(%hu).\n", buf->buf_id, devres->protocol_id);
-		inf_devres_put(devres);
-		return;
-	}
+	/* Mark all buffers ready before trying to execute, so a request
+	 * waiting for several of them is not tried once per buffer
+	 */
+	for (i = 0; i < ncrs; i++)
+		devres[i] = sphcs_inf_p2p_buf_ready(&crs[i], new_data);
 
-	NNP_ASSERT(devres->is_p2p_src);
+	for (i = 0; i < ncrs; i++) {
+		if (devres[i] == NULL)
+			continue;
 
-	sph_log_debug(EXECUTE_COMMAND_LOG, "Data consumed (buf id %hhu)\n", buf->buf_id);
+		/* advance sched tick and try execute next requests */
+		atomic_add(2, &devres[i]->context->sched_tick);
+		inf_devres_try_execute(devres[i]);
 
-	devres->p2p_buf.ready = true;
-	NNP_SPIN_UNLOCK_IRQRESTORE(&devres->lock_irq, flags);
+		inf_devres_put(devres[i]);
+	}
+}
 
-	/* advance sched tick and try execute next requests */
-	atomic_add(2, &devres->context->sched_tick);
-	inf_devres_try_execute(devres);
+static void sphcs_inf_new_data_arrived(struct sphcs_p2p_credit *crs, u32 ncrs)
+{
+	sphcs_inf_p2p_bufs_ready(crs, ncrs, true);
+}
 
-	inf_devres_put(devres);
+static void sphcs_inf_data_consumed(struct sphcs_p2p_credit *crs, u32 ncrs)
+{
+	sphcs_inf_p2p_bufs_ready(crs, ncrs, false);
 }
 
-static enum event_val sphcs_inf_dst_devres_peer(struct sphcs_p2p_buf *buf, struct sphcs_p2p_peer_dev *peer_dev)
+static enum event_val sphcs_inf_dst_devres_peer(struct sphcs_p2p_buf *buf, struct sphcs_p2p_peer_dev *peer_dev, u8 peer_nslots)
 {
 	struct inf_devres *devres = get_devres_from_p2p_buf(buf);
 	enum event_val eval = NNP_IPC_NO_ERROR;
@@ -4278,16 +4540,26 @@ static enum event_val sphcs_inf_dst_devres_peer(struct sphcs_p2p_buf *buf, struc
 		goto done;
 	}
 
+	/* slot offsets on both sides must match */
+	if (unlikely(peer_dev != NULL && peer_nslots != buf->nslots)) {
+		sph_log_err(CREATE_COMMAND_LOG, "Peer with %hhu slots connected to p2p buf(%hhu) with %hhu slots.\n",
+			    peer_nslots, buf->buf_id, buf->nslots);
+		eval = NNP_IPC_NOT_SUPPORTED;
+		goto done;
+	}
+
 	buf->peer_dev = peer_dev;
 
 	sph_log_debug(CREATE_COMMAND_LOG, "Peer is being %sconnected to buf (id %hhu).\n", peer_dev != NULL ? "" : "dis", buf->buf_id);
 
 	if (peer_dev != NULL) { // connect
-		devres->p2p_buf.ready = devres->is_p2p_src;
+		/* src may fill all peer slots, dst has no data yet */
+		sphcs_p2p_buf_reset_slots(&devres->p2p_buf);
 		if (devres->is_p2p_dst) // for src buf  p2p copy holds the ref
 			inf_devres_get(devres);
 	} else {
 		devres->p2p_buf.ready = false;
+		devres->p2p_buf.navail = 0;
 		if (devres->is_p2p_dst) // for src buf  p2p copy holds the ref
 			inf_devres_put(devres);
 	}
@@ -4354,9 +4626,9 @@ int inference_init(struct sphcs *sphcs)
 		goto free_mutex;
 	}
 
-	inf_data->inf_wq = create_singlethread_workqueue("sphcs_inf_wq");
-	if (!inf_data->inf_wq) {
-		sph_log_err(START_UP_LOG, "Failed to initialize ctx create/destroy workqueue");
+	ret = inf_slab_init();
+	if (ret) {
+		sph_log_err(START_UP_LOG, "Failed to create inference object caches");
 		goto free_ctx_uids;
 	}
 
@@ -4365,13 +4637,13 @@ int inference_init(struct sphcs *sphcs)
 	ret = sphcs_p2p_init(sphcs, &s_p2p_cbs);
 	if (ret) {
 		sph_log_err(START_UP_LOG, "Failed to initialize p2p");
-		goto destroy_wq;
+		goto free_slabs;
 	}
 
 	return 0;
 
-destroy_wq:
-	destroy_workqueue(sphcs->inf_data->inf_wq);
+free_slabs:
+	inf_slab_fini();
 free_ctx_uids:
 	sphcs_ctx_uids_fini();
 free_mutex:
@@ -4393,8 +4665,8 @@ int inference_fini(struct sphcs *sphcs)
 {
 	clean_ptr2id();
 	sphcs_p2p_fini(sphcs);
+	inf_slab_fini();
 	sphcs_ctx_uids_fini();
-	destroy_workqueue(sphcs->inf_data->inf_wq);
 	device_destroy(s_class, s_devnum);
 	class_destroy(s_class);
 	cdev_del(&s_cdev);
@@ -4533,8 +4805,10 @@ static int ctx_status_show(struct seq_file *m, void *v)
 	struct inf_req *infreq;
 	struct inf_cmd_list *cmd;
 	struct inf_sync_point *sync_point;
+	unsigned long flags;
 	unsigned int i, j, k;
 	unsigned int num_contexts = 0;
+	u32 sp;
 
 	if (!g_the_sphcs)
 		return -1;
@@ -4549,6 +4823,10 @@ static int ctx_status_show(struct seq_file *m, void *v)
 			   context->destroyed,
 			   context->runtime_detach_sent,
 			   atomic_read(&context->ref));
+		seq_printf(m, "\tmem reserved: device=%lld device_ecc=%lld p2p=%lld\n",
+			   (long long)atomic64_read(&context->mem_acct.reserved[SPHCS_MEM_POOL_DEVICE]),
+			   (long long)atomic64_read(&context->mem_acct.reserved[SPHCS_MEM_POOL_DEVICE_ECC]),
+			   (long long)atomic64_read(&context->mem_acct.reserved[SPHCS_MEM_POOL_P2P]));
 
 		//NNP_SPIN_LOCK(&context->lock);
 		hash_for_each(context->cmd_hash, j, cmd, hash_node)
@@ -4571,12 +4849,18 @@ static int ctx_status_show(struct seq_file *m, void *v)
 				seq_printf(m, "\t\tp2p %s buf_id %hhu, %s\n", devres->is_p2p_src ? "src" : "dst",
 					   buf->buf_id, buf->peer_dev != NULL ? "connected:" : "disconnected.");
 				if (buf->peer_dev != NULL)
-					seq_printf(m, "\t\tready=%d, peer_buf_id %hhu, peer_dev %hhu.\n",
-						   buf->ready, buf->peer_buf_id, sphcs_p2p_get_peer_dev_id(buf));
+					seq_printf(m, "\t\tready=%d, peer_buf_id %hhu, peer_dev %hhu, slots %hhu avail %hhu wr %hhu rd %hhu.\n",
+						   buf->ready, buf->peer_buf_id, sphcs_p2p_get_peer_dev_id(buf),
+						   buf->nslots, buf->navail, buf->wr_slot, buf->rd_slot);
 			}
 		}
-		list_for_each_entry(sync_point, &context->sync_points, node)
-			seq_printf(m, "\tsync_point %u host_sync_id=%hu\n", sync_point->seq_id, sync_point->host_sync_id);
+		NNP_SPIN_LOCK_IRQSAVE(&context->sync_lock_irq, flags);
+		seq_printf(m, "\tnext_seq_id=%llu\n", context->next_seq_id);
+		for (sp = context->sync_points_head; sp != context->sync_points_tail; sp++) {
+			sync_point = &context->sync_points[sp & (context->sync_points_size - 1)];
+			seq_printf(m, "\tsync_point %llu host_sync_id=%hu\n", sync_point->seq_id, sync_point->host_sync_id);
+		}
+		NNP_SPIN_UNLOCK_IRQRESTORE(&context->sync_lock_irq, flags);
 		//NNP_SPIN_UNLOCK(&context->lock);
 	}
 	//NNP_SPIN_UNLOCK_BH(&inf_data->lock_bh);
@@ -4697,4 +4981,6 @@ void sphcs_inf_init_debugfs(struct dentry *parent)
 			    parent,
 			    NULL,
 			    &ids_map_trace_fops);
+
+	inf_slab_init_debugfs(parent);
 }
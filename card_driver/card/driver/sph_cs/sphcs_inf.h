@@ -20,7 +20,6 @@ struct inf_data {
 	spinlock_t lock_bh;
 	struct mutex io_lock;
 	DECLARE_HASHTABLE(context_hash, 4);
-	struct workqueue_struct *inf_wq;
 	struct inf_daemon *daemon;
 #ifdef ULT
 	struct inf_daemon *ult_daemon_save;
@@ -40,6 +39,9 @@ void IPC_OPCODE_HANDLER(CHAN_SYNC)(struct sphcs   *sphcs,
 void IPC_OPCODE_HANDLER(CHAN_INF_RESOURCE)(struct sphcs                  *sphcs,
 					   union h2c_ChanInferenceResourceOp     *cmd);
 
+void IPC_OPCODE_HANDLER(CHAN_INF_RESOURCE_BATCH)(struct sphcs                         *sphcs,
+						 union h2c_ChanInferenceResourceBatch *cmd);
+
 void IPC_OPCODE_HANDLER(CHAN_INF_CMDLIST)(struct sphcs                      *sphcs,
 					  union h2c_ChanInferenceCmdListOp  *cmd);
 
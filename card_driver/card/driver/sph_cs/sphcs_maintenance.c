@@ -19,6 +19,7 @@
 #include "ipc_protocol.h"
 #include "sphcs_dma_sched.h"
 #include "dma_page_pool.h"
+#include "sphcs_mem_acct.h"
 
 #define SPH_FPGA_SMBUS_ADDRESS   0x16
 
@@ -229,6 +230,9 @@ static long set_sys_info(void __user *arg)
 	s_sys_info_packet.stepping = sys_info.stepping;
 	s_sys_info_packet_valid = true;
 
+	sphcs_mem_acct_set_budget(SPHCS_MEM_POOL_DEVICE, sys_info.total_unprotected_memory);
+	sphcs_mem_acct_set_budget(SPHCS_MEM_POOL_DEVICE_ECC, sys_info.total_ecc_memory);
+
 	sphcs_maint_send_sys_info();
 
 	return 0;
@@ -0,0 +1,241 @@
+/********************************************
+ * Copyright (C) 2019-2021 Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ ********************************************/
+
+#include "sphcs_mem_acct.h"
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/seq_file.h>
+#include "ipc_protocol.h"
+#include "sph_log.h"
+#include "nnp_debug.h"
+
+/* min system memory threshold in KB */
+static uint32_t mem_thr;
+module_param(mem_thr, uint, 0644);
+
+struct sphcs_mem_pool_acct {
+	u64 budget;
+	u64 reserved;
+	u64 peak;
+	u64 admitted;
+	u64 failed;
+};
+
+static const char * const s_pool_name[SPHCS_MEM_NUM_POOLS] = {
+	[SPHCS_MEM_POOL_DEVICE]     = "device",
+	[SPHCS_MEM_POOL_DEVICE_ECC] = "device_ecc",
+	[SPHCS_MEM_POOL_P2P]        = "p2p",
+	[SPHCS_MEM_POOL_SYSTEM]     = "system",
+};
+
+static struct sphcs_mem_pool_acct s_pools[SPHCS_MEM_NUM_POOLS];
+static DEFINE_SPINLOCK(s_pools_lock);
+
+static LIST_HEAD(s_reclaimers);
+static DEFINE_MUTEX(s_reclaimers_lock);
+
+void sphcs_mem_acct_set_budget(enum sphcs_mem_pool pool, u64 bytes)
+{
+	NNP_ASSERT(pool < SPHCS_MEM_NUM_POOLS);
+
+	NNP_SPIN_LOCK(&s_pools_lock);
+	s_pools[pool].budget = bytes;
+	NNP_SPIN_UNLOCK(&s_pools_lock);
+
+	sph_log_info(START_UP_LOG, "%s memory budget set to %llu bytes\n",
+		     s_pool_name[pool], bytes);
+}
+
+static bool try_reserve(enum sphcs_mem_pool pool, u64 bytes)
+{
+	struct sphcs_mem_pool_acct *p = &s_pools[pool];
+	bool admitted = false;
+
+	NNP_SPIN_LOCK(&s_pools_lock);
+	if (p->budget == 0 || p->reserved + bytes <= p->budget) {
+		p->reserved += bytes;
+		if (p->reserved > p->peak)
+			p->peak = p->reserved;
+		p->admitted++;
+		admitted = true;
+	}
+	NNP_SPIN_UNLOCK(&s_pools_lock);
+
+	return admitted;
+}
+
+static u64 run_reclaimers(enum sphcs_mem_pool pool, u64 bytes)
+{
+	struct sphcs_mem_reclaimer *r;
+	u64 freed = 0;
+	u64 n;
+
+	mutex_lock(&s_reclaimers_lock);
+	list_for_each_entry(r, &s_reclaimers, node) {
+		n = r->reclaim(r->ctx, pool, bytes - freed);
+		r->reclaimed += n;
+		freed += n;
+		if (freed >= bytes)
+			break;
+	}
+	mutex_unlock(&s_reclaimers_lock);
+
+	return freed;
+}
+
+/*
+ * Reserve @bytes from @pool on behalf of @user (may be NULL).
+ * May sleep in the reclaimers, must not be called from atomic context.
+ */
+int sphcs_mem_acct_reserve(struct sphcs_mem_acct_user *user,
+			   enum sphcs_mem_pool         pool,
+			   u64                         bytes)
+{
+	NNP_ASSERT(pool < SPHCS_MEM_NUM_POOLS);
+
+	if (try_reserve(pool, bytes))
+		goto admitted;
+
+	run_reclaimers(pool, bytes);
+	if (try_reserve(pool, bytes))
+		goto admitted;
+
+	NNP_SPIN_LOCK(&s_pools_lock);
+	s_pools[pool].failed++;
+	sph_log_err(CREATE_COMMAND_LOG, "Not enough %s memory: requested %llu reserved %llu budget %llu\n",
+		    s_pool_name[pool], bytes, s_pools[pool].reserved, s_pools[pool].budget);
+	NNP_SPIN_UNLOCK(&s_pools_lock);
+
+	return -ENOMEM;
+
+admitted:
+	if (user)
+		atomic64_add(bytes, &user->reserved[pool]);
+
+	return 0;
+}
+
+void sphcs_mem_acct_release(struct sphcs_mem_acct_user *user,
+			    enum sphcs_mem_pool         pool,
+			    u64                         bytes)
+{
+	NNP_ASSERT(pool < SPHCS_MEM_NUM_POOLS);
+
+	if (bytes == 0)
+		return;
+
+	NNP_SPIN_LOCK(&s_pools_lock);
+	NNP_ASSERT(s_pools[pool].reserved >= bytes);
+	s_pools[pool].reserved -= min(bytes, s_pools[pool].reserved);
+	NNP_SPIN_UNLOCK(&s_pools_lock);
+
+	if (user)
+		atomic64_sub(bytes, &user->reserved[pool]);
+}
+
+/*
+ * Check that the card kernel has at least mem_thr KB available,
+ * reclaiming cached memory if it has not.
+ */
+bool sphcs_mem_acct_check_system(void)
+{
+	uint32_t thr = READ_ONCE(mem_thr);
+	uint64_t available_ram_kb;
+
+	if (!thr)
+		return true;
+
+	available_ram_kb = (uint64_t)si_mem_available() << (NNP_PAGE_SHIFT - 10);
+	if (available_ram_kb >= thr)
+		return true;
+
+	run_reclaimers(SPHCS_MEM_POOL_SYSTEM, (thr - available_ram_kb) << 10);
+
+	available_ram_kb = (uint64_t)si_mem_available() << (NNP_PAGE_SHIFT - 10);
+	if (available_ram_kb >= thr)
+		return true;
+
+	NNP_SPIN_LOCK(&s_pools_lock);
+	s_pools[SPHCS_MEM_POOL_SYSTEM].failed++;
+	NNP_SPIN_UNLOCK(&s_pools_lock);
+
+	sph_log_err(CREATE_COMMAND_LOG, "Available memory (%llu KB) below the threshold (%u KB) ", available_ram_kb, thr);
+
+	return false;
+}
+
+void sphcs_mem_acct_register_reclaimer(struct sphcs_mem_reclaimer *r)
+{
+	r->reclaimed = 0;
+
+	mutex_lock(&s_reclaimers_lock);
+	list_add_tail(&r->node, &s_reclaimers);
+	mutex_unlock(&s_reclaimers_lock);
+}
+
+void sphcs_mem_acct_unregister_reclaimer(struct sphcs_mem_reclaimer *r)
+{
+	mutex_lock(&s_reclaimers_lock);
+	list_del(&r->node);
+	mutex_unlock(&s_reclaimers_lock);
+}
+
+static int debug_mem_acct_show(struct seq_file *m, void *v)
+{
+	struct sphcs_mem_pool_acct pools[SPHCS_MEM_NUM_POOLS];
+	struct sphcs_mem_reclaimer *r;
+	int i;
+
+	NNP_SPIN_LOCK(&s_pools_lock);
+	memcpy(pools, s_pools, sizeof(pools));
+	NNP_SPIN_UNLOCK(&s_pools_lock);
+
+	for (i = 0; i < SPHCS_MEM_NUM_POOLS; i++)
+		seq_printf(m, "%s: budget=%llu reserved=%llu peak=%llu admitted=%llu failed=%llu\n",
+			   s_pool_name[i],
+			   pools[i].budget,
+			   pools[i].reserved,
+			   pools[i].peak,
+			   pools[i].admitted,
+			   pools[i].failed);
+
+	seq_printf(m, "system: available=%lu KB threshold=%u KB\n",
+		   si_mem_available() << (NNP_PAGE_SHIFT - 10), mem_thr);
+
+	mutex_lock(&s_reclaimers_lock);
+	list_for_each_entry(r, &s_reclaimers, node)
+		seq_printf(m, "reclaimer %s: reclaimed=%llu\n", r->name, r->reclaimed);
+	mutex_unlock(&s_reclaimers_lock);
+
+	return 0;
+}
+
+static int debug_mem_acct_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, debug_mem_acct_show, inode->i_private);
+}
+
+static const struct file_operations debug_mem_acct_fops = {
+	.open		= debug_mem_acct_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void sphcs_mem_acct_init_debugfs(struct dentry *parent)
+{
+	if (!parent)
+		return;
+
+	debugfs_create_file("mem_acct",
+			    0444,
+			    parent,
+			    NULL,
+			    &debug_mem_acct_fops);
+}
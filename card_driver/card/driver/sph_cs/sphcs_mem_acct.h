@@ -0,0 +1,81 @@
+/********************************************
+ * Copyright (C) 2019-2021 Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ ********************************************/
+
+#ifndef _SPHCS_MEM_ACCT_H
+#define _SPHCS_MEM_ACCT_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/atomic.h>
+#include <linux/debugfs.h>
+
+/*
+ * Card memory accounting and admission control.
+ *
+ * Memory used by inference objects is reserved against a per-pool
+ * budget when the object is created and released when it is destroyed.
+ * A reservation which does not fit runs the registered reclaimers and,
+ * if still short, fails with -ENOMEM.
+ *
+ * Only device resources are accounted for now. Command lists and pages
+ * taken from the DMA page pools are not reserved per context; the DMA
+ * page pools are only covered by the system pool reclaimer.
+ *
+ * A pool with zero budget is tracked but never refuses a reservation.
+ */
+enum sphcs_mem_pool {
+	SPHCS_MEM_POOL_DEVICE = 0,  /* non ECC protected device memory */
+	SPHCS_MEM_POOL_DEVICE_ECC,  /* ECC protected device memory */
+	SPHCS_MEM_POOL_P2P,         /* inbound BAR window (p2p heap) */
+	SPHCS_MEM_POOL_SYSTEM,      /* card kernel memory */
+	SPHCS_MEM_NUM_POOLS
+};
+
+/* Reservations held by a single user, e.g. an inference context */
+struct sphcs_mem_acct_user {
+	atomic64_t reserved[SPHCS_MEM_NUM_POOLS];
+};
+
+/*
+ * Reclaimer callback, called in process context without locks held.
+ * Should try to free at least @bytes from @pool and return the number
+ * of bytes actually freed.
+ */
+typedef u64 (*sphcs_mem_reclaim_cb)(void *ctx, enum sphcs_mem_pool pool, u64 bytes);
+
+struct sphcs_mem_reclaimer {
+	struct list_head     node;
+	const char          *name;
+	sphcs_mem_reclaim_cb reclaim;
+	void                *ctx;
+	u64                  reclaimed;
+};
+
+void sphcs_mem_acct_init_debugfs(struct dentry *parent);
+
+void sphcs_mem_acct_set_budget(enum sphcs_mem_pool pool, u64 bytes);
+
+int sphcs_mem_acct_reserve(struct sphcs_mem_acct_user *user,
+			   enum sphcs_mem_pool         pool,
+			   u64                         bytes);
+void sphcs_mem_acct_release(struct sphcs_mem_acct_user *user,
+			    enum sphcs_mem_pool         pool,
+			    u64                         bytes);
+
+bool sphcs_mem_acct_check_system(void);
+
+void sphcs_mem_acct_register_reclaimer(struct sphcs_mem_reclaimer *r);
+void sphcs_mem_acct_unregister_reclaimer(struct sphcs_mem_reclaimer *r);
+
+static inline void sphcs_mem_acct_user_init(struct sphcs_mem_acct_user *user)
+{
+	int i;
+
+	for (i = 0; i < SPHCS_MEM_NUM_POOLS; i++)
+		atomic64_set(&user->reserved[i], 0);
+}
+
+#endif
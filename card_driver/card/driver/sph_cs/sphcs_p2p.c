@@ -10,6 +10,8 @@
 #include <linux/dma-mapping.h>
 #include <linux/slab.h>
 #include <linux/bits.h>
+#include <linux/bitmap.h>
+#include <linux/scatterlist.h>
 #include "sphcs_p2p.h"
 #include "sph_log.h"
 #include "sphcs_cs.h"
@@ -20,6 +22,9 @@
 #define MAX_NUM_OF_P2P_BUFS BIT(MAX_NUM_OF_P2P_BUFS_SHIFT)
 #define CR_FIFO_DEPTH MAX_NUM_OF_P2P_BUFS
 
+/* space for an LLI of up to 3 elements: 2 credit ranges and the doorbell */
+#define P2P_BATCH_LLI_SIZE 256
+
 struct sphcs_p2p_peer_db {
 	dma_addr_t dma_addr;
 
@@ -28,17 +33,34 @@ struct sphcs_p2p_peer_db {
 	void *buf_vaddr;
 };
 
+/* Completion of a credit sent to a peer */
+struct sphcs_p2p_cr_req {
+	sphcs_dma_sched_completion_callback callback;
+	void *callback_ctx;
+};
+
 struct sphcs_p2p_peer_fifo {
 	/* fifo dma addr */
 	dma_addr_t dma_addr;
 	u32 elem_size;
 	u32 depth;
 
-	/* for wr_ptr */
+	/* for the counters below */
 	spinlock_t lock;
 
-	/* index of next element to be written */
-	u32 wr_ptr;
+	/* Free running counters of credits written to the local buffer,
+	 * transferred to the peer and completed. The fifo index of a
+	 * credit is its counter modulo depth.
+	 * Only one transfer is in flight per peer, credits pushed meanwhile
+	 * are sent together by the next transfer with a single doorbell.
+	 */
+	u32 wr_cnt;
+	u32 sent_cnt;
+	u32 done_cnt;
+	bool xfer_inflight;
+
+	/* completion of each fifo element */
+	struct sphcs_p2p_cr_req *reqs;
 
 	/* local buffer to be used for DMA */
 	dma_addr_t buf_dma_addr;
@@ -46,6 +68,9 @@ struct sphcs_p2p_peer_fifo {
 
 	/* Preallocated LLIs*/
 	struct lli_desc *llis;
+
+	/* LLI for a transfer of several credits */
+	struct lli_desc batch_lli;
 };
 
 struct sphcs_p2p_peer_dev {
@@ -58,14 +83,16 @@ struct sphcs_p2p_fw_cr_fifo_elem {
 	u64 sbid :MAX_NUM_OF_P2P_BUFS_SHIFT;
 	u64 dbid :MAX_NUM_OF_P2P_BUFS_SHIFT;
 	u64 is_new :1;
-	u64 reserved :47;
+	u64 slot :4;
+	u64 reserved :43;
 };
 
 /* 32 bit release creadit message */
 struct sphcs_p2p_rel_cr_fifo_elem {
 	u32 sbid :MAX_NUM_OF_P2P_BUFS_SHIFT;
 	u32 is_new :1;
-	u32 reserved :23;
+	u32 slot :4;
+	u32 reserved :19;
 };
 
 struct sphcs_p2p_cr_fifo {
@@ -90,6 +117,14 @@ static struct sphcs_p2p_buf *dst_bufs[MAX_NUM_OF_P2P_BUFS] = {NULL};
 static struct sphcs_p2p_cr_fifo fw_fifos[MAX_NUM_OF_P2P_DEVS];
 static struct sphcs_p2p_cr_fifo rel_fifos[MAX_NUM_OF_P2P_DEVS];
 
+/* FIFOs handed to a peer, only those are scanned on doorbell */
+static DECLARE_BITMAP(fw_fifos_used, MAX_NUM_OF_P2P_DEVS);
+static DECLARE_BITMAP(rel_fifos_used, MAX_NUM_OF_P2P_DEVS);
+
+/* Memory of the batch LLIs of all peer devices */
+static void *batch_llis_vaddr;
+static dma_addr_t batch_llis_dma_addr;
+
 DEFINE_IDA(p2p_dbid_ida);
 DEFINE_IDA(p2p_sbid_ida);
 
@@ -168,6 +203,9 @@ int sphcs_p2p_init_p2p_buf(bool is_src_buf, struct sphcs_p2p_buf *buf)
 	buf->peer_buf_id = (-1);
 	buf->peer_dev = NULL;
 	buf->ready = false;
+	buf->wr_slot = 0;
+	buf->rd_slot = 0;
+	buf->navail = 0;
 
 	if (buf->is_src_buf) {
 		bufs = src_bufs;
@@ -204,70 +242,201 @@ void sphcs_p2p_remove_buffer(struct sphcs_p2p_buf *buf)
 
 }
 
-int sphcs_p2p_send_fw_cr_and_ring_db(struct sphcs_p2p_buf *buf,
-				     sphcs_dma_sched_completion_callback callback,
-				     void *callback_ctx)
+/* Sends all credits not sent yet with a single transfer followed by
+ * the doorbell, must be called with the fifo lock held
+ */
+static int p2p_cr_fifo_flush(struct sphcs_p2p_peer_dev *peer_dev);
+
+static int p2p_cr_xfer_complete(struct sphcs *sphcs,
+				void *ctx,
+				const void *user_data,
+				int status,
+				u32 xferTimeUS)
 {
-	struct sphcs_p2p_fw_cr_fifo_elem *fifo_elem;
-	u32 off;
-	int ret = 0;
+	struct sphcs_p2p_peer_dev *peer_dev = (struct sphcs_p2p_peer_dev *)ctx;
+	struct sphcs_p2p_peer_fifo *fifo = &peer_dev->peer_cr_fifo;
+	struct sphcs_p2p_cr_req *req;
+	unsigned long flags;
+	u32 from, to, i;
+	int ret;
 
-	sph_log_debug(GENERAL_LOG, "Forward credit (src buf id %u, dst buf id %u)\n", buf->buf_id, buf->peer_buf_id);
+	NNP_SPIN_LOCK_IRQSAVE(&fifo->lock, flags);
+	from = fifo->done_cnt;
+	to = fifo->sent_cnt;
+	NNP_SPIN_UNLOCK_IRQRESTORE(&fifo->lock, flags);
+
+	for (;;) {
+		/* fifo elements are not reused before done_cnt is promoted */
+		for (i = from; i != to; i++) {
+			req = &fifo->reqs[i % fifo->depth];
+			if (req->callback)
+				req->callback(sphcs, req->callback_ctx, user_data, status, xferTimeUS);
+		}
+
+		NNP_SPIN_LOCK_IRQSAVE(&fifo->lock, flags);
+		fifo->done_cnt = to;
+		fifo->xfer_inflight = false;
+		ret = 0;
+		if (fifo->sent_cnt != fifo->wr_cnt)
+			ret = p2p_cr_fifo_flush(peer_dev);
+		if (likely(ret == 0)) {
+			NNP_SPIN_UNLOCK_IRQRESTORE(&fifo->lock, flags);
+			break;
+		}
 
-	NNP_SPIN_LOCK(&buf->peer_dev->peer_cr_fifo.lock);
-	off = buf->peer_dev->peer_cr_fifo.wr_ptr * buf->peer_dev->peer_cr_fifo.elem_size;
-	fifo_elem = (struct sphcs_p2p_fw_cr_fifo_elem *)(buf->peer_dev->peer_cr_fifo.buf_vaddr + off);
-	fifo_elem->sbid = buf->buf_id;
-	fifo_elem->dbid = buf->peer_buf_id;
-	fifo_elem->is_new = 1;
+		/* Failed to send the credits pushed meanwhile, complete them */
+		from = fifo->sent_cnt;
+		to = fifo->wr_cnt;
+		fifo->sent_cnt = to;
+		fifo->xfer_inflight = true;
+		NNP_SPIN_UNLOCK_IRQRESTORE(&fifo->lock, flags);
+
+		sph_log_err(GENERAL_LOG, "Failed to send %u credits, err %d\n", to - from, ret);
+		status = SPHCS_DMA_STATUS_FAILED;
+	}
+
+	return 0;
+}
+
+static int p2p_cr_fifo_flush(struct sphcs_p2p_peer_dev *peer_dev)
+{
+	struct sphcs_p2p_peer_fifo *fifo = &peer_dev->peer_cr_fifo;
+	struct scatterlist src_sgl[3], dst_sgl[3];
+	struct sg_table src_sgt, dst_sgt;
+	struct lli_desc *lli;
+	u32 n = fifo->wr_cnt - fifo->sent_cnt;
+	u32 first = fifo->sent_cnt % fifo->depth;
+	u32 n1, nents;
+	u64 transfer_size = n * fifo->elem_size + 1;
+	int ret;
+
+	if (n == 1) {
+		lli = &fifo->llis[first];
+	} else {
+		/* credits range may wrap around the end of the fifo */
+		n1 = min(n, fifo->depth - first);
+		nents = (n1 < n) ? 3 : 2;
+
+		sg_init_table(src_sgl, nents);
+		sg_init_table(dst_sgl, nents);
+		src_sgl[0].dma_address = fifo->buf_dma_addr + first * fifo->elem_size;
+		dst_sgl[0].dma_address = fifo->dma_addr + first * fifo->elem_size;
+		src_sgl[0].length = n1 * fifo->elem_size;
+		dst_sgl[0].length = n1 * fifo->elem_size;
+		if (n1 < n) {
+			src_sgl[1].dma_address = fifo->buf_dma_addr;
+			dst_sgl[1].dma_address = fifo->dma_addr;
+			src_sgl[1].length = (n - n1) * fifo->elem_size;
+			dst_sgl[1].length = (n - n1) * fifo->elem_size;
+		}
+		src_sgl[nents - 1].dma_address = peer_dev->peer_db.buf_dma_addr;
+		dst_sgl[nents - 1].dma_address = peer_dev->peer_db.dma_addr;
+		src_sgl[nents - 1].length = 1;
+		dst_sgl[nents - 1].length = 1;
+
+		src_sgt.sgl = src_sgl;
+		src_sgt.nents = nents;
+		src_sgt.orig_nents = nents;
+		dst_sgt.sgl = dst_sgl;
+		dst_sgt.nents = nents;
+		dst_sgt.orig_nents = nents;
+
+		lli = &fifo->batch_lli;
+		ret = g_the_sphcs->hw_ops->dma.init_lli(g_the_sphcs->hw_handle, lli, &src_sgt, &dst_sgt, 0, true);
+		if (unlikely(ret != 0 || lli->size > P2P_BATCH_LLI_SIZE))
+			return -EINVAL;
+
+		if (unlikely(g_the_sphcs->hw_ops->dma.gen_lli(g_the_sphcs->hw_handle, &src_sgt, &dst_sgt, lli, 0) != transfer_size))
+			return -EINVAL;
+	}
 
 	ret = sphcs_dma_sched_start_xfer_multi(g_the_sphcs->dmaSched,
 					       NULL,
 					       &g_dma_desc_c2h_high_nowait,
-					       &buf->peer_dev->peer_cr_fifo.llis[buf->peer_dev->peer_cr_fifo.wr_ptr],
-					       buf->peer_dev->peer_cr_fifo.elem_size + 1,
-					       callback,
-					       callback_ctx);
+					       lli,
+					       transfer_size,
+					       p2p_cr_xfer_complete,
+					       peer_dev);
+	if (likely(ret == 0)) {
+		fifo->sent_cnt = fifo->wr_cnt;
+		fifo->xfer_inflight = true;
+	}
+
+	return ret;
+}
+
+static int p2p_push_cr(struct sphcs_p2p_peer_dev *peer_dev,
+		       const void *elem,
+		       sphcs_dma_sched_completion_callback callback,
+		       void *callback_ctx)
+{
+	struct sphcs_p2p_peer_fifo *fifo = &peer_dev->peer_cr_fifo;
+	unsigned long flags;
+	u32 idx;
+	int ret = 0;
+
+	NNP_SPIN_LOCK_IRQSAVE(&fifo->lock, flags);
+	if (unlikely(fifo->wr_cnt - fifo->done_cnt >= fifo->depth)) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+
+	idx = fifo->wr_cnt % fifo->depth;
+	memcpy(fifo->buf_vaddr + idx * fifo->elem_size, elem, fifo->elem_size);
+	fifo->reqs[idx].callback = callback;
+	fifo->reqs[idx].callback_ctx = callback_ctx;
+	fifo->wr_cnt++;
+
+	/* otherwise sent by the completion of the transfer in flight */
+	if (!fifo->xfer_inflight) {
+		ret = p2p_cr_fifo_flush(peer_dev);
+		if (unlikely(ret))
+			fifo->wr_cnt--;
+	}
+
+unlock:
+	NNP_SPIN_UNLOCK_IRQRESTORE(&fifo->lock, flags);
+
+	return ret;
+}
+
+int sphcs_p2p_send_fw_cr_and_ring_db(struct sphcs_p2p_buf *buf,
+				     u8 slot,
+				     sphcs_dma_sched_completion_callback callback,
+				     void *callback_ctx)
+{
+	struct sphcs_p2p_fw_cr_fifo_elem fifo_elem = { 0 };
+	int ret;
+
+	sph_log_debug(GENERAL_LOG, "Forward credit (src buf id %u, dst buf id %u, slot %u)\n", buf->buf_id, buf->peer_buf_id, slot);
+
+	fifo_elem.sbid = buf->buf_id;
+	fifo_elem.dbid = buf->peer_buf_id;
+	fifo_elem.slot = slot;
+	fifo_elem.is_new = 1;
+
+	ret = p2p_push_cr(buf->peer_dev, &fifo_elem, callback, callback_ctx);
 	if (unlikely(ret))
 		sph_log_err(GENERAL_LOG, "Failed to forward credit (src buf id %u, dst buf id %u)\n", buf->buf_id, buf->peer_buf_id);
-	else
-		buf->peer_dev->peer_cr_fifo.wr_ptr = inc_fifo_ptr(buf->peer_dev->peer_cr_fifo.depth, buf->peer_dev->peer_cr_fifo.wr_ptr);
-
-	NNP_SPIN_UNLOCK(&buf->peer_dev->peer_cr_fifo.lock);
 
 	return ret;
 
 }
 
 int sphcs_p2p_send_rel_cr_and_ring_db(struct sphcs_p2p_buf *buf,
+				      u8 slot,
 				      sphcs_dma_sched_completion_callback callback,
 				      void *callback_ctx)
 {
-	struct sphcs_p2p_rel_cr_fifo_elem *fifo_elem;
-	u32 off;
-	int ret = 0;
+	struct sphcs_p2p_rel_cr_fifo_elem fifo_elem = { 0 };
 
-	sph_log_debug(GENERAL_LOG, "Release credit (src buf id %u, dst buf id %u)\n", buf->buf_id, buf->peer_buf_id);
+	sph_log_debug(GENERAL_LOG, "Release credit (src buf id %u, dst buf id %u, slot %u)\n", buf->buf_id, buf->peer_buf_id, slot);
 
-	NNP_SPIN_LOCK(&buf->peer_dev->peer_cr_fifo.lock);
-	off = buf->peer_dev->peer_cr_fifo.wr_ptr * buf->peer_dev->peer_cr_fifo.elem_size;
-	fifo_elem = (struct sphcs_p2p_rel_cr_fifo_elem *)(buf->peer_dev->peer_cr_fifo.buf_vaddr + off);
-	fifo_elem->sbid = buf->peer_buf_id;
-	fifo_elem->is_new = 1;
+	fifo_elem.sbid = buf->peer_buf_id;
+	fifo_elem.slot = slot;
+	fifo_elem.is_new = 1;
 
-	ret = sphcs_dma_sched_start_xfer_multi(g_the_sphcs->dmaSched,
-					       NULL,
-					       &g_dma_desc_c2h_high_nowait,
-					       &buf->peer_dev->peer_cr_fifo.llis[buf->peer_dev->peer_cr_fifo.wr_ptr],
-					       buf->peer_dev->peer_cr_fifo.elem_size + 1,
-					       callback,
-					       callback_ctx);
-
-	buf->peer_dev->peer_cr_fifo.wr_ptr = inc_fifo_ptr(buf->peer_dev->peer_cr_fifo.depth, buf->peer_dev->peer_cr_fifo.wr_ptr);
-
-	NNP_SPIN_UNLOCK(&buf->peer_dev->peer_cr_fifo.lock);
-
-	return ret;
+	return p2p_push_cr(buf->peer_dev, &fifo_elem, callback, callback_ctx);
 
 }
 
@@ -278,6 +447,7 @@ void IPC_OPCODE_HANDLER(CHAN_P2P_GET_CR_FIFO)(struct sphcs *sphcs, union h2c_Cha
 	sph_log_debug(GENERAL_LOG, "tr id %u, peer_id %u fw_fifo %u\n", cmd->p2p_tr_id, cmd->peer_id, cmd->fw_fifo);
 
 	fifo = cmd->fw_fifo ? &fw_fifos[cmd->peer_id] : &rel_fifos[cmd->peer_id];
+	set_bit(cmd->peer_id, cmd->fw_fifo ? fw_fifos_used : rel_fifos_used);
 
 	sphcs_send_event_report_ext(sphcs,
 				NNP_IPC_GET_CR_FIFO_REPLY,
@@ -308,7 +478,7 @@ void IPC_OPCODE_HANDLER(CHAN_P2P_CONNECT_PEERS)(struct sphcs *sphcs, union h2c_C
 		peer_dev = (cmd->is_src_buf) ? &p2p_consumers[cmd->peer_dev_id] : &p2p_producers[cmd->peer_dev_id];
 	}
 
-	eval = s_p2p_cbs->dst_devres_peer(buf, peer_dev);
+	eval = s_p2p_cbs->dst_devres_peer(buf, peer_dev, max_t(u8, cmd->peer_nslots, 1));
 
 send_report:
 	if (!cmd->disconnect)
@@ -486,55 +656,106 @@ void IPC_OPCODE_HANDLER(CHAN_P2P_UPDATE_PEER_DEV)(struct sphcs *sphcs, union h2c
 }
 
 
+struct p2p_cr_batch {
+	struct sphcs_p2p_credit crs[SPHCS_P2P_MAX_CR_BATCH];
+	u32 ncrs;
+	void (*deliver)(struct sphcs_p2p_credit *crs, u32 ncrs);
+};
+
+static inline void p2p_cr_batch_flush(struct p2p_cr_batch *batch)
+{
+	if (batch->ncrs > 0) {
+		batch->deliver(batch->crs, batch->ncrs);
+		batch->ncrs = 0;
+	}
+}
+
+static inline void p2p_cr_batch_add(struct p2p_cr_batch *batch, struct sphcs_p2p_buf *buf, u8 slot)
+{
+	batch->crs[batch->ncrs].buf = buf;
+	batch->crs[batch->ncrs].slot = slot;
+	if (++batch->ncrs == SPHCS_P2P_MAX_CR_BATCH)
+		p2p_cr_batch_flush(batch);
+}
+
 int sphcs_p2p_new_message_arrived(void)
 {
 	u32 i;
 	struct sphcs_p2p_fw_cr_fifo_elem *fw_fifo_elem;
 	struct sphcs_p2p_rel_cr_fifo_elem *rel_fifo_elem;
-	bool new_element_found;
+	struct p2p_cr_batch batch;
 
-	/* Check all FIFOs managed by this device */
-	for (i = 0; i < MAX_NUM_OF_P2P_DEVS; i++) {
-		do {
+	/* Check fw credit FIFOs handed to producers */
+	batch.ncrs = 0;
+	batch.deliver = s_p2p_cbs->new_data_arrived;
+	for_each_set_bit(i, fw_fifos_used, MAX_NUM_OF_P2P_DEVS) {
+		for (;;) {
 			/* Check whether the new element has been written to the fw credit fifo */
 			fw_fifo_elem = fw_fifos[i].vaddr + fw_fifos[i].rd_ptr * fw_fifos[i].elem_size;
 			NNP_ASSERT(fw_fifo_elem);
-			new_element_found = fw_fifo_elem->is_new;
-			if (new_element_found) {
+			if (!fw_fifo_elem->is_new)
+				break;
 #ifdef _DEBUG
+			{
 				struct sphcs_p2p_buf *buf = dst_bufs[fw_fifo_elem->dbid];
 
 				if (buf != NULL)
 					NNP_ASSERT(buf->buf_id == fw_fifo_elem->dbid);
-#endif
-				sph_log_debug(EXECUTE_COMMAND_LOG, "Credit forwarded for dst buffer %u\n", fw_fifo_elem->dbid);
-				s_p2p_cbs->new_data_arrived(dst_bufs[fw_fifo_elem->dbid]);
-				/* Mark the element as handled and promote the read ptr */
-				fw_fifo_elem->is_new = 0;
-				fw_fifos[i].rd_ptr = inc_fifo_ptr(fw_fifos[i].depth, fw_fifos[i].rd_ptr);
 			}
-		} while (new_element_found);
+#endif
+			sph_log_debug(EXECUTE_COMMAND_LOG, "Credit forwarded for dst buffer %u slot %u\n", fw_fifo_elem->dbid, fw_fifo_elem->slot);
+			p2p_cr_batch_add(&batch, dst_bufs[fw_fifo_elem->dbid], fw_fifo_elem->slot);
+			/* Mark the element as handled and promote the read ptr */
+			fw_fifo_elem->is_new = 0;
+			fw_fifos[i].rd_ptr = inc_fifo_ptr(fw_fifos[i].depth, fw_fifos[i].rd_ptr);
+		}
+	}
+	p2p_cr_batch_flush(&batch);
 
-		do {
+	/* Check rel credit FIFOs handed to consumers */
+	batch.deliver = s_p2p_cbs->data_consumed;
+	for_each_set_bit(i, rel_fifos_used, MAX_NUM_OF_P2P_DEVS) {
+		for (;;) {
 			/* Check whether the new element has been written to the rel credit fifo */
 			rel_fifo_elem = rel_fifos[i].vaddr + rel_fifos[i].rd_ptr * rel_fifos[i].elem_size;
 			NNP_ASSERT(rel_fifo_elem);
-			new_element_found = rel_fifo_elem->is_new;
-			if (new_element_found) {
+			if (!rel_fifo_elem->is_new)
+				break;
 #ifdef _DEBUG
-				struct sphcs_p2p_buf *buf = src_bufs[fw_fifo_elem->sbid];
+			{
+				struct sphcs_p2p_buf *buf = src_bufs[rel_fifo_elem->sbid];
 
 				if (buf != NULL)
-					NNP_ASSERT(buf->buf_id == fw_fifo_elem->sbid);
-#endif
-				sph_log_debug(EXECUTE_COMMAND_LOG, "Credit released for src buffer %u\n", rel_fifo_elem->sbid);
-				s_p2p_cbs->data_consumed(src_bufs[rel_fifo_elem->sbid]);
-				/* Mark the element as handled and promote the read ptr */
-				rel_fifo_elem->is_new = 0;
-				rel_fifos[i].rd_ptr = inc_fifo_ptr(rel_fifos[i].depth, rel_fifos[i].rd_ptr);
+					NNP_ASSERT(buf->buf_id == rel_fifo_elem->sbid);
 			}
-		} while (new_element_found);
+#endif
+			sph_log_debug(EXECUTE_COMMAND_LOG, "Credit released for src buffer %u slot %u\n", rel_fifo_elem->sbid, rel_fifo_elem->slot);
+			p2p_cr_batch_add(&batch, src_bufs[rel_fifo_elem->sbid], rel_fifo_elem->slot);
+			/* Mark the element as handled and promote the read ptr */
+			rel_fifo_elem->is_new = 0;
+			rel_fifos[i].rd_ptr = inc_fifo_ptr(rel_fifos[i].depth, rel_fifos[i].rd_ptr);
+		}
 	}
+	p2p_cr_batch_flush(&batch);
+
+	return 0;
+}
+
+static int p2p_init_peer_fifo(struct sphcs_p2p_peer_fifo *fifo, u32 batch_lli_idx)
+{
+	fifo->depth = CR_FIFO_DEPTH;
+	fifo->wr_cnt = 0;
+	fifo->sent_cnt = 0;
+	fifo->done_cnt = 0;
+	fifo->xfer_inflight = false;
+	spin_lock_init(&fifo->lock);
+
+	fifo->batch_lli.vptr = (u8 *)batch_llis_vaddr + batch_lli_idx * P2P_BATCH_LLI_SIZE;
+	fifo->batch_lli.dma_addr = batch_llis_dma_addr + batch_lli_idx * P2P_BATCH_LLI_SIZE;
+
+	fifo->reqs = kcalloc(CR_FIFO_DEPTH, sizeof(struct sphcs_p2p_cr_req), GFP_KERNEL);
+	if (fifo->reqs == NULL)
+		return -ENOMEM;
 
 	return 0;
 }
@@ -544,6 +765,15 @@ int sphcs_p2p_init(struct sphcs *sphcs, struct sphcs_p2p_cbs *p2p_cbs)
 	u32 i;
 	int rc = 0;
 
+	batch_llis_vaddr = dma_alloc_coherent(sphcs->hw_device,
+					      2 * MAX_NUM_OF_P2P_DEVS * P2P_BATCH_LLI_SIZE,
+					      &batch_llis_dma_addr,
+					      GFP_KERNEL);
+	if (batch_llis_vaddr == NULL) {
+		sph_log_err(GENERAL_LOG, "couldn't allocate memory\n");
+		return -ENOMEM;
+	}
+
 	for (i = 0; i < MAX_NUM_OF_P2P_DEVS; i++) {
 
 		p2p_producers[i].peer_db.buf_vaddr = dma_alloc_coherent(sphcs->hw_device, 1, &p2p_producers[i].peer_db.buf_dma_addr, GFP_KERNEL);
@@ -554,9 +784,11 @@ int sphcs_p2p_init(struct sphcs *sphcs, struct sphcs_p2p_cbs *p2p_cbs)
 		}
 		*(u8 *)p2p_producers[i].peer_db.buf_vaddr = 0x80;
 
-		p2p_producers[i].peer_cr_fifo.depth = CR_FIFO_DEPTH;
-		p2p_producers[i].peer_cr_fifo.wr_ptr = 0;
-		spin_lock_init(&p2p_producers[i].peer_cr_fifo.lock);
+		if (p2p_init_peer_fifo(&p2p_producers[i].peer_cr_fifo, 2 * i) != 0) {
+			sph_log_err(GENERAL_LOG, "couldn't allocate memory\n");
+			rc = -ENOMEM;
+			goto err;
+		}
 		/* We send release credit messages to producers */
 		p2p_producers[i].peer_cr_fifo.elem_size = sizeof(struct sphcs_p2p_rel_cr_fifo_elem);
 		p2p_producers[i].peer_cr_fifo.buf_vaddr = dma_alloc_coherent(sphcs->hw_device,
@@ -584,9 +816,11 @@ int sphcs_p2p_init(struct sphcs *sphcs, struct sphcs_p2p_cbs *p2p_cbs)
 		}
 		*(u8 *)p2p_consumers[i].peer_db.buf_vaddr = 0x80;
 
-		p2p_consumers[i].peer_cr_fifo.depth = CR_FIFO_DEPTH;
-		p2p_consumers[i].peer_cr_fifo.wr_ptr = 0;
-		spin_lock_init(&p2p_consumers[i].peer_cr_fifo.lock);
+		if (p2p_init_peer_fifo(&p2p_consumers[i].peer_cr_fifo, 2 * i + 1) != 0) {
+			sph_log_err(GENERAL_LOG, "couldn't allocate memory\n");
+			rc = -ENOMEM;
+			goto err;
+		}
 		/* We send forward credit messages to consumers */
 		p2p_consumers[i].peer_cr_fifo.elem_size = sizeof(struct sphcs_p2p_fw_cr_fifo_elem);
 		p2p_consumers[i].peer_cr_fifo.buf_vaddr = dma_alloc_coherent(sphcs->hw_device,
@@ -710,6 +944,9 @@ void sphcs_p2p_fini(struct sphcs *sphcs)
 		if (p2p_producers[i].peer_cr_fifo.llis)
 			kzfree(p2p_producers[i].peer_cr_fifo.llis);
 
+		kfree(p2p_producers[i].peer_cr_fifo.reqs);
+		p2p_producers[i].peer_cr_fifo.reqs = NULL;
+
 		if (p2p_consumers[i].peer_db.buf_vaddr) {
 			dma_free_coherent(sphcs->hw_device,
 					  1,
@@ -728,6 +965,9 @@ void sphcs_p2p_fini(struct sphcs *sphcs)
 		if (p2p_consumers[i].peer_cr_fifo.llis)
 			kzfree(p2p_consumers[i].peer_cr_fifo.llis);
 
+		kfree(p2p_consumers[i].peer_cr_fifo.reqs);
+		p2p_consumers[i].peer_cr_fifo.reqs = NULL;
+
 		if (!IS_ERR_OR_NULL(fw_fifos[i].buf_handle)) {
 			if (fw_fifos[i].sgt->nents)
 				dma_unmap_sg(sphcs->hw_device,
@@ -748,4 +988,14 @@ void sphcs_p2p_fini(struct sphcs *sphcs)
 		}
 	}
 
+	bitmap_zero(fw_fifos_used, MAX_NUM_OF_P2P_DEVS);
+	bitmap_zero(rel_fifos_used, MAX_NUM_OF_P2P_DEVS);
+
+	if (batch_llis_vaddr) {
+		dma_free_coherent(sphcs->hw_device,
+				  2 * MAX_NUM_OF_P2P_DEVS * P2P_BATCH_LLI_SIZE,
+				  batch_llis_vaddr,
+				  batch_llis_dma_addr);
+		batch_llis_vaddr = NULL;
+	}
 }
@@ -15,6 +15,9 @@
 struct sphcs;
 struct sphcs_p2p_peer_dev;
 
+/* Max number of slots of a p2p buffer, slot index must fit credit bits */
+#define SPHCS_P2P_MAX_SLOTS 8
+
 struct sphcs_p2p_buf {
 	/* For src buffer, ready means that data in the destination buffer
 	 * is consumed and d2d copy may be executed
@@ -26,22 +29,99 @@ struct sphcs_p2p_buf {
 	u8 buf_id;
 	u8 peer_buf_id;
 	struct sphcs_p2p_peer_dev *peer_dev;
+
+	/* The destination buffer is a ring of nslots slots, filled by the
+	 * producer and consumed by the consumer in order. Credits carry the
+	 * slot index.
+	 * For src buffer navail is the number of free slots in the peer,
+	 * for dst buffer it is the number of slots filled and not consumed.
+	 */
+	u8 nslots;
+	u8 wr_slot; /* src: next slot to be filled */
+	u8 rd_slot; /* dst: next slot to be consumed */
+	u8 navail;
 };
 
+/* Credit received from a peer */
+struct sphcs_p2p_credit {
+	struct sphcs_p2p_buf *buf;
+	u8 slot;
+};
+
+/*
+ * Slot accounting, called with the lock of the buffer owner held.
+ */
+static inline void sphcs_p2p_buf_reset_slots(struct sphcs_p2p_buf *buf)
+{
+	buf->wr_slot = 0;
+	buf->rd_slot = 0;
+	buf->navail = buf->is_src_buf ? buf->nslots : 0;
+	buf->ready = (buf->navail > 0);
+}
+
+/* src: take the next free slot of the peer, returns its index */
+static inline u8 sphcs_p2p_buf_fill_slot(struct sphcs_p2p_buf *buf)
+{
+	u8 slot = buf->wr_slot;
+
+	buf->wr_slot = (buf->wr_slot + 1) % buf->nslots;
+	if (buf->navail > 0)
+		buf->navail--;
+	buf->ready = (buf->navail > 0);
+
+	return slot;
+}
+
+/* src: a slot was consumed by the peer */
+static inline void sphcs_p2p_buf_slot_released(struct sphcs_p2p_buf *buf)
+{
+	if (buf->navail < buf->nslots)
+		buf->navail++;
+	buf->ready = true;
+}
+
+/* dst: a slot was filled by the peer */
+static inline void sphcs_p2p_buf_slot_filled(struct sphcs_p2p_buf *buf)
+{
+	if (buf->navail < buf->nslots)
+		buf->navail++;
+	buf->ready = true;
+}
+
+/* dst: consume the oldest filled slot, returns its index */
+static inline u8 sphcs_p2p_buf_consume_slot(struct sphcs_p2p_buf *buf)
+{
+	u8 slot = buf->rd_slot;
+
+	buf->rd_slot = (buf->rd_slot + 1) % buf->nslots;
+	if (buf->navail > 0)
+		buf->navail--;
+	buf->ready = (buf->navail > 0);
+
+	return slot;
+}
+
+/* Max number of buffers passed in one credit callback */
+#define SPHCS_P2P_MAX_CR_BATCH 16
+
 /* */
 struct sphcs_p2p_cbs {
-	/* Called on consumer side when new element is pushed into
-	 * fw cr fifo with dbid equal to buf->buf_id
+	/* Called on consumer side when new elements are pushed into
+	 * fw cr fifos, with the buffers whose buf_id equal to the dbids
+	 * (up to SPHCS_P2P_MAX_CR_BATCH credits per call)
 	 */
-	void (*new_data_arrived)(struct sphcs_p2p_buf *buf);
+	void (*new_data_arrived)(struct sphcs_p2p_credit *crs, u32 ncrs);
 
-	/* Called on producer side when new element is pushed into
-	 * rel cr fifo with sbid equal to buf->buf_id
+	/* Called on producer side when new elements are pushed into
+	 * rel cr fifos, with the buffers whose buf_id equal to the sbids
+	 * (up to SPHCS_P2P_MAX_CR_BATCH credits per call)
 	 */
-	void (*data_consumed)(struct sphcs_p2p_buf *buf);
+	void (*data_consumed)(struct sphcs_p2p_credit *crs, u32 ncrs);
 
-	/* Called when a peer buf is connected or disconnected */
-	enum event_val (*dst_devres_peer)(struct sphcs_p2p_buf *buf, struct sphcs_p2p_peer_dev *peer_dev);
+	/* Called when a peer buf is connected or disconnected,
+	 * peer_nslots is the number of slots of the peer buf
+	 */
+	enum event_val (*dst_devres_peer)(struct sphcs_p2p_buf *buf, struct sphcs_p2p_peer_dev *peer_dev, u8 peer_nslots);
 };
 
 /* Only for SPH EP */
@@ -58,9 +138,11 @@ int sphcs_p2p_init_p2p_buf(bool is_src_buf, struct sphcs_p2p_buf *buf);
 void sphcs_p2p_remove_buffer(struct sphcs_p2p_buf *buf);
 
 int sphcs_p2p_send_fw_cr_and_ring_db(struct sphcs_p2p_buf *buf,
+				     u8 slot,
 				     sphcs_dma_sched_completion_callback callback,
 				     void *callback_ctx);
 int sphcs_p2p_send_rel_cr_and_ring_db(struct sphcs_p2p_buf *buf,
+				      u8 slot,
 				      sphcs_dma_sched_completion_callback callback,
 				      void *callback_ctx);
 
@@ -102,6 +184,7 @@ static inline void sphcs_p2p_remove_buffer(struct sphcs_p2p_buf *buf)
 }
 
 static inline int sphcs_p2p_send_fw_cr_and_ring_db(struct sphcs_p2p_buf *buf,
+					    u8 slot,
 					    sphcs_dma_sched_completion_callback callback,
 					    void *callback_ctx)
 {
@@ -109,6 +192,7 @@ static inline int sphcs_p2p_send_fw_cr_and_ring_db(struct sphcs_p2p_buf *buf,
 }
 
 static inline int sphcs_p2p_send_rel_cr_and_ring_db(struct sphcs_p2p_buf *buf,
+						    u8 slot,
 						    sphcs_dma_sched_completion_callback callback,
 						    void *callback_ctx)
 {
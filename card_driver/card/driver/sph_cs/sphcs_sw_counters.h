@@ -193,7 +193,8 @@ static const struct nnp_sw_counters_set g_sw_counters_set_global = {
 	g_sphcs_sw_counters_info,
 	ARRAY_SIZE(g_sphcs_sw_counters_info),
 	g_sphcs_sw_counters_groups_info,
-	ARRAY_SIZE(g_sphcs_sw_counters_groups_info)};
+	ARRAY_SIZE(g_sphcs_sw_counters_groups_info),
+	true};
 
 enum CTX_SPHCS_SW_COUNTERS_GROUPS {
 	CTX_SPHCS_SW_COUNTERS_GROUP_INFERENCE
@@ -236,7 +237,8 @@ static const struct nnp_sw_counters_set g_sw_counters_set_context = {
 	g_ctx_sphcs_sw_counters_info,
 	ARRAY_SIZE(g_ctx_sphcs_sw_counters_info),
 	g_ctx_sphcs_sw_counters_groups_info,
-	ARRAY_SIZE(g_ctx_sphcs_sw_counters_groups_info)};
+	ARRAY_SIZE(g_ctx_sphcs_sw_counters_groups_info),
+	true};
 
 enum NET_SPHCS_SW_COUNTERS_GROUPS {
 	NET_SPHCS_SW_COUNTERS_GROUP
@@ -19,6 +19,8 @@
 #include <linux/anon_inodes.h>
 #include <linux/uaccess.h>
 #include <linux/fcntl.h>
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
 #include "sph_log.h"
 
 
@@ -103,11 +105,100 @@ struct nnp_internal_sw_counters {
 	struct nnp_sw_counters				sw_counters;
 	struct nnp_internal_sw_counters			*parent;
 	struct gen_sync_attr			        *gen_sync_attr;
+	u64						*pcpu_folded;
+	struct list_head				pcpu_node;
 };
 
 static DEFINE_MUTEX(values_tree_sync_mutex);
 static u64 s_perID_seq;
 
+/* values nodes which have per-CPU shards, protected by s_pcpu_lock */
+static LIST_HEAD(s_pcpu_list);
+static DEFINE_SPINLOCK(s_pcpu_lock);
+
+static unsigned int sw_counters_fold_ms = 100;
+module_param(sw_counters_fold_ms, uint, 0644);
+
+static void pcpu_fold_work_handler(struct work_struct *work);
+static DECLARE_DELAYED_WORK(s_pcpu_fold_work, pcpu_fold_work_handler);
+
+/*
+ * Add the per-CPU shard totals accumulated since the last fold to the
+ * published values. Only counters which changed are written, so counters
+ * updated with the plain macros are left untouched.
+ * Called with s_pcpu_lock held.
+ */
+static void pcpu_fold_node(struct nnp_internal_sw_counters *sw_counters)
+{
+	struct nnp_sw_counters *c = &sw_counters->sw_counters;
+	u32 n = sw_counters->counters_set->counters_count;
+	u64 sum;
+	int cpu;
+	u32 i;
+
+	for (i = 0; i < n; i++) {
+		sum = 0;
+		for_each_possible_cpu(cpu)
+			sum += READ_ONCE(*per_cpu_ptr(c->pcpu_values + i, cpu));
+
+		if (sum != sw_counters->pcpu_folded[i]) {
+			WRITE_ONCE(c->values[i],
+				   c->values[i] + sum - sw_counters->pcpu_folded[i]);
+			sw_counters->pcpu_folded[i] = sum;
+		}
+	}
+}
+
+void nnp_sw_counters_fold_all(void)
+{
+	struct nnp_internal_sw_counters *sw_counters;
+
+	spin_lock(&s_pcpu_lock);
+	list_for_each_entry(sw_counters, &s_pcpu_list, pcpu_node)
+		pcpu_fold_node(sw_counters);
+	spin_unlock(&s_pcpu_lock);
+}
+
+static void pcpu_fold_work_handler(struct work_struct *work)
+{
+	bool empty;
+
+	nnp_sw_counters_fold_all();
+
+	spin_lock(&s_pcpu_lock);
+	empty = list_empty(&s_pcpu_list);
+	spin_unlock(&s_pcpu_lock);
+
+	if (!empty && sw_counters_fold_ms)
+		schedule_delayed_work(&s_pcpu_fold_work,
+				      msecs_to_jiffies(sw_counters_fold_ms));
+}
+
+static void pcpu_add_node(struct nnp_internal_sw_counters *sw_counters)
+{
+	spin_lock(&s_pcpu_lock);
+	list_add_tail(&sw_counters->pcpu_node, &s_pcpu_list);
+	spin_unlock(&s_pcpu_lock);
+
+	if (sw_counters_fold_ms)
+		schedule_delayed_work(&s_pcpu_fold_work,
+				      msecs_to_jiffies(sw_counters_fold_ms));
+}
+
+/* publish the final shard values and detach the node from the aggregator */
+static void pcpu_remove_node(struct nnp_internal_sw_counters *sw_counters)
+{
+	spin_lock(&s_pcpu_lock);
+	pcpu_fold_node(sw_counters);
+	list_del(&sw_counters->pcpu_node);
+	spin_unlock(&s_pcpu_lock);
+
+	free_percpu(sw_counters->sw_counters.pcpu_values);
+	kfree(sw_counters->pcpu_folded);
+	sw_counters->sw_counters.pcpu_values = NULL;
+	sw_counters->pcpu_folded = NULL;
+}
+
 /* create counters description buffer object */
 int create_sw_counters_description_data(const  struct nnp_sw_counters_set *counters_set,
 					bool isRoot,
@@ -229,14 +320,17 @@ static ssize_t read_nnp_counter_bin_values(struct file *f,
 
 	struct nnp_sw_counters_bin_file_attr *counters_att = (struct nnp_sw_counters_bin_file_attr *)attr;
 
-	if (!counters_att->bin_page || !counters_att->page_count)
+	if (!counters_att->bin_page || !counters_att->page_count) {
 		ret = -1;
-	else
+	} else {
+		if (offset == 0)
+			nnp_sw_counters_fold_all();
 		ret = memory_read_from_buffer(buf,
 					      count,
 					      &offset,
 					      page_address(counters_att->bin_page),
 					      counters_att->page_count * PAGE_SIZE);
+	}
 	return ret;
 }
 
@@ -598,6 +692,12 @@ static long gen_sync_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 
 	client_refresh_dirty_updated(client->gen_sync);
 
+	/*
+	 * Publish all per-CPU shards, so a client that refreshes through
+	 * gen_sync reads values which are up to date as of this call.
+	 */
+	nnp_sw_counters_fold_all();
+
 	return 0;
 }
 
@@ -841,6 +941,10 @@ int nnp_remove_sw_counters_info_node(void *hInfoNode)
 	remove_group_files(sw_counters_info);
 	release_bin_file(sw_counters_info->kobj, &sw_counters_info->bin_file);
 
+	/* root info node is removed on unload, stop the aggregator */
+	if (!sw_counters_info->parent)
+		cancel_delayed_work_sync(&s_pcpu_fold_work);
+
 	/* remove gen sync attribute if root info node */
 	if (!sw_counters_info->parent &&
 	    sw_counters_info->gen_sync_attr) {
@@ -1091,6 +1195,26 @@ int nnp_create_sw_counters_values_node(void *hInfoNode,
 		sw_counters_values->sw_counters.spinlocks = NULL;
 	}
 
+	/* allocate per-CPU shards for hot path counters */
+	if (sw_counters_info->counters_set->perCPU && counters_size > 0) {
+		n = sw_counters_info->counters_set->counters_count;
+		sw_counters_values->sw_counters.pcpu_values =
+			__alloc_percpu(n * NNP_COUNTER_SIZE, NNP_COUNTER_SIZE);
+		sw_counters_values->pcpu_folded = kcalloc(n,
+							  NNP_COUNTER_SIZE,
+							  GFP_KERNEL);
+		if (!sw_counters_values->sw_counters.pcpu_values ||
+		    !sw_counters_values->pcpu_folded) {
+			sph_log_err(GENERAL_LOG, "unable to allocate per-CPU counters\n");
+			free_percpu(sw_counters_values->sw_counters.pcpu_values);
+			kfree(sw_counters_values->pcpu_folded);
+			kfree(sw_counters_values->sw_counters.spinlocks);
+			ret = -ENOMEM;
+			goto cleanup_sw_counters_children_kobject_list;
+		}
+		pcpu_add_node(sw_counters_values);
+	}
+
 	/* set the external buffer to user */
 	*counters = &(sw_counters_values->sw_counters);
 
@@ -1153,6 +1277,8 @@ int nnp_sw_counters_release_values_node(struct nnp_internal_sw_counters *sw_coun
 	}
 	root_dirty = ++(*tmp_sw_counters_values->dirty);
 
+	if (sw_counters_values->sw_counters.pcpu_values)
+		pcpu_remove_node(sw_counters_values);
 
 
 	remove_group_files(sw_counters_values);
@@ -19,6 +19,7 @@
 #define IOCTL_GENMSG_ACCEPT_CLIENT	_IOR('G', 1, int)
 #define IOCTL_GENMSG_WRITE_RESPONSE_WAIT _IO('G', 2)
 #define IOCTL_GENMSG_IS_PRIVILEGED      _IOR('G', 3, int)
+#define IOCTL_GENMSG_SET_STREAM_MODE    _IOW('G', 4, int)
 
 struct ioctl_register_service {
 	uint32_t name_len;
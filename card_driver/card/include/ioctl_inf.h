@@ -28,6 +28,7 @@
 #define IOCTL_INF_DEVNET_RESOURCES_RESERVATION_REPLY _IOW('I', 8, struct inf_devnet_resource_reserve_reply)
 #define IOCTL_INF_GET_ALLOC_PGT          _IOWR('I', 10, struct inf_get_alloc_pgt)
 #define IOCTL_INF_DEVNET_RESET_REPLY      _IOW('I', 11, struct inf_devnet_reset_reply)
+#define IOCTL_INF_SET_RUNTIME_CAPS        _IOW('I', 12, uint32_t)
 #ifdef ULT
 #define IOCTL_INF_SWITCH_DAEMON            _IO('I', 9)
 #endif
@@ -68,6 +69,10 @@ struct inf_sched_params {
 #define SPHCS_RUNTIME_CMD_DESTROY_INFREQ    10
 #define SPHCS_RUNTIME_CMD_DEVNET_RESOURCES_RESERVATION  11
 #define SPHCS_RUNTIME_CMD_DEVNET_RESET  12
+#define SPHCS_RUNTIME_CMD_EXECUTE_INFREQ_SLOTS  13
+
+/* Runtime capabilities, set by the runtime with IOCTL_INF_SET_RUNTIME_CAPS */
+#define INF_RT_CAP_P2P_SLOTS         1 /* handles SPHCS_RUNTIME_CMD_EXECUTE_INFREQ_SLOTS */
 
 /* IoctlSphcsError should be EQUAL to SphcsError!! */
 typedef enum {
@@ -178,6 +183,24 @@ struct inf_exec_infreq {
 	uint8_t  sched_params_is_null;
 };
 
+#define INF_P2P_SLOT_BITS 4
+#define INF_P2P_MAX_SLOTTED_INPUTS (64 / INF_P2P_SLOT_BITS)
+#define INF_EXEC_INFREQ_SLOTS_VERSION 1
+
+/*
+ * Sent right before SPHCS_RUNTIME_CMD_EXECUTE_INFREQ of a request which
+ * has p2p destination inputs with depth > 1.
+ * p2p_slots holds the slot to read of each such input,
+ * INF_P2P_SLOT_BITS per input in input order.
+ * Slot N data is at offset N * (resource size / depth).
+ */
+struct inf_exec_infreq_slots {
+	uint64_t infreq_rt_handle;
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t p2p_slots;
+};
+
 struct inf_infreq_exec_done {
 	uint64_t	infreq_drv_handle;
 	uint32_t	infreq_ctx_id;
@@ -19,6 +19,7 @@
 #include <linux/sched.h>
 #include <linux/firmware.h>
 #include <linux/timer.h>
+#include <linux/ktime.h>
 #include "bootimage.h"
 #include "device.h"
 #include "nnp_log.h"
@@ -41,11 +42,13 @@ struct image_wait_list {
 struct image_info {
 	char             name[MAX_IMAGE_NAME_LEN];
 	enum image_state state;
-	struct nnp_device *requested_nnpdev;
+	struct device   *load_dev;  /* referenced device to load the image for */
 	struct nnpdrv_host_resource  *hostres;
 	struct list_head wait_list;
 	struct work_struct work;
 	struct list_head node;
+	unsigned long    last_used; /* jiffies of last map request */
+	ktime_t          load_start;
 };
 
 struct nnpdrv_bootimage {
@@ -58,6 +61,14 @@ struct nnpdrv_bootimage {
 static struct nnpdrv_bootimage *s_boot_loader;
 static DEFINE_MUTEX(s_lock);
 
+/* images used within this period are not garbage collected */
+static unsigned int bootimage_keep_sec = 300;
+module_param(bootimage_keep_sec, uint, 0600);
+
+/* report time from device probe to boot image delivery */
+static bool bootimage_measure;
+module_param(bootimage_measure, bool, 0600);
+
 static void garbage_collect_work_handler(struct work_struct *work);
 
 static void loaded_images_garbage_collect(struct timer_list *timer)
@@ -121,8 +132,10 @@ static void image_load_state_changed(struct image_info *image)
 	}
 }
 
-static int load_firmware_no_copy(struct image_info *image_info)
+static int load_firmware_no_copy(struct image_info            *image_info,
+				 struct nnpdrv_host_resource **out_hostres)
 {
+	struct nnpdrv_host_resource *hostres;
 	const struct firmware *fw;
 	struct kstat stat;
 	struct path path;
@@ -167,7 +180,7 @@ static int load_firmware_no_copy(struct image_info *image_info)
 
 	ret = nnpdrv_hostres_create(stat.size,
 				    DMA_TO_DEVICE,
-				    &image_info->hostres);
+				    &hostres);
 	if (ret) {
 		nnp_log_err(GENERAL_LOG,
 			    "failed to create host resource for boot image size=%lld error=%d\n",
@@ -176,35 +189,33 @@ static int load_firmware_no_copy(struct image_info *image_info)
 		return ret;
 	}
 
-	ret = nnpdrv_hostres_vmap(image_info->hostres, &vptr);
+	ret = nnpdrv_hostres_vmap(hostres, &vptr);
 	if (ret) {
 		nnp_log_err(GENERAL_LOG,
 			    "failed to vmap host resource error=%d\n",
 			    ret);
-		nnpdrv_hostres_destroy(image_info->hostres);
-		image_info->hostres = 0;
+		nnpdrv_hostres_destroy(hostres);
 		return ret;
 	}
 
 	ret = request_firmware_into_buf(&fw,
 			image_info->name,
-			image_info->requested_nnpdev->hw_device_info->hw_device,
+			image_info->load_dev,
 			vptr,
 			stat.size);
 	if (ret) {
 		nnp_log_err(GENERAL_LOG,
 			    "failed to load firmware %s ret==%d\n",
 			    image_info->name, ret);
-		nnpdrv_hostres_vunmap(image_info->hostres, vptr);
-		nnpdrv_hostres_destroy(image_info->hostres);
-		image_info->hostres = 0;
+		nnpdrv_hostres_vunmap(hostres, vptr);
+		nnpdrv_hostres_destroy(hostres);
 		return ret;
 	}
 
-	nnpdrv_hostres_vunmap(image_info->hostres, vptr);
+	nnpdrv_hostres_vunmap(hostres, vptr);
 	release_firmware(fw);
-	image_info->state = IMAGE_AVAILABLE;
 
+	*out_hostres = hostres;
 	return 0;
 }
 
@@ -215,61 +226,81 @@ static void load_image_handler(struct work_struct *work)
 						     work);
 
 	const struct firmware *fw;
+	struct nnpdrv_host_resource *hostres = NULL;
+	enum image_state state = IMAGE_LOAD_FAILED;
 	void *vptr;
 	int ret;
 
-	mutex_lock(&s_lock);
+	/*
+	 * The image is loaded without holding s_lock so several images
+	 * may be loaded concurrently. Only the image name and load_dev,
+	 * which do not change while the image is in IMAGE_REQUESTED
+	 * state, are used here. The loaded host resource is published
+	 * together with the new state under s_lock.
+	 */
 
 	/* First, try to load image without extra memcpy */
-	ret = load_firmware_no_copy(image_info);
-	if (ret == 0)
+	ret = load_firmware_no_copy(image_info, &hostres);
+	if (ret == 0) {
+		state = IMAGE_AVAILABLE;
 		goto done;
+	}
 
 	/* Try to load firmware to kernel allocated memory */
 	ret = request_firmware(&fw,
 		image_info->name,
-		image_info->requested_nnpdev->hw_device_info->hw_device);
+		image_info->load_dev);
 
 	if (ret) {
 		nnp_log_err(GENERAL_LOG, "failed to load boot image %s error=%d\n",
 			    image_info->name,
 			    ret);
-		image_info->state = IMAGE_LOAD_FAILED;
 		goto done;
 	}
 
 	ret = nnpdrv_hostres_create(fw->size,
 				    DMA_TO_DEVICE,
-				    &image_info->hostres);
+				    &hostres);
 	if (ret) {
 		nnp_log_err(GENERAL_LOG,
 			    "failed to create host resource for boot image size=%ld error=%d\n",
 			    fw->size,
 			    ret);
-		image_info->state = IMAGE_LOAD_FAILED;
 		goto free_fw;
 	}
 
-	ret = nnpdrv_hostres_vmap(image_info->hostres, &vptr);
+	ret = nnpdrv_hostres_vmap(hostres, &vptr);
 	if (ret) {
 		nnp_log_err(GENERAL_LOG,
 			    "failed to vmap host resource error=%d\n", ret);
-		image_info->state = IMAGE_LOAD_FAILED;
-		nnpdrv_hostres_destroy(image_info->hostres);
-		image_info->hostres = 0;
+		nnpdrv_hostres_destroy(hostres);
+		hostres = NULL;
 		goto free_fw;
 	}
 
 	/* Copy image data */
 	memcpy(vptr, fw->data, fw->size);
-	nnpdrv_hostres_vunmap(image_info->hostres, vptr);
+	nnpdrv_hostres_vunmap(hostres, vptr);
 
-	image_info->state = IMAGE_AVAILABLE;
+	state = IMAGE_AVAILABLE;
 
 free_fw:
 	release_firmware(fw);
 done:
+	if (bootimage_measure)
+		nnp_log_info(GENERAL_LOG, "Boot image %s load %s in %lld ms\n",
+			     image_info->name,
+			     state == IMAGE_AVAILABLE ?
+			     "done" : "failed",
+			     ktime_ms_delta(ktime_get(),
+					    image_info->load_start));
+
 	/* give the boot image to waiting devices */
+	mutex_lock(&s_lock);
+	image_info->hostres = hostres;
+	image_info->state = state;
+	put_device(image_info->load_dev);
+	image_info->load_dev = NULL;
 	image_load_state_changed(image_info);
 	mutex_unlock(&s_lock);
 }
@@ -304,6 +335,7 @@ static int map_image(struct nnp_device    *nnpdev,
 			}
 
 	if (found) {
+		image_info->last_used = jiffies;
 		if (image_info->state == IMAGE_AVAILABLE) {
 			ret = nnpdrv_hostres_map_device(image_info->hostres,
 							nnpdev,
@@ -338,7 +370,10 @@ static int map_image(struct nnp_device    *nnpdev,
 				strncpy(image_info->name, image_name,
 					MAX_IMAGE_NAME_LEN - 1);
 				image_info->state = IMAGE_REQUESTED;
-				image_info->requested_nnpdev = nnpdev;
+				image_info->load_dev = get_device(
+					nnpdev->hw_device_info->hw_device);
+				image_info->last_used = jiffies;
+				image_info->load_start = ktime_get();
 				INIT_LIST_HEAD(&image_info->wait_list);
 				INIT_WORK(&image_info->work,
 					  load_image_handler);
@@ -391,6 +426,12 @@ static bool image_remove(struct image_info *image)
 		if (image->state == IMAGE_AVAILABLE &&
 		    nnpdrv_hostres_read_refcount(image->hostres) > 1)
 			return false;
+
+		/* keep recently used images resident for next boots */
+		if (image->state == IMAGE_AVAILABLE &&
+		    time_before(jiffies, image->last_used +
+				msecs_to_jiffies(bootimage_keep_sec * 1000)))
+			return false;
 	}
 
 	/* OK to destroy and delete image */
@@ -473,6 +514,13 @@ int nnpdrv_bootimage_load_boot_image(struct nnp_device    *nnpdev,
 					   sizeof(msg) / sizeof(u64),
 					   NULL);
 
+		if (bootimage_measure && !ret)
+			nnp_log_info(GENERAL_LOG,
+				     "Boot image %s delivered to device %u %lld ms after probe\n",
+				     image_info->name, nnpdev->id,
+				     ktime_ms_delta(ktime_get(),
+						    nnpdev->probe_time));
+
 	} else if (ret != -ENOENT) {
 		/* notify card that boot image cannot be loaded */
 		nnpdev->hw_ops->set_host_doorbell_value(
@@ -513,8 +561,25 @@ int nnpdrv_bootimage_unload_boot_image(struct nnp_device    *nnpdev,
 	return ret;
 }
 
+/*
+ * must be called when s_lock is held.
+ * returns an image which is still being loaded, if any
+ */
+static struct image_info *find_loading_image(void)
+{
+	struct image_info *image;
+
+	list_for_each_entry(image, &s_boot_loader->boot_images, node)
+		if (image->state == IMAGE_REQUESTED)
+			return image;
+
+	return NULL;
+}
+
 void nnpdrv_bootimage_fini(void)
 {
+	struct image_info *image;
+
 	mutex_lock(&s_lock);
 	if (!s_boot_loader) {
 		mutex_unlock(&s_lock);
@@ -528,6 +593,18 @@ void nnpdrv_bootimage_fini(void)
 	 */
 	del_timer(&s_boot_loader->garbage_collect_timer);
 	cancel_work_sync(&s_boot_loader->garbage_collect_work);
+
+	/*
+	 * image load work runs without s_lock, wait for it to finish
+	 * before images are forcibly removed. An image in REQUESTED
+	 * state is never removed while unloading_module is not set.
+	 */
+	while ((image = find_loading_image()) != NULL) {
+		mutex_unlock(&s_lock);
+		flush_work(&image->work);
+		mutex_lock(&s_lock);
+	}
+
 	s_boot_loader->unloading_module = 1;
 	mutex_unlock(&s_lock);
 	garbage_collect_work_handler(&s_boot_loader->garbage_collect_work);
@@ -15,6 +15,7 @@
 #include <linux/sched/clock.h>
 #include <linux/mutex.h>
 #include <linux/debugfs.h>
+#include <linux/dmapool.h>
 #include "nnp_log.h"
 #include "nnp_debug.h"
 #include "pcie.h"
@@ -504,6 +505,7 @@ static void nnpdrv_device_process_events(struct nnp_device *nnpdev,
 			nnpdev->host_crash_dump.dump_size =
 				((u32)event_msg->obj_id_2 << 16) |
 				(u32)event_msg->obj_id;
+			nnpdev->host_crash_dump.gen++;
 			nnpdev->counters.uncorr.os_crashed++;
 			break;
 		case NNP_IPC_ERROR_PCI_ERROR:
@@ -1293,6 +1295,8 @@ int nnpdrv_device_create(void                              *hw_handle,
 	if (!nnpdev)
 		return -ENOMEM;
 
+	nnpdev->probe_time = ktime_get();
+
 	nnpdev->id = -1;
 	ret = ida_simple_get(&s_dev_ida, 0, NNP_MAX_DEVS, GFP_KERNEL);
 	if (ret < 0) {
@@ -1358,6 +1362,7 @@ int nnpdrv_device_create(void                              *hw_handle,
 	}
 
 	/* setup crash dump memory */
+	mutex_init(&nnpdev->host_crash_dump.unpack_mutex);
 	nnpdev->host_crash_dump.vaddr = dma_alloc_coherent(
 					nnpdev->hw_device_info->hw_device,
 					1lu << (NNP_PAGE_SHIFT +
@@ -1388,6 +1393,17 @@ int nnpdrv_device_create(void                              *hw_handle,
 		(struct nnp_sys_info *)((uintptr_t)nnpdev->bios_system_info +
 					NNP_PAGE_SIZE);
 
+	/* pool of host resource DMA chain pages */
+	nnpdev->dma_chain_pool = dma_pool_create("nnp_dma_chain",
+					nnpdev->hw_device_info->hw_device,
+					NNP_PAGE_SIZE, NNP_PAGE_SIZE, 0);
+	if (!nnpdev->dma_chain_pool) {
+		nnp_log_err(START_UP_LOG,
+			    "FATAL: failed to create dma chain pool\n");
+		ret = -ENOMEM;
+		goto err_exit;
+	}
+
 	/* Create the character device interface to this device */
 	ret = nnpdev_device_chardev_create(nnpdev);
 	if (ret)
@@ -1413,6 +1429,7 @@ int nnpdrv_device_create(void                              *hw_handle,
 	return 0;
 
 err_exit:
+	dma_pool_destroy(nnpdev->dma_chain_pool);
 	if (nnpdev->bios_system_info)
 		dma_free_coherent(nnpdev->hw_device_info->hw_device,
 				  2 * NNP_PAGE_SIZE,
@@ -1424,6 +1441,7 @@ err_exit:
 					NNP_CRASH_DUMP_SIZE_PAGE_ORDER),
 				nnpdev->host_crash_dump.vaddr,
 				nnpdev->host_crash_dump.dma_addr);
+	kvfree(nnpdev->host_crash_dump.unpacked);
 	if (nnpdev->wq)
 		destroy_workqueue(nnpdev->wq);
 	nnpdrv_destroy_cmd_queue(nnpdev, nnpdev->public_cmdq);
@@ -1595,12 +1613,15 @@ static void nnpdrv_free_device(struct work_struct *work)
 			1 << (NNP_PAGE_SHIFT + NNP_CRASH_DUMP_SIZE_PAGE_ORDER),
 			nnpdev->host_crash_dump.vaddr,
 			nnpdev->host_crash_dump.dma_addr);
+	kvfree(nnpdev->host_crash_dump.unpacked);
 
 	dma_free_coherent(nnpdev->hw_device_info->hw_device,
 			  2 * NNP_PAGE_SIZE,
 			  nnpdev->bios_system_info,
 			  nnpdev->bios_system_info_dma_addr);
 
+	dma_pool_destroy(nnpdev->dma_chain_pool);
+
 	destroy_workqueue(nnpdev->wq);
 
 	if (nnpdrv_destroy_cmd_queue(nnpdev, nnpdev->public_cmdq))
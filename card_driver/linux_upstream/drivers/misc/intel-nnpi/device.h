@@ -14,7 +14,9 @@
 #include <linux/idr.h>
 #include <linux/hashtable.h>
 #include <linux/spinlock.h>
+#include <linux/mutex.h>
 #include <linux/cdev.h>
+#include <linux/ktime.h>
 #include "pcie.h"
 #include "msg_scheduler.h"
 #include "nnp_inbound_mem.h"
@@ -60,6 +62,15 @@ struct host_crash_dump {
 	void *vaddr;
 	dma_addr_t dma_addr;
 	u32 dump_size;
+	u32 gen; /* bumped on every crash event, protected by nnpdev->lock */
+
+	u32 inbound_crc; /* crc of last dump seen in inbound_mem */
+
+	/* protects the unpacked copy below and readers of it */
+	struct mutex unpack_mutex;
+	void *unpacked;
+	u32 unpacked_size;
+	u32 unpacked_gen;
 };
 
 struct nnp_device_counters {
@@ -152,6 +163,7 @@ struct nnp_device {
 
 	u32          id;
 	char         name[DEVICE_NAME_LEN];
+	ktime_t      probe_time;
 	u32          boot_image_loaded;
 	char         reset_boot_image_path[NNP_DEVICE_MAX_BOOT_IMAGE_PATH_SIZE];
 
@@ -189,6 +201,8 @@ struct nnp_device {
 
 	struct dentry *debugfs_dir;
 
+	struct dma_pool *dma_chain_pool; /* hostres DMA chain pages */
+
 	bool ipc_h2c_en[IPC_OP_MAX];
 	bool ipc_c2h_en[IPC_OP_MAX];
 	u8   ipc_chan_resp_op_size[32];
@@ -11,6 +11,9 @@
 #include <linux/device.h>
 #include <linux/kobject.h>
 #include <linux/delay.h>
+#include <linux/mm.h>
+#include <linux/lz4.h>
+#include <linux/crc32.h>
 #include "cmd_chan.h"
 #include "nnp_inbound_mem.h"
 #include "nnp_log.h"
@@ -814,30 +817,147 @@ static ssize_t pcie_inject_store(struct device           *dev,
 }
 static DEVICE_ATTR_WO(pcie_inject);
 
-static ssize_t crashlog_size_show(struct device           *dev,
-				  struct device_attribute *attr,
-				  char                    *buf)
+/*
+ * If the card sent an LZ4 compressed crash dump, expand it into a host
+ * buffer which is kept until the next crash event. Otherwise the dump
+ * is returned as is. Called with unpack_mutex held.
+ */
+static int crashlog_unpack(struct nnp_device *nnpdev, u32 gen,
+			   void **vaddr, u32 *dump_size)
 {
-	struct nnp_device *nnpdev;
+	struct host_crash_dump *hcd = &nnpdev->host_crash_dump;
+	const struct nnp_crash_dump_lz4_hdr *hdr = *vaddr;
+	u32 orig_size, comp_size;
+	ktime_t start;
+	s64 usec;
+	void *out;
+	int ret = 0;
+	int n;
+
+	if (*dump_size < sizeof(*hdr) ||
+	    le32_to_cpu(hdr->magic) != NNP_CRASH_DUMP_LZ4_MAGIC)
+		return 0;
+
+	orig_size = le32_to_cpu(hdr->orig_size);
+	comp_size = le32_to_cpu(hdr->comp_size);
+	if (comp_size > *dump_size - sizeof(*hdr) ||
+	    orig_size > NNP_CRASH_DUMP_LZ4_MAX_ORIG)
+		return -EINVAL;
+
+	lockdep_assert_held(&hcd->unpack_mutex);
+
+	if (hcd->unpacked && hcd->unpacked_gen == gen)
+		goto done;
+
+	kvfree(hcd->unpacked);
+	hcd->unpacked = NULL;
+
+	out = kvmalloc(orig_size, GFP_KERNEL);
+	if (!out)
+		return -ENOMEM;
+
+	start = ktime_get();
+	n = LZ4_decompress_safe((const char *)hdr->data, out,
+				comp_size, orig_size);
+	usec = ktime_us_delta(ktime_get(), start);
+	if (n != orig_size) {
+		nnp_log_err(GENERAL_LOG, "crash dump decompress failed %d\n",
+			    n);
+		kvfree(out);
+		return -EIO;
+	}
+
+	nnp_log_info(GENERAL_LOG,
+		     "crash dump: %u bytes unpacked from %u, ratio %u.%02u, %lld usec\n",
+		     orig_size, comp_size + (u32)sizeof(*hdr),
+		     orig_size / (comp_size + (u32)sizeof(*hdr)),
+		     (orig_size * 100 / (comp_size + (u32)sizeof(*hdr))) % 100,
+		     usec);
+
+	hcd->unpacked = out;
+	hcd->unpacked_size = orig_size;
+	hcd->unpacked_gen = gen;
+
+done:
+	*vaddr = hcd->unpacked;
+	*dump_size = hcd->unpacked_size;
+
+	return ret;
+}
+
+/*
+ * Returns the crash dump with unpack_mutex held, so an unpacked dump
+ * is not freed while it is used. Must be followed by crashlog_put().
+ */
+static u32 crashlog_get(struct nnp_device *nnpdev, void **vaddr)
+{
+	struct host_crash_dump *hcd = &nnpdev->host_crash_dump;
+	bool inbound = false;
 	u32 dump_size;
+	u32 crc;
+	u32 gen;
 
-	nnpdev = (struct nnp_device *)dev_get_drvdata(dev);
-	if (!nnpdev)
-		return -EINVAL;
+	mutex_lock(&hcd->unpack_mutex);
 
 	spin_lock(&nnpdev->lock);
 
+	gen = nnpdev->host_crash_dump.gen;
 	if (nnpdev->host_crash_dump.dump_size) {
 		dump_size = nnpdev->host_crash_dump.dump_size;
+		*vaddr = nnpdev->host_crash_dump.vaddr;
 	} else if (nnpdev->inbound_mem &&
 		   nnpdev->inbound_mem->magic == NNP_INBOUND_MEM_MAGIC &&
 		   nnpdev->inbound_mem->crash_dump_size) {
 		dump_size = nnpdev->inbound_mem->crash_dump_size;
+		*vaddr = nnpdev->inbound_mem->crash_dump;
+		inbound = true;
 	} else {
 		dump_size = 0;
+		*vaddr = NULL;
 	}
 	spin_unlock(&nnpdev->lock);
 
+	/*
+	 * No crash event is received for a dump found only in inbound_mem,
+	 * so a new dump there is detected by its content.
+	 */
+	if (inbound) {
+		crc = crc32_le(~0, *vaddr, dump_size);
+		spin_lock(&nnpdev->lock);
+		if (crc != hcd->inbound_crc) {
+			hcd->inbound_crc = crc;
+			hcd->gen++;
+		}
+		gen = hcd->gen;
+		spin_unlock(&nnpdev->lock);
+	}
+
+	if (dump_size && crashlog_unpack(nnpdev, gen, vaddr, &dump_size))
+		dump_size = 0;
+
+	return dump_size;
+}
+
+static inline void crashlog_put(struct nnp_device *nnpdev)
+{
+	mutex_unlock(&nnpdev->host_crash_dump.unpack_mutex);
+}
+
+static ssize_t crashlog_size_show(struct device           *dev,
+				  struct device_attribute *attr,
+				  char                    *buf)
+{
+	struct nnp_device *nnpdev;
+	void *vaddr;
+	u32 dump_size;
+
+	nnpdev = (struct nnp_device *)dev_get_drvdata(dev);
+	if (!nnpdev)
+		return -EINVAL;
+
+	dump_size = crashlog_get(nnpdev, &vaddr);
+	crashlog_put(nnpdev);
+
 	return sprintf(buf, "%d\n", dump_size);
 }
 static DEVICE_ATTR_RO(crashlog_size);
@@ -1091,21 +1211,11 @@ static ssize_t crashlog_read(struct file *filp,
 	if (!nnpdev)
 		return -EINVAL;
 
-	spin_lock(&nnpdev->lock);
-
-	if (nnpdev->host_crash_dump.dump_size) {
-		dump_size = nnpdev->host_crash_dump.dump_size;
-		vaddr = nnpdev->host_crash_dump.vaddr;
-	} else if (nnpdev->inbound_mem &&
-		   nnpdev->inbound_mem->magic == NNP_INBOUND_MEM_MAGIC &&
-		   nnpdev->inbound_mem->crash_dump_size) {
-		dump_size = nnpdev->inbound_mem->crash_dump_size;
-		vaddr = nnpdev->inbound_mem->crash_dump;
-	} else {
+	dump_size = crashlog_get(nnpdev, &vaddr);
+	if (!dump_size) {
 		vaddr = "crashlog empty\n";
 		dump_size = strlen(vaddr);
 	}
-	spin_unlock(&nnpdev->lock);
 
 	if (dump_size > 0) {
 		ret = memory_read_from_buffer(buf,
@@ -1117,6 +1227,8 @@ static ssize_t crashlog_read(struct file *filp,
 		ret = 0;
 	}
 
+	crashlog_put(nnpdev);
+
 	return ret;
 }
 
@@ -1125,7 +1237,7 @@ static const struct bin_attribute crashlog_attr = {
 		.name = "crashlog",
 		.mode = 0400
 	},
-	.size = NNP_CRASH_DUMP_SIZE,
+	.size = NNP_CRASH_DUMP_LZ4_MAX_ORIG,
 	.read = crashlog_read,
 	.write = NULL,
 	.mmap = NULL,
@@ -265,6 +265,143 @@ no_put:
 	return ret;
 }
 
+/* DMA_NONE selects the host resource direction */
+static enum dma_data_direction user_lock_direction(u32 flags)
+{
+	flags &= (IOCTL_INF_RES_INPUT | IOCTL_INF_RES_OUTPUT);
+
+	if (flags == IOCTL_INF_RES_INPUT)
+		return DMA_TO_DEVICE;
+
+	if (flags == IOCTL_INF_RES_OUTPUT)
+		return DMA_FROM_DEVICE;
+
+	if (flags != 0)
+		return DMA_BIDIRECTIONAL;
+
+	return DMA_NONE;
+}
+
+/* Per entry o_errno of a batched lock/unlock */
+static u8 lock_err_to_nnper(int err, bool lock)
+{
+	switch (err) {
+	case 0:
+		return 0;
+	case -EPERM:
+		/* requested access does not match the resource direction */
+		return NNPER_INCOMPATIBLE_RESOURCES;
+	case -EINVAL:
+		return lock ? NNPER_RESOURCE_LOCKED : NNPER_RESOURCE_NOT_LOCKED;
+	case -EBUSY:
+		return NNPER_RESOURCE_BUSY;
+	case -ETIME:
+		return NNPER_TIMED_OUT;
+	case -EINTR:
+		return NNPER_INTERRUPTED;
+	default:
+		return NNPER_DEVICE_ERROR;
+	}
+}
+
+/*
+ * Locks or unlocks an array of host resources with one call.
+ * Lock is all or none, with one timeout for the whole array.
+ */
+static long lock_hostres_batch(struct inf_process_info *proc_info,
+			       void __user             *arg,
+			       bool                     lock)
+{
+	struct nnpdrv_ioctl_lock_hostres_batch batch_args;
+	struct nnpdrv_ioctl_lock_hostres_entry *entries;
+	struct inf_hostres **inf_entries;
+	struct nnpdrv_hostres_lock_req *reqs;
+	unsigned int i, n_got = 0;
+	long ret;
+
+	if (copy_from_user(&batch_args, arg, sizeof(batch_args))) {
+		nnp_log_err(GENERAL_LOG, "copy from user failed\n");
+		return -EIO;
+	}
+
+	batch_args.o_errno = 0;
+	if (batch_args.num_entries == 0 ||
+	    batch_args.num_entries > NNP_MAX_HOSTRES_LOCK_BATCH)
+		return -EINVAL;
+
+	entries = kmalloc_array(batch_args.num_entries, sizeof(*entries),
+				GFP_KERNEL);
+	inf_entries = kmalloc_array(batch_args.num_entries,
+				    sizeof(*inf_entries), GFP_KERNEL);
+	reqs = kmalloc_array(batch_args.num_entries, sizeof(*reqs),
+			     GFP_KERNEL);
+	if (unlikely(!entries || !inf_entries || !reqs)) {
+		ret = -ENOMEM;
+		goto free_mem;
+	}
+
+	if (copy_from_user(entries, u64_to_user_ptr(batch_args.entries),
+			   batch_args.num_entries * sizeof(*entries))) {
+		ret = -EIO;
+		goto free_mem;
+	}
+
+	ret = 0;
+	for (i = 0; i < batch_args.num_entries; i++) {
+		entries[i].o_errno = 0;
+		inf_entries[i] = NNP_IDR_GET_OBJECT(entries[i].user_handle,
+						    inf_hostres_check_and_get);
+		if (unlikely(!inf_entries[i])) {
+			entries[i].o_errno = NNPER_NO_SUCH_RESOURCE;
+			batch_args.o_errno = NNPER_NO_SUCH_RESOURCE;
+			ret = -EFAULT;
+			break;
+		}
+		n_got++;
+
+		reqs[i].res = inf_entries[i]->hostres;
+		reqs[i].dir = user_lock_direction(entries[i].usage_flags);
+	}
+
+	if (likely(ret == 0)) {
+		if (lock)
+			ret = nnpdrv_hostres_user_lock_batch(reqs,
+						batch_args.num_entries,
+						batch_args.timeout_us);
+		else
+			ret = nnpdrv_hostres_user_unlock_batch(reqs,
+						batch_args.num_entries);
+
+		for (i = 0; i < batch_args.num_entries; i++) {
+			entries[i].o_errno = lock_err_to_nnper(reqs[i].err, lock);
+			if (entries[i].o_errno && !batch_args.o_errno)
+				batch_args.o_errno = entries[i].o_errno;
+		}
+
+		if (unlikely(ret < 0))
+			nnp_log_debug(GENERAL_LOG,
+				      "failed to %s host resources batch. err:%ld\n",
+				      lock ? "lock" : "unlock", ret);
+	}
+
+	for (i = 0; i < n_got; i++)
+		inf_hostres_put(inf_entries[i]);
+
+	/* report per entry errors */
+	if (unlikely(ret < 0)) {
+		if (copy_to_user(u64_to_user_ptr(batch_args.entries), entries,
+				 batch_args.num_entries * sizeof(*entries)) ||
+		    copy_to_user(arg, &batch_args, sizeof(batch_args)))
+			ret = -EIO;
+	}
+
+free_mem:
+	kfree(reqs);
+	kfree(inf_entries);
+	kfree(entries);
+	return ret;
+}
+
 struct file *nnpdrv_host_file_get(int host_fd)
 {
 	struct file *host_file;
@@ -352,6 +489,12 @@ static long host_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 	case IOCTL_INF_LOCK_HOST_RESOURCE:
 		ret = lock_hostres(proc_info, (void __user *)arg);
 		break;
+	case IOCTL_INF_LOCK_HOST_RESOURCES:
+		ret = lock_hostres_batch(proc_info, (void __user *)arg, true);
+		break;
+	case IOCTL_INF_UNLOCK_HOST_RESOURCES:
+		ret = lock_hostres_batch(proc_info, (void __user *)arg, false);
+		break;
 	default:
 		nnp_log_err(GENERAL_LOG,
 			    "Unsupported inference host IOCTL 0x%x\n", cmd);
@@ -15,6 +15,14 @@
 #include <linux/atomic.h>
 #include <linux/dma-buf.h>
 #include <linux/pagemap.h>
+#include <linux/dmapool.h>
+#include <linux/hashtable.h>
+#include <linux/mmu_notifier.h>
+#include <linux/sched/clock.h>
+#include <linux/log2.h>
+#include <linux/iommu.h>
+#include <linux/llist.h>
+#include <linux/workqueue.h>
 #include "ipc_protocol.h"
 #include "nnp_debug.h"
 #include "nnp_log.h"
@@ -32,13 +40,36 @@ struct dev_mapping {
 	enum dma_data_direction dir;
 	struct sg_table  *sgt;
 	struct dma_list  *list;
+	struct dma_pool  *pool; /* chain pages pool, NULL if allocated directly */
 	unsigned int      num;
 	unsigned int      entry_pages;
+	bool              shareable; /* may be used by devices in same domain */
 	struct list_head  node;
 
 	struct dma_buf_attachment *dma_att;
 };
 
+/*
+ * Pinned user pages, shared by all host resources created for the same
+ * user range. Each of those resources has its own lock state and device
+ * mappings, only the pinned pages are shared.
+ */
+struct usermem_pin {
+	struct kref       ref;
+	/* registration cache, protected by s_usermem_cache_lock */
+	struct hlist_node cache_node;
+	bool              cached;
+	struct mmu_interval_notifier notifier;
+	bool              mmu_registered;
+	struct mm_struct *mm;
+	uintptr_t         user_addr;
+	size_t            size;
+	enum dma_data_direction dir;
+	struct page     **pages;
+	unsigned int      n_pages;
+	struct llist_node free_node;
+};
+
 struct nnpdrv_host_resource {
 	void             *magic;
 	struct kref       ref;
@@ -49,15 +80,23 @@ struct nnpdrv_host_resource {
 	bool              destroyed;
 #endif
 	enum dma_data_direction dir;
-	wait_queue_head_t access_waitq;
+	wait_queue_head_t read_waitq;  /* waiters for shared access */
+	wait_queue_head_t write_waitq; /* waiters for exclusive access */
 	/* == 0 => unlocked; > 0 => locked for read; -1 => locked for write */
-	int               readers;
+	atomic_t          readers;
+	/* log2 usec buckets of lock wait times */
+	atomic_t          wait_hist[NNP_HOSTRES_WAIT_HIST_BUCKETS];
 	bool              user_locked;
+	/* DMA_FROM_DEVICE => user lock is shared with other readers */
+	enum dma_data_direction user_lock_dir;
 
 	bool external_buf;
 	bool user_memory_buf;
 	u16 start_offset;
 
+	/* pinned pages of user memory resource, pages below point into it */
+	struct usermem_pin *pin;
+
 	union {
 		struct {
 			struct page **pages;
@@ -76,8 +115,40 @@ NNP_STATIC_ASSERT(NENTS_PER_PAGE >= 1,
 static int hostres_min_order;
 module_param(hostres_min_order, int, 0600);
 
+/* usec to busy poll a busy resource before sleeping, 0 - no polling */
+static unsigned int hostres_lock_spin_us;
+module_param(hostres_lock_spin_us, uint, 0600);
+
+static bool hostres_usermem_cache = true;
+module_param(hostres_usermem_cache, bool, 0600);
+
 static atomic64_t s_total_hostres_size;
 
+/*
+ * Cache of pinned user memory, keyed by user address. Registering the
+ * same user range again reuses the pinned pages of the cached entry.
+ */
+static DEFINE_HASHTABLE(s_usermem_cache, 6);
+static DEFINE_SPINLOCK(s_usermem_cache_lock);
+
+/*
+ * Unpinning may sleep in mmu_interval_notifier_remove() while the last
+ * host resource reference may be dropped in atomic context, so pins
+ * are released from a work item.
+ */
+static LLIST_HEAD(s_pin_free_list);
+static void usermem_pin_free_work_handler(struct work_struct *work);
+static DECLARE_WORK(s_pin_free_work, usermem_pin_free_work_handler);
+
+static void free_chain_page(struct dev_mapping *m, struct dma_list *l)
+{
+	if (m->pool)
+		dma_pool_free(m->pool, l->vaddr, l->dma_addr);
+	else
+		dma_free_coherent(m->dev, m->entry_pages * NNP_PAGE_SIZE,
+				  l->vaddr, l->dma_addr);
+}
+
 /* Destroys DMA page list of DMA addresses */
 static void destroy_dma_list(struct dev_mapping *m)
 {
@@ -85,12 +156,106 @@ static void destroy_dma_list(struct dev_mapping *m)
 
 	for (i = 0; i < m->num; ++i) {
 		NNP_ASSERT(m->list[i].vaddr);
-		dma_free_coherent(m->dev, m->entry_pages * NNP_PAGE_SIZE,
-				  m->list[i].vaddr, m->list[i].dma_addr);
+		free_chain_page(m, &m->list[i]);
 	}
 	kfree(m->list);
 }
 
+/* Removes pin from the registration cache, if it is there */
+static void usermem_cache_remove(struct usermem_pin *pin)
+{
+	spin_lock(&s_usermem_cache_lock);
+	if (pin->cached) {
+		hash_del(&pin->cache_node);
+		pin->cached = false;
+	}
+	spin_unlock(&s_usermem_cache_lock);
+}
+
+/*
+ * User mapping of the range has changed, pinned pages stay valid for
+ * the current users but must not be handed out again.
+ */
+static bool usermem_invalidate(struct mmu_interval_notifier     *mni,
+			       const struct mmu_notifier_range  *range,
+			       unsigned long                     cur_seq)
+{
+	struct usermem_pin *pin =
+		container_of(mni, struct usermem_pin, notifier);
+
+	usermem_cache_remove(pin);
+	mmu_interval_set_seq(mni, cur_seq);
+
+	return true;
+}
+
+static const struct mmu_interval_notifier_ops usermem_notifier_ops = {
+	.invalidate = usermem_invalidate,
+};
+
+static struct usermem_pin *usermem_cache_lookup(uintptr_t               user_addr,
+						size_t                  size,
+						enum dma_data_direction dir)
+{
+	struct usermem_pin *pin;
+
+	spin_lock(&s_usermem_cache_lock);
+	hash_for_each_possible(s_usermem_cache, pin, cache_node, user_addr) {
+		if (pin->mm == current->mm && pin->user_addr == user_addr &&
+		    pin->size == size && pin->dir == dir &&
+		    kref_get_unless_zero(&pin->ref)) {
+			spin_unlock(&s_usermem_cache_lock);
+			return pin;
+		}
+	}
+	spin_unlock(&s_usermem_cache_lock);
+
+	return NULL;
+}
+
+static void usermem_cache_add(struct usermem_pin *pin)
+{
+	if (mmu_interval_notifier_insert(&pin->notifier, current->mm,
+					 pin->user_addr, pin->size,
+					 &usermem_notifier_ops))
+		return;
+
+	pin->mmu_registered = true;
+
+	spin_lock(&s_usermem_cache_lock);
+	hash_add(s_usermem_cache, &pin->cache_node, pin->user_addr);
+	pin->cached = true;
+	spin_unlock(&s_usermem_cache_lock);
+}
+
+static void usermem_pin_free_work_handler(struct work_struct *work)
+{
+	struct llist_node *list = llist_del_all(&s_pin_free_list);
+	struct usermem_pin *pin, *n;
+
+	llist_for_each_entry_safe(pin, n, list, free_node) {
+		usermem_cache_remove(pin);
+		if (pin->mmu_registered)
+			mmu_interval_notifier_remove(&pin->notifier);
+		unpin_user_pages(pin->pages, pin->n_pages);
+		vfree(pin->pages);
+		kfree(pin);
+	}
+}
+
+static void release_usermem_pin(struct kref *kref)
+{
+	struct usermem_pin *pin = container_of(kref, struct usermem_pin, ref);
+
+	if (llist_add(&pin->free_node, &s_pin_free_list))
+		schedule_work(&s_pin_free_work);
+}
+
+static inline void usermem_pin_put(struct usermem_pin *pin)
+{
+	kref_put(&pin->ref, release_usermem_pin);
+}
+
 /* Really destroys host resource, when all references to it were released */
 static void release_hostres(struct kref *kref)
 {
@@ -102,6 +267,8 @@ static void release_hostres(struct kref *kref)
 
 	NNP_ASSERT(list_empty(&r->devices));
 
+	DO_TRACE(trace_hostres_wait_hist((u64)(uintptr_t)r, r->wait_hist));
+
 	if (r->external_buf) {
 		dma_buf_put(r->buf);
 		kfree(r);
@@ -117,8 +284,7 @@ static void release_hostres(struct kref *kref)
 		}
 		vfree(r->pages);
 	} else {
-		release_pages(r->pages, r->n_pages);
-		vfree(r->pages);
+		usermem_pin_put(r->pin);
 	}
 
 	kfree(r);
@@ -166,6 +332,7 @@ static void release_mapping(struct kref *kref)
 
 	nnpdrv_hostres_put(m->res);
 
+	put_device(m->dev);
 	kfree(m);
 }
 
@@ -196,8 +363,9 @@ static struct nnpdrv_host_resource *alloc_hostres(size_t                  size,
 						  enum dma_data_direction dir)
 {
 	struct nnpdrv_host_resource *r;
+	unsigned int i;
 
-	r = kmalloc(sizeof(sizeof(*r)), GFP_KERNEL);
+	r = kmalloc(sizeof(*r), GFP_KERNEL);
 	if (unlikely(!r))
 		return r;
 
@@ -207,12 +375,17 @@ static struct nnpdrv_host_resource *alloc_hostres(size_t                  size,
 #endif
 	kref_init(&r->ref);
 	spin_lock_init(&r->lock);
-	init_waitqueue_head(&r->access_waitq);
-	r->readers = 0;
+	init_waitqueue_head(&r->read_waitq);
+	init_waitqueue_head(&r->write_waitq);
+	atomic_set(&r->readers, 0);
+	for (i = 0; i < NNP_HOSTRES_WAIT_HIST_BUCKETS; i++)
+		atomic_set(&r->wait_hist[i], 0);
 	r->dir = dir;
 	r->size = size;
 	r->user_locked = false;
+	r->user_lock_dir = dir;
 	r->start_offset = 0;
+	r->pin = NULL;
 	INIT_LIST_HEAD(&r->devices);
 
 	return r;
@@ -303,46 +476,51 @@ free_res:
 	return err;
 }
 
-int nnpdrv_hostres_create_usermem(void __user                  *user_ptr,
-				  size_t                        size,
-				  enum dma_data_direction       dir,
-				  struct nnpdrv_host_resource **out_resource)
+/* Pins user range, reusing a cached pin of the same range if there is one */
+static int get_usermem_pin(uintptr_t                user_addr,
+			   size_t                   size,
+			   enum dma_data_direction  dir,
+			   struct usermem_pin     **out_pin)
 {
-	int err;
-	struct nnpdrv_host_resource *r;
+	struct usermem_pin *pin;
 	unsigned int pinned_pages = 0;
-	uintptr_t user_addr = (uintptr_t)user_ptr;
+	uintptr_t start_addr;
 	int gup_flags;
+	int err;
 
-	if (unlikely(!out_resource || size == 0 || dir == DMA_NONE))
-		return -EINVAL;
-
-	/* restrict for 4 byte alignment - is this enough? */
-	if ((user_addr & 0x3) != 0)
-		return -EINVAL;
+	if (hostres_usermem_cache) {
+		pin = usermem_cache_lookup(user_addr, size, dir);
+		if (pin) {
+			*out_pin = pin;
+			return 0;
+		}
+	}
 
-	r = alloc_hostres(size, dir);
-	if (unlikely(!r))
+	pin = kzalloc(sizeof(*pin), GFP_KERNEL);
+	if (unlikely(!pin))
 		return -ENOMEM;
 
-	r->user_memory_buf = true;
-	r->external_buf = false;
+	kref_init(&pin->ref);
+	pin->mm = current->mm;
+	pin->user_addr = user_addr;
+	pin->size = size;
+	pin->dir = dir;
 
-	r->start_offset = user_addr & (PAGE_SIZE - 1);
-	user_addr &= ~(PAGE_SIZE - 1);
+	start_addr = user_addr & ~(PAGE_SIZE - 1);
 
 	/*
 	 * In this place actual pages are allocated of PAGE_SIZE and not
 	 * NNP_PAGE_SIZE, This list will be used for sg_alloc_table
 	 */
-	r->n_pages = DIV_ROUND_UP(size + r->start_offset, PAGE_SIZE);
-	r->pages = vmalloc(r->n_pages * sizeof(struct page *));
-	if (IS_ERR_OR_NULL(r->pages)) {
+	pin->n_pages = DIV_ROUND_UP(size + (user_addr & (PAGE_SIZE - 1)),
+				    PAGE_SIZE);
+	pin->pages = vmalloc(pin->n_pages * sizeof(struct page *));
+	if (IS_ERR_OR_NULL(pin->pages)) {
 		nnp_log_err(CREATE_COMMAND_LOG,
 			    "failed to vmalloc %zu bytes array\n",
-			    (r->n_pages * sizeof(struct page *)));
+			    (pin->n_pages * sizeof(struct page *)));
 		err = -ENOMEM;
-		goto free_res;
+		goto free_pin;
 	}
 
 	gup_flags = (dir == DMA_TO_DEVICE ||
@@ -355,33 +533,79 @@ int nnpdrv_hostres_create_usermem(void __user                  *user_ptr,
 	 */
 	gup_flags |= FOLL_LONGTERM;
 
+	/*
+	 * The fast variant walks the page tables without mmap lock and
+	 * fills all subpages of a huge page mapping at once. Physically
+	 * contiguous runs are later joined into large DMA chunks by
+	 * sg_alloc_table_from_pages.
+	 */
 	do {
-		int n = pin_user_pages(user_addr + pinned_pages * PAGE_SIZE,
-				       r->n_pages - pinned_pages,
-				       gup_flags,
-				       &r->pages[pinned_pages],
-				       NULL);
-		if (n < 0) {
-			err = -ENOMEM;
+		int n = pin_user_pages_fast(start_addr +
+					    pinned_pages * PAGE_SIZE,
+					    pin->n_pages - pinned_pages,
+					    gup_flags,
+					    &pin->pages[pinned_pages]);
+		if (n <= 0) {
+			err = (n < 0 ? -ENOMEM : -EFAULT);
 			goto free_pages;
 		}
 
 		pinned_pages += n;
-	} while (pinned_pages < r->n_pages);
+	} while (pinned_pages < pin->n_pages);
 
-	atomic64_add(size, &s_total_hostres_size);
+	if (hostres_usermem_cache)
+		usermem_cache_add(pin);
 
-	*out_resource = r;
+	*out_pin = pin;
 	return 0;
 
 free_pages:
-	release_pages(r->pages, pinned_pages);
-	vfree(r->pages);
-free_res:
-	kfree(r);
+	unpin_user_pages(pin->pages, pinned_pages);
+	vfree(pin->pages);
+free_pin:
+	kfree(pin);
 	return err;
 }
 
+int nnpdrv_hostres_create_usermem(void __user                  *user_ptr,
+				  size_t                        size,
+				  enum dma_data_direction       dir,
+				  struct nnpdrv_host_resource **out_resource)
+{
+	int err;
+	struct nnpdrv_host_resource *r;
+	uintptr_t user_addr = (uintptr_t)user_ptr;
+
+	if (unlikely(!out_resource || size == 0 || dir == DMA_NONE))
+		return -EINVAL;
+
+	/* restrict for 4 byte alignment - is this enough? */
+	if ((user_addr & 0x3) != 0)
+		return -EINVAL;
+
+	r = alloc_hostres(size, dir);
+	if (unlikely(!r))
+		return -ENOMEM;
+
+	r->user_memory_buf = true;
+	r->external_buf = false;
+	r->start_offset = user_addr & (PAGE_SIZE - 1);
+
+	err = get_usermem_pin(user_addr, size, dir, &r->pin);
+	if (unlikely(err < 0)) {
+		kfree(r);
+		return err;
+	}
+
+	r->pages = r->pin->pages;
+	r->n_pages = r->pin->n_pages;
+
+	atomic64_add(size, &s_total_hostres_size);
+
+	*out_resource = r;
+	return 0;
+}
+
 int nnpdrv_hostres_dma_buf_create(int                           dma_buf_fd,
 				  enum dma_data_direction       dir,
 				  struct nnpdrv_host_resource **out_resource)
@@ -486,24 +710,47 @@ bool nnpdrv_hostres_destroy(struct nnpdrv_host_resource *res)
 	return nnpdrv_hostres_put(res);
 }
 
-/* Finds mapping by device. NULL if not found*/
+/*
+ * true if a DMA mapping made for d1 is valid for d2 as well. This holds
+ * only when both are behind the same translating DMA API domain; with
+ * identity/passthrough domains or without an IOMMU the addresses depend
+ * on each device (swiotlb bouncing, dma_mask), so each maps on its own.
+ */
+static bool same_dma_domain(struct device *d1, struct device *d2)
+{
+	struct iommu_domain *domain = iommu_get_domain_for_dev(d1);
+
+	return domain && domain->type == IOMMU_DOMAIN_DMA &&
+	       domain == iommu_get_domain_for_dev(d2) &&
+	       dma_get_mask(d1) == dma_get_mask(d2);
+}
+
+/*
+ * Finds mapping by device. NULL if not found.
+ * If any_in_domain is set, a shareable mapping of another device in
+ * the same IOMMU domain is returned when the device has none of its own.
+ */
 static struct dev_mapping *mapping_for_dev(struct nnpdrv_host_resource *res,
-					   struct device               *dev)
+					   struct device               *dev,
+					   bool                         any_in_domain)
 {
-	struct dev_mapping *m;
+	struct dev_mapping *m, *shared = NULL;
 
 	spin_lock(&res->lock);
 
 	list_for_each_entry(m, &res->devices, node) {
 		if (m->dev == dev)
 			break;
+		if (any_in_domain && !shared && m->shareable &&
+		    same_dma_domain(m->dev, dev))
+			shared = m;
 	}
 
 	spin_unlock(&res->lock);
 
 	/* Check if no mapping found */
 	if (&m->node == &res->devices)
-		return NULL;
+		return shared;
 
 	return m;
 }
@@ -511,7 +758,8 @@ static struct dev_mapping *mapping_for_dev(struct nnpdrv_host_resource *res,
 /* builds DMA page list with DMA addresses of the mapped host resource */
 static int build_dma_list(struct dev_mapping *m,
 			  bool                use_one_entry,
-			  u32                 start_offset)
+			  u32                 start_offset,
+			  struct dma_pool    *pool)
 {
 	unsigned int i, k = 0;
 	int err;
@@ -535,12 +783,23 @@ static int build_dma_list(struct dev_mapping *m,
 		m->num = DIV_ROUND_UP(m->sgt->nents, NENTS_PER_PAGE);
 	}
 
-	m->list = kmalloc_array(m->num, sizeof(struct dma_list), GFP_KERNEL);
+	/*
+	 * chain pages are taken from the device pool, single entry lists
+	 * may be shared with other devices, so they are allocated directly
+	 */
+	m->pool = (!use_one_entry ? pool : NULL);
+	m->shareable = use_one_entry;
+
+	m->list = kcalloc(m->num, sizeof(struct dma_list), GFP_KERNEL);
 	if (unlikely(!m->list))
 		return -ENOMEM;
 
 	for (i = 0; i < m->num; ++i) {
-		m->list[i].vaddr = dma_alloc_coherent(m->dev,
+		if (m->pool)
+			m->list[i].vaddr = dma_pool_alloc(m->pool, GFP_KERNEL,
+							  &m->list[i].dma_addr);
+		else
+			m->list[i].vaddr = dma_alloc_coherent(m->dev,
 						 m->entry_pages * NNP_PAGE_SIZE,
 						 &m->list[i].dma_addr,
 						 GFP_KERNEL);
@@ -622,8 +881,7 @@ free_pages:
 	for (i = 0; i < m->num; ++i) {
 		if (!m->list[i].vaddr)
 			break;
-		dma_free_coherent(m->dev, m->entry_pages * NNP_PAGE_SIZE,
-				  m->list[i].vaddr, m->list[i].dma_addr);
+		free_chain_page(m, &m->list[i]);
 	}
 	kfree(m->list);
 
@@ -642,8 +900,12 @@ int nnpdrv_hostres_map_device(struct nnpdrv_host_resource *res,
 	if (unlikely(!res || !nnpdev || !page_list))
 		return -EINVAL;
 
-	/* Check if already mapped for the device */
-	m = mapping_for_dev(res, nnpdev->hw_device_info->hw_device);
+	/*
+	 * Check if already mapped for the device, single entry lists
+	 * are built once per IOMMU domain.
+	 */
+	m = mapping_for_dev(res, nnpdev->hw_device_info->hw_device,
+			    use_one_entry);
 	/*
 	 * "mapping_get" will fail and return 0, if m is at destroy stage
 	 * so if mapping is exist and it is not being destroyed,
@@ -651,6 +913,8 @@ int nnpdrv_hostres_map_device(struct nnpdrv_host_resource *res,
 	 */
 	if (likely(m && mapping_get(m) == 1)) {
 		*page_list = m->list[0].dma_addr;
+		if (total_chunks)
+			*total_chunks = m->sgt->nents;
 		return 0;
 	}
 
@@ -664,7 +928,8 @@ int nnpdrv_hostres_map_device(struct nnpdrv_host_resource *res,
 
 	kref_init(&m->ref);
 
-	m->dev = nnpdev->hw_device_info->hw_device;
+	/* shared mapping may outlive the device which created it */
+	m->dev = get_device(nnpdev->hw_device_info->hw_device);
 	m->res = res;
 
 	if (res->external_buf) {
@@ -702,7 +967,8 @@ int nnpdrv_hostres_map_device(struct nnpdrv_host_resource *res,
 		m->sgt->nents = ret;
 	}
 
-	ret = build_dma_list(m, use_one_entry, res->start_offset);
+	ret = build_dma_list(m, use_one_entry, res->start_offset,
+			     nnpdev->dma_chain_pool);
 	if (unlikely(ret < 0))
 		goto unmap;
 
@@ -730,6 +996,7 @@ free_sgt_struct:
 		kfree(m->sgt);
 	}
 free_mapping:
+	put_device(m->dev);
 	kfree(m);
 put_resource:
 	nnpdrv_hostres_put(res);
@@ -744,7 +1011,7 @@ int nnpdrv_hostres_unmap_device(struct nnpdrv_host_resource *res,
 	if (unlikely(!res))
 		return -EINVAL;
 
-	m = mapping_for_dev(res, nnpdev->hw_device_info->hw_device);
+	m = mapping_for_dev(res, nnpdev->hw_device_info->hw_device, true);
 	if (unlikely(!m))
 		return -ENXIO;
 
@@ -797,6 +1064,82 @@ int nnpdrv_hostres_map_user(struct nnpdrv_host_resource *res,
 	return err;
 }
 
+/*
+ * Lock free access state, see readers field.
+ * Shared lockers only wait for a writer to leave, so releasing a
+ * read lock wakes exclusive waiters only and only by the last reader.
+ */
+static inline bool try_read_lock(struct nnpdrv_host_resource *res)
+{
+	int v = atomic_read(&res->readers);
+
+	do {
+		if (v < 0)
+			return false;
+	} while (!atomic_try_cmpxchg(&res->readers, &v, v + 1));
+
+	return true;
+}
+
+static inline bool try_write_lock(struct nnpdrv_host_resource *res)
+{
+	return atomic_cmpxchg(&res->readers, 0, -1) == 0;
+}
+
+static inline bool try_lock(struct nnpdrv_host_resource *res, bool read)
+{
+	return read ? try_read_lock(res) : try_write_lock(res);
+}
+
+static inline void read_unlock(struct nnpdrv_host_resource *res)
+{
+	int v = atomic_dec_return(&res->readers);
+
+	NNP_ASSERT(v >= 0);
+	if (v == 0)
+		wake_up(&res->write_waitq);
+}
+
+static inline void write_unlock(struct nnpdrv_host_resource *res)
+{
+	NNP_ASSERT(atomic_read(&res->readers) == -1);
+	atomic_set_release(&res->readers, 0);
+	wake_up(&res->read_waitq);
+	wake_up(&res->write_waitq);
+}
+
+/* Busy poll for hostres_lock_spin_us before going to sleep */
+static bool spin_lock_access(struct nnpdrv_host_resource *res, bool read)
+{
+	u64 end;
+
+	if (!hostres_lock_spin_us)
+		return false;
+
+	end = local_clock() + (u64)hostres_lock_spin_us * NSEC_PER_USEC;
+	do {
+		if (try_lock(res, read))
+			return true;
+		cpu_relax();
+	} while (local_clock() < end);
+
+	return false;
+}
+
+static u32 account_wait(struct nnpdrv_host_resource *res, u64 wait_ns)
+{
+	u32 wait_us = (u32)min_t(u64, div_u64(wait_ns, NSEC_PER_USEC),
+				 U32_MAX);
+	unsigned int b = 0;
+
+	if (wait_us)
+		b = min_t(unsigned int, ilog2(wait_us) + 1,
+			  NNP_HOSTRES_WAIT_HIST_BUCKETS - 1);
+	atomic_inc(&res->wait_hist[b]);
+
+	return wait_us;
+}
+
 int nnpdrv_hostres_dev_lock(struct nnpdrv_host_resource *res,
 			    struct nnp_device           *nnpdev,
 			    enum dma_data_direction      dir)
@@ -818,40 +1161,35 @@ int nnpdrv_hostres_dev_lock(struct nnpdrv_host_resource *res,
 		return -EPERM;
 	}
 
-	NNP_ASSERT(mapping_for_dev(res, nnpdev->hw_device_info->hw_device) !=
-		   NULL);
+	NNP_ASSERT(mapping_for_dev(res, nnpdev->hw_device_info->hw_device,
+				   true) != NULL);
 
 	DO_TRACE(trace_hostres(NNP_TRACE_LOCK_ENTER,
 			       0,
 			       (u64)(uintptr_t)res,
-			       res->readers,
-			       res->dir == DMA_TO_DEVICE));
+			       atomic_read(&res->readers),
+			       res->dir == DMA_TO_DEVICE,
+			       0));
 
-	spin_lock(&res->lock);
 	/* Check if requested access is Read Only */
 	if (dir == DMA_TO_DEVICE) {
-		if (unlikely(res->readers < 0)) {
+		if (unlikely(!try_read_lock(res))) {
 			nnp_log_err(GENERAL_LOG, "Error: lock is busy for read\n");
-			NNP_ASSERT(res->readers == -1);
-			spin_unlock(&res->lock);
 			return -EBUSY;
 		}
-		++res->readers;
 	} else {
-		if (unlikely(res->readers != 0)) {
+		if (unlikely(!try_write_lock(res))) {
 			nnp_log_err(GENERAL_LOG, "Error: lock is busy for write\n");
-			spin_unlock(&res->lock);
 			return -EBUSY;
 		}
-		res->readers = -1;
 	}
-	spin_unlock(&res->lock);
 
 	DO_TRACE(trace_hostres(NNP_TRACE_LOCK_EXIT,
 			       0,
 			       (u64)(uintptr_t)res,
-			       res->readers,
-			       res->dir == DMA_TO_DEVICE));
+			       atomic_read(&res->readers),
+			       res->dir == DMA_TO_DEVICE,
+			       0));
 
 	return 0;
 }
@@ -866,33 +1204,28 @@ int nnpdrv_hostres_dev_unlock(struct nnpdrv_host_resource *res,
 	if (unlikely(res->dir != DMA_BIDIRECTIONAL && dir != res->dir))
 		return -EPERM;
 
-	NNP_ASSERT(mapping_for_dev(res, nnpdev->hw_device_info->hw_device) !=
-		   NULL);
+	NNP_ASSERT(mapping_for_dev(res, nnpdev->hw_device_info->hw_device,
+				   true) != NULL);
 
 	DO_TRACE(trace_hostres(NNP_TRACE_UNLOCK_ENTER,
 			       0,
 			       (u64)(uintptr_t)res,
-			       res->readers,
-			       res->dir == DMA_TO_DEVICE));
+			       atomic_read(&res->readers),
+			       res->dir == DMA_TO_DEVICE,
+			       0));
 
-	spin_lock(&res->lock);
 	/* Check if requested access is Read Only */
-	if (dir == DMA_TO_DEVICE) {
-		NNP_ASSERT(res->readers > 0);
-		--res->readers;
-	} else {
-		NNP_ASSERT(res->readers == -1);
-		res->readers = 0;
-	}
-	spin_unlock(&res->lock);
+	if (dir == DMA_TO_DEVICE)
+		read_unlock(res);
+	else
+		write_unlock(res);
 
 	DO_TRACE(trace_hostres(NNP_TRACE_UNLOCK_EXIT,
 			       0,
 			       (u64)(uintptr_t)res,
-			       res->readers,
-			       res->dir == DMA_TO_DEVICE));
-
-	wake_up_all(&res->access_waitq);
+			       atomic_read(&res->readers),
+			       res->dir == DMA_TO_DEVICE,
+			       0));
 
 	return 0;
 }
@@ -913,16 +1246,20 @@ int nnpdrv_hostres_dev_unlock(struct nnpdrv_host_resource *res,
 		)						\
 	)
 
-int nnpdrv_hostres_user_lock(struct nnpdrv_host_resource *res,
-			     unsigned int                 timeout)
+/*
+ * Locks resource for user access in direction dir, waiting at most
+ * *left jiffies. *left is decreased by the time spent waiting so
+ * several locks can share one timeout budget.
+ */
+static int user_lock(struct nnpdrv_host_resource *res,
+		     enum dma_data_direction      dir,
+		     long                        *left,
+		     bool                         nowait)
 {
-	long ret, left, before;
-
-	left = (timeout != U32_MAX ? usecs_to_jiffies(timeout) :
-				     MAX_SCHEDULE_TIMEOUT);
-
-	if (unlikely(!res || (unsigned long)left > MAX_SCHEDULE_TIMEOUT))
-		return -EINVAL;
+	bool read = (dir == DMA_FROM_DEVICE);
+	u32 wait_us = 0;
+	u64 start;
+	long ret = 0;
 
 	/* No need to get kref, as it should be already got */
 	spin_lock(&res->lock);
@@ -935,74 +1272,51 @@ int nnpdrv_hostres_user_lock(struct nnpdrv_host_resource *res,
 	DO_TRACE(trace_hostres(NNP_TRACE_LOCK_ENTER,
 			       1,
 			       (u64)(uintptr_t)res,
-			       res->readers,
-			       res->dir == DMA_FROM_DEVICE));
-
-	spin_lock(&res->lock);
-	/* Check if requested access is Read Only */
-	if (res->dir == DMA_FROM_DEVICE) {
-		while (res->readers < 0 && left > 0) {
-			NNP_ASSERT(res->readers == -1);
-
-			spin_unlock(&res->lock);
-
-			before = jiffies;
-			ret = wait_event_interruptible_timeout(
-							res->access_waitq,
-							(res->readers >= 0),
-							left);
-			ret = GET_WAIT_EVENT_ERR(ret);
-			if (unlikely(ret < 0))
-				return ret;
-
-			spin_lock(&res->lock);
-			left -= jiffies - before;
-		}
+			       atomic_read(&res->readers),
+			       read,
+			       0));
 
-		if (likely(res->readers >= 0)) {
-			++res->readers;
-			ret = 0;
-		} else {
-			ret = -ETIME;
-		}
-	} else {
-		while (res->readers != 0 && left > 0) {
-			spin_unlock(&res->lock);
+	if (unlikely(!try_lock(res, read))) {
+		if (nowait)
+			return -EBUSY;
 
-			before = jiffies;
-			ret = wait_event_interruptible_timeout(
-							res->access_waitq,
-							(res->readers == 0),
-							left);
+		start = local_clock();
+		if (!spin_lock_access(res, read)) {
+			if (read)
+				ret = wait_event_interruptible_timeout(
+							res->read_waitq,
+							try_read_lock(res),
+							*left);
+			else
+				ret = wait_event_interruptible_timeout(
+							res->write_waitq,
+							try_write_lock(res),
+							*left);
+			*left = (ret > 0 ? ret : 0);
 			ret = GET_WAIT_EVENT_ERR(ret);
 			if (unlikely(ret < 0))
 				return ret;
-
-			spin_lock(&res->lock);
-			left -= jiffies - before;
-		}
-
-		if (likely(res->readers == 0)) {
-			res->readers = -1;
-			ret = 0;
-		} else {
-			ret = -ETIME;
 		}
+		wait_us = account_wait(res, local_clock() - start);
 	}
 
-	if (ret == -ETIME && timeout == 0)
-		ret = -EBUSY;
-
-	if (unlikely(ret < 0)) {
-		spin_unlock(&res->lock);
-		return ret;
-	}
-
+	spin_lock(&res->lock);
 	res->user_locked = true;
+	res->user_lock_dir = dir;
 
 	if (res->external_buf) {
 		spin_unlock(&res->lock);
 		ret = dma_buf_begin_cpu_access(res->buf, res->dir);
+		if (unlikely(ret < 0)) {
+			/* leave the resource as it was before the call */
+			spin_lock(&res->lock);
+			res->user_locked = false;
+			spin_unlock(&res->lock);
+			if (read)
+				read_unlock(res);
+			else
+				write_unlock(res);
+		}
 	} else {
 		struct dev_mapping *m;
 
@@ -1016,8 +1330,88 @@ int nnpdrv_hostres_user_lock(struct nnpdrv_host_resource *res,
 	DO_TRACE(trace_hostres(NNP_TRACE_LOCK_EXIT,
 			       1,
 			       (u64)(uintptr_t)res,
-			       res->readers,
-			       res->dir == DMA_FROM_DEVICE));
+			       atomic_read(&res->readers),
+			       read,
+			       wait_us));
+
+	return ret;
+}
+
+static inline long timeout_to_jiffies(unsigned int timeout)
+{
+	return (timeout != U32_MAX ? usecs_to_jiffies(timeout) :
+				     MAX_SCHEDULE_TIMEOUT);
+}
+
+int nnpdrv_hostres_user_lock(struct nnpdrv_host_resource *res,
+			     unsigned int                 timeout)
+{
+	long left = timeout_to_jiffies(timeout);
+
+	if (unlikely(!res || (unsigned long)left > MAX_SCHEDULE_TIMEOUT))
+		return -EINVAL;
+
+	return user_lock(res, res->dir, &left, timeout == 0);
+}
+
+int nnpdrv_hostres_user_lock_batch(struct nnpdrv_hostres_lock_req *reqs,
+				   unsigned int                    n,
+				   unsigned int                    timeout)
+{
+	long left = timeout_to_jiffies(timeout);
+	unsigned int i;
+	int ret = 0;
+
+	if (unlikely(!reqs || (unsigned long)left > MAX_SCHEDULE_TIMEOUT))
+		return -EINVAL;
+
+	for (i = 0; i < n; i++)
+		reqs[i].err = 0;
+
+	for (i = 0; i < n; i++) {
+		if (reqs[i].res && reqs[i].dir == DMA_NONE)
+			reqs[i].dir = reqs[i].res->dir;
+
+		if (unlikely(!reqs[i].res ||
+			     (reqs[i].res->dir != DMA_BIDIRECTIONAL &&
+			      reqs[i].dir != reqs[i].res->dir))) {
+			ret = -EPERM;
+		} else {
+			/* later entries get what is left of the budget */
+			ret = user_lock(reqs[i].res, reqs[i].dir, &left,
+					timeout == 0);
+		}
+
+		if (unlikely(ret < 0)) {
+			reqs[i].err = ret;
+			break;
+		}
+	}
+
+	if (likely(ret == 0))
+		return 0;
+
+	/* all or none - release what was already locked */
+	while (i-- > 0)
+		nnpdrv_hostres_user_unlock(reqs[i].res);
+
+	return ret;
+}
+
+int nnpdrv_hostres_user_unlock_batch(struct nnpdrv_hostres_lock_req *reqs,
+				     unsigned int                    n)
+{
+	unsigned int i;
+	int ret = 0;
+
+	if (unlikely(!reqs))
+		return -EINVAL;
+
+	for (i = 0; i < n; i++) {
+		reqs[i].err = nnpdrv_hostres_user_unlock(reqs[i].res);
+		if (unlikely(reqs[i].err < 0 && ret == 0))
+			ret = reqs[i].err;
+	}
 
 	return ret;
 }
@@ -1038,19 +1432,11 @@ int nnpdrv_hostres_user_unlock(struct nnpdrv_host_resource *res)
 	DO_TRACE(trace_hostres(NNP_TRACE_UNLOCK_ENTER,
 			       1,
 			       (u64)(uintptr_t)res,
-			       res->readers,
-			       res->dir == DMA_FROM_DEVICE));
+			       atomic_read(&res->readers),
+			       res->user_lock_dir == DMA_FROM_DEVICE,
+			       0));
 
 	spin_lock(&res->lock);
-	/* Check if requested access is Read Only */
-	if (res->dir == DMA_FROM_DEVICE) {
-		NNP_ASSERT(res->readers > 0);
-		--res->readers;
-	} else {
-		NNP_ASSERT(res->readers == -1);
-		res->readers = 0;
-	}
-
 	res->user_locked = false;
 
 	if (res->external_buf) {
@@ -1066,13 +1452,18 @@ int nnpdrv_hostres_user_unlock(struct nnpdrv_host_resource *res)
 		spin_unlock(&res->lock);
 	}
 
+	/* release access only after buffer was handed back to devices */
+	if (res->user_lock_dir == DMA_FROM_DEVICE)
+		read_unlock(res);
+	else
+		write_unlock(res);
+
 	DO_TRACE(trace_hostres(NNP_TRACE_UNLOCK_EXIT,
 			       1,
 			       (u64)(uintptr_t)res,
-			       res->readers,
-			       res->dir == DMA_FROM_DEVICE));
-
-	wake_up_all(&res->access_waitq);
+			       atomic_read(&res->readers),
+			       res->user_lock_dir == DMA_FROM_DEVICE,
+			       0));
 
 	return 0;
 }
@@ -1142,4 +1533,7 @@ int nnpdrv_hostres_init_sysfs(struct kobject *kobj)
 void nnpdrv_hostres_fini_sysfs(struct kobject *kobj)
 {
 	sysfs_remove_group(kobj, &nnp_host_attrs_grp);
+
+	/* release pins of resources destroyed last */
+	flush_work(&s_pin_free_work);
 }
@@ -100,6 +100,8 @@ bool nnpdrv_hostres_destroy(struct nnpdrv_host_resource *res);
  * and returns the dma page list of DMA addresses.
  * The resource can be mapped to multiple devices.
  * The resource can be mapped to userspace and to device at the same time.
+ * A single entry page list is built once per IOMMU domain and shared
+ * by all devices in that domain.
  *
  * @param[in]   res           handle to the host resource
  * @param[in]   nnpdev        handle to the device
@@ -190,6 +192,43 @@ int nnpdrv_hostres_dev_unlock(struct nnpdrv_host_resource *res,
 int nnpdrv_hostres_user_lock(struct nnpdrv_host_resource *res,
 			     unsigned int                 timeout);
 
+/* One entry of a batched user lock/unlock request */
+struct nnpdrv_hostres_lock_req {
+	struct nnpdrv_host_resource *res;
+	enum dma_data_direction      dir;  /* user access, DMA_NONE - res dir */
+	int                          err;  /* [out] entry error */
+};
+
+/**
+ * @brief Lock several host resources for access from userspace
+ *
+ * Locks all resources or none of them. All entries share a single
+ * timeout budget. A user lock with direction DMA_FROM_DEVICE is shared
+ * with other readers, otherwise it is exclusive.
+ * On failure, err of the failing entry is set.
+ *
+ * @param[in/out]  reqs     array of lock requests
+ * @param[in]      n        number of entries in reqs
+ * @param[in]      timeout  timeout in usec for the whole batch.
+ * @return error on failure.
+ */
+int nnpdrv_hostres_user_lock_batch(struct nnpdrv_hostres_lock_req *reqs,
+				   unsigned int                    n,
+				   unsigned int                    timeout);
+
+/**
+ * @brief Unlocks several host resources from being accessed by userspace
+ *
+ * All entries are unlocked even if some of them fail, err of each
+ * failing entry is set.
+ *
+ * @param[in/out]  reqs  array of unlock requests
+ * @param[in]      n     number of entries in reqs
+ * @return first error on failure.
+ */
+int nnpdrv_hostres_user_unlock_batch(struct nnpdrv_hostres_lock_req *reqs,
+				     unsigned int                    n);
+
 /**
  * @brief Unlocks the host resource from being accessed by userspace
  *
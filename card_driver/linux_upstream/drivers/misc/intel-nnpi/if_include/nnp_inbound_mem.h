@@ -34,6 +34,21 @@ union nnp_inbound_mem {
 	__u8 row[NNP_CRASH_DUMP_SIZE];
 };
 
+/*
+ * When the card compresses its crash dump, the dump area starts with this
+ * header followed by comp_size bytes of LZ4 block data which expand to
+ * orig_size bytes of kernel log text. A dump without the header is raw text.
+ */
+#define NNP_CRASH_DUMP_LZ4_MAGIC  0x5a504e4e  /* value of 'NNPZ' */
+#define NNP_CRASH_DUMP_LZ4_MAX_ORIG  (NNP_CRASH_DUMP_SIZE * 4)
+
+struct nnp_crash_dump_lz4_hdr {
+	__le32  magic;
+	__le32  orig_size;
+	__le32  comp_size;
+	__u8	data[];
+};
+
 #pragma pack(pop)
 
 #endif
@@ -73,25 +73,48 @@ static inline const char *C2H_HWQ_MSG_STR(u8 x)
 
 TRACE_EVENT(hostres,
 	    TP_PROTO(u32 lock_state, u32 is_user,
-		     u64 handle, int readers, u32 is_read),
-	    TP_ARGS(lock_state, is_user, handle, readers, is_read),
+		     u64 handle, int readers, u32 is_read, u32 wait_us),
+	    TP_ARGS(lock_state, is_user, handle, readers, is_read, wait_us),
 	    NNP_TP_STRUCT__entry(__field(u64, handle)
 				 __field(u32, lock_state)
 				 __field(u32, is_user)
 				 __field(u32, is_read)
-				 __field(int, readers)),
+				 __field(int, readers)
+				 __field(u32, wait_us)),
 	    NNP_TP_fast_assign(__entry->lock_state = lock_state;
 			       __entry->is_user = is_user;
 			       __entry->handle  = handle;
 			       __entry->readers = readers;
-			       __entry->is_read = is_read;),
+			       __entry->is_read = is_read;
+			       __entry->wait_us = wait_us;),
 	    NNP_TP_printk(
-		"lock_state=%s is_user=%d handle=0x%llx readers=%d is_read=%d",
+		"lock_state=%s is_user=%d handle=0x%llx readers=%d is_read=%d wait_us=%u",
 		__NNP_TRACE_LOCK_STR(__entry->lock_state),
 		__entry->is_user,
 		__entry->handle,
 		__entry->readers,
-		__entry->is_read)
+		__entry->is_read,
+		__entry->wait_us)
+);
+
+TRACE_EVENT(hostres_wait_hist,
+	    TP_PROTO(u64 handle, atomic_t *hist),
+	    TP_ARGS(handle, hist),
+	    NNP_TP_STRUCT__entry(__field(u64, handle)
+				 __array(u32, hist,
+					 NNP_HOSTRES_WAIT_HIST_BUCKETS)),
+	    NNP_TP_fast_assign(int i;
+
+			       __entry->handle = handle;
+			       for (i = 0; i < NNP_HOSTRES_WAIT_HIST_BUCKETS;
+				    i++)
+					__entry->hist[i] =
+						atomic_read(&hist[i]);),
+	    NNP_TP_printk("handle=0x%llx wait_us_log2_hist=%s",
+		__entry->handle,
+		__print_array(__entry->hist,
+			      NNP_HOSTRES_WAIT_HIST_BUCKETS,
+			      sizeof(u32)))
 );
 
 TRACE_EVENT(NNP_TRACE_IPC,
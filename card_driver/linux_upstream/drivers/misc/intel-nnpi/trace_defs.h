@@ -14,6 +14,9 @@ enum {
 	NNP_TRACE_LOCK_EXIT    = 3
 };
 
+/* log2 usec buckets of host resource lock wait histogram */
+#define NNP_HOSTRES_WAIT_HIST_BUCKETS 16
+
 #define __NNP_TRACE_LOCK_STR(x) \
 	((x) == NNP_TRACE_UNLOCK_ENTER ? "unlock_enter" : \
 	 ((x) == NNP_TRACE_UNLOCK_EXIT  ? "unlock_exit" : \
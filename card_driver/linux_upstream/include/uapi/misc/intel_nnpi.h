@@ -32,6 +32,15 @@
 #define IOCTL_INF_UNLOCK_HOST_RESOURCE      \
 	_IOWR('h', 4, struct nnpdrv_ioctl_lock_hostres)
 
+#define IOCTL_INF_LOCK_HOST_RESOURCES       \
+	_IOWR('h', 5, struct nnpdrv_ioctl_lock_hostres_batch)
+
+#define IOCTL_INF_UNLOCK_HOST_RESOURCES     \
+	_IOWR('h', 6, struct nnpdrv_ioctl_lock_hostres_batch)
+
+/* Max number of entries in one batched lock/unlock request */
+#define NNP_MAX_HOSTRES_LOCK_BATCH   256
+
 /* Resource usage_flags bits */
 #define IOCTL_INF_RES_INPUT          1
 #define IOCTL_INF_RES_OUTPUT         2
@@ -56,6 +65,24 @@ struct nnpdrv_ioctl_lock_hostres {
 	__u8  o_errno;
 };
 
+/*
+ * Entry of batched lock/unlock request.
+ * usage_flags selects user access direction - IOCTL_INF_RES_OUTPUT only
+ * takes a shared (read) lock, 0 uses the resource direction.
+ */
+struct nnpdrv_ioctl_lock_hostres_entry {
+	__u64 user_handle;
+	__u32 usage_flags;
+	__u8  o_errno;
+};
+
+struct nnpdrv_ioctl_lock_hostres_batch {
+	__u64 entries;      /* pointer to nnpdrv_ioctl_lock_hostres_entry array */
+	__u32 num_entries;
+	__u32 timeout_us;   /* for all entries together */
+	__u8  o_errno;
+};
+
 struct nnpdrv_ioctl_destroy_hostres {
 	__u64 user_handle;
 	__u8  o_errno;
@@ -136,5 +163,10 @@ struct ioctl_nnpi_channel_unmap_hostres {
 #define NNPER_NO_SUCH_CHANNEL                   (NNP_ERRNO_BASE + 5)
 #define NNPER_NO_SUCH_HOSTRES_MAP               (NNP_ERRNO_BASE + 6)
 #define NNPER_VERSIONS_MISMATCH                 (NNP_ERRNO_BASE + 7)
+#define NNPER_RESOURCE_LOCKED                   (NNP_ERRNO_BASE + 8)
+#define NNPER_RESOURCE_NOT_LOCKED               (NNP_ERRNO_BASE + 9)
+#define NNPER_RESOURCE_BUSY                     (NNP_ERRNO_BASE + 10)
+#define NNPER_TIMED_OUT                         (NNP_ERRNO_BASE + 11)
+#define NNPER_INTERRUPTED                       (NNP_ERRNO_BASE + 12)
 
 #endif /* of _NNP_UAPI_H */
@@ -173,7 +173,7 @@ void cve_device_clean(struct cve_device *dev)
 	cve_di_mask_interrupts(dev);
 
 	/* base fw package unloading */
-	cve_fw_unload(dev, dev->fw_loaded_list);
+	cve_fw_unload_base(dev);
 
 	cleanup_platform_data(dev);
 
@@ -428,18 +428,28 @@ struct trace_node_sysfs {
 #define FW_SECTION_ALIGNED_SZ_32K (1024 * 32)
 #define FW_SECTION_ALIGNED_SZ_4M (1024 * 1024 * 4)
 
+/* Size classes of f/w section cache, in increasing order of size.
+ * Sections up to 32K are not cached.
+ */
 enum ice_mem_cache_sz_type {
 	ICE_MEM_CACHE_SZ_TYPE_32K,
+	ICE_MEM_CACHE_SZ_TYPE_256K,
+	ICE_MEM_CACHE_SZ_TYPE_1M,
 	ICE_MEM_CACHE_SZ_TYPE_4M,
 	ICE_MEM_CACHE_SZ_TYPE_MAX
 };
 
 enum ice_mem_cache_sz {
 	ICE_MEM_CACHE_SZ_32K = (32 * 1024),
+	ICE_MEM_CACHE_SZ_256K = (256 * 1024),
+	ICE_MEM_CACHE_SZ_1M = (1024 * 1024),
 	ICE_MEM_CACHE_SZ_4M = (4 * 1024 * 1024)
 };
 #define ICE_MEM_CACHE_SZ_DEFAULT ICE_MEM_CACHE_SZ_4M
 
+/* Number of buckets in MD5 keyed hash of cached f/w, power of 2 */
+#define ICE_FW_CACHE_HASH_SZ 32
+
 struct ice_mem_cache_node {
 	/* link of cache nodes */
 	struct cve_dle_t list;
@@ -509,6 +519,12 @@ struct cve_device_group {
 	struct cve_device *poweroff_dev_list;
 	/* Lock for accessing poweroff_dev_list */
 	cve_os_lock_t poweroff_dev_list_lock;
+	/* Warm pool: jiffy of last resource borrow */
+	unsigned long last_borrow_jiffy;
+	/* Warm pool: moving average of borrow inter-arrival in msec */
+	u32 avg_borrow_gap_ms;
+	/* Warm pool: number of idle ICEs to keep powered on */
+	u32 warm_pool_target;
 	/* CLOS book keeping */
 	struct clos_manager dg_clos_manager;
 #ifdef _DEBUG
@@ -573,7 +589,10 @@ struct cve_device_group {
 	int trace_update_status;
 	struct trace_node_sysfs *node_group_sysfs;
 
+	/* globally cached custom f/w, in LRU order (head is oldest) */
 	struct cve_fw_loaded_sections *loaded_cust_fw_sections;
+	/* MD5 keyed hash of loaded_cust_fw_sections */
+	struct cve_fw_loaded_sections *cust_fw_hash[ICE_FW_CACHE_HASH_SZ];
 	/* place holder to store all information related memory caching */
 	struct ice_fw_mem_cache fw_mem_cache;
 
@@ -889,6 +908,10 @@ struct ice_pnetwork {
 	struct execution_node pntw_res_node;
 	/* Parent Network's Release node */
 	struct execution_node pntw_rel_node;
+	/* Inferences waiting in scheduler queues */
+	u32 sch_queued;
+	/* ICE time consumed (virtual time within the context) */
+	u64 sch_vtime;
 	/* ------------------------- */
 
 	/****************************************/
@@ -1133,6 +1156,8 @@ struct ice_infer {
 	 * Will be used to calculate network busy time
 	 */
 	u64 busy_start_time;
+	/* Time stamp, when inference was queued for schedule */
+	u64 sch_enqueue_time;
 };
 
 /* hold information about user buffer allocation (surface or cb) */
@@ -1210,6 +1235,25 @@ struct ds_context {
 	/* List of full networks within the context*/
 	struct ice_user_full_ntw *user_full_ntw;
 	/**************************************/
+
+	/* ------------------------- */
+	/* Exclusively for scheduler */
+	/* ------------------------- */
+	/* Share of ICE time relative to other contexts */
+	u32 sch_weight;
+	/* Max ICEs of running networks, 0 for no limit */
+	u32 sch_ice_quota;
+	/* Served ahead of non latency SLO contexts */
+	bool sch_latency_slo;
+	/* ICEs of the running networks */
+	u32 sch_ices_running;
+	/* Inferences waiting in scheduler queues */
+	u32 sch_queued;
+	/* ICE time consumed, scaled by weight (virtual time) */
+	u64 sch_vtime;
+	/* Virtual time of the last parent network served */
+	u64 sch_pntw_vclock;
+	/* ------------------------- */
 };
 
 struct ds_dev_data {
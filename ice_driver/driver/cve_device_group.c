@@ -34,6 +34,7 @@ static struct ice_drv_config drv_config_param = {
 	.enable_llc_config_via_axi_reg = 0,
 	.sph_soc = 0,
 	.ice_power_off_delay_ms = 0,
+	.ice_warm_pool_max = MAX_CVE_DEVICES_NR,
 	.enable_sph_b_step = false,
 	.enable_sph_c_step = false,
 	.ice_sch_preemption = 1,
@@ -232,6 +233,178 @@ static u32 __is_time_greater(const u64 t1, const u64 t2)
 		return 1;
 }
 
+/* Weight of a new sample in borrow gap average is 1/(2^SHIFT) */
+#define WARM_POOL_AVG_SHIFT 3
+/* Pool grows if average borrow gap is below FACTOR * power off delay */
+#define WARM_POOL_ENTER_FACTOR 2
+/* Pool is drained if no borrow for FACTOR * average gap + power off delay */
+#define WARM_POOL_EXIT_FACTOR 8
+
+#define ICEBO_MASK(bo_id) (0x3 << (2 * (bo_id)))
+
+void ice_dg_warm_pool_record_borrow(u32 num_ice)
+{
+	struct cve_device_group *dg = g_cve_dev_group_list;
+	unsigned long cur_jiffy;
+	u32 delay_ms, max_pool, gap_ms, target;
+
+	delay_ms = (u32)ice_get_power_off_delay_param();
+	max_pool = ice_get_warm_pool_max_param();
+	if (!delay_ms || !max_pool)
+		return;
+
+	if (cve_os_lock(&dg->poweroff_dev_list_lock, CVE_INTERRUPTIBLE)) {
+		cve_os_log(CVE_LOGLEVEL_ERROR, "cve_os_lock error\n");
+		return;
+	}
+
+	cur_jiffy = ice_os_get_current_jiffy();
+	if (!dg->last_borrow_jiffy) {
+		/* Start neutral, neither bursty nor idle */
+		dg->avg_borrow_gap_ms = delay_ms * WARM_POOL_ENTER_FACTOR;
+	} else {
+		gap_ms = jiffies_to_msecs(cur_jiffy - dg->last_borrow_jiffy);
+		dg->avg_borrow_gap_ms = dg->avg_borrow_gap_ms -
+			(dg->avg_borrow_gap_ms >> WARM_POOL_AVG_SHIFT) +
+			(gap_ms >> WARM_POOL_AVG_SHIFT);
+	}
+	dg->last_borrow_jiffy = cur_jiffy;
+
+	if (dg->avg_borrow_gap_ms >= delay_ms * WARM_POOL_ENTER_FACTOR)
+		goto unlock;
+
+	/* Bursty traffic. Keep enough whole ICEBOs warm for this demand */
+	target = (num_ice + 1) & ~1U;
+	if (target > max_pool)
+		target = max_pool;
+
+	if (target > dg->warm_pool_target) {
+		dg->warm_pool_target = target;
+		ice_swc_counter_set(g_sph_swc_global,
+				ICEDRV_SWC_GLOBAL_COUNTER_WARM_POOL_TARGET,
+				dg->warm_pool_target);
+		cve_os_log(CVE_LOGLEVEL_DEBUG,
+			"Warm pool grown to %u ICEs. AvgGap=%ums\n",
+			dg->warm_pool_target, dg->avg_borrow_gap_ms);
+	}
+
+unlock:
+	cve_os_unlock(&dg->poweroff_dev_list_lock);
+}
+
+/* Must be called with poweroff_dev_list_lock held */
+static u32 __warm_pool_target(struct cve_device_group *dg,
+		unsigned long cur_jiffy, u32 delay_ms)
+{
+	u32 idle_ms;
+
+	if (!dg->warm_pool_target)
+		return 0;
+
+	idle_ms = jiffies_to_msecs(cur_jiffy - dg->last_borrow_jiffy);
+	if (idle_ms >= delay_ms +
+		(WARM_POOL_EXIT_FACTOR * dg->avg_borrow_gap_ms)) {
+
+		cve_os_log(CVE_LOGLEVEL_DEBUG,
+			"Warm pool drained. Idle=%ums AvgGap=%ums\n",
+			idle_ms, dg->avg_borrow_gap_ms);
+
+		dg->warm_pool_target = 0;
+		ice_swc_counter_set(g_sph_swc_global,
+				ICEDRV_SWC_GLOBAL_COUNTER_WARM_POOL_TARGET, 0);
+	}
+
+	return dg->warm_pool_target;
+}
+
+/*
+ * Returns mask of queued ICEs that can be powered off now. ICEs are
+ * released per ICEBO so that both ICEs of a BO go down in one batch,
+ * and whole ICEBOs are held back while the warm pool needs them.
+ * Must be called with poweroff_dev_list_lock held.
+ */
+static u32 __get_poweroff_icemask(struct cve_device_group *dg,
+		unsigned long cur_jiffy, u32 delay_ms, bool drain)
+{
+	struct cve_device *head = dg->poweroff_dev_list;
+	struct cve_device *dev = head;
+	u32 queued = 0, expired = 0, warm;
+	u32 bo_id, bo_mask;
+
+	do {
+		queued |= (1 << dev->dev_index);
+		if (jiffies_to_msecs(cur_jiffy - dev->poff_jiffy) >= delay_ms)
+			expired |= (1 << dev->dev_index);
+
+		dev = cve_dle_next(dev, poweroff_list);
+	} while (dev != head);
+
+	if (drain)
+		return expired;
+
+	/* Wait for the other ICE of this BO if it is queued too */
+	for (bo_id = 0; bo_id < MAX_NUM_ICEBO; bo_id++) {
+		bo_mask = ICEBO_MASK(bo_id);
+		if (((queued & bo_mask) == bo_mask) &&
+			((expired & bo_mask) != bo_mask))
+			expired &= ~bo_mask;
+	}
+
+	warm = __warm_pool_target(dg, cur_jiffy, delay_ms);
+	for (bo_id = 0; bo_id < MAX_NUM_ICEBO; bo_id++) {
+		if (__builtin_popcount(queued & ~expired) >= warm)
+			break;
+		expired &= ~ICEBO_MASK(bo_id);
+	}
+
+	return expired;
+}
+
+static void __power_off_idle_ice(struct cve_device_group *dg,
+		struct cve_device *dev, u64 t)
+{
+	const struct sphpb_callbacks *sphpb_cbs;
+	int ret;
+
+	/* The ICEs can be in either ON or INITIATED state
+	 * because maybe power-off thread started after
+	 * executing some tests.
+	 */
+	ASSERT((dev->power_state == ICE_POWER_OFF_INITIATED) ||
+		(dev->power_state == ICE_POWER_ON));
+
+	ice_dev_set_power_state(dev, ICE_POWER_OFF);
+	ice_swc_counter_set(dev->hswc,
+			ICEDRV_SWC_DEVICE_COUNTER_POWER_STATE,
+			ice_dev_get_power_state(dev));
+
+	if (!__is_time_greater(dev->idle_start_time,
+				dev->busy_start_time)) {
+		dev->idle_start_time = t;
+		ice_swc_counter_set(dev->hswc,
+		ICEDRV_SWC_DEVICE_COUNTER_IDLE_START_TIME,
+		nsec_to_usec(dev->idle_start_time));
+	}
+
+	sphpb_cbs = dg->sphpb.sphpb_cbs;
+	if (sphpb_cbs && sphpb_cbs->set_power_state) {
+		ret = sphpb_cbs->set_power_state(
+				dev->dev_index, false);
+		if (ret) {
+			cve_os_dev_log(
+				CVE_LOGLEVEL_ERROR,
+				dev->dev_index,
+				"failed setting OFF power state OFF with power balancer (%d)\n",
+				ret);
+		}
+	}
+
+	cve_dle_remove_from_list(
+		dg->poweroff_dev_list,
+		poweroff_list,
+		dev);
+}
+
 #ifdef RING3_VALIDATION
 static void *ice_pm_monitor_task(void *data)
 #else
@@ -239,14 +412,13 @@ static int ice_pm_monitor_task(void *data)
 #endif
 {
 	int ret = 0, wq_status;
-	u32 icemask;
+	u32 icemask, i;
 	u32 configured_timeout_ms;
 	u32 time_60sec = 60000;
 	u32 timeout_msec = time_60sec;
 	unsigned long cur_jiffy;
 	struct cve_device *head;
 	struct cve_device_group *dg = (struct cve_device_group *)data;
-	const struct sphpb_callbacks *sphpb_cbs;
 	u64 t;
 
 #ifdef RING3_VALIDATION
@@ -292,58 +464,23 @@ static int ice_pm_monitor_task(void *data)
 		if (!head)
 			goto out_null_list;
 
-		icemask = 0;
+		/* Warm pool is ignored if thread is terminating */
+		icemask = __get_poweroff_icemask(dg, cur_jiffy,
+				configured_timeout_ms, terminate_thread(dg));
 		t = trace_clock_global();
 
-		while (jiffies_to_msecs(cur_jiffy - head->poff_jiffy) >=
-				configured_timeout_ms) {
-
-			/* The ICEs can be in either ON or INITIATED state
-			 * because maybe power-off thread started after
-			 * executing some tests.
-			 */
-			ASSERT((head->power_state == ICE_POWER_OFF_INITIATED) ||
-				(head->power_state == ICE_POWER_ON));
-
-			icemask |= (1 << head->dev_index);
-			ice_dev_set_power_state(head, ICE_POWER_OFF);
-			ice_swc_counter_set(head->hswc,
-					ICEDRV_SWC_DEVICE_COUNTER_POWER_STATE,
-					ice_dev_get_power_state(head));
-
-			if (!__is_time_greater(head->idle_start_time,
-						head->busy_start_time)) {
-				head->idle_start_time = t;
-				ice_swc_counter_set(head->hswc,
-				ICEDRV_SWC_DEVICE_COUNTER_IDLE_START_TIME,
-				nsec_to_usec(head->idle_start_time));
-			}
-
-			sphpb_cbs = dg->sphpb.sphpb_cbs;
-			if (sphpb_cbs && sphpb_cbs->set_power_state) {
-				ret = sphpb_cbs->set_power_state(
-						head->dev_index, false);
-				if (ret) {
-					cve_os_dev_log(
-						CVE_LOGLEVEL_ERROR,
-						head->dev_index,
-						"failed setting OFF power state OFF with power balancer (%d)\n",
-						ret);
-				}
-			}
-
-			cve_dle_remove_from_list(
-				dg->poweroff_dev_list,
-				poweroff_list,
-				head);
-
-			head = dg->poweroff_dev_list;
-			if (!head)
-				break;
+		for (i = 0; i < MAX_CVE_DEVICES_NR; i++) {
+			if (icemask & (1 << i))
+				__power_off_idle_ice(dg, cve_device_get(i), t);
 		}
 
-		if (icemask)
+		if (icemask) {
+			cve_os_log(CVE_LOGLEVEL_DEBUG,
+				"Powering off ICEs. Mask=0x%x\n", icemask);
 			unset_idc_registers_multi(icemask, false);
+		}
+
+		head = dg->poweroff_dev_list;
 
 out_null_list:
 
@@ -355,7 +492,12 @@ out_null_list:
 			u32 time_spent = jiffies_to_msecs(cur_jiffy -
 							head->poff_jiffy);
 
-			timeout_msec = (configured_timeout_ms - time_spent);
+			/* Head already expired but is held warm */
+			if (time_spent >= configured_timeout_ms)
+				timeout_msec = configured_timeout_ms;
+			else
+				timeout_msec = (configured_timeout_ms -
+						time_spent);
 		} else {
 			timeout_msec = time_60sec;
 
@@ -753,12 +895,16 @@ void ice_set_driver_config_param(struct ice_drv_config *param)
 	drv_config_param.initial_iccp_config[1] = param->initial_iccp_config[1];
 	drv_config_param.initial_iccp_config[2] = param->initial_iccp_config[2];
 	ice_set_power_off_delay_param(param->ice_power_off_delay_ms);
+	drv_config_param.ice_warm_pool_max =
+		(param->ice_warm_pool_max > MAX_CVE_DEVICES_NR) ?
+		MAX_CVE_DEVICES_NR : param->ice_warm_pool_max;
 
 	cve_os_log(CVE_LOGLEVEL_INFO,
-			"DriverConfig: enable_llc_config_via_axi_reg:%d sph_soc:%d ice_power_off_delay_ms:%d, is_b_step_enabled: %d is_c_step_enabled: %d Preemption:%d is_iccp_throttling_enabled:%d initial_cdyn:0x%x reset_cdyn:0x%x blocked_cdyn:0x%x\n",
+			"DriverConfig: enable_llc_config_via_axi_reg:%d sph_soc:%d ice_power_off_delay_ms:%d ice_warm_pool_max:%u, is_b_step_enabled: %d is_c_step_enabled: %d Preemption:%d is_iccp_throttling_enabled:%d initial_cdyn:0x%x reset_cdyn:0x%x blocked_cdyn:0x%x\n",
 			drv_config_param.enable_llc_config_via_axi_reg,
 			drv_config_param.sph_soc,
 			drv_config_param.ice_power_off_delay_ms,
+			drv_config_param.ice_warm_pool_max,
 			drv_config_param.enable_sph_b_step,
 			drv_config_param.enable_sph_c_step,
 			drv_config_param.ice_sch_preemption,
@@ -793,6 +939,11 @@ int ice_get_power_off_delay_param(void)
 		return drv_config_param.ice_power_off_delay_ms;
 }
 
+u32 ice_get_warm_pool_max_param(void)
+{
+	return drv_config_param.ice_warm_pool_max;
+}
+
 int ice_get_a_step_enable_flag(void)
 {
 	if (drv_config_param.enable_sph_c_step ||
@@ -999,6 +1150,7 @@ void ice_dg_borrow_this_ice(struct ice_pnetwork *pntw,
 {
 	struct cve_device_group *dg = cve_dg_get();
 	struct icebo_desc *bo = &dg->dev_info.icebo_list[dev->dev_index / 2];
+	bool same_pntw = (dev->dev_pntw_id == pntw->pntw_id);
 
 	if (dev->dev_ctx_id != pntw->wq->context->context_id) {
 
@@ -1006,6 +1158,13 @@ void ice_dg_borrow_this_ice(struct ice_pnetwork *pntw,
 		dev->dev_ctx_id = pntw->wq->context->context_id;
 	}
 
+	if (same_pntw)
+		ice_swc_counter_inc(g_sph_swc_global,
+				ICEDRV_SWC_GLOBAL_COUNTER_ICE_AFFINITY_HIT);
+	else
+		ice_swc_counter_inc(g_sph_swc_global,
+				ICEDRV_SWC_GLOBAL_COUNTER_ICE_AFFINITY_MISS);
+
 	dev->dev_pntw_id = pntw->pntw_id;
 
 	cve_os_log(CVE_LOGLEVEL_INFO,
@@ -1013,7 +1172,11 @@ void ice_dg_borrow_this_ice(struct ice_pnetwork *pntw,
 			pntw->pntw_id, dev->dev_index,
 			ice_dev_get_power_state(dev));
 
-	if (!lazy)
+	/*
+	 * ICE which last ran this pntw keeps its state, unless it was
+	 * powered off or switched context which set their own reset flag
+	 */
+	if (!lazy && !same_pntw)
 		cve_di_set_device_reset_flag(dev, CVE_DI_RESET_DUE_PNTW_SWITCH);
 
 	cve_dle_add_to_list_before(pntw->ice_list, owner_list, dev);
@@ -1056,48 +1219,126 @@ void ice_dg_borrow_this_ice(struct ice_pnetwork *pntw,
 	bo->in_pool_ice--;
 }
 
+/* Affinity weights used while choosing an ICE from free pool */
+#define ICE_AFFINITY_SAME_PNTW 4
+#define ICE_AFFINITY_SAME_CTX 2
+#define ICE_AFFINITY_POWERED 1
+
+/*
+ * Higher score means lesser work (reset, power on, embedded CB) before
+ * this ICE can execute given pntw. ICE must be in free pool.
+ */
+static u32 __ice_affinity_score(struct ice_pnetwork *pntw,
+		struct cve_device *dev)
+{
+	u32 score = 0;
+
+	if (dev->dev_pntw_id == pntw->pntw_id)
+		score += ICE_AFFINITY_SAME_PNTW;
+	if (dev->dev_ctx_id == pntw->wq->context->context_id)
+		score += ICE_AFFINITY_SAME_CTX;
+	if (dev->power_state != ICE_POWER_OFF)
+		score += ICE_AFFINITY_POWERED;
+
+	return score;
+}
+
+/* On equal score, least recently used ICE wins */
+static bool __is_better_ice(u32 score, u64 idle_time,
+		u32 best_score, u64 best_idle_time)
+{
+	if (score != best_score)
+		return (score > best_score);
+
+	return (idle_time < best_idle_time);
+}
+
 void ice_dg_borrow_next_pbo(struct ice_pnetwork *pntw,
 		struct cve_device **ice0,
 		struct cve_device **ice1)
 {
 	struct cve_device_group *dg = cve_dg_get();
-	struct icebo_desc *bo = dg->dev_info.picebo_list;
-	struct cve_device *dev;
+	struct icebo_desc *head = dg->dev_info.picebo_list;
+	struct icebo_desc *bo = head, *best_bo = head;
+	struct cve_device *dev, *dev1;
+	u32 score, best_score = 0;
+	u64 idle_time, best_idle_time = 0;
+	bool first = true;
+
+	ASSERT(head);
+
+	/* Both ICEs of a BO are free, so evaluate them as a pair */
+	do {
+		dev = bo->dev_list;
+		dev1 = cve_dle_next(dev, bo_list);
+
+		score = __ice_affinity_score(pntw, dev) +
+			__ice_affinity_score(pntw, dev1);
+		idle_time = (dev->idle_start_time > dev1->idle_start_time) ?
+			dev->idle_start_time : dev1->idle_start_time;
+
+		if (first || __is_better_ice(score, idle_time,
+					best_score, best_idle_time)) {
+			best_bo = bo;
+			best_score = score;
+			best_idle_time = idle_time;
+			first = false;
+		}
+
+		bo = cve_dle_next(bo, owner_list);
+	} while (bo != head);
 
 	/* add first device of BOn to ntw ice list */
-	dev = bo->dev_list;
+	dev = best_bo->dev_list;
+	dev1 = cve_dle_next(dev, bo_list);
 	ice_dg_borrow_this_ice(pntw, dev, false);
 	*ice0 = dev;
 
-	dev = cve_dle_next(dev, bo_list);
-	ice_dg_borrow_this_ice(pntw, dev, false);
-	*ice1 = dev;
+	ice_dg_borrow_this_ice(pntw, dev1, false);
+	*ice1 = dev1;
 }
 
 void ice_dg_borrow_next_dice(struct ice_pnetwork *pntw,
 		struct cve_device **ice0)
 {
 	struct cve_device_group *dg = cve_dg_get();
-	struct icebo_desc *bo;
-	struct cve_device *dev;
+	struct icebo_desc *head, *bo;
+	struct cve_device *dev, *best = NULL;
+	u32 score, best_score = 0;
+	u64 best_idle_time = 0;
+
+	/* Partially used BOs are consumed first to keep full BOs for
+	 * networks that require ICEBO.
+	 */
+	if (dg->dev_info.dicebo_list)
+		head = dg->dev_info.dicebo_list;
+	else
+		head = dg->dev_info.picebo_list;
+	ASSERT(head);
 
-	if (dg->dev_info.dicebo_list) {
-		bo = dg->dev_info.dicebo_list;
+	bo = head;
+	do {
 		dev = bo->dev_list;
-
-		if (!dev->in_free_pool)
+		do {
+			if (dev->in_free_pool) {
+				score = __ice_affinity_score(pntw, dev);
+				if (!best || __is_better_ice(score,
+						dev->idle_start_time,
+						best_score, best_idle_time)) {
+					best = dev;
+					best_score = score;
+					best_idle_time = dev->idle_start_time;
+				}
+			}
 			dev = cve_dle_next(dev, bo_list);
+		} while (dev != bo->dev_list);
 
-	} else {
-		bo = dg->dev_info.picebo_list;
-		ASSERT(bo);
-		dev = bo->dev_list;
-
-	}
+		bo = cve_dle_next(bo, owner_list);
+	} while (bo != head);
 
-	ASSERT(dev);
-	ice_dg_borrow_this_ice(pntw, dev, false);
-	*ice0 = dev;
+	ASSERT(best);
+	ice_dg_borrow_this_ice(pntw, best, false);
+	*ice0 = best;
 }
 
 void ice_dg_reserve_this_ice(struct cve_device *dev)
@@ -1201,39 +1442,51 @@ static int __free_mem_node(struct ice_mem_cache_node *node)
 }
 
 
+/* Size of each cache size class */
+static const u32 ice_mem_cache_sz[ICE_MEM_CACHE_SZ_TYPE_MAX] = {
+	ICE_MEM_CACHE_SZ_32K,
+	ICE_MEM_CACHE_SZ_256K,
+	ICE_MEM_CACHE_SZ_1M,
+	ICE_MEM_CACHE_SZ_4M
+};
+
+/*
+ * Number of preallocated nodes per size class. 0 means not cached.
+ * Total must not exceed the MAX_CVE_DEVICES_NR x 4M of the old 4M-only
+ * pool: 2N x 256K + N x 1M + N/2 x 4M = 3.5M per device.
+ */
+static const u8 ice_mem_cache_nodes_nr[ICE_MEM_CACHE_SZ_TYPE_MAX] = {
+	0,
+	2 * MAX_CVE_DEVICES_NR,
+	MAX_CVE_DEVICES_NR,
+	MAX_CVE_DEVICES_NR / 2
+};
+
+/* Smallest cached size class that can hold given size */
 static int __map_size_to_type(u32 size, enum ice_mem_cache_sz_type *type)
 {
-	int ret = 0;
+	u8 i;
 
 	if (size <= ICE_MEM_CACHE_SZ_32K)
-		ret = -1;
-	else if (size <= ICE_MEM_CACHE_SZ_4M)
-		*type = ICE_MEM_CACHE_SZ_TYPE_4M;
-	else
-		ret = -1;
+		return -1;
 
-	return ret;
+	for (i = 0; i < ICE_MEM_CACHE_SZ_TYPE_MAX; i++) {
+		if (ice_mem_cache_nodes_nr[i] && size <= ice_mem_cache_sz[i]) {
+			*type = i;
+			return 0;
+		}
+	}
+
+	return -1;
 }
 
 static int __init_mem_node(struct ice_mem_cache_node *node,
 	       enum ice_mem_cache_sz_type type)
 {
 	struct cve_device *dev = ice_get_first_dev();
-	u32 size = 0;
+	u32 size = ice_mem_cache_sz[type];
 	int ret = 0;
 
-	switch (type) {
-	case ICE_MEM_CACHE_SZ_TYPE_32K:
-		size = ICE_MEM_CACHE_SZ_32K;
-		break;
-	case ICE_MEM_CACHE_SZ_TYPE_4M:
-		size = ICE_MEM_CACHE_SZ_4M;
-		break;
-	default:
-		size = ICE_MEM_CACHE_SZ_32K;
-		break;
-	}
-
 	/* Allocate DMA'able memory and get its kernel virt address */
 	ret = OS_ALLOC_DMA_SG(dev, size, 1, &node->dma_handle, true);
 	if (ret != 0) {
@@ -1336,7 +1589,7 @@ exit:
 static int __alloc_mem_cache_nodes_per_type(enum ice_mem_cache_sz_type type,
 		struct ice_fw_mem_cache *fw_mem_cache)
 {
-	u8 max_nodes = MAX_CVE_DEVICES_NR;
+	u8 max_nodes = ice_mem_cache_nodes_nr[type];
 	u8 count = 0;
 	struct ice_mem_cache_node *node;
 	int ret = 0;
@@ -1398,8 +1651,7 @@ static int __put_free_mem_cache_node(struct ice_fw_mem_cache *fw_mem_cache,
 	struct ice_mem_cache_node *lookup = NULL;
 	int ret = 0;
 
-	if (node->type != ICE_MEM_CACHE_SZ_TYPE_32K &&
-			node->type != ICE_MEM_CACHE_SZ_TYPE_4M) {
+	if (node->type >= ICE_MEM_CACHE_SZ_TYPE_MAX) {
 		ret = -1;
 		cve_os_log(CVE_LOGLEVEL_ERROR,
 				"Type:%u Node:%p is invalid\n",
@@ -1441,7 +1693,7 @@ exit:
 
 int ice_dg_free_fw_mem_cache_nodes(struct ice_fw_mem_cache *fw_mem_cache)
 {
-	u8 i = ICE_MEM_CACHE_SZ_TYPE_4M;
+	u8 i = 0;
 
 	for (; i < ICE_MEM_CACHE_SZ_TYPE_MAX; i++)
 		__free_mem_cache_nodes_per_type(i, fw_mem_cache);
@@ -1452,7 +1704,7 @@ int ice_dg_free_fw_mem_cache_nodes(struct ice_fw_mem_cache *fw_mem_cache)
 int ice_dg_alloc_fw_mem_cache_nodes(struct ice_fw_mem_cache *fw_mem_cache)
 {
 	u8 max_types = ICE_MEM_CACHE_SZ_TYPE_MAX;
-	u8 i = ICE_MEM_CACHE_SZ_TYPE_4M, j = ICE_MEM_CACHE_SZ_TYPE_4M;
+	u8 i = 0, j = 0;
 	int ret = 0;
 
 	for (; i < max_types; i++) {
@@ -1463,12 +1715,30 @@ int ice_dg_alloc_fw_mem_cache_nodes(struct ice_fw_mem_cache *fw_mem_cache)
 
 	return ret;
 error:
-	for (j = 0; j <= i; j++)
+	/* failed type has already cleaned up itself */
+	for (j = 0; j < i; j++)
 		__free_mem_cache_nodes_per_type(j, fw_mem_cache);
 
 	return ret;
 }
 
+/* Smallest size class >= given type that has a free node */
+static int __find_free_type(struct cve_device_group *dg,
+		enum ice_mem_cache_sz_type type,
+		enum ice_mem_cache_sz_type *out_type)
+{
+	u8 i;
+
+	for (i = type; i < ICE_MEM_CACHE_SZ_TYPE_MAX; i++) {
+		if (dg->fw_mem_cache.cache_free_head[i]) {
+			*out_type = i;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 /*
  * Success : 1
  * No free Node : 0
@@ -1477,7 +1747,7 @@ error:
 int __ice_dg_check_free_cached_mem(u32 size)
 {
 	int ret = 1;
-	enum ice_mem_cache_sz_type type;
+	enum ice_mem_cache_sz_type type, free_type;
 	struct cve_device_group *dg = cve_dg_get();
 
 	ret = __map_size_to_type(size, &type);
@@ -1488,29 +1758,32 @@ int __ice_dg_check_free_cached_mem(u32 size)
 		goto exit;
 	}
 
-	if (!dg->fw_mem_cache.cache_free_head[type]) {
-		ret = 0;
+	ret = __find_free_type(dg, type, &free_type);
+	if (!ret) {
 		cve_os_log(CVE_LOGLEVEL_WARNING,
 				"Type:%u No free Node\n", type);
 		goto exit;
 	}
 
-	/* reached here, so there is atleast one free node */
-	ret = 1;
 exit:
 	cve_os_log(CVE_LOGLEVEL_DEBUG,
-				"Type:%u Free Node status:%d\n", type, ret);
+				"Size:%u Free Node status:%d\n", size, ret);
 	return ret;
 
 }
 
+static int __dg_find_lru_cached_fw(struct cve_device_group *dg,
+		struct cve_fw_loaded_sections **out_node);
+static void __dg_evict_cached_fw(struct cve_device_group *dg,
+		struct cve_fw_loaded_sections *fw_sec);
 
 int __ice_dg_get_cached_mem(u32 size, struct cve_dma_handle *dma_handle)
 {
 	int ret = 0;
-	enum ice_mem_cache_sz_type type;
+	enum ice_mem_cache_sz_type type, free_type;
 	struct cve_device_group *dg = cve_dg_get();
 	struct ice_mem_cache_node *node;
+	struct cve_fw_loaded_sections *lru;
 
 	ret = __map_size_to_type(size, &type);
 	if (ret < 0) {
@@ -1520,7 +1793,22 @@ int __ice_dg_get_cached_mem(u32 size, struct cve_dma_handle *dma_handle)
 		goto exit;
 	}
 
-	ret = __get_free_mem_cache_node(type, &dg->fw_mem_cache, &node);
+	/* Evict unused f/w, oldest first, until this size class or a
+	 * bigger one has a free node
+	 */
+	while (!__find_free_type(dg, type, &free_type)) {
+		ret = __dg_find_lru_cached_fw(dg, &lru);
+		if (ret < 0 || !lru) {
+			ret = -1;
+			cve_os_log(CVE_LOGLEVEL_WARNING,
+					"Size:%u No free node\n", size);
+			goto exit;
+		}
+
+		__dg_evict_cached_fw(dg, lru);
+	}
+
+	ret = __get_free_mem_cache_node(free_type, &dg->fw_mem_cache, &node);
 	if (ret < 0) {
 		cve_os_log(CVE_LOGLEVEL_ERROR,
 				"Size:%u No free node\n", size);
@@ -1572,14 +1860,46 @@ static void __dump_fw_list_info(struct cve_fw_loaded_sections *loaded_fw_list)
 }
 #endif
 
+static u32 __fw_md5_hash(const u8 *md5)
+{
+	/* MD5 is uniformly distributed, so first bytes are a good hash */
+	u32 key = md5[0] | (md5[1] << 8) | (md5[2] << 16) | ((u32)md5[3] << 24);
+
+	return key & (ICE_FW_CACHE_HASH_SZ - 1);
+}
+
+void ice_dg_add_cached_fw(struct cve_fw_loaded_sections *fw_sec)
+{
+	struct cve_device_group *dg = cve_dg_get();
+	u32 key = __fw_md5_hash(fw_sec->md5);
+
+	/* Newest entry goes to tail of LRU list */
+	cve_dle_add_to_list_before(dg->loaded_cust_fw_sections,
+			list, fw_sec);
+	cve_dle_add_to_list_before(dg->cust_fw_hash[key],
+			hash_list, fw_sec);
+}
+
+void ice_dg_del_cached_fw(struct cve_fw_loaded_sections *fw_sec)
+{
+	struct cve_device_group *dg = cve_dg_get();
+	u32 key = __fw_md5_hash(fw_sec->md5);
+
+	cve_dle_remove_from_list(dg->loaded_cust_fw_sections,
+			list, fw_sec);
+	cve_dle_remove_from_list(dg->cust_fw_hash[key],
+			hash_list, fw_sec);
+}
+
+/* Oldest cached f/w that has no active users */
 static int __dg_find_lru_cached_fw(struct cve_device_group *dg,
 		struct cve_fw_loaded_sections **out_node)
 {
 	int ret = 0;
-	u64 __lru = trace_clock_global();
 	struct cve_fw_loaded_sections *loaded_fw_section;
 	struct cve_fw_loaded_sections *loaded_fw_sections_list;
 
+	*out_node = NULL;
 	loaded_fw_sections_list = dg->loaded_cust_fw_sections;
 	if (!loaded_fw_sections_list) {
 		cve_os_log(CVE_LOGLEVEL_ERROR,
@@ -1588,19 +1908,16 @@ static int __dg_find_lru_cached_fw(struct cve_device_group *dg,
 		goto exit;
 	}
 
-	*out_node = NULL;
-	loaded_fw_section = dg->loaded_cust_fw_sections;
+	/* List is in LRU order, so first node without users is the LRU */
+	loaded_fw_section = loaded_fw_sections_list;
 	do {
-		/* Only look for such LRU nodes which have no active users */
 		if (loaded_fw_section->owners == NULL) {
-			if (loaded_fw_section->last_used < __lru) {
-				__lru = loaded_fw_section->last_used;
-				*out_node = loaded_fw_section;
-				cve_os_log(CVE_LOGLEVEL_DEBUG,
-						"LRU f/w(0x%p) found MD5:%s #FwCaching\n",
-						loaded_fw_section,
-						loaded_fw_section->md5_str);
-			}
+			*out_node = loaded_fw_section;
+			cve_os_log(CVE_LOGLEVEL_DEBUG,
+					"LRU f/w(0x%p) found MD5:%s #FwCaching\n",
+					loaded_fw_section,
+					loaded_fw_section->md5_str);
+			break;
 		}
 		loaded_fw_section = cve_dle_next(loaded_fw_section, list);
 	} while (loaded_fw_sections_list != loaded_fw_section);
@@ -1609,14 +1926,30 @@ exit:
 	return ret;
 }
 
+static void __dg_evict_cached_fw(struct cve_device_group *dg,
+		struct cve_fw_loaded_sections *fw_sec)
+{
+	ice_dg_del_cached_fw(fw_sec);
+	cve_os_log(CVE_LOGLEVEL_INFO,
+			"Evicting cached f/w(0x%p) MD5:%s #FwCaching\n",
+			fw_sec, fw_sec->md5_str);
+
+	cve_fw_unload(NULL, fw_sec);
+	ice_swc_counter_inc(g_sph_swc_global,
+			ICEDRV_SWC_GLOBAL_COUNTER_FW_CACHE_EVICT);
+}
+
 /* release oldest cached f/w until atleast 1 cached memory is available */
 int __ice_dg_return_cached_mem(struct ice_pnetwork *pntw)
 {
 	int ret = 0;
 	struct cve_device_group *dg = cve_dg_get();
 	struct cve_fw_loaded_sections *loaded_fw_section;
-	u32 sz = ICE_MEM_CACHE_SZ_DEFAULT;
+	u32 sz = ICE_MEM_CACHE_SZ_32K + 1;
 
+	/* Any free node will do. Per size class eviction happens on
+	 * demand while the sections are being loaded.
+	 */
 	ret = __ice_dg_check_free_cached_mem(sz);
 	while (ret == 0) {
 		ret = __dg_find_lru_cached_fw(dg, &loaded_fw_section);
@@ -1631,14 +1964,7 @@ int __ice_dg_return_cached_mem(struct ice_pnetwork *pntw)
 			break;
 		}
 
-		cve_dle_remove_from_list(dg->loaded_cust_fw_sections,
-				list, loaded_fw_section);
-		cve_os_log(CVE_LOGLEVEL_INFO,
-				"PNTW:0x%llx releasing f/w(0x%p) MD5:%s\n",
-				pntw->pntw_id, loaded_fw_section,
-				loaded_fw_section->md5_str);
-
-		cve_fw_unload(NULL, loaded_fw_section);
+		__dg_evict_cached_fw(dg, loaded_fw_section);
 		ret = __ice_dg_check_free_cached_mem(sz);
 	}
 
@@ -1650,17 +1976,14 @@ int __ice_dg_return_cached_mem(struct ice_pnetwork *pntw)
 int __ice_dg_find_matching_fw(struct ice_pnetwork *pntw, u8 *md5,
 		struct cve_fw_loaded_sections **out_node)
 {
-	int not_equal = 0;
-	u8 i = 0;
+	int not_equal = 1;
 	struct cve_fw_loaded_sections *loaded_fw_section;
-	struct cve_fw_loaded_sections *loaded_fw_sections_list;
+	struct cve_fw_loaded_sections *bucket;
 	struct cve_device_group *dg = cve_dg_get();
 
 	/* If no MD5, exit */
-	if (!md5) {
-		not_equal = 1;
+	if (!md5)
 		goto exit;
-	}
 
 	/* if no copy cached yet, so nothing to compare */
 	if (!dg->loaded_cust_fw_sections) {
@@ -1670,37 +1993,39 @@ int __ice_dg_find_matching_fw(struct ice_pnetwork *pntw, u8 *md5,
 		goto exit;
 	}
 
-	loaded_fw_sections_list = dg->loaded_cust_fw_sections;
-	loaded_fw_section = dg->loaded_cust_fw_sections;
-	do {
-		for (i = 0; i < ICEDRV_MD5_MAX_SIZE; i++) {
-			if (loaded_fw_section->md5[i] != md5[i])
-				break;
-		}
+	bucket = dg->cust_fw_hash[__fw_md5_hash(md5)];
+	if (!bucket)
+		goto miss;
 
-		/* at least 1 byte did not match */
-		if (i < ICEDRV_MD5_MAX_SIZE) {
-			not_equal = 1;
-			cve_os_log(CVE_LOGLEVEL_INFO,
-					"MD5 mismatch cached MD5:%s\n",
-					loaded_fw_section->md5_str);
-		} else {
+	loaded_fw_section = bucket;
+	do {
+		if (!memcmp(loaded_fw_section->md5, md5,
+					ICEDRV_MD5_MAX_SIZE)) {
 			not_equal = 0;
-			/* match found, so update time stamp to latest
-			 * so that its last to evict
-			 */
-			loaded_fw_section->last_used = trace_clock_global();
-			*out_node = loaded_fw_section;
-			cve_os_log(CVE_LOGLEVEL_DEBUG,
-					"MD5 match found cached MD5:%s\n",
-					loaded_fw_section->md5_str);
 			break;
 		}
+		loaded_fw_section = cve_dle_next(loaded_fw_section,
+				hash_list);
+	} while (loaded_fw_section != bucket);
+
+	if (not_equal)
+		goto miss;
+
+	/* match found, move to LRU tail so that its last to evict */
+	loaded_fw_section->last_used = trace_clock_global();
+	cve_dle_move(dg->loaded_cust_fw_sections,
+			dg->loaded_cust_fw_sections, list, loaded_fw_section);
+	*out_node = loaded_fw_section;
+	ice_swc_counter_inc(g_sph_swc_global,
+			ICEDRV_SWC_GLOBAL_COUNTER_FW_CACHE_HIT);
+	cve_os_log(CVE_LOGLEVEL_DEBUG,
+			"MD5 match found cached MD5:%s\n",
+			loaded_fw_section->md5_str);
+	goto exit;
 
-		loaded_fw_section = cve_dle_next(loaded_fw_section, list);
-	} while (loaded_fw_sections_list != loaded_fw_section &&
-			not_equal != 0);
-
+miss:
+	cve_os_log(CVE_LOGLEVEL_INFO,
+			"MD5 not found in f/w cache, loading new firmware\n");
 exit:
 	return not_equal;
 }
@@ -32,6 +32,7 @@ struct ice_drv_config {
 	u8 enable_llc_config_via_axi_reg;
 	u8 sph_soc;
 	int ice_power_off_delay_ms;
+	u32 ice_warm_pool_max;
 	bool enable_sph_b_step;
 	bool enable_sph_c_step;
 	u8 ice_sch_preemption;
@@ -147,6 +148,17 @@ void ice_set_power_off_delay_param(int time_ms);
 /* retrieve status of driver's ice power off delay config parameter */
 int ice_get_power_off_delay_param(void);
 
+/* retrieve max number of idle ICEs that warm pool may keep powered on */
+u32 ice_get_warm_pool_max_param(void);
+
+/*
+ * Record a resource borrow in the warm pool policy. If borrows arrive
+ * faster than the power off delay, the pool grows to cover num_ice.
+ * inputs :
+ * num_ice - number of ICEs borrowed
+ */
+void ice_dg_warm_pool_record_borrow(u32 num_ice);
+
 /* retrieve  a step enable flag */
 int ice_get_a_step_enable_flag(void);
 
@@ -198,6 +210,8 @@ int __ice_dg_put_cached_mem(struct cve_dma_handle *dma_handle);
 int __ice_dg_return_cached_mem(struct ice_pnetwork *pntw);
 int __ice_dg_find_matching_fw(struct ice_pnetwork *pntw, u8 *md5,
 		struct cve_fw_loaded_sections **out_node);
+void ice_dg_add_cached_fw(struct cve_fw_loaded_sections *fw_sec);
+void ice_dg_del_cached_fw(struct cve_fw_loaded_sections *fw_sec);
 
 #ifndef RING3_VALIDATION
 
@@ -18,6 +18,7 @@
 #include "cve_device_group.h"
 #include "project_settings.h"
 #include "scheduler.h"
+#include "ice_trace_ring.h"
 #ifdef RING3_VALIDATION
 #include "coral_memory.h"
 #endif
@@ -33,6 +34,12 @@ int cve_driver_init(void)
 {
 	int retval;
 
+	/* tracing is optional, the driver works without the ring */
+	retval = ice_trace_ring_init();
+	if (retval != 0)
+		cve_os_log_default(CVE_LOGLEVEL_WARNING,
+				"trace ring disabled %d\n", retval);
+
 	/*debug fs and module params set*/
 	cve_debug_init();
 
@@ -103,6 +110,7 @@ dg_cleanup:
 #endif
 debug_cleanup:
 	cve_debug_destroy();
+	ice_trace_ring_cleanup();
 
 	return retval;
 }
@@ -129,6 +137,9 @@ void cve_driver_cleanup(void)
 	/* need to be outside the lock to avoid deadlocks */
 	cve_os_interface_cleanup();
 
+	/* only after IRQs are freed, the ISR records into the ring */
+	ice_trace_ring_cleanup();
+
 	ice_kmd_destroy_dg();
 
 #ifdef RING3_VALIDATION
@@ -581,8 +581,32 @@ struct cve_create_context_params {
 	__s64 obj_id;
 	/*out, context ID of created context*/
 	__u64 out_contextid;
+	/* share of ICE time relative to other contexts,
+	 * 0 for ICE_SCH_WEIGHT_DEFAULT
+	 */
+	__u32 sch_weight;
+	/* max number of ICEs used concurrently, 0 for no limit */
+	__u32 sch_ice_quota;
+	/* ICE_SCH_CTX_FLAG_* */
+	__u32 sch_flags;
+	/* must be 0 when ICE_SCH_CTX_FLAG_PARAMS_VALID is set */
+	__u32 reserved;
 };
 
+#define ICE_SCH_WEIGHT_DEFAULT 100
+
+/* Inferences of the context are served ahead of other contexts,
+ * requires CAP_SYS_NICE
+ */
+#define ICE_SCH_CTX_FLAG_LATENCY_SLO (1 << 0)
+/* sch_weight, sch_ice_quota, sch_flags and reserved are set by the user,
+ * they are ignored otherwise since older users do not initialize them
+ */
+#define ICE_SCH_CTX_FLAG_PARAMS_VALID (1U << 31)
+
+#define ICE_SCH_CTX_FLAGS_MASK (ICE_SCH_CTX_FLAG_LATENCY_SLO | \
+				ICE_SCH_CTX_FLAG_PARAMS_VALID)
+
 /*
 * parameter for IOCTL-destroy-context
 */
@@ -94,6 +94,12 @@ Version tlc_version;
 Version ivp_version;
 Version asip_version;
 
+/* Base package is identical for all ICEs, so it is loaded once and
+ * shared. Device init/term are serialized, so no lock is required.
+ */
+static struct cve_fw_loaded_sections *base_fw_loaded_list;
+static u32 base_fw_users;
+
 #ifndef NULL_DEVICE_RING0
 static struct cve_fw_file fw_binaries_files[] =  {
 		/* TLC */
@@ -1319,11 +1325,23 @@ int cve_fw_load(struct cve_device *cve_dev)
 	int retval = CVE_DEFAULT_ERROR_CODE;
 #ifndef NULL_DEVICE_RING0
 	u32 i;
+	u64 start;
 	struct cve_fw_loaded_sections *loaded_fw_list = NULL;
 
+	if (base_fw_loaded_list) {
+		cve_dev->fw_loaded_list = base_fw_loaded_list;
+		base_fw_users++;
+		cve_os_dev_log(CVE_LOGLEVEL_DEBUG,
+				cve_dev->dev_index,
+				"Sharing base Firmwares, Users=%u\n",
+				base_fw_users);
+		return 0;
+	}
+
 	cve_os_dev_log(CVE_LOGLEVEL_DEBUG,
 			cve_dev->dev_index,
 			"Load Firmwares on device\n");
+	start = trace_clock_global();
 
 	for (i = 0; i < ARRAY_SIZE(fw_binaries_files); i++) {
 		struct cve_fw_loaded_sections *loaded_fw = NULL;
@@ -1373,6 +1391,12 @@ int cve_fw_load(struct cve_device *cve_dev)
 	}
 
 	cve_dev->fw_loaded_list = loaded_fw_list;
+	base_fw_loaded_list = loaded_fw_list;
+	base_fw_users = 1;
+	cve_os_log_default(CVE_LOGLEVEL_INFO,
+			"ICE:%d Base Firmwares loaded in %llu usec\n",
+			cve_dev->dev_index,
+			nsec_to_usec(trace_clock_global() - start));
 	/* success */
 	retval = 0;
 out:
@@ -1514,6 +1538,20 @@ void cve_fw_unload(struct cve_device *ice,
 #endif
 }
 
+void cve_fw_unload_base(struct cve_device *ice)
+{
+	if (!ice->fw_loaded_list)
+		return;
+
+	ice->fw_loaded_list = NULL;
+	base_fw_users--;
+	if (base_fw_users)
+		return;
+
+	cve_fw_unload(ice, base_fw_loaded_list);
+	base_fw_loaded_list = NULL;
+}
+
 void cve_fw_unmap(struct cve_fw_mapped_sections *fw_mapped_list,
 		cve_di_subjob_handle_t *embedded_cbs_subjobs)
 {
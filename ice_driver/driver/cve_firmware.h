@@ -95,7 +95,8 @@ int cve_fw_init(void);
 
 /*
  * load the firmware binaries of the base package to
- * a given memory for specific cve device.
+ * a given memory for specific cve device. Package is loaded
+ * only once and shared by all devices.
  * inputs :cve_dev - cve device
  * returns: 0 on success, a negative error code on failure
  */
@@ -141,6 +142,15 @@ void cve_fw_restore_ivp(struct cve_device *cve_dev,
 void cve_fw_unload(struct cve_device *ice,
 		struct cve_fw_loaded_sections *fw_loaded_list);
 
+/*
+ * drop device reference to the shared base package, and unload
+ * it when last device is gone
+ * inputs : cve_device *ice - cve device handle
+ * outputs:
+ * returns:
+ */
+void cve_fw_unload_base(struct cve_device *ice);
+
 /*
  * unmap all the firmware sections that were mapped to this context
  * inputs :cve_device *cve_dev - cve device handle
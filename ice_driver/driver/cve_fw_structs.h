@@ -72,6 +72,8 @@ struct ice_fw_owner_info {
 #define __MD5_MAX_SZ 16
 struct cve_fw_loaded_sections {
 	struct cve_dle_t list;
+	/* link in MD5 hash bucket, valid only if cached_mem_used */
+	struct cve_dle_t hash_list;
 	/* firmware sections */
 	u32 sections_nr;
 	struct cve_fw_section_descriptor *sections;
@@ -35,6 +35,8 @@
 #include "linux/delay.h"
 #endif
 
+#include "ice_trace_ring.h"
+
 #include "ice_sw_counters.h"
 #ifndef RING3_VALIDATION
 #include "intel_sphpb.h"
@@ -1498,9 +1500,12 @@ int cve_di_interrupt_handler(struct idc_device *idc_dev)
 	u64 status64, userIDCIntStatus;
 	u32 status_lo = 0, status_hi = 0, status_hl = 0;
 	struct cve_device *cve_dev = NULL;
+	struct ice_isr_pending *pending;
+	unsigned long int_jiffy;
 	u64 cur_ts;
 
-	u32 head, tail;
+	u32 head, tail, q_full;
+	struct dev_isr_status ovf_node;
 	struct dev_isr_status *isr_status_node;
 
 	if (!is_driver_active) {
@@ -1515,13 +1520,17 @@ int cve_di_interrupt_handler(struct idc_device *idc_dev)
 				SPH_TRACE_OP_STATE_START,
 				0, 0, 0,
 				SPH_TRACE_OP_STATUS_Q_HEAD, head));
+	ICE_TRACE_RING(ICE_TR_EV_ISR, 0, head, tail);
 
-	if (((head + 1) % IDC_ISR_BH_QUEUE_SZ) == tail) {
-		/* Q FULL*/
-		cve_os_log_default(CVE_LOGLEVEL_ERROR, "BH ISR Q FULL\n");
-	}
+	/* If Q is full, status is folded into overflow accumulators
+	 * instead of overwriting a node which BH has not read yet
+	 */
+	q_full = (((head + 1) % IDC_ISR_BH_QUEUE_SZ) == tail);
+	if (q_full)
+		isr_status_node = &ovf_node;
+	else
+		isr_status_node = &idc_dev->isr_status[head];
 
-	isr_status_node = &idc_dev->isr_status[head];
 	/* Set the valid to 0 as not data is yet processed
 	 * Set to one if some relevant data is filled
 	 */
@@ -1566,7 +1575,7 @@ int cve_di_interrupt_handler(struct idc_device *idc_dev)
 		goto exit;
 	}
 
-	isr_status_node->int_jiffy = ice_os_get_current_jiffy();
+	int_jiffy = ice_os_get_current_jiffy();
 	cur_ts = trace_clock_global();
 
 	/* Currently only serving ICE Int Request, not Ice Error request */
@@ -1594,7 +1603,12 @@ int cve_di_interrupt_handler(struct idc_device *idc_dev)
 		status_32 = cve_os_read_mmio_32(cve_dev,
 				cfg_default.mmio_intr_status_offset);
 		status_32 |= ice_os_get_user_intst(cve_dev->dev_index);
-		isr_status_node->ice_isr_status[index] = status_32;
+
+		/* Coalesce with status which BH has not consumed yet */
+		pending = &idc_dev->ice_pending[index];
+		pending->int_jiffy = int_jiffy;
+		smp_wmb();
+		atomic_or(status_32, &pending->status);
 		cve_os_dev_log(CVE_LOGLEVEL_INFO,
 			index,
 			"Received interrupt from IDC. Status=0x%x\n",
@@ -1609,6 +1623,22 @@ int cve_di_interrupt_handler(struct idc_device *idc_dev)
 		 */
 	}
 
+	if (q_full) {
+		if (isr_status_node->valid) {
+			atomic64_or(isr_status_node->idc_status,
+					&idc_dev->ovf_idc_status);
+			atomic64_or(isr_status_node->ice_status,
+					&idc_dev->ovf_ice_status);
+		}
+		ice_swc_counter_atomic_inc(g_sph_swc_global,
+				ICEDRV_SWC_GLOBAL_COUNTER_ISR_Q_OVERFLOW);
+		/* Make sure BH runs to drain the Q */
+		need_dpc = 1;
+		goto exit;
+	}
+
+	/* Node must be visible to BH before head moves past it */
+	smp_wmb();
 	head = ((head + 1) % IDC_ISR_BH_QUEUE_SZ);
 	atomic_set(&idc_dev->status_q_head, head);
 
@@ -1628,49 +1658,23 @@ static inline void __read_isr_q(struct idc_device *dev,
 	u32 head = atomic_read(&dev->status_q_head);
 	u32 tail = atomic_read(&dev->status_q_tail);
 	struct dev_isr_status *qnode;
+	struct ice_isr_pending *pending;
 	struct cve_device *ice = NULL;
 	u32 status_lo = 0, status_hi = 0, status_hl = 0, index = 0;
+	u32 status_32;
+
+	/* Pairs with smp_wmb() in ISR before head is published */
+	smp_rmb();
 
 	while (tail != head) {
-		index = 0;
 		qnode = &dev->isr_status[tail];
 		if (qnode->valid) {
 			qnode->valid = 0;
 			*idc_status |= qnode->idc_status;
 			*ice_status |= qnode->ice_status;
-			status_lo = (qnode->ice_status & 0xFFFF);
-			status_hi = ((qnode->ice_status >> 32) & 0xFFFF);
-			status_hl = status_hi | status_lo;
 			cve_os_log(CVE_LOGLEVEL_DEBUG,
 					"IsrQNode[%d] idc_status:0x%llx ice_status:0x%llx\n",
 					tail, *idc_status, *ice_status);
-
-			status_hl >>= 4;
-			while (status_hl && index < NUM_ICE_UNIT) {
-				if (status_hl & 0x1) {
-					ice = &dev->cve_dev[index];
-
-					if (qnode->int_jiffy >= ice->db_jiffy) {
-
-						ice->interrupts_status |=
-						qnode->ice_isr_status[index];
-
-						cve_os_log(CVE_LOGLEVEL_DEBUG,
-						"IsrQNode[%d] ice%d status:0x%x\n",
-						tail, index,
-						ice->interrupts_status);
-					} else {
-					 cve_os_log_default(CVE_LOGLEVEL_ERROR,
-						"Discarding outdated interrupt of ICE%d status:0x%x DB_jiffy=%lu Int_jiffy=%lu\n",
-						index,
-						qnode->ice_isr_status[index],
-						ice->db_jiffy,
-						qnode->int_jiffy);
-					}
-				}
-				status_hl = (status_hl >> 1);
-				index++;
-			}
 		} else {
 			cve_os_log_default(CVE_LOGLEVEL_ERROR,
 				"Spurious BH IsrQNode[%d] idc_status:0x%llx ice_status:0x%llx\n",
@@ -1680,6 +1684,40 @@ static inline void __read_isr_q(struct idc_device *dev,
 		tail = (tail + 1) % IDC_ISR_BH_QUEUE_SZ;
 	}
 
+	/* Interrupts which could not be queued */
+	*idc_status |= atomic64_xchg(&dev->ovf_idc_status, 0);
+	*ice_status |= atomic64_xchg(&dev->ovf_ice_status, 0);
+
+	status_lo = (*ice_status & 0xFFFF);
+	status_hi = ((*ice_status >> 32) & 0xFFFF);
+	status_hl = (status_hi | status_lo) >> 4;
+	while (status_hl && index < NUM_ICE_UNIT) {
+		if (status_hl & 0x1) {
+			ice = &dev->cve_dev[index];
+			pending = &dev->ice_pending[index];
+
+			status_32 = atomic_xchg(&pending->status, 0);
+			/* Pairs with smp_wmb() in ISR before status is set */
+			smp_rmb();
+
+			if (pending->int_jiffy >= ice->db_jiffy) {
+				ice->interrupts_status |= status_32;
+
+				cve_os_log(CVE_LOGLEVEL_DEBUG,
+					"ice%d status:0x%x\n",
+					index, ice->interrupts_status);
+			} else {
+				cve_os_log_default(CVE_LOGLEVEL_ERROR,
+					"Discarding outdated interrupt of ICE%d status:0x%x DB_jiffy=%lu Int_jiffy=%lu\n",
+					index, status_32,
+					ice->db_jiffy,
+					pending->int_jiffy);
+			}
+		}
+		status_hl = (status_hl >> 1);
+		index++;
+	}
+
 	*q_tail = tail;
 }
 
@@ -1732,6 +1770,7 @@ void cve_di_interrupt_handler_deferred_proc(struct idc_device *dev)
 				SPH_TRACE_OP_STATE_QUEUED,
 				0, 0, 0,
 				SPH_TRACE_OP_STATUS_LOCATION, __LINE__));
+	ICE_TRACE_RING(ICE_TR_EV_BH, 0, 0, 0);
 
 	cve_os_lock(&g_cve_driver_biglock, CVE_NON_INTERRUPTIBLE);
 
@@ -1747,7 +1786,8 @@ void cve_di_interrupt_handler_deferred_proc(struct idc_device *dev)
 	head = atomic_read(&dev->status_q_head);
 	tail = atomic_read(&dev->status_q_tail);
 
-	if (tail == head) {
+	if (tail == head && !atomic64_read(&dev->ovf_ice_status) &&
+			!atomic64_read(&dev->ovf_idc_status)) {
 		/* Q Empty*/
 		cve_os_log(CVE_LOGLEVEL_INFO,
 			"ISR-BH Q is EMPTY, nothing to do\n");
@@ -1756,6 +1796,8 @@ void cve_di_interrupt_handler_deferred_proc(struct idc_device *dev)
 
 	__read_isr_q(dev, &idc_status, &ice_status, &tail);
 
+	/* Node reads must complete before slots are given back to ISR */
+	smp_mb();
 	atomic_set(&dev->status_q_tail, tail);
 
 	idc_err_status.val = idc_status;
@@ -2104,6 +2146,8 @@ void cve_di_dispatch_job(struct cve_device *cve_dev,
 		job->next_subjob = 0;
 		job->remaining_subjobs_nr = job->subjobs_nr + 1;
 		cve_dev->is_cold_run = 1;
+		ice_swc_counter_inc(cve_dev->hswc,
+				ICEDRV_SWC_DEVICE_COUNTER_COLD_DISPATCH);
 	} else if (e_cbs == NULL && job->cold_run == 1) {
 		/* this is a special case when same warm ICE from a parent
 		 * is used to run a new infer from a new network. In this case
@@ -2115,6 +2159,8 @@ void cve_di_dispatch_job(struct cve_device *cve_dev,
 		job->next_subjob = 0;
 		job->remaining_subjobs_nr = job->subjobs_nr + 1;
 		cve_dev->is_cold_run = 0;
+		ice_swc_counter_inc(cve_dev->hswc,
+				ICEDRV_SWC_DEVICE_COUNTER_WARM_DISPATCH);
 		cve_os_dev_log(CVE_LOGLEVEL_DEBUG,
 				cve_dev->dev_index,
 				"WARM ECB was added to job:0x%p\n", job);
@@ -2128,6 +2174,8 @@ void cve_di_dispatch_job(struct cve_device *cve_dev,
 		/* Can only be executed during Warm run */
 		ASSERT(!job->cold_run);
 		cve_dev->is_cold_run = 0;
+		ice_swc_counter_inc(cve_dev->hswc,
+				ICEDRV_SWC_DEVICE_COUNTER_WARM_DISPATCH);
 
 		if (job->has_scb) {
 			job->next_subjob = 2;
@@ -2183,6 +2231,8 @@ void cve_di_do_job_db(struct cve_device *ice, cve_di_job_handle_t hjob)
 				(void *)job->ds_hjob,
 				SPH_TRACE_OP_STATUS_EXEC_TYPE,
 				ice->is_cold_run));
+	ICE_TRACE_RING(ICE_TR_EV_JOB_DOORBELL, (u16)ice->dev_index,
+		ntw->swc_node.sw_id, ntw->curr_exe->swc_node.sw_id);
 
 }
 
@@ -38,6 +38,7 @@
 #include "device_interface_internal.h"
 #include "ice_debug.h"
 #include "ice_trace.h"
+#include "ice_trace_ring.h"
 #include "icedrv_internal_sw_counter_funcs.h"
 #include "ice_safe_func.h"
 
@@ -158,9 +159,8 @@ static void __assign_fw_ownership(struct cve_device_group *dg,
 	out_fw_sec->md5_str[i*2] = '\0';
 
 	if (out_fw_sec->cached_mem_used) {
-		/* add new loaded dynamic fw to global struct */
-		cve_dle_add_to_list_after(dg->loaded_cust_fw_sections,
-				list, out_fw_sec);
+		/* add new loaded dynamic fw to global cache */
+		ice_dg_add_cached_fw(out_fw_sec);
 		cve_os_log(CVE_LOGLEVEL_DEBUG,
 				"Cached firmware fw_sec_struct:0x%p MD5:%s #FwCaching\n",
 				out_fw_sec, out_fw_sec->md5_str);
@@ -185,13 +185,11 @@ static void __cleanup_fw_loading(struct ice_pnetwork *pnetwork,
 		struct cve_fw_loaded_sections *out_fw_sec,
 		int md5_match)
 {
-	struct cve_device_group *dg = cve_dg_get();
 	struct cve_fw_loaded_sections *fw_sec = out_fw_sec;
 
 	if (out_fw_sec->cached_mem_used) {
-		/* remove fw from global struct */
-		cve_dle_remove_from_list(dg->loaded_cust_fw_sections,
-				list, out_fw_sec);
+		/* remove fw from global cache */
+		ice_dg_del_cached_fw(out_fw_sec);
 		cve_os_log(CVE_LOGLEVEL_DEBUG,
 				"PNTW:0x%llx release cached firmware fw_sec_struct:0x%p MD5:%s #FwCaching\n",
 				pnetwork->pntw_id, out_fw_sec,
@@ -1457,6 +1455,8 @@ int ice_ds_dispatch_jg(struct jobgroup_descriptor *jobgroup)
 		ntw->swc_node.sw_id, ntw->network_id,
 		ntw->curr_exe->swc_node.sw_id,
 		SPH_TRACE_OP_STATUS_ICE, ntw->ntw_icemask));
+	ICE_TRACE_RING(ICE_TR_EV_INFER_QUEUED, 0, ntw->swc_node.sw_id,
+		ntw->curr_exe->swc_node.sw_id);
 
 	ice_swc_counter_inc(ntw->hswc,
 			ICEDRV_SWC_SUB_NETWORK_COUNTER_INF_SCHEDULED);
@@ -1736,6 +1736,8 @@ int ice_ds_raise_event(struct ice_network *ntw,
 				ntw->swc_node.sw_id, ntw->network_id,
 				inf->swc_node.sw_id,
 				trace_status, max_ice_cycle));
+	ICE_TRACE_RING(ICE_TR_EV_INFER_COMPLETE, (u16)status,
+		ntw->swc_node.sw_id, inf->swc_node.sw_id);
 
 
 	/* Can we do this before DB? This will reduce duplicacy.
@@ -1897,6 +1899,8 @@ int ice_ds_raise_event(struct ice_network *ntw,
 					inf->swc_node.sw_id,
 					SPH_TRACE_OP_STATUS_MAX,
 					event.max_ice_cycle));
+		ICE_TRACE_RING(ICE_TR_EV_EVENT_ADD, 0, ntw->swc_node.sw_id,
+			inf->swc_node.sw_id);
 	}
 	return ret;
 }
@@ -4658,7 +4662,8 @@ out:
 }
 
 int cve_ds_open_context(cve_context_process_id_t context_pid,
-		int64_t obj_id, u64 *out_contextid)
+		int64_t obj_id, u32 sch_weight, u32 sch_ice_quota,
+		u32 sch_flags, u32 sch_reserved, u64 *out_contextid)
 {
 	struct cve_context_process *context_process = NULL;
 	struct ds_context *new_context = NULL;
@@ -4666,8 +4671,20 @@ int cve_ds_open_context(cve_context_process_id_t context_pid,
 	struct cve_device_group *dg = NULL;
 	uint16_t i;
 	struct ice_swc_node *swc_node;
+	int retval;
 
-	int retval = cve_os_lock(&g_cve_driver_biglock, CVE_INTERRUPTIBLE);
+	if (!(sch_flags & ICE_SCH_CTX_FLAG_PARAMS_VALID)) {
+		sch_weight = 0;
+		sch_ice_quota = 0;
+		sch_flags = 0;
+	} else if ((sch_flags & ~ICE_SCH_CTX_FLAGS_MASK) || sch_reserved) {
+		cve_os_log(CVE_LOGLEVEL_ERROR,
+				"Invalid sch_flags 0x%x or reserved 0x%x\n",
+				sch_flags, sch_reserved);
+		return -EINVAL;
+	}
+
+	retval = cve_os_lock(&g_cve_driver_biglock, CVE_INTERRUPTIBLE);
 
 	DO_TRACE(trace_icedrvCreateContext(
 		SPH_TRACE_OP_STATE_START, obj_id, 0,
@@ -4724,6 +4741,12 @@ int cve_ds_open_context(cve_context_process_id_t context_pid,
 
 	new_context->process = context_process;
 
+	new_context->sch_weight = sch_weight ?
+		sch_weight : ICE_SCH_WEIGHT_DEFAULT;
+	new_context->sch_ice_quota = sch_ice_quota;
+	new_context->sch_latency_slo =
+		!!(sch_flags & ICE_SCH_CTX_FLAG_LATENCY_SLO);
+
 	cve_create_workqueue(new_context, dg, &new_workqueue);
 
 	cve_os_log(CVE_LOGLEVEL_DEBUG,
@@ -6110,6 +6133,9 @@ enum resource_status ice_ds_ntw_borrow_resource(struct ice_pnetwork *pntw)
 
 	pntw->has_resource = 1;
 
+	/* Feed borrow inter-arrival to the warm pool policy */
+	ice_dg_warm_pool_record_borrow(pntw->num_ice);
+
 	cve_os_log(CVE_LOGLEVEL_INFO,
 		"Resources borrowed. PNtwID=0x%lx\n",
 		(uintptr_t)pntw);
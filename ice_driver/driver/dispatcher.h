@@ -38,6 +38,10 @@ struct resource_info {
  * inputs :
  *	context_pid - the given process id
  *	cve_dg - device group id
+ *	sch_weight - share of ICE time, 0 for default
+ *	sch_ice_quota - max ICEs used concurrently, 0 for no limit
+ *	sch_flags - ICE_SCH_CTX_FLAG_*
+ *	sch_reserved - must be 0 when ICE_SCH_CTX_FLAG_PARAMS_VALID is set
  * outputs:
  *  out_context_id - the newely created dispatcher context id
  * returns: 0 on success, a negative error code on failure
@@ -45,6 +49,10 @@ struct resource_info {
 int cve_ds_open_context(
 		cve_context_process_id_t context_pid,
 		int64_t obj_id,
+		u32 sch_weight,
+		u32 sch_ice_quota,
+		u32 sch_flags,
+		u32 sch_reserved,
 		u64 *out_context_id);
 
 int config_ds_trace_node_sysfs(struct cve_device *dev, struct ice_network *ntw,
@@ -54,6 +54,24 @@ static const struct sph_sw_counter_info g_swc_global_info[] = {
 	/* ICEDRV_SWC_GLOBAL_COUNTER_FW_DYNAMIC_ALLOC */
 	{ICEDRV_SWC_GLOBAL_GROUP_GEN, "fwDynamicAllocCount",
 	 "Total number of FW loaded using dynamic allocation"},
+	/* ICEDRV_SWC_GLOBAL_COUNTER_WARM_POOL_TARGET */
+	{ICEDRV_SWC_GLOBAL_GROUP_GEN, "warmPoolTarget",
+	 "Number of idle ICEs currently kept powered on by warm pool"},
+	/* ICEDRV_SWC_GLOBAL_COUNTER_ICE_AFFINITY_HIT */
+	{ICEDRV_SWC_GLOBAL_GROUP_GEN, "iceAffinityHit",
+	 "Total number of ICEs borrowed by the pnetwork that last ran on them"},
+	/* ICEDRV_SWC_GLOBAL_COUNTER_ICE_AFFINITY_MISS */
+	{ICEDRV_SWC_GLOBAL_GROUP_GEN, "iceAffinityMiss",
+	 "Total number of ICEs borrowed from a different pnetwork"},
+	/* ICEDRV_SWC_GLOBAL_COUNTER_FW_CACHE_HIT */
+	{ICEDRV_SWC_GLOBAL_GROUP_GEN, "fwCacheHitCount",
+	 "Total number of fw found in cache"},
+	/* ICEDRV_SWC_GLOBAL_COUNTER_FW_CACHE_EVICT */
+	{ICEDRV_SWC_GLOBAL_GROUP_GEN, "fwCacheEvictCount",
+	 "Total number of cached fw evicted to free memory"},
+	/* ICEDRV_SWC_GLOBAL_COUNTER_ISR_Q_OVERFLOW */
+	{ICEDRV_SWC_GLOBAL_GROUP_GEN, "isrQueueOverflowCount",
+	 "Total number of interrupts which found ISR-BH queue full"},
 };
 
 static const struct sph_sw_counters_set g_swc_global_set = {
@@ -229,6 +247,12 @@ static const struct sph_sw_counter_info g_swc_device_info[] = {
 	/* ICEDRV_SWC_DEVICE_COUNTER_ECC_DERRCOUNT */
 	{ICEDRV_SWC_DEVICE_GROUP_GEN, "eccDerrCount",
 	 "Total count of Deep SRAM ECC double errors"},
+	/* ICEDRV_SWC_DEVICE_COUNTER_COLD_DISPATCH */
+	{ICEDRV_SWC_DEVICE_GROUP_GEN, "coldDispatchCount",
+	 "Total number of jobs dispatched with embedded CB (cold run)"},
+	/* ICEDRV_SWC_DEVICE_COUNTER_WARM_DISPATCH */
+	{ICEDRV_SWC_DEVICE_GROUP_GEN, "warmDispatchCount",
+	 "Total number of jobs dispatched on a warm ICE"},
 };
 
 static const struct sph_sw_counters_set g_swc_device_set = {
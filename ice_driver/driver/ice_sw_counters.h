@@ -52,7 +52,13 @@ enum ICEDRV_SWC_GLOBAL_COUNTER {
 	ICEDRV_SWC_GLOBAL_ACTIVE_ICE_COUNT,
 	ICEDRV_SWC_GLOBAL_COUNTER_PNTW_TOT,
 	ICEDRV_SWC_GLOBAL_COUNTER_FW_MD5_MISMATCH,
-	ICEDRV_SWC_GLOBAL_COUNTER_FW_DYNAMIC_ALLOC
+	ICEDRV_SWC_GLOBAL_COUNTER_FW_DYNAMIC_ALLOC,
+	ICEDRV_SWC_GLOBAL_COUNTER_WARM_POOL_TARGET,
+	ICEDRV_SWC_GLOBAL_COUNTER_ICE_AFFINITY_HIT,
+	ICEDRV_SWC_GLOBAL_COUNTER_ICE_AFFINITY_MISS,
+	ICEDRV_SWC_GLOBAL_COUNTER_FW_CACHE_HIT,
+	ICEDRV_SWC_GLOBAL_COUNTER_FW_CACHE_EVICT,
+	ICEDRV_SWC_GLOBAL_COUNTER_ISR_Q_OVERFLOW
 };
 
 /* Groups in ICEDRV_SWC_CLASS_CONTEXT */
@@ -137,6 +143,8 @@ enum ICEDRV_SWC_DEVICE_COUNTER {
 	ICEDRV_SWC_DEVICE_COUNTER_ECC_SERRCOUNT,
 	ICEDRV_SWC_DEVICE_COUNTER_ECC_DERRCOUNT_WRAP,
 	ICEDRV_SWC_DEVICE_COUNTER_ECC_DERRCOUNT,
+	ICEDRV_SWC_DEVICE_COUNTER_COLD_DISPATCH,
+	ICEDRV_SWC_DEVICE_COUNTER_WARM_DISPATCH,
 };
 
 /* Groups in ICEDRV_SWC_CLASS_INFER_DEVICE */
@@ -0,0 +1,307 @@
+/********************************************
+ * Copyright (C) 2019-2021 Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ ********************************************/
+
+
+
+#ifndef RING3_VALIDATION
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/debugfs.h>
+#include <linux/irqflags.h>
+#include <linux/smp.h>
+#include <linux/log2.h>
+#include <linux/trace_clock.h>
+#include <linux/rcupdate.h>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "linux_kernel_mock.h"
+#endif
+
+#include "os_interface.h"
+#include "ice_trace_ring.h"
+
+#define ICE_TRACE_RING_DEFAULT_KB 256
+
+struct ice_trace_ring {
+	struct ice_trace_ring_hdr hdr;
+	struct ice_trace_ring_rec recs[];
+};
+
+static void *s_ring_buf;
+static size_t s_ring_size;	/* bytes per ring, page aligned */
+static u32 s_ring_count;
+static u32 s_nr_recs;
+
+static inline struct ice_trace_ring *ring_of(u32 idx)
+{
+	return (struct ice_trace_ring *)((char *)s_ring_buf +
+					 (size_t)idx * s_ring_size);
+}
+
+static inline void emit_rec(struct ice_trace_ring *ring, u64 ts,
+			    u16 event, u16 arg, u64 a0, u64 a1)
+{
+	struct ice_trace_ring_rec *rec;
+	u64 pos;
+
+	pos = ring->hdr.head;
+	rec = &ring->recs[pos & (s_nr_recs - 1)];
+
+	/* a reader which sees the old seq knows the record is torn */
+	rec->seq = 0;
+	smp_wmb();
+	rec->ts = ts;
+	rec->event = event;
+	rec->arg = arg;
+	rec->a0 = a0;
+	rec->a1 = a1;
+	smp_wmb();
+	rec->seq = (u32)pos + 1;
+	ring->hdr.head = pos + 1;
+}
+
+static void init_rings(void)
+{
+	struct ice_trace_ring *ring;
+	u32 i;
+
+	for (i = 0; i < s_ring_count; i++) {
+		ring = ring_of(i);
+		ring->hdr.magic = ICE_TRACE_RING_MAGIC;
+		ring->hdr.version = ICE_TRACE_RING_VERSION;
+		ring->hdr.rec_size = sizeof(struct ice_trace_ring_rec);
+		ring->hdr.nr_recs = s_nr_recs;
+		ring->hdr.cpu = i;
+		ring->hdr.head = 0;
+		ring->hdr.ring_size = s_ring_size;
+	}
+}
+
+#ifndef RING3_VALIDATION
+
+DEFINE_STATIC_KEY_FALSE(ice_trace_ring_key);
+
+/* ring size per CPU, 0 disables the ring */
+static u32 trace_ring_kb = ICE_TRACE_RING_DEFAULT_KB;
+module_param(trace_ring_kb, uint, 0);
+MODULE_PARM_DESC(trace_ring_kb, "Per CPU binary trace ring size in KB (0 disables the ring)");
+
+/* trace_ring_enable given at load time, applied once the ring exists */
+static bool s_ring_enable_req;
+static bool s_ring_init_done;
+
+static int trace_ring_enable_set(const char *val,
+				 const struct kernel_param *kp)
+{
+	bool enable;
+	int ret;
+
+	ret = kstrtobool(val, &enable);
+	if (ret)
+		return ret;
+
+	if (!s_ring_buf) {
+		if (s_ring_init_done)
+			return -ENODEV;
+
+		s_ring_enable_req = enable;
+		return 0;
+	}
+
+	if (enable && !static_key_enabled(&ice_trace_ring_key))
+		static_branch_enable(&ice_trace_ring_key);
+	else if (!enable && static_key_enabled(&ice_trace_ring_key))
+		static_branch_disable(&ice_trace_ring_key);
+
+	return 0;
+}
+
+static int trace_ring_enable_get(char *buffer,
+				 const struct kernel_param *kp)
+{
+	return sprintf(buffer, "%d\n",
+		       static_key_enabled(&ice_trace_ring_key) ? 1 : 0);
+}
+
+static const struct kernel_param_ops trace_ring_enable_ops = {
+	.set = trace_ring_enable_set,
+	.get = trace_ring_enable_get,
+};
+module_param_cb(trace_ring_enable, &trace_ring_enable_ops, NULL, 0644);
+MODULE_PARM_DESC(trace_ring_enable, "Record ICE driver events into the binary trace ring");
+
+void __ice_trace_ring_emit(u16 event, u16 arg, u64 a0, u64 a1)
+{
+	unsigned long flags;
+
+	/*
+	 * irqs off so the ISR can not interleave with a task on this CPU.
+	 * Global clock so the decoder can merge the per CPU rings.
+	 */
+	local_irq_save(flags);
+	/* the ring may be going away, see ice_trace_ring_cleanup() */
+	if (likely(static_key_enabled(&ice_trace_ring_key)))
+		emit_rec(ring_of(smp_processor_id()), trace_clock_global(),
+			 event, arg, a0, a1);
+	local_irq_restore(flags);
+}
+
+int ice_trace_ring_init(void)
+{
+	size_t nr_recs;
+
+	s_ring_init_done = true;
+
+	if (!trace_ring_kb)
+		return 0;
+
+	nr_recs = ((size_t)trace_ring_kb * 1024 -
+		   sizeof(struct ice_trace_ring_hdr)) /
+		  sizeof(struct ice_trace_ring_rec);
+	if (!nr_recs)
+		return 0;
+
+	s_nr_recs = rounddown_pow_of_two(nr_recs);
+	s_ring_size = PAGE_ALIGN(sizeof(struct ice_trace_ring_hdr) +
+			s_nr_recs * sizeof(struct ice_trace_ring_rec));
+	s_ring_count = nr_cpu_ids;
+
+	s_ring_buf = vmalloc_user(s_ring_size * s_ring_count);
+	if (!s_ring_buf) {
+		cve_os_log(CVE_LOGLEVEL_ERROR,
+			"failed to allocate trace ring %zu bytes\n",
+			s_ring_size * s_ring_count);
+		return -ENOMEM;
+	}
+
+	init_rings();
+
+	if (s_ring_enable_req)
+		static_branch_enable(&ice_trace_ring_key);
+
+	return 0;
+}
+
+void ice_trace_ring_cleanup(void)
+{
+	if (static_key_enabled(&ice_trace_ring_key))
+		static_branch_disable(&ice_trace_ring_key);
+
+	/*
+	 * Emitters record with irqs off and re-check the key there, so
+	 * once every irqs off section which may have seen the key enabled
+	 * is done, nobody writes into the ring.
+	 */
+	synchronize_rcu();
+
+	vfree(s_ring_buf);
+	s_ring_buf = NULL;
+}
+
+static ssize_t trace_ring_read(struct file *filp, char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	return simple_read_from_buffer(buf, count, ppos, s_ring_buf,
+				       s_ring_size * s_ring_count);
+}
+
+static int trace_ring_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	return remap_vmalloc_range(vma, s_ring_buf, vma->vm_pgoff);
+}
+
+static const struct file_operations trace_ring_fops = {
+	.owner	= THIS_MODULE,
+	.open	= simple_open,
+	.read	= trace_ring_read,
+	.mmap	= trace_ring_mmap,
+	.llseek	= default_llseek,
+};
+
+void ice_trace_ring_debugfs_init(struct dentry *dir)
+{
+	if (!s_ring_buf)
+		return;
+
+	debugfs_create_file_size("trace_ring",
+				 0400,
+				 dir,
+				 NULL,
+				 &trace_ring_fops,
+				 s_ring_size * s_ring_count);
+}
+
+#else /* RING3_VALIDATION */
+
+#define ICE_TRACE_RING_FILE_ENV "ICEDRV_TRACE_RING_FILE"
+
+bool ice_trace_ring_on;
+
+void __ice_trace_ring_emit(u16 event, u16 arg, u64 a0, u64 a1)
+{
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+	pthread_mutex_lock(&lock);
+	emit_rec(ring_of(0), trace_clock_global(), event, arg, a0, a1);
+	pthread_mutex_unlock(&lock);
+}
+
+int ice_trace_ring_init(void)
+{
+	if (!getenv(ICE_TRACE_RING_FILE_ENV))
+		return 0;
+
+	s_nr_recs = (ICE_TRACE_RING_DEFAULT_KB * 1024 -
+		     sizeof(struct ice_trace_ring_hdr)) /
+		    sizeof(struct ice_trace_ring_rec);
+	/* round down to a power of 2 */
+	while (s_nr_recs & (s_nr_recs - 1))
+		s_nr_recs &= s_nr_recs - 1;
+	s_ring_size = sizeof(struct ice_trace_ring_hdr) +
+		      s_nr_recs * sizeof(struct ice_trace_ring_rec);
+	s_ring_count = 1;
+
+	s_ring_buf = calloc(1, s_ring_size);
+	if (!s_ring_buf)
+		return -ENOMEM;
+
+	init_rings();
+	ice_trace_ring_on = true;
+
+	return 0;
+}
+
+void ice_trace_ring_cleanup(void)
+{
+	const char *path = getenv(ICE_TRACE_RING_FILE_ENV);
+	FILE *f;
+
+	if (!s_ring_buf)
+		return;
+
+	ice_trace_ring_on = false;
+
+	f = path ? fopen(path, "wb") : NULL;
+	if (f) {
+		if (fwrite(s_ring_buf, s_ring_size, 1, f) != 1)
+			cve_os_log(CVE_LOGLEVEL_ERROR,
+				"failed to write trace ring to %s\n", path);
+		fclose(f);
+	}
+
+	free(s_ring_buf);
+	s_ring_buf = NULL;
+}
+
+#endif /* RING3_VALIDATION */
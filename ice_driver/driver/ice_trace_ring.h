@@ -0,0 +1,95 @@
+/********************************************
+ * Copyright (C) 2019-2021 Intel Corporation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ ********************************************/
+
+
+
+#ifndef _ICE_TRACE_RING_H_
+#define _ICE_TRACE_RING_H_
+
+#ifndef RING3_VALIDATION
+#include <linux/types.h>
+#include <linux/jump_label.h>
+#else
+#include "os_interface_stub.h"
+#endif
+
+/*
+ * Binary event ring.
+ *
+ * Each CPU owns a ring of fixed size records which is overwritten
+ * when full. The rings are laid out back to back, each one starting
+ * with a struct ice_trace_ring_hdr, and are exported as a single
+ * buffer through the debugfs file cve/trace_ring (read or mmap).
+ * In the ring3 build there is a single ring which is written to the
+ * file named by ICEDRV_TRACE_RING_FILE on driver cleanup.
+ *
+ * Record layout and event ids are ABI for the offline decoder
+ * (tools/ice_trace_ring_decode.py), only append new ids.
+ */
+
+#define ICE_TRACE_RING_MAGIC	0x52544349	/* value of 'ICTR' */
+#define ICE_TRACE_RING_VERSION	1
+
+enum ice_trace_ring_event {
+	ICE_TR_EV_NONE = 0,
+	ICE_TR_EV_INFER_QUEUED,	  /* a0=ntw sw_id a1=infer sw_id */
+	ICE_TR_EV_INFER_START,	  /* a0=ntw sw_id a1=infer sw_id arg=icemask */
+	ICE_TR_EV_JOB_DOORBELL,	  /* a0=ntw sw_id a1=infer sw_id arg=ice */
+	ICE_TR_EV_ISR,		  /* a0=status q head a1=status q tail */
+	ICE_TR_EV_BH,
+	ICE_TR_EV_INFER_COMPLETE, /* a0=ntw sw_id a1=infer sw_id arg=jg status */
+	ICE_TR_EV_EVENT_ADD,	  /* a0=ntw sw_id a1=infer sw_id */
+	ICE_TR_EV_MMU_MAP,	  /* a0=iova a1=pages arg=partition */
+	ICE_TR_EV_NUM
+};
+
+#pragma pack(push, 1)
+
+struct ice_trace_ring_rec {
+	u64 ts;		/* trace_clock_global ns, comparable across CPUs */
+	u32 seq;	/* low 32 bits of ring position + 1, written last */
+	u16 event;	/* enum ice_trace_ring_event */
+	u16 arg;
+	u64 a0;
+	u64 a1;
+};
+
+struct ice_trace_ring_hdr {
+	u32 magic;
+	u16 version;
+	u16 rec_size;
+	u32 nr_recs;	/* power of 2 */
+	u32 cpu;
+	u64 head;	/* number of records ever written */
+	u64 ring_size;	/* bytes from this header to the next one */
+	u8  reserved[32];
+};
+
+#pragma pack(pop)
+
+int ice_trace_ring_init(void);
+void ice_trace_ring_cleanup(void);
+void __ice_trace_ring_emit(u16 event, u16 arg, u64 a0, u64 a1);
+
+#ifndef RING3_VALIDATION
+struct dentry;
+
+void ice_trace_ring_debugfs_init(struct dentry *dir);
+
+DECLARE_STATIC_KEY_FALSE(ice_trace_ring_key);
+#define ice_trace_ring_enabled() static_branch_unlikely(&ice_trace_ring_key)
+#else
+extern bool ice_trace_ring_on;
+#define ice_trace_ring_enabled() (ice_trace_ring_on)
+#endif
+
+/* hot path entry, a single patched out branch when the ring is off */
+#define ICE_TRACE_RING(event, arg, a0, a1) do { \
+		if (ice_trace_ring_enabled()) \
+			__ice_trace_ring_emit((event), (arg), (a0), (a1)); \
+	} while (0)
+
+#endif /* _ICE_TRACE_RING_H_ */
@@ -25,8 +25,12 @@
 struct dev_isr_status {
 	uint64_t ice_status;
 	uint64_t idc_status;
-	uint32_t ice_isr_status[NUM_ICE_UNIT];
 	int8_t valid;
+};
+
+/* Per ICE interrupt status, coalesced by ISR until BH consumes it */
+struct ice_isr_pending {
+	atomic_t status;
 	/* To discard outdated interrupts */
 	unsigned long int_jiffy;
 };
@@ -41,9 +45,14 @@ struct idc_device {
 	dma_addr_t bar1_base_address;
 #endif
 
+	/* SPSC ring. ISR produces at head, BH consumes at tail */
 	struct dev_isr_status isr_status[IDC_ISR_BH_QUEUE_SZ];
 	atomic_t status_q_head;
 	atomic_t status_q_tail;
+	/* Status of interrupts which found the ring full */
+	atomic64_t ovf_idc_status;
+	atomic64_t ovf_ice_status;
+	struct ice_isr_pending ice_pending[NUM_ICE_UNIT];
 };
 
 #define ice_to_idc(ice_dev)\
@@ -22,6 +22,8 @@
 #include "device_interface.h"
 #include "device_interface_internal.h"
 #include "ice_debug.h"
+#include "ice_trace_ring.h"
+#include "scheduler.h"
 
 /* GLOBAL VARIABLES */
 static struct dentry *dirret;
@@ -139,6 +141,9 @@ void cve_debug_init(void)
 			    dirret,
 			    NULL,
 			    &ice_firmware_info_fops);
+
+	ice_trace_ring_debugfs_init(dirret);
+	ice_sch_debugfs_init(dirret);
 out:
 	return;
 }
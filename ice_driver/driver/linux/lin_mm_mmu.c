@@ -21,6 +21,7 @@
 #include "cve_linux_internal.h"
 #include "project_device_interface.h"
 #include "device_interface.h"
+#include "ice_trace_ring.h"
 
 /* CONSTANTS */
 
@@ -598,6 +599,8 @@ int lin_mm_map(struct cve_lin_mm_domain *adom,
 		da += mmu_config->page_sz;
 		mapped_pages++;
 	}
+	ICE_TRACE_RING(ICE_TR_EV_MMU_MAP, buf_meta_data->partition_id,
+		va_start, cve_pages_nr);
 	retval = 0;
 out:
 	FUNC_LEAVE();
@@ -24,6 +24,7 @@
 #include <asm/processor.h>
 #include <linux/vmalloc.h>
 #include <linux/slab.h>
+#include <linux/capability.h>
 #include <linux/miscdevice.h>
 #include <linux/debugfs.h>
 #include <asm/processor.h>
@@ -136,6 +137,7 @@ static u32 iccp_throttling = 1;
 static u32 initial_iccp_config[3] = {INITIAL_CDYN_VAL, RESET_CDYN_VAL,
 							BLOCKED_CDYN_VAL};
 static int ice_power_off_delay_ms;
+static u32 ice_warm_pool_max = MAX_CVE_DEVICES_NR;
 #ifdef ENABLE_MEM_DETECT
 static int enable_ice_drv_memleak;
 #endif
@@ -146,6 +148,9 @@ MODULE_PARM_DESC(icemask_user, "User provided ICE Mask");
 module_param(sph_soc, int, 0);
 MODULE_PARM_DESC(sph_soc, "if set, means that driver is running on real SOC and not simulator");
 
+module_param(ice_warm_pool_max, int, 0);
+MODULE_PARM_DESC(ice_warm_pool_max, "Max number of idle ICEs kept powered on under bursty load (0 disables warm pool)");
+
 #ifdef _DEBUG
 
 module_param(ice_fw_select, int, 0);
@@ -2036,7 +2041,15 @@ static long cve_ioctl_misc(
 
 			cve_os_log(CVE_LOGLEVEL_DEBUG,
 					"CVE_IOCTL_CREATE_CONTEXT n/a\n");
+			if ((p->sch_flags & ICE_SCH_CTX_FLAG_PARAMS_VALID) &&
+				(p->sch_flags & ICE_SCH_CTX_FLAG_LATENCY_SLO) &&
+				!capable(CAP_SYS_NICE)) {
+				retval = -EPERM;
+				break;
+			}
 			retval = cve_ds_open_context(context_pid, p->obj_id,
+					p->sch_weight, p->sch_ice_quota,
+					p->sch_flags, p->reserved,
 					&p->out_contextid);
 		}
 		break;
@@ -2284,6 +2297,7 @@ static int __init cve_init(void)
 	param.sph_soc = sph_soc;
 	param.enable_llc_config_via_axi_reg = enable_llc_config_via_axi_reg;
 	param.ice_power_off_delay_ms = ice_power_off_delay_ms;
+	param.ice_warm_pool_max = ice_warm_pool_max;
 	param.ice_sch_preemption = ice_sch_preemption;
 	param.initial_iccp_config[0] = initial_iccp_config[0];
 	param.initial_iccp_config[1] = initial_iccp_config[1];
@@ -17,9 +17,13 @@
 #include "coral.h"
 #include <icedrv_sw_trace_stub.h>
 #else
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "icedrv_sw_trace.h"
 #endif
 
+#include "ice_trace_ring.h"
+
 enum sch_status {
 	/* Ok */
 	SCH_STATUS_DONE,
@@ -33,10 +37,33 @@ enum sch_status {
 	SCH_STATUS_MAX
 };
 
+/* Queueing delay is accounted per scheduling class */
+enum sch_class {
+	SCH_CLASS_LATENCY_SLO,
+	SCH_CLASS_P0,
+	SCH_CLASS_P1,
+	SCH_CLASS_MAX
+};
+
+/* log2 buckets of queueing delay in usec, the last one is open ended */
+#define SCH_DELAY_BUCKETS 20
+
+struct sch_delay_stats {
+	u64 hist[SCH_DELAY_BUCKETS];
+	u64 count;
+	u64 sum_us;
+	u64 max_us;
+};
+
 /* Each scheduler queue is associated with Priority */
 static struct execution_node *sch_queue[EXE_INF_PRIORITY_MAX];
 /* Network to be deleted during next Scheduler cycle */
 static struct ice_pnetwork *sch_del_pntw;
+/* Virtual time of the last context served */
+static u64 sch_vclock;
+/* Inferences of latency SLO contexts waiting in scheduler queues */
+static u32 sch_slo_queued;
+static struct sch_delay_stats sch_delay[SCH_CLASS_MAX];
 
 int ice_sch_init(void)
 {
@@ -45,93 +72,207 @@ int ice_sch_init(void)
 	return ret;
 }
 
-static struct execution_node *__get_next_exe_node(struct ice_pnetwork *pntw)
+static inline struct ds_context *__node_ctx(struct execution_node *node)
 {
-	struct execution_node *p0_head = NULL, *p1_head = NULL;
-	struct execution_node *p0_node = NULL, *p1_node = NULL;
-	struct execution_node *node = NULL;
-	bool p0_node_rdy = false, p1_node_rdy = false;
+	return node->pntw->wq->context;
+}
 
-	/* Finding next P0 node */
-	if (pntw) {
+/* A context is always allowed one running network */
+static inline bool __sch_within_quota(struct execution_node *node)
+{
+	struct ds_context *ctx = __node_ctx(node);
 
-		p0_head = pntw->sch_queue[EXE_INF_PRIORITY_0];
-		if (p0_head) {
-			ASSERT(pntw->res_resource);
-			p0_node = p0_head;
-			p0_node_rdy = true;
-		}
+	return !ctx->sch_ice_quota || !ctx->sch_ices_running ||
+		(ctx->sch_ices_running + node->ntw->num_ice <=
+			ctx->sch_ice_quota);
+}
 
-	} else {
+/* Should node a be served before node b */
+static inline bool __sch_before(struct execution_node *a,
+		struct execution_node *b)
+{
+	struct ds_context *ctx_a = __node_ctx(a);
+	struct ds_context *ctx_b = __node_ctx(b);
 
-		p0_head = sch_queue[EXE_INF_PRIORITY_0];
-		if (p0_head) {
+	if (ctx_a != ctx_b)
+		return ctx_a->sch_vtime < ctx_b->sch_vtime;
 
-			p0_node = p0_head;
-			do {
-				if ((p0_node->ntype == NODE_TYPE_INFERENCE) &&
-					(!p0_node->pntw->pntw_running)) {
+	return a->pntw->sch_vtime < b->pntw->sch_vtime;
+}
 
-					p0_node_rdy = true;
-					break;
-				} else if (p0_node->ntype !=
-						NODE_TYPE_INFERENCE) {
+/*
+ * Pick an Inference node from Sch's queue of given priority.
+ * Only nodes ahead of the first RES/REL node are candidates. Among the
+ * candidates whose parent network is idle and whose context is within
+ * its ICE quota, the context with least weighted ICE time wins, then
+ * the parent network with least ICE time within it. Ties are served in
+ * queue order.
+ */
+static struct execution_node *__pick_inf_node(
+		enum ice_execute_infer_priority pr, bool slo_only)
+{
+	struct execution_node *head = sch_queue[pr];
+	struct execution_node *node, *best = NULL;
 
-					/* If not Inf Node ==> Break now*/
-					break;
-				}
+	if (!head)
+		return NULL;
 
-				p0_node = cve_dle_next(p0_node,
-						sch_list[EXE_INF_PRIORITY_0]);
-			} while (p0_node != p0_head);
-		}
-	}
+	node = head;
+	do {
+		/* If not Inf Node ==> Break now*/
+		if (node->ntype != NODE_TYPE_INFERENCE)
+			break;
 
-	if (p0_node_rdy && (p0_node->ntype == NODE_TYPE_INFERENCE)) {
+		if (!node->pntw->pntw_running &&
+			(!slo_only || __node_ctx(node)->sch_latency_slo) &&
+			__sch_within_quota(node) &&
+			(!best || __sch_before(node, best)))
+			best = node;
 
-		/* P0 Inference nodes, if any, will be served here */
-		node = p0_node;
-		goto out;
-	}
+		node = cve_dle_next(node, sch_list[pr]);
+	} while (node != head);
+
+	return best;
+}
+
+/* Account a newly queued inference */
+static void __sch_activate(struct ice_infer *inf)
+{
+	struct ice_pnetwork *pntw = inf->ntw->pntw;
+	struct ds_context *ctx = pntw->wq->context;
+
+	/* Idle time does not earn credit */
+	if (ctx->sch_queued++ == 0 && ctx->sch_vtime < sch_vclock)
+		ctx->sch_vtime = sch_vclock;
+	if (pntw->sch_queued++ == 0 &&
+		pntw->sch_vtime < ctx->sch_pntw_vclock)
+		pntw->sch_vtime = ctx->sch_pntw_vclock;
+
+	if (ctx->sch_latency_slo)
+		sch_slo_queued++;
+
+	inf->sch_enqueue_time = trace_clock_global();
+}
+
+static void __sch_deactivate(struct ice_infer *inf)
+{
+	struct ice_pnetwork *pntw = inf->ntw->pntw;
+	struct ds_context *ctx = pntw->wq->context;
+
+	ASSERT(ctx->sch_queued && pntw->sch_queued);
+	ctx->sch_queued--;
+	pntw->sch_queued--;
+
+	if (ctx->sch_latency_slo)
+		sch_slo_queued--;
+}
+
+/* Inference of ntw was selected for execution */
+static void __sch_start(struct ice_network *ntw)
+{
+	struct ice_pnetwork *pntw = ntw->pntw;
+	struct ds_context *ctx = pntw->wq->context;
+
+	ctx->sch_ices_running += ntw->num_ice;
+
+	if (ctx->sch_vtime > sch_vclock)
+		sch_vclock = ctx->sch_vtime;
+	if (pntw->sch_vtime > ctx->sch_pntw_vclock)
+		ctx->sch_pntw_vclock = pntw->sch_vtime;
+}
+
+/* Charge the ICE time of the completed inference of ntw */
+static void __sch_charge(struct ice_network *ntw)
+{
+	struct ice_pnetwork *pntw = ntw->pntw;
+	struct ds_context *ctx = pntw->wq->context;
+	u64 cost;
+
+	cost = (trace_clock_global() - ntw->curr_exe->busy_start_time) *
+		ntw->num_ice;
+
+	ctx->sch_vtime += cost * ICE_SCH_WEIGHT_DEFAULT / ctx->sch_weight;
+	pntw->sch_vtime += cost;
+
+	ASSERT(ctx->sch_ices_running >= ntw->num_ice);
+	ctx->sch_ices_running -= ntw->num_ice;
+}
+
+static void __sch_account_delay(struct ice_infer *inf)
+{
+	struct sch_delay_stats *stats;
+	u64 delay_us;
+	u32 bucket = 0;
+
+	if (inf->ntw->pntw->wq->context->sch_latency_slo)
+		stats = &sch_delay[SCH_CLASS_LATENCY_SLO];
+	else if (inf->inf_pr == EXE_INF_PRIORITY_0)
+		stats = &sch_delay[SCH_CLASS_P0];
+	else
+		stats = &sch_delay[SCH_CLASS_P1];
+
+	delay_us = nsec_to_usec(inf->busy_start_time - inf->sch_enqueue_time);
+	while ((delay_us >> bucket) && (bucket < SCH_DELAY_BUCKETS - 1))
+		bucket++;
+
+	stats->hist[bucket]++;
+	stats->count++;
+	stats->sum_us += delay_us;
+	if (delay_us > stats->max_us)
+		stats->max_us = delay_us;
+}
+
+static struct execution_node *__get_next_exe_node(struct ice_pnetwork *pntw)
+{
+	struct execution_node *p0_head = NULL, *p1_head = NULL;
+	struct execution_node *node = NULL;
 
-	/* Finding next P1 node */
 	if (pntw) {
 
+		/* Ntw's queue is served in order, P0 first */
+		p0_head = pntw->sch_queue[EXE_INF_PRIORITY_0];
 		p1_head = pntw->sch_queue[EXE_INF_PRIORITY_1];
-		if (p1_head) {
+		if (p0_head || p1_head)
 			ASSERT(pntw->res_resource);
-			p1_node = p1_head;
-			p1_node_rdy = true;
-		}
 
-	} else {
-		p1_head = sch_queue[EXE_INF_PRIORITY_1];
-		if (p1_head) {
-
-			p1_node = p1_head;
-			do {
-				if ((p1_node->ntype == NODE_TYPE_INFERENCE) &&
-					(!p1_node->pntw->pntw_running)) {
-
-					p1_node_rdy = true;
-					break;
-				} else if (p1_node->ntype !=
-						NODE_TYPE_INFERENCE) {
-
-					/* If not Inf Node ==> Break now*/
-					break;
-				}
-
-				p1_node = cve_dle_next(p1_node,
-						sch_list[EXE_INF_PRIORITY_1]);
-			} while (p1_node != p1_head);
+		if (p0_head && (p0_head->ntype == NODE_TYPE_INFERENCE)) {
+			/* P0 Inference nodes, if any, will be served here */
+			node = p0_head;
+			goto out;
 		}
+
+		if (p1_head && (p1_head->ntype == NODE_TYPE_INFERENCE))
+			node = p1_head;
+		else if ((p0_head != NULL) && (p0_head == p1_head))
+			/* Node must be related to Reserve/Release */
+			node = p0_head;
+
+		goto out;
+	}
+
+	/* Latency SLO Inference nodes are served first, at the next
+	 * Job Group boundary
+	 */
+	if (sch_slo_queued) {
+		node = __pick_inf_node(EXE_INF_PRIORITY_0, true);
+		if (!node)
+			node = __pick_inf_node(EXE_INF_PRIORITY_1, true);
+		if (node)
+			goto out;
 	}
 
-	if (p1_node_rdy && (p1_node->ntype == NODE_TYPE_INFERENCE)) {
-		/* P1 Inference nodes, if any, will be served here */
-		node = p1_node;
-	} else if ((p0_head != NULL) && (p0_head == p1_head)) {
+	/* P0 Inference nodes, if any, will be served here */
+	node = __pick_inf_node(EXE_INF_PRIORITY_0, false);
+	if (node)
+		goto out;
+
+	node = __pick_inf_node(EXE_INF_PRIORITY_1, false);
+	if (node)
+		goto out;
+
+	p0_head = sch_queue[EXE_INF_PRIORITY_0];
+	p1_head = sch_queue[EXE_INF_PRIORITY_1];
+	if ((p0_head != NULL) && (p0_head == p1_head)) {
 		/* Node must be related to Reserve/Release */
 		node = p0_head;
 	}
@@ -332,6 +473,7 @@ static enum sch_status __l_process_next_exe_node(struct ice_pnetwork *pntw,
 
 	if (is_ntw_over) {
 		ASSERT(ntw);
+		__sch_charge(ntw);
 		ntw->ntw_running = false;
 		pntw->pntw_running = false;
 		ntw->curr_exe->inf_running = false;
@@ -396,6 +538,7 @@ static enum sch_status __l_process_next_exe_node(struct ice_pnetwork *pntw,
 			node->pntw->pntw_running = true;
 			node->inf->inf_running = true;
 			node->pntw->curr_ntw = node->ntw;
+			__sch_start(node->ntw);
 		}
 	} else if (node->ntype == NODE_TYPE_RESERVE) {
 
@@ -429,6 +572,7 @@ static enum sch_status __schedule_node(struct execution_node *node)
 	ntw->curr_exe = inf;
 	/* time stamp to capture start of inference for network busy time*/
 	inf->busy_start_time = trace_clock_global();
+	__sch_account_delay(inf);
 	cve_os_log(CVE_LOGLEVEL_INFO,
 		"Scheduling Infer Request. PNTW:0x%llx NtwID=0x%llx, InfID=0x%lx\n",
 		ntw->pntw->pntw_id, ntw->network_id, (uintptr_t)inf);
@@ -445,6 +589,8 @@ static enum sch_status __schedule_node(struct execution_node *node)
 				inf->swc_node.sw_id,
 				SPH_TRACE_OP_STATUS_ICE,
 				ntw->ntw_icemask));
+	ICE_TRACE_RING(ICE_TR_EV_INFER_START, (u16)ntw->ntw_icemask,
+		ntw->swc_node.sw_id, inf->swc_node.sw_id);
 
 	/* ICEs must be enough to schedule all Jobs */
 	ASSERT(cur_jg->submitted_jobs_nr <= ntw->num_ice);
@@ -528,6 +674,7 @@ bool ice_lsch_add_inf_to_queue(struct ice_infer *inf,
 	inf->inf_sch_node.is_queued = true;
 	inf->inf_sch_node.ready_to_run = false;
 	inf->ntw->ntw_enable_bp = enable_bp;
+	__sch_activate(inf);
 
 
 	if (pntw->res_resource &&
@@ -593,6 +740,7 @@ bool ice_lsch_del_inf_from_queue(struct ice_infer *inf,
 	if (inf->inf_sch_node.is_queued) {
 
 		inf->inf_sch_node.is_queued = false;
+		__sch_deactivate(inf);
 
 		if (inf->inf_sch_node.in_pntw_queue) {
 
@@ -742,3 +890,77 @@ void ice_lsch_destroy_pnetwork(struct ice_pnetwork *pntw)
 	ice_sch_engine(NULL, false);
 }
 
+#ifndef RING3_VALIDATION
+static const char * const sch_class_name[SCH_CLASS_MAX] = {
+	[SCH_CLASS_LATENCY_SLO] = "latency_slo",
+	[SCH_CLASS_P0] = "p0",
+	[SCH_CLASS_P1] = "p1",
+};
+
+static int sch_qos_info_show(struct seq_file *m, void *v)
+{
+	struct cve_device_group *dg;
+	struct ds_context *ctx;
+	struct sch_delay_stats *stats;
+	u32 i, b;
+	int retval;
+
+	retval = cve_os_lock(&g_cve_driver_biglock, CVE_INTERRUPTIBLE);
+	if (retval != 0)
+		return -ERESTARTSYS;
+
+	seq_puts(m, "Queueing delay (usec), bucket N counts delays below 2^N\n");
+	for (i = 0; i < SCH_CLASS_MAX; i++) {
+		stats = &sch_delay[i];
+		seq_printf(m, "%s: count=%llu avg=%llu max=%llu\n\t",
+				sch_class_name[i], stats->count,
+				stats->count ? stats->sum_us / stats->count : 0,
+				stats->max_us);
+		for (b = 0; b < SCH_DELAY_BUCKETS; b++)
+			seq_printf(m, " %llu", stats->hist[b]);
+		seq_puts(m, "\n");
+	}
+
+	seq_printf(m, "vclock=%llu slo_queued=%u\n", sch_vclock, sch_slo_queued);
+
+	dg = cve_dg_get();
+	if (dg == NULL || dg->list_contexts == NULL)
+		goto out;
+
+	ctx = dg->list_contexts;
+	do {
+		seq_printf(m, "Ctx ID: 0x%llx\tweight=%u ice_quota=%u latency_slo=%d ices_running=%u queued=%u vtime=%llu\n",
+				ctx->context_id, ctx->sch_weight,
+				ctx->sch_ice_quota, ctx->sch_latency_slo,
+				ctx->sch_ices_running, ctx->sch_queued,
+				ctx->sch_vtime);
+		ctx = cve_dle_next(ctx, dg_list);
+	} while (ctx != dg->list_contexts);
+
+out:
+	cve_os_unlock(&g_cve_driver_biglock);
+
+	return 0;
+}
+
+static int sch_qos_info_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, sch_qos_info_show, inode->i_private);
+}
+
+static const struct file_operations sch_qos_info_fops = {
+	.open		= sch_qos_info_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void ice_sch_debugfs_init(struct dentry *dir)
+{
+	debugfs_create_file("sch_qos_info",
+			    0444,
+			    dir,
+			    NULL,
+			    &sch_qos_info_fops);
+}
+#endif
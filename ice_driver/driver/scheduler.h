@@ -19,4 +19,10 @@ bool ice_lsch_del_inf_from_queue(struct ice_infer *inf, bool lock);
 bool ice_lsch_add_rr_to_queue(struct execution_node *node);
 bool ice_lsch_del_rr_from_queue(struct execution_node *node, bool lock);
 void ice_lsch_destroy_pnetwork(struct ice_pnetwork *pntw);
+
+#ifndef RING3_VALIDATION
+struct dentry;
+
+void ice_sch_debugfs_init(struct dentry *dir);
+#endif
 #endif /* DRIVER_SCHEDULER_H_ */
@@ -265,6 +265,12 @@ void atomic64_set(atomic64_t *v, u64 i);
 u64 atomic64_read(const atomic64_t *v);
 u64 atomic64_xchg(atomic64_t *v, u64 n);
 u64 atomic64_add_return(u64 i, atomic64_t *v);
+void atomic_or(int i, atomic_t *v);
+void atomic64_or(u64 i, atomic64_t *v);
+
+#define smp_mb() __sync_synchronize()
+#define smp_rmb() smp_mb()
+#define smp_wmb() smp_mb()
 
 struct dma_buf { };
 
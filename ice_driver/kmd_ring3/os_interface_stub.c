@@ -381,10 +381,18 @@ int cve_os_interface_init(void)
 	param.enable_llc_config_via_axi_reg = enable_llc_config_via_axi_reg;
 	/* For RING3, space is always set to 0*/
 	param.sph_soc = 0;
-	/* For RING3, ice_power_off_delay is 0 ms */
-
-	/* Should expose ENV to set this value */
+	/* For RING3, ice_power_off_delay is 0 ms unless set through ENV.
+	 * Non zero delay runs the power off thread and warm pool policy
+	 * against the null device.
+	 */
 	param.ice_power_off_delay_ms = 0;
+	if (getenv("ICE_POWER_OFF_DELAY_MS") != NULL)
+		param.ice_power_off_delay_ms =
+			atoi(getenv("ICE_POWER_OFF_DELAY_MS"));
+
+	param.ice_warm_pool_max = MAX_CVE_DEVICES_NR;
+	if (getenv("ICE_WARM_POOL_MAX") != NULL)
+		param.ice_warm_pool_max = atoi(getenv("ICE_WARM_POOL_MAX"));
 	if(getenv("ENABLE_C_STEP") != NULL) {
 		param.enable_sph_b_step = false;
 		param.enable_sph_c_step = true;
@@ -781,9 +789,12 @@ int __cve_os_free(void *base_address, uint32_t size_bytes)
 
 int atomic_xchg(atomic_t *v, int n)
 {
-	int r = *v;
-	*v = n;
-	return r;
+	return __sync_lock_test_and_set(v, n);
+}
+
+void atomic_or(int i, atomic_t *v)
+{
+	__sync_fetch_and_or(v, i);
 }
 
 int atomic_read(const atomic_t *v)
@@ -803,9 +814,12 @@ int atomic_add_return(int i, atomic_t *v)
 
 u64 atomic64_xchg(atomic64_t *v, u64 n)
 {
-	u64 r = *v;
-	*v = n;
-	return r;
+	return __sync_lock_test_and_set(v, n);
+}
+
+void atomic64_or(u64 i, atomic64_t *v)
+{
+	__sync_fetch_and_or(v, i);
 }
 
 u64 atomic64_read(const atomic64_t *v)
@@ -912,6 +926,10 @@ int cve_ioctl_misc(int fd, int request, struct cve_ioctl_param *param)
 				"Simulation mode - CVE_IOCTL_CREATE_CONTEXT\n");
 		retval = cve_ds_open_context(context_pid,
 				param->create_context.obj_id,
+				param->create_context.sch_weight,
+				param->create_context.sch_ice_quota,
+				param->create_context.sch_flags,
+				param->create_context.reserved,
 				(uint64_t *)&param->create_context.out_contextid);
 		break;
 	case CVE_IOCTL_DESTROY_CONTEXT:
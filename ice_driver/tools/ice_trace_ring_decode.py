@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2019-2021 Intel Corporation
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Decode an ICE driver binary trace ring dump.
+#
+# The dump is a copy of /sys/kernel/debug/cve/trace_ring or the file
+# written by the ring3 driver (ICEDRV_TRACE_RING_FILE). Layout and event
+# ids must match driver/ice_trace_ring.h.
+#
+# usage: ice_trace_ring_decode.py [--infer] <dump file>
+#   default  print all events merged by timestamp (trace_clock_global)
+#   --infer  print a per inference timeline (queued/start/complete/event)
+#
+
+import struct
+import sys
+
+RING_MAGIC = 0x52544349
+RING_VERSION = 1
+
+HDR_FMT = '<IHHIIQQ32x'
+HDR_SIZE = struct.calcsize(HDR_FMT)
+REC_FMT = '<QIHHQQ'
+REC_SIZE = struct.calcsize(REC_FMT)
+
+EVENTS = [
+    'NONE',
+    'INFER_QUEUED',
+    'INFER_START',
+    'JOB_DOORBELL',
+    'ISR',
+    'BH',
+    'INFER_COMPLETE',
+    'EVENT_ADD',
+    'MMU_MAP',
+]
+
+INFER_EVENTS = ('INFER_QUEUED', 'INFER_START', 'JOB_DOORBELL',
+                'INFER_COMPLETE', 'EVENT_ADD')
+
+
+def event_name(ev):
+    if ev < len(EVENTS):
+        return EVENTS[ev]
+    return 'EV_%d' % ev
+
+
+def read_rings(data):
+    """Yield (cpu, ts, event, arg, a0, a1) of all complete records."""
+    off = 0
+    while off + HDR_SIZE <= len(data):
+        (magic, version, rec_size, nr_recs, cpu, head,
+         ring_size) = struct.unpack_from(HDR_FMT, data, off)
+        if magic != RING_MAGIC or ring_size == 0:
+            break
+        if version != RING_VERSION or rec_size != REC_SIZE:
+            sys.exit('unsupported ring version %d record size %d' %
+                     (version, rec_size))
+
+        first = max(0, head - nr_recs)
+        for pos in range(first, head):
+            rec_off = off + HDR_SIZE + (pos % nr_recs) * REC_SIZE
+            ts, seq, ev, arg, a0, a1 = struct.unpack_from(REC_FMT, data,
+                                                          rec_off)
+            # skip records overwritten or torn while the dump was taken
+            if seq != ((pos + 1) & 0xffffffff):
+                continue
+            yield cpu, ts, ev, arg, a0, a1
+
+        off += ring_size
+
+
+def print_events(recs):
+    for cpu, ts, ev, arg, a0, a1 in recs:
+        print('%16d cpu%-3d %-15s arg=0x%x a0=0x%x a1=0x%x' %
+              (ts, cpu, event_name(ev), arg, a0, a1))
+
+
+def print_infer_timeline(recs):
+    infers = {}
+    for cpu, ts, ev, arg, a0, a1 in recs:
+        name = event_name(ev)
+        if name not in INFER_EVENTS:
+            continue
+        infers.setdefault((a0, a1), []).append((ts, name, arg))
+
+    for (ntw, inf), events in sorted(infers.items(),
+                                     key=lambda kv: kv[1][0][0]):
+        base = events[0][0]
+        print('ntw 0x%x infer 0x%x' % (ntw, inf))
+        for ts, name, arg in events:
+            print('  +%10.3f us %-15s arg=0x%x' %
+                  ((ts - base) / 1000.0, name, arg))
+
+
+def main(argv):
+    infer = '--infer' in argv
+    args = [a for a in argv if a != '--infer']
+    if len(args) != 1:
+        sys.exit('usage: %s [--infer] <dump file>' % sys.argv[0])
+
+    with open(args[0], 'rb') as f:
+        data = f.read()
+
+    recs = sorted(read_rings(data), key=lambda r: r[1])
+    if infer:
+        print_infer_timeline(recs)
+    else:
+        print_events(recs)
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])